@@ -66,6 +66,9 @@ void Config::ReadValues() {
     Settings::values.pad_cright_key = glfw_config->GetInteger("Controls", "pad_cright", GLFW_KEY_L);
 
     // Core
+    Settings::values.cpu_core = glfw_config->GetInteger("Core", "cpu_core", 0);
+    Settings::values.profile_blocks = glfw_config->GetBoolean("Core", "profile_blocks", false);
+    Settings::values.shader_engine = glfw_config->GetInteger("Core", "shader_engine", 0);
     Settings::values.gpu_refresh_rate = glfw_config->GetInteger("Core", "gpu_refresh_rate", 30);
     Settings::values.frame_skip = glfw_config->GetInteger("Core", "frame_skip", 0);
 
@@ -33,6 +33,19 @@ pad_cleft =
 pad_cright =
 
 [Core]
+# Which CPU core to use for the emulated application
+# 0 (default): Interpreter, 1: x86-64 JIT, 2: x86-64 JIT checked against the interpreter (slow, for debugging)
+cpu_core =
+
+# Whether to count how often each block of guest code runs, and write a report of the hottest
+# blocks and functions (and a flamegraph input file) to the log directory when emulation stops
+# 0 (default): No, 1: Yes
+profile_blocks =
+
+# Which vertex shader implementation to use when vertices are processed on the CPU
+# 0 (default): Interpreter, 1: x86-64 JIT, 2: x86-64 JIT checked against the interpreter (slow, for debugging)
+shader_engine =
+
 # The refresh rate for the GPU
 # Defaults to 30
 gpu_refresh_rate =
@@ -49,6 +49,9 @@ void Config::ReadValues() {
     qt_config->endGroup();
 
     qt_config->beginGroup("Core");
+    Settings::values.cpu_core = qt_config->value("cpu_core", 0).toInt();
+    Settings::values.profile_blocks = qt_config->value("profile_blocks", false).toBool();
+    Settings::values.shader_engine = qt_config->value("shader_engine", 0).toInt();
     Settings::values.gpu_refresh_rate = qt_config->value("gpu_refresh_rate", 30).toInt();
     Settings::values.frame_skip = qt_config->value("frame_skip", 0).toInt();
     qt_config->endGroup();
@@ -100,6 +103,9 @@ void Config::SaveValues() {
     qt_config->endGroup();
 
     qt_config->beginGroup("Core");
+    qt_config->setValue("cpu_core", Settings::values.cpu_core);
+    qt_config->setValue("profile_blocks", Settings::values.profile_blocks);
+    qt_config->setValue("shader_engine", Settings::values.shader_engine);
     qt_config->setValue("gpu_refresh_rate", Settings::values.gpu_refresh_rate);
     qt_config->setValue("frame_skip", Settings::values.frame_skip);
     qt_config->endGroup();
@@ -23,6 +23,16 @@ static QVariant GetDataForColumn(int col, const AggregatedDuration& duration)
     }
 }
 
+static QVariant GetDataForColumn(int col, const AggregatedCount& count)
+{
+    switch (col) {
+    case 1: return count.avg;
+    case 2: return (qulonglong)count.min;
+    case 3: return (qulonglong)count.max;
+    default: return QVariant();
+    }
+}
+
 static const TimingCategoryInfo* GetCategoryInfo(int id)
 {
     const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
@@ -33,11 +43,23 @@ static const TimingCategoryInfo* GetCategoryInfo(int id)
     }
 }
 
+static const CounterInfo* GetCounterInfo(int id)
+{
+    const auto& counters = GetProfilingManager().GetCountersInfo();
+    if ((size_t)id >= counters.size()) {
+        return nullptr;
+    } else {
+        return &counters[id];
+    }
+}
+
 ProfilerModel::ProfilerModel(QObject* parent) : QAbstractItemModel(parent)
 {
     updateProfilingInfo();
     const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
     results.time_per_category.resize(categories.size());
+    const auto& counters = GetProfilingManager().GetCountersInfo();
+    results.count_per_counter.resize(counters.size());
 }
 
 QVariant ProfilerModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -74,7 +96,7 @@ int ProfilerModel::rowCount(const QModelIndex& parent) const
     if (parent.isValid()) {
         return 0;
     } else {
-        return results.time_per_category.size() + 2;
+        return results.time_per_category.size() + results.count_per_counter.size() + 2;
     }
 }
 
@@ -93,6 +115,19 @@ QVariant ProfilerModel::data(const QModelIndex& index, int role) const
             } else {
                 return GetDataForColumn(index.column(), results.interframe_time);
             }
+        } else if (index.row() - 2 >= (int)results.time_per_category.size()) {
+            // Counters are listed after the timing categories
+            int counter = index.row() - 2 - (int)results.time_per_category.size();
+            if (index.column() == 0) {
+                const CounterInfo* info = GetCounterInfo(counter);
+                return info != nullptr ? QString(info->name) : QVariant();
+            } else {
+                if (counter < (int)results.count_per_counter.size()) {
+                    return GetDataForColumn(index.column(), results.count_per_counter[counter]);
+                } else {
+                    return QVariant();
+                }
+            }
         } else {
             if (index.column() == 0) {
                 const TimingCategoryInfo* info = GetCategoryInfo(index.row() - 2);
@@ -0,0 +1,23 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Computes a 64-bit hash of a block of memory (using MurmurHash64A). The hash is fast and
+ * well-distributed, but it is not a cryptographic one.
+ * @param data Pointer to the data to hash
+ * @param len Size of the data in bytes
+ * @param seed Initial value, which can be used to chain the hashes of several blocks
+ * @return Hash of the data
+ */
+u64 ComputeHash64(const void* data, size_t len, u64 seed = 0);
+
+} // namespace
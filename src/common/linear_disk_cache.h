@@ -5,17 +5,17 @@
 #pragma once
 
 #include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/scm_rev.h"
+#include <cstring>
 #include <fstream>
 
-// defined in Version.cpp
-extern const char *scm_rev_git_str;
-
 // On disk format:
 //header{
 // u32 'DCAC';
-// u32 version;  // svn_rev
 // u16 sizeof(key_type);
 // u16 sizeof(value_type);
+// char version[40];  // git revision
 //}
 
 //key_value_pair{
@@ -173,7 +173,9 @@ private:
             , key_t_size(sizeof(K))
             , value_t_size(sizeof(V))
         {
-            memcpy(ver, scm_rev_git_str, 40);
+            // Caches written by other builds are discarded
+            memset(ver, 0, sizeof(ver));
+            strncpy(ver, Common::g_scm_rev, sizeof(ver));
         }
 
         const u32 id;
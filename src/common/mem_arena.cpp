@@ -0,0 +1,147 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <string>
+
+#include "common/common_funcs.h"
+#include "common/logging/log.h"
+#include "common/mem_arena.h"
+#include "common/string_util.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+MemArena::MemArena() {
+#ifdef _WIN32
+    handle = nullptr;
+#else
+    fd = -1;
+#endif
+}
+
+MemArena::~MemArena() {
+    ReleaseSHMSegment();
+}
+
+#ifdef _WIN32
+
+bool MemArena::GrabSHMSegment(size_t size) {
+    handle = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | SEC_RESERVE,
+                               (DWORD)((u64)size >> 32), (DWORD)size, nullptr);
+    if (handle == nullptr) {
+        LOG_ERROR(Common_Memory, "CreateFileMapping failed: %s", GetLastErrorMsg());
+        return false;
+    }
+    return true;
+}
+
+void MemArena::ReleaseSHMSegment() {
+    if (handle != nullptr) {
+        CloseHandle(handle);
+        handle = nullptr;
+    }
+}
+
+void* MemArena::CreateView(size_t offset, size_t size, void* base) {
+    void* view = MapViewOfFileEx(handle, FILE_MAP_ALL_ACCESS, (DWORD)((u64)offset >> 32), (DWORD)offset, size, base);
+    if (view == nullptr) {
+        LOG_ERROR(Common_Memory, "MapViewOfFileEx failed: %s", GetLastErrorMsg());
+        return nullptr;
+    }
+
+    // Pages of a SEC_RESERVE mapping have to be committed before they can be accessed. This
+    // doesn't allocate them yet, this only happens when they are first touched.
+    VirtualAlloc(view, size, MEM_COMMIT, PAGE_READWRITE);
+    return view;
+}
+
+void MemArena::ReleaseView(void* view, size_t size) {
+    UnmapViewOfFile(view);
+}
+
+u8* MemArena::ReserveAddressSpace(size_t size) {
+    u8* base = static_cast<u8*>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_READWRITE));
+    if (base == nullptr)
+        return nullptr;
+
+    VirtualFree(base, 0, MEM_RELEASE);
+    return base;
+}
+
+void MemArena::ReleaseAddressSpace(u8* base, size_t size) {
+}
+
+#else
+
+bool MemArena::GrabSHMSegment(size_t size) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+    fd = static_cast<int>(syscall(SYS_memfd_create, "citra-memory", 0));
+#endif
+
+    if (fd < 0) {
+        // Fall back to a named POSIX shared memory object, unlinked right away
+        const std::string name = Common::StringFromFormat("/citra.%d", (int)getpid());
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            shm_unlink(name.c_str());
+    }
+
+    if (fd < 0) {
+        LOG_ERROR(Common_Memory, "Could not create shared memory segment: %s", strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(fd, size) < 0) {
+        LOG_ERROR(Common_Memory, "Could not resize shared memory segment to %lu bytes: %s",
+                  (unsigned long)size, strerror(errno));
+        ReleaseSHMSegment();
+        return false;
+    }
+    return true;
+}
+
+void MemArena::ReleaseSHMSegment() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void* MemArena::CreateView(size_t offset, size_t size, void* base) {
+    void* view = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+    if (view == MAP_FAILED) {
+        LOG_ERROR(Common_Memory, "Could not map shared memory view at %p: %s", base, strerror(errno));
+        return nullptr;
+    }
+    return view;
+}
+
+void MemArena::ReleaseView(void* view, size_t size) {
+    // Put the reservation back in place rather than leaving a hole in the address space
+    mmap(view, size, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+u8* MemArena::ReserveAddressSpace(size_t size) {
+    void* base = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        LOG_ERROR(Common_Memory, "Could not reserve %lu bytes of address space: %s",
+                  (unsigned long)size, strerror(errno));
+        return nullptr;
+    }
+    return static_cast<u8*>(base);
+}
+
+void MemArena::ReleaseAddressSpace(u8* base, size_t size) {
+    munmap(base, size);
+}
+
+#endif
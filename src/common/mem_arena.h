@@ -0,0 +1,65 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "common/common_types.h"
+
+/**
+ * Shared memory segment which can be mapped several times into the host address space, so that
+ * different emulated addresses can alias the same memory. Pages of the segment are only committed
+ * once they are first written to.
+ */
+class MemArena : NonCopyable {
+public:
+    MemArena();
+    ~MemArena();
+
+    /**
+     * Creates the shared memory segment
+     * @param size Size of the segment in bytes, a multiple of the host page size
+     * @return True on success
+     */
+    bool GrabSHMSegment(size_t size);
+
+    /// Destroys the shared memory segment, all views of it have to be released first
+    void ReleaseSHMSegment();
+
+    /**
+     * Maps part of the segment at a fixed host address
+     * @param offset Offset of the mapped part in the segment, a multiple of the host page size
+     * @param size Size of the mapped part in bytes
+     * @param base Host address of the view, inside a region returned by ReserveAddressSpace()
+     * @return The address of the view (equal to `base`), or nullptr on failure
+     */
+    void* CreateView(size_t offset, size_t size, void* base);
+
+    /// Unmaps a view created by CreateView()
+    void ReleaseView(void* view, size_t size);
+
+    /**
+     * Reserves a region of the host address space to create views in. Accessing the parts of the
+     * region which aren't covered by a view faults.
+     * @note On Windows, views can't be placed inside reserved memory, so this only finds a region
+     *       which is free at the time of the call.
+     * @return The start of the region, or nullptr on failure
+     */
+    static u8* ReserveAddressSpace(size_t size);
+
+    /// Releases a region returned by ReserveAddressSpace(), along with the views it contains
+    static void ReleaseAddressSpace(u8* base, size_t size);
+
+private:
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+};
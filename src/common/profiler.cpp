@@ -44,6 +44,12 @@ TimingCategory::TimingCategory(const char* name, TimingCategory* parent)
         manager.SetTimingCategoryParent(category_id, parent->category_id);
 }
 
+Counter::Counter(const char* name)
+        : accumulated_count(0) {
+
+    GetProfilingManager().RegisterCounter(this, name);
+}
+
 ProfilingManager::ProfilingManager()
         : last_frame_end(Clock::now()), this_frame_start(Clock::now()) {
 }
@@ -67,6 +73,17 @@ void ProfilingManager::SetTimingCategoryParent(unsigned int category, unsigned i
     timing_categories[category].parent = parent;
 }
 
+unsigned int ProfilingManager::RegisterCounter(Counter* counter, const char* name) {
+    CounterInfo info;
+    info.counter = counter;
+    info.name = name;
+
+    unsigned int id = (unsigned int)counters.size();
+    counters.push_back(std::move(info));
+
+    return id;
+}
+
 void ProfilingManager::BeginFrame() {
     this_frame_start = Clock::now();
 }
@@ -82,6 +99,11 @@ void ProfilingManager::FinishFrame() {
         results.time_per_category[i] = timing_categories[i].category->GetAccumulatedTime();
     }
 
+    results.count_per_counter.resize(counters.size());
+    for (size_t i = 0; i < counters.size(); ++i) {
+        results.count_per_counter[i] = counters[i].counter->GetAccumulatedCount();
+    }
+
     last_frame_end = now;
 }
 
@@ -107,14 +129,30 @@ void TimingResultsAggregator::SetNumberOfCategories(size_t n) {
     }
 }
 
+void TimingResultsAggregator::SetNumberOfCounters(size_t n) {
+    size_t old_size = counts_per_counter.size();
+    if (n == old_size)
+        return;
+
+    counts_per_counter.resize(n);
+
+    for (size_t i = old_size; i < n; ++i) {
+        counts_per_counter[i].resize(max_window_size, 0);
+    }
+}
+
 void TimingResultsAggregator::AddFrame(const ProfilingFrameResult& frame_result) {
     SetNumberOfCategories(frame_result.time_per_category.size());
+    SetNumberOfCounters(frame_result.count_per_counter.size());
 
     interframe_times[cursor] = frame_result.interframe_time;
     frame_times[cursor] = frame_result.frame_time;
     for (size_t i = 0; i < frame_result.time_per_category.size(); ++i) {
         times_per_category[i][cursor] = frame_result.time_per_category[i];
     }
+    for (size_t i = 0; i < frame_result.count_per_counter.size(); ++i) {
+        counts_per_counter[i][cursor] = frame_result.count_per_counter[i];
+    }
 
     ++cursor;
     if (cursor == max_window_size)
@@ -140,6 +178,22 @@ static AggregatedDuration AggregateField(const std::vector<Duration>& v, size_t
     return result;
 }
 
+static AggregatedCount AggregateCount(const std::vector<u64>& v, size_t len) {
+    AggregatedCount result;
+    u64 total = 0;
+    result.min = result.max = (len == 0 ? 0 : v[0]);
+
+    for (size_t i = 0; i < len; ++i) {
+        u64 value = v[i];
+        total += value;
+        result.min = std::min(result.min, value);
+        result.max = std::max(result.max, value);
+    }
+    result.avg = (len != 0) ? (float)total / len : 0.0f;
+
+    return result;
+}
+
 static float tof(Common::Profiling::Duration dur) {
     using FloatMs = std::chrono::duration<float, std::chrono::milliseconds::period>;
     return std::chrono::duration_cast<FloatMs>(dur).count();
@@ -162,6 +216,11 @@ AggregatedFrameResult TimingResultsAggregator::GetAggregatedResults() const {
         result.time_per_category[i] = AggregateField(times_per_category[i], window_size);
     }
 
+    result.count_per_counter.resize(counts_per_counter.size());
+    for (size_t i = 0; i < counts_per_counter.size(); ++i) {
+        result.count_per_counter[i] = AggregateCount(counts_per_counter[i], window_size);
+    }
+
     return result;
 }
 
@@ -8,6 +8,7 @@
 #include <chrono>
 
 #include "common/assert.h"
+#include "common/common_types.h"
 #include "common/thread.h"
 
 namespace Common {
@@ -73,6 +74,33 @@ private:
     std::atomic<Duration::rep> accumulated_duration;
 };
 
+/**
+ * Counts occurrences of an event (e.g. cache hits), reported per frame alongside the timing
+ * categories. Should be declared as a global variable.
+ */
+class Counter final {
+public:
+    Counter(const char* name);
+
+    /// Adds to the count of this counter. Can safely be called from multiple threads at the same time.
+    void Add(u64 amount) {
+#if ENABLE_PROFILING
+        std::atomic_fetch_add_explicit(&accumulated_count, amount, std::memory_order_relaxed);
+#endif
+    }
+
+    /**
+     * Atomically retrieves the accumulated count and resets it to zero. Can be safely called
+     * concurrently with Add.
+     */
+    u64 GetAccumulatedCount() {
+        return std::atomic_exchange_explicit(&accumulated_count, (u64)0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<u64> accumulated_count;
+};
+
 /**
  * Measures time elapsed between a call to Start and a call to Stop and attributes it to the given
  * TimingCategory. Start/Stop can be called multiple times on the same timer, but each call must be
@@ -24,6 +24,11 @@ struct TimingCategoryInfo {
     unsigned int parent;
 };
 
+struct CounterInfo {
+    Counter* counter;
+    const char* name;
+};
+
 struct ProfilingFrameResult {
     /// Time since the last delivered frame
     Duration interframe_time;
@@ -33,6 +38,9 @@ struct ProfilingFrameResult {
 
     /// Total amount of time spent inside each category in this frame. Indexed by the category id
     std::vector<Duration> time_per_category;
+
+    /// Total count of each counter in this frame. Indexed by the counter id
+    std::vector<u64> count_per_counter;
 };
 
 class ProfilingManager final {
@@ -41,11 +49,16 @@ public:
 
     unsigned int RegisterTimingCategory(TimingCategory* category, const char* name);
     void SetTimingCategoryParent(unsigned int category, unsigned int parent);
+    unsigned int RegisterCounter(Counter* counter, const char* name);
 
     const std::vector<TimingCategoryInfo>& GetTimingCategoriesInfo() const {
         return timing_categories;
     }
 
+    const std::vector<CounterInfo>& GetCountersInfo() const {
+        return counters;
+    }
+
     /// This should be called after swapping screen buffers.
     void BeginFrame();
     /// This should be called before swapping screen buffers.
@@ -58,6 +71,7 @@ public:
 
 private:
     std::vector<TimingCategoryInfo> timing_categories;
+    std::vector<CounterInfo> counters;
     Clock::time_point last_frame_end;
     Clock::time_point this_frame_start;
 
@@ -68,6 +82,11 @@ struct AggregatedDuration {
     Duration avg, min, max;
 };
 
+struct AggregatedCount {
+    float avg;
+    u64 min, max;
+};
+
 struct AggregatedFrameResult {
     /// Time since the last delivered frame
     AggregatedDuration interframe_time;
@@ -79,6 +98,9 @@ struct AggregatedFrameResult {
 
     /// Total amount of time spent inside each category in this frame. Indexed by the category id
     std::vector<AggregatedDuration> time_per_category;
+
+    /// Total count of each counter in this frame. Indexed by the counter id
+    std::vector<AggregatedCount> count_per_counter;
 };
 
 class TimingResultsAggregator final {
@@ -87,6 +109,7 @@ public:
 
     void Clear();
     void SetNumberOfCategories(size_t n);
+    void SetNumberOfCounters(size_t n);
 
     void AddFrame(const ProfilingFrameResult& frame_result);
 
@@ -99,6 +122,7 @@ public:
     std::vector<Duration> interframe_times;
     std::vector<Duration> frame_times;
     std::vector<std::vector<Duration>> times_per_category;
+    std::vector<std::vector<u64>> counts_per_counter;
 };
 
 ProfilingManager& GetProfilingManager();
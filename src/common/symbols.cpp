@@ -40,6 +40,20 @@ namespace Symbols
 
         return symbol;
     }
+    TSymbol GetSymbolContaining(u32 _address)
+    {
+        TSymbolsMap::iterator foundSymbolItr = g_symbols.upper_bound(_address);
+        if (foundSymbolItr == g_symbols.begin())
+            return TSymbol();
+
+        --foundSymbolItr;
+        const TSymbol& symbol = (*foundSymbolItr).second;
+        if (symbol.size != 0 && _address - symbol.address >= symbol.size)
+            return TSymbol();
+
+        return symbol;
+    }
+
     const std::string GetName(u32 _address)
     {
         return GetSymbol(_address).name;
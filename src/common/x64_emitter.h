@@ -0,0 +1,283 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstring>
+
+#include "common/assert.h"
+#include "common/common_types.h"
+
+namespace X64 {
+
+/// x86-64 general purpose registers, numbered as in their encoding
+enum Reg : u8 {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+/// SSE registers
+enum XReg : u8 {
+    XMM0 = 0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15,
+};
+
+/// Predicates of CMPPS, numbered as in their immediate encoding
+enum CmpPred : u8 {
+    CMP_EQ = 0, CMP_LT = 1, CMP_LE = 2, CMP_UNORD = 3, CMP_NEQ = 4, CMP_NLT = 5, CMP_NLE = 6, CMP_ORD = 7,
+};
+
+/// Condition codes, numbered as in the encoding of Jcc/SETcc
+enum Cond : u8 {
+    CC_O = 0x0, CC_NO = 0x1, CC_C = 0x2, CC_NC = 0x3, CC_Z = 0x4, CC_NZ = 0x5, CC_BE = 0x6, CC_A = 0x7,
+    CC_S = 0x8, CC_NS = 0x9, CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+};
+
+/// Two-operand ALU operations, numbered as in their /digit opcode extension
+enum AluOp : u8 {
+    ALU_ADD = 0, ALU_OR = 1, ALU_ADC = 2, ALU_SBB = 3, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7,
+};
+
+/// Shift and rotate operations, numbered as in their /digit opcode extension
+enum ShiftOp : u8 {
+    SHIFT_ROL = 0, SHIFT_ROR = 1, SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7,
+};
+
+#ifdef _WIN32
+const Reg ABI_PARAM1 = RCX;
+const Reg ABI_PARAM2 = RDX;
+const Reg ABI_PARAM3 = R8;
+/// Stack space a caller has to reserve for its callee to spill its register parameters to
+const u32 ABI_SHADOW_SPACE = 32;
+#else
+const Reg ABI_PARAM1 = RDI;
+const Reg ABI_PARAM2 = RSI;
+const Reg ABI_PARAM3 = RDX;
+const u32 ABI_SHADOW_SPACE = 0;
+#endif
+
+/**
+ * Minimal x86-64 machine code emitter covering what the ARM and PICA shader recompilers need.
+ * Memory operands are limited to [base + disp32], which is all the recompilers use to access the
+ * guest state and the stack.
+ */
+class Emitter {
+public:
+    Emitter(u8* code, size_t size) : ptr(code), end(code + size) {
+    }
+
+    /// Returns the address at which the next instruction is going to be emitted
+    u8* GetCodePtr() const {
+        return ptr;
+    }
+
+    /// Moves the emission point, e.g. to throw away code emitted after `code`
+    void SetCodePtr(u8* code) {
+        ptr = code;
+    }
+
+    /// Returns the number of bytes left in the code buffer
+    size_t GetSpaceLeft() const {
+        return end - ptr;
+    }
+
+    // Register/register and register/immediate forms operate on 32 bits unless noted otherwise
+
+    void MOV(Reg dst, Reg src)                  { RexRR(false, src, dst); Write8(0x89); ModRM(3, src, dst); }
+    void MOV64(Reg dst, Reg src)                { RexRR(true, src, dst); Write8(0x89); ModRM(3, src, dst); }
+    void MOV(Reg dst, u32 imm)                  { Rex(false, 0, 0, dst); Write8(0xB8 + (dst & 7)); Write32(imm); }
+    void MOV64(Reg dst, u64 imm)                { Rex(true, 0, 0, dst); Write8(0xB8 + (dst & 7)); Write64(imm); }
+    void MOV(Reg dst, Reg base, s32 disp)       { Mem(0x8B, dst, base, disp); }
+    void MOV(Reg base, s32 disp, Reg src)       { Mem(0x89, src, base, disp); }
+    void MOV(Reg base, s32 disp, u32 imm)       { Mem(0xC7, 0, base, disp); Write32(imm); }
+    void MOV64(Reg dst, Reg base, s32 disp)     { Mem(0x8B, dst, base, disp, true); }
+
+    void ALU(AluOp op, Reg dst, Reg src)        { RexRR(false, src, dst); Write8(op * 8 + 1); ModRM(3, src, dst); }
+    void ALU(AluOp op, Reg dst, u32 imm)        { Rex(false, 0, 0, dst); Write8(0x81); ModRM(3, op, dst); Write32(imm); }
+    void ALU(AluOp op, Reg base, s32 disp, u32 imm) { Mem(0x81, op, base, disp); Write32(imm); }
+    void ALU64(AluOp op, Reg dst, u32 imm)      { Rex(true, 0, 0, dst); Write8(0x81); ModRM(3, op, dst); Write32(imm); }
+
+    void TEST(Reg a, Reg b)                     { RexRR(false, b, a); Write8(0x85); ModRM(3, b, a); }
+    void TEST(Reg a, u32 imm)                   { Rex(false, 0, 0, a); Write8(0xF7); ModRM(3, 0, a); Write32(imm); }
+    void NOT(Reg reg)                           { Rex(false, 0, 0, reg); Write8(0xF7); ModRM(3, 2, reg); }
+    void IMUL(Reg dst, Reg src)                 { RexRR(false, dst, src); Write8(0x0F); Write8(0xAF); ModRM(3, dst, src); }
+
+    void SHIFT(ShiftOp op, Reg reg, u8 amount)  { Rex(false, 0, 0, reg); Write8(0xC1); ModRM(3, op, reg); Write8(amount); }
+
+    /// Copies bit `bit` of `bits` to the carry flag
+    void BT(Reg bits, Reg bit)                  { RexRR(false, bit, bits); Write8(0x0F); Write8(0xA3); ModRM(3, bit, bits); }
+    /// Copies the given bit of the 32-bit value at [base + disp] to the carry flag
+    void BT(Reg base, s32 disp, u8 bit)         { Mem(0x0FBA, 4, base, disp); Write8(bit); }
+    void CMC()                                  { Write8(0xF5); }
+
+    /// Sets the low byte of `reg` (which must be RAX-RBX or R8-R15) to 1 if `cond` holds, to 0 otherwise
+    void SETcc(Cond cond, Reg reg)              { Rex(false, 0, 0, reg); Write8(0x0F); Write8(0x90 + cond); ModRM(3, 0, reg); }
+    /// Zero-extends the low byte of `src` (which must be RAX-RBX or R8-R15) into `dst`
+    void MOVZX8(Reg dst, Reg src)               { RexRR(false, dst, src); Write8(0x0F); Write8(0xB6); ModRM(3, dst, src); }
+    /// Zero-extends the byte at [base + disp] into `dst`
+    void MOVZX8(Reg dst, Reg base, s32 disp)    { Mem(0x0FB6, dst, base, disp); }
+
+    void PUSH(Reg reg)                          { Rex(false, 0, 0, reg); Write8(0x50 + (reg & 7)); }
+    void POP(Reg reg)                           { Rex(false, 0, 0, reg); Write8(0x58 + (reg & 7)); }
+    void RET()                                  { Write8(0xC3); }
+
+    /// Calls the given function through RAX
+    void CALL(const void* function) {
+        MOV64(RAX, reinterpret_cast<u64>(function));
+        Write8(0xFF);
+        ModRM(3, 2, RAX);
+    }
+
+    /// Emits a call with a 32-bit displacement, to be resolved with SetJumpTarget
+    u8* CALL() {
+        Write8(0xE8);
+        Write32(0);
+        return ptr;
+    }
+
+    /// Emits a conditional jump with a 32-bit displacement, to be resolved with SetJumpTarget
+    u8* Jcc(Cond cond) {
+        Write8(0x0F);
+        Write8(0x80 + cond);
+        Write32(0);
+        return ptr;
+    }
+
+    /// Emits an unconditional jump with a 32-bit displacement, to be resolved with SetJumpTarget
+    u8* JMP() {
+        Write8(0xE9);
+        Write32(0);
+        return ptr;
+    }
+
+    /// Makes a jump emitted by Jcc or JMP land at the current emission point
+    void SetJumpTarget(u8* jump_end) {
+        SetJumpTarget(jump_end, ptr);
+    }
+
+    /// Makes a jump or call emitted by Jcc, JMP or CALL land at the given address
+    void SetJumpTarget(u8* jump_end, const u8* target) {
+        const s32 displacement = static_cast<s32>(target - jump_end);
+        std::memcpy(jump_end - 4, &displacement, sizeof(displacement));
+    }
+
+    // SSE instructions operate on packed single precision floats unless noted otherwise. Memory
+    // operands other than those of MOVUPS have to be 16-byte aligned.
+
+    void MOVAPS(XReg dst, XReg src)             { SSE(0, 0x28, dst, src); }
+    void MOVAPS(XReg dst, Reg base, s32 disp)   { SSEMem(0, 0x28, dst, base, disp); }
+    void MOVUPS(XReg dst, Reg base, s32 disp)   { SSEMem(0, 0x10, dst, base, disp); }
+    void MOVUPS(Reg base, s32 disp, XReg src)   { SSEMem(0, 0x11, src, base, disp); }
+    /// Moves the upper two floats of `src` to the lower half of `dst`
+    void MOVHLPS(XReg dst, XReg src)            { SSE(0, 0x12, dst, src); }
+    /// Moves the lower two floats of `src` to the upper half of `dst`
+    void MOVLHPS(XReg dst, XReg src)            { SSE(0, 0x16, dst, src); }
+
+    void ADDPS(XReg dst, XReg src)              { SSE(0, 0x58, dst, src); }
+    void ADDSS(XReg dst, XReg src)              { SSE(0xF3, 0x58, dst, src); }
+    void SUBPS(XReg dst, XReg src)              { SSE(0, 0x5C, dst, src); }
+    void MULPS(XReg dst, XReg src)              { SSE(0, 0x59, dst, src); }
+    void DIVPS(XReg dst, XReg src)              { SSE(0, 0x5E, dst, src); }
+    void MINPS(XReg dst, XReg src)              { SSE(0, 0x5D, dst, src); }
+    void MAXPS(XReg dst, XReg src)              { SSE(0, 0x5F, dst, src); }
+
+    void ANDPS(XReg dst, XReg src)              { SSE(0, 0x54, dst, src); }
+    void ANDPS(XReg dst, Reg base, s32 disp)    { SSEMem(0, 0x54, dst, base, disp); }
+    /// dst = ~dst & src
+    void ANDNPS(XReg dst, XReg src)             { SSE(0, 0x55, dst, src); }
+    void ORPS(XReg dst, XReg src)               { SSE(0, 0x56, dst, src); }
+    void XORPS(XReg dst, XReg src)              { SSE(0, 0x57, dst, src); }
+    void XORPS(XReg dst, Reg base, s32 disp)    { SSEMem(0, 0x57, dst, base, disp); }
+
+    /// Picks the two lower floats of `dst` from `dst` and the two upper ones from `src`
+    void SHUFPS(XReg dst, XReg src, u8 shuffle) { SSE(0, 0xC6, dst, src); Write8(shuffle); }
+    /// Sets all bits of the floats of `dst` for which `dst <pred> src` holds, clears them otherwise
+    void CMPPS(XReg dst, XReg src, CmpPred pred) { SSE(0, 0xC2, dst, src); Write8(pred); }
+    void CMPPS(XReg dst, Reg base, s32 disp, CmpPred pred) { SSEMem(0, 0xC2, dst, base, disp); Write8(pred); }
+    /// Gathers the sign bits of the floats of `src` into the low bits of `dst`
+    void MOVMSKPS(Reg dst, XReg src)            { SSE(0, 0x50, dst, src); }
+
+    /// Converts to 32-bit integers, rounding towards zero
+    void CVTTPS2DQ(XReg dst, XReg src)          { SSE(0xF3, 0x5B, dst, src); }
+    /// Converts the lowest float to a 32-bit integer, rounding towards zero
+    void CVTTSS2SI(Reg dst, XReg src)           { SSE(0xF3, 0x2C, dst, src); }
+    void CVTDQ2PS(XReg dst, XReg src)           { SSE(0, 0x5B, dst, src); }
+
+    // Double precision operations on the two doubles of an SSE register
+
+    /// Converts the two lower floats of `src` to doubles
+    void CVTPS2PD(XReg dst, XReg src)           { SSE(0, 0x5A, dst, src); }
+    /// Converts the two doubles of `src` to the lower floats of `dst`, clearing the upper ones
+    void CVTPD2PS(XReg dst, XReg src)           { SSE(0x66, 0x5A, dst, src); }
+    void SQRTPD(XReg dst, XReg src)             { SSE(0x66, 0x51, dst, src); }
+    void DIVPD(XReg dst, XReg src)              { SSE(0x66, 0x5E, dst, src); }
+
+private:
+    void Write8(u8 value) {
+        ASSERT(ptr < end);
+        *ptr++ = value;
+    }
+
+    void Write32(u32 value) {
+        ASSERT(ptr + sizeof(value) <= end);
+        std::memcpy(ptr, &value, sizeof(value));
+        ptr += sizeof(value);
+    }
+
+    void Write64(u64 value) {
+        ASSERT(ptr + sizeof(value) <= end);
+        std::memcpy(ptr, &value, sizeof(value));
+        ptr += sizeof(value);
+    }
+
+    /// Emits a REX prefix if any of the operands requires one
+    void Rex(bool w, unsigned reg, unsigned index, unsigned rm) {
+        const u8 rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (rm >> 3);
+        if (rex != 0x40)
+            Write8(rex);
+    }
+
+    void RexRR(bool w, unsigned reg, unsigned rm) {
+        Rex(w, reg, 0, rm);
+    }
+
+    void ModRM(unsigned mod, unsigned reg, unsigned rm) {
+        Write8(static_cast<u8>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    /// Emits an instruction with a [base + disp32] memory operand, `opcode` may be a 0x0F-prefixed one
+    void Mem(u16 opcode, unsigned reg, Reg base, s32 disp, bool w = false) {
+        Rex(w, reg, 0, base);
+        if (opcode > 0xFF)
+            Write8(opcode >> 8);
+        Write8(opcode & 0xFF);
+        ModRM(2, reg, base);
+        // RSP and R12 can only be used as a base through a SIB byte
+        if ((base & 7) == RSP)
+            Write8(0x24);
+        Write32(static_cast<u32>(disp));
+    }
+
+    /// Emits a 0x0F-prefixed SSE instruction on two registers, with an optional 0x66/0xF2/0xF3 prefix
+    void SSE(u8 prefix, u8 opcode, unsigned reg, unsigned rm) {
+        if (prefix != 0)
+            Write8(prefix);
+        RexRR(false, reg, rm);
+        Write8(0x0F);
+        Write8(opcode);
+        ModRM(3, reg, rm);
+    }
+
+    /// Emits a 0x0F-prefixed SSE instruction with a [base + disp32] memory operand
+    void SSEMem(u8 prefix, u8 opcode, unsigned reg, Reg base, s32 disp) {
+        if (prefix != 0)
+            Write8(prefix);
+        Mem(0x0F00 | opcode, reg, base, disp);
+    }
+
+    u8* ptr;
+    u8* end;
+};
+
+} // namespace
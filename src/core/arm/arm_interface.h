@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <vector>
+
 #include "common/common_types.h"
+#include "core/arm/block_profiler.h"
 #include "core/arm/skyeye_common/arm_regformat.h"
 
 namespace Core {
@@ -117,6 +120,23 @@ public:
     /// Prepare core for thread reschedule (if needed to correctly handle state)
     virtual void PrepareReschedule() = 0;
 
+    /**
+     * Discards any cached translation of the code in the given memory range, so that changes to it
+     * are picked up the next time it is executed
+     * @param addr Start address of the range
+     * @param size Size of the range, in bytes
+     */
+    virtual void ClearInstructionCache(u32 addr, u32 size) = 0;
+
+    /**
+     * Enables or disables counting how often each basic block of guest code is executed
+     * @param enable Whether to count block executions
+     */
+    virtual void SetBlockProfilingEnabled(bool enable) = 0;
+
+    /// Returns the execution counts of the blocks executed while block profiling was enabled
+    virtual std::vector<BlockProfileEntry> GetBlockProfile() const = 0;
+
     /// Getter for num_instructions
     u64 GetNumInstructions() {
         return num_instructions;
@@ -0,0 +1,130 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <map>
+
+#include "common/string_util.h"
+#include "common/symbols.h"
+
+#include "core/arm/block_profiler.h"
+
+namespace BlockProfiler {
+
+/// Name under which blocks outside of any known function are grouped
+static const char UNKNOWN_FUNCTION[] = "[unknown]";
+
+/// Returns the number of guest instructions executed in the given block
+static u64 GetWeight(const BlockProfileEntry& entry) {
+    return entry.exec_count * entry.num_instructions;
+}
+
+/// Returns the profile sorted by decreasing number of executed instructions
+static std::vector<BlockProfileEntry> SortByWeight(const std::vector<BlockProfileEntry>& profile) {
+    std::vector<BlockProfileEntry> sorted = profile;
+    std::sort(sorted.begin(), sorted.end(), [](const BlockProfileEntry& a, const BlockProfileEntry& b) {
+        return GetWeight(a) > GetWeight(b);
+    });
+    return sorted;
+}
+
+/// Returns the name of the function containing the given address, and the offset of the address in it
+static std::string GetFunctionName(u32 address, u32* offset = nullptr) {
+    const TSymbol symbol = Symbols::GetSymbolContaining(address);
+    if (symbol.name.empty()) {
+        if (offset != nullptr)
+            *offset = 0;
+        return UNKNOWN_FUNCTION;
+    }
+
+    if (offset != nullptr)
+        *offset = address - symbol.address;
+    return symbol.name;
+}
+
+std::string FormatReport(const std::vector<BlockProfileEntry>& profile, size_t max_entries) {
+    const std::vector<BlockProfileEntry> blocks = SortByWeight(profile);
+
+    u64 total = 0;
+    std::map<std::string, u64> functions;
+    for (const BlockProfileEntry& entry : blocks) {
+        total += GetWeight(entry);
+        functions[GetFunctionName(entry.start_addr)] += GetWeight(entry);
+    }
+
+    std::vector<std::pair<std::string, u64>> sorted_functions(functions.begin(), functions.end());
+    std::sort(sorted_functions.begin(), sorted_functions.end(), [](const std::pair<std::string, u64>& a,
+                                                                   const std::pair<std::string, u64>& b) {
+        return a.second > b.second;
+    });
+
+    const double scale = total != 0 ? 100.0 / total : 0.0;
+
+    std::string report = Common::StringFromFormat("%llu guest instructions executed in %u blocks\n\n",
+                                                  (unsigned long long)total, (unsigned)blocks.size());
+
+    report += "Hottest functions:\n";
+    report += "  instrs %    instructions  function\n";
+    for (size_t i = 0; i < sorted_functions.size() && i < max_entries; ++i) {
+        report += Common::StringFromFormat("  %7.2f%%  %14llu  %s\n", sorted_functions[i].second * scale,
+                                           (unsigned long long)sorted_functions[i].second,
+                                           sorted_functions[i].first.c_str());
+    }
+
+    report += "\nHottest blocks:\n";
+    report += "  instrs %      executions  length  address     location\n";
+    for (size_t i = 0; i < blocks.size() && i < max_entries; ++i) {
+        const BlockProfileEntry& entry = blocks[i];
+        u32 offset;
+        const std::string function = GetFunctionName(entry.start_addr, &offset);
+
+        report += Common::StringFromFormat("  %7.2f%%  %14llu  %6u  0x%08X  %s+0x%X\n", GetWeight(entry) * scale,
+                                           (unsigned long long)entry.exec_count, entry.num_instructions,
+                                           entry.start_addr, function.c_str(), offset);
+    }
+
+    std::vector<BlockProfileEntry> idle_loops;
+    u64 total_idle_cycles = 0;
+    for (const BlockProfileEntry& entry : profile) {
+        if (entry.idle_cycles != 0) {
+            idle_loops.push_back(entry);
+            total_idle_cycles += entry.idle_cycles;
+        }
+    }
+
+    if (!idle_loops.empty()) {
+        std::sort(idle_loops.begin(), idle_loops.end(), [](const BlockProfileEntry& a, const BlockProfileEntry& b) {
+            return a.idle_cycles > b.idle_cycles;
+        });
+
+        report += Common::StringFromFormat("\n%llu cycles skipped in idle loops:\n", (unsigned long long)total_idle_cycles);
+        report += "  skipped cycles  address     location\n";
+        for (size_t i = 0; i < idle_loops.size() && i < max_entries; ++i) {
+            const BlockProfileEntry& entry = idle_loops[i];
+            u32 offset;
+            const std::string function = GetFunctionName(entry.start_addr, &offset);
+
+            report += Common::StringFromFormat("  %14llu  0x%08X  %s+0x%X\n", (unsigned long long)entry.idle_cycles,
+                                               entry.start_addr, function.c_str(), offset);
+        }
+    }
+
+    return report;
+}
+
+std::string FormatCollapsedStacks(const std::vector<BlockProfileEntry>& profile) {
+    const std::vector<BlockProfileEntry> blocks = SortByWeight(profile);
+
+    std::string result;
+    for (const BlockProfileEntry& entry : blocks) {
+        if (GetWeight(entry) == 0)
+            continue;
+
+        result += Common::StringFromFormat("%s;0x%08X %llu\n", GetFunctionName(entry.start_addr).c_str(),
+                                           entry.start_addr, (unsigned long long)GetWeight(entry));
+    }
+    return result;
+}
+
+} // namespace
@@ -0,0 +1,40 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+
+/// Execution count of a basic block of guest code
+struct BlockProfileEntry {
+    u32 start_addr;        ///< Guest address of the first instruction of the block
+    u32 num_instructions;  ///< Number of guest instructions in the block
+    u64 exec_count;        ///< Number of times the block was executed
+    u64 idle_cycles;       ///< Number of cycles skipped while the block was spinning as an idle loop
+};
+
+namespace BlockProfiler {
+
+/**
+ * Formats a report of the functions and blocks in which the most guest instructions were executed,
+ * followed by the idle loops in which the most cycles were skipped. Blocks are attributed to the
+ * functions of the loaded symbol map, if any (see Symbols).
+ * @param profile Execution counts of the profiled blocks, in any order
+ * @param max_entries Maximum number of functions and of blocks to list
+ * @return The report, as human-readable text
+ */
+std::string FormatReport(const std::vector<BlockProfileEntry>& profile, size_t max_entries);
+
+/**
+ * Formats the profile in the "collapsed stack" format understood by flamegraph.pl and similar
+ * tools. There is no call stack information, so each block appears as a child of its function.
+ * @param profile Execution counts of the profiled blocks, in any order
+ * @return One "function;block count" line per block, weighted by executed instructions
+ */
+std::string FormatCollapsedStacks(const std::vector<BlockProfileEntry>& profile);
+
+} // namespace
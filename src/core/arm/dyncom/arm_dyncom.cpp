@@ -87,9 +87,25 @@ void ARM_DynCom::ExecuteInstructions(int num_instructions) {
     // executing one instruction at a time. Otherwise, if a block is being executed, more
     // instructions may actually be executed than specified.
     unsigned ticks_executed = InterpreterMainLoop(state.get());
+
+    if (state->IdleLoopBlock != nullptr) {
+        down_count -= ticks_executed;
+        ticks_executed = 0;
+        state->IdleLoopBlock->idle_cycles += SkipIdleLoop();
+    }
+
     AddTicks(ticks_executed);
 }
 
+u64 ARM_DynCom::SkipIdleLoop() {
+    if (down_count <= 0)
+        return 0;
+
+    const u64 idle_ticks = CoreTiming::GetIdleTicks();
+    CoreTiming::Idle();
+    return CoreTiming::GetIdleTicks() - idle_ticks;
+}
+
 void ARM_DynCom::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) {
     memset(&context, 0, sizeof(Core::ThreadContext));
 
@@ -128,3 +144,15 @@ void ARM_DynCom::LoadContext(const Core::ThreadContext& ctx) {
 void ARM_DynCom::PrepareReschedule() {
     state->NumInstrsToExecute = 0;
 }
+
+void ARM_DynCom::ClearInstructionCache(u32 addr, u32 size) {
+    state->instruction_cache.Invalidate(addr, size);
+}
+
+void ARM_DynCom::SetBlockProfilingEnabled(bool enable) {
+    state->instruction_cache.SetProfilingEnabled(enable);
+}
+
+std::vector<BlockProfileEntry> ARM_DynCom::GetBlockProfile() const {
+    return state->instruction_cache.GetProfile();
+}
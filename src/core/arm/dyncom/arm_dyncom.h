@@ -11,7 +11,7 @@
 #include "core/arm/arm_interface.h"
 #include "core/arm/skyeye_common/armdefs.h"
 
-class ARM_DynCom final : virtual public ARM_Interface {
+class ARM_DynCom : virtual public ARM_Interface {
 public:
     ARM_DynCom(PrivilegeMode initial_mode);
     ~ARM_DynCom();
@@ -32,8 +32,18 @@ public:
     void LoadContext(const Core::ThreadContext& ctx) override;
 
     void PrepareReschedule() override;
+    void ClearInstructionCache(u32 addr, u32 size) override;
+    void SetBlockProfilingEnabled(bool enable) override;
+    std::vector<BlockProfileEntry> GetBlockProfile() const override;
     void ExecuteInstructions(int num_instructions) override;
 
-private:
+protected:
+    /**
+     * Fast-forwards CoreTiming to the next scheduled event, for when the CPU is spinning in an idle
+     * loop. The cycles executed so far must already have been subtracted from down_count.
+     * @return The number of cycles skipped
+     */
+    u64 SkipIdleLoop();
+
     std::unique_ptr<ARMul_State> state;
 };
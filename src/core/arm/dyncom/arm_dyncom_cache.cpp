@@ -0,0 +1,245 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+
+#include "core/arm/dyncom/arm_dyncom_cache.h"
+
+/// Number of entries in the page table, covering the whole 32-bit address space
+static const size_t NUM_PAGES = size_t(1) << (32 - TRANSLATION_PAGE_BITS);
+
+/// Granularity at which page arenas grow, in bytes
+static const size_t CHUNK_SIZE = 8 * 1024;
+
+/// Alignment of the blocks inside a page arena
+static const size_t BLOCK_ALIGNMENT = 16;
+
+TranslationCache::TranslationCache(size_t capacity)
+    : page_table(new TranslationPage*[NUM_PAGES]()), capacity(capacity), allocated_size(0), generation(0),
+      profiling_enabled(false) {
+}
+
+TranslationCache::~TranslationCache() {
+}
+
+TranslatedBlock* TranslationCache::Insert(u32 addr, const u8* creams, size_t size, u32 num_instructions, bool is_idle_loop) {
+    // No block can be executing while translating, so now is the time to release invalidated pages
+    retired_pages.clear();
+
+    const size_t block_size = (sizeof(TranslatedBlock) + size + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+
+    auto& page = pages[addr >> TRANSLATION_PAGE_BITS];
+    if (page == nullptr) {
+        page = Common::make_unique<TranslationPage>();
+        page->index = addr >> TRANSLATION_PAGE_BITS;
+        page->size = sizeof(TranslationPage);
+        page->chunk_used = 0;
+        page->chunk_size = 0;
+        page->blocks.fill(nullptr);
+
+        page_table[page->index] = page.get();
+        allocated_size += page->size;
+    }
+
+    if (page->chunk_used + block_size > page->chunk_size) {
+        const size_t chunk_size = std::max(block_size, CHUNK_SIZE);
+        page->chunks.emplace_back(new u8[chunk_size]);
+        page->chunk_used = 0;
+        page->chunk_size = chunk_size;
+        page->size += chunk_size;
+        allocated_size += chunk_size;
+    }
+
+    TranslatedBlock* block = reinterpret_cast<TranslatedBlock*>(page->chunks.back().get() + page->chunk_used);
+    page->chunk_used += block_size;
+
+    block->start_addr = addr;
+    block->num_instructions = num_instructions;
+    block->exec_count = 0;
+    block->idle_cycles = 0;
+    block->page = page.get();
+    block->links[EXIT_TAKEN] = nullptr;
+    block->links[EXIT_FALLTHROUGH] = nullptr;
+    block->is_idle_loop = is_idle_loop;
+    std::memcpy(block->GetCreams(), creams, size);
+
+    page->blocks[(addr & TRANSLATION_PAGE_MASK) >> 1] = block;
+    page->last_used = ++generation;
+
+    if (allocated_size > capacity)
+        EvictPages(page.get());
+
+    return block;
+}
+
+void TranslationCache::Link(TranslatedBlock* source, BlockExit exit, TranslatedBlock* target) {
+    // The source block may have been invalidated by a store it executed
+    if (source->links[exit] == target || source->start_addr == INVALID_BLOCK_ADDR)
+        return;
+
+    if (source->links[exit] != nullptr)
+        ForgetLink(source, exit);
+
+    source->links[exit] = target;
+    target->page->incoming_links.push_back({ source, exit });
+}
+
+void TranslationCache::ForgetLink(TranslatedBlock* source, BlockExit exit) {
+    auto& links = source->links[exit]->page->incoming_links;
+    links.erase(std::remove_if(links.begin(), links.end(), [=](const BlockLink& link) {
+        return link.source == source && link.exit == exit;
+    }), links.end());
+}
+
+void TranslationCache::Invalidate(u32 addr, u32 size) {
+    if (size == 0)
+        return;
+
+    const u32 first_page = addr >> TRANSLATION_PAGE_BITS;
+    const u32 last_page = static_cast<u32>(std::min<u64>((u64(addr) + size - 1) >> TRANSLATION_PAGE_BITS, NUM_PAGES - 1));
+
+    for (u32 index = first_page; index <= last_page; ++index) {
+        TranslationPage* page = page_table[index];
+        if (page != nullptr) {
+            UnmapPage(page);
+
+            for (TranslatedBlock* block : page->blocks) {
+                if (block == nullptr)
+                    continue;
+
+                block->start_addr = INVALID_BLOCK_ADDR;
+                block->links[EXIT_TAKEN] = nullptr;
+                block->links[EXIT_FALLTHROUGH] = nullptr;
+            }
+
+            auto it = pages.find(index);
+            retired_pages.push_back(std::move(it->second));
+            pages.erase(it);
+        }
+    }
+}
+
+void TranslationCache::Clear() {
+    for (auto& entry : pages) {
+        SaveProfile(entry.second.get());
+        page_table[entry.first] = nullptr;
+    }
+
+    pages.clear();
+    retired_pages.clear();
+    allocated_size = 0;
+}
+
+void TranslationCache::EvictPages(const TranslationPage* keep) {
+    std::vector<TranslationPage*> candidates;
+    candidates.reserve(pages.size());
+    for (auto& entry : pages) {
+        if (entry.second.get() != keep)
+            candidates.push_back(entry.second.get());
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const TranslationPage* a, const TranslationPage* b) {
+        return a->last_used < b->last_used;
+    });
+
+    // Free a quarter of the budget at once so that we don't end up evicting on every translation
+    const size_t target_size = capacity - capacity / 4;
+    const size_t size_before = allocated_size;
+    size_t num_evicted = 0;
+
+    for (TranslationPage* page : candidates) {
+        if (allocated_size <= target_size)
+            break;
+
+        FreePage(page);
+        ++num_evicted;
+    }
+
+    LOG_DEBUG(Core_ARM11, "Evicted %u pages (%u bytes) from the translation cache",
+              (unsigned)num_evicted, (unsigned)(size_before - allocated_size));
+}
+
+void TranslationCache::FreePage(TranslationPage* page) {
+    UnmapPage(page);
+    pages.erase(page->index);
+}
+
+void TranslationCache::UnmapPage(TranslationPage* page) {
+    SaveProfile(page);
+
+    // Unlink blocks of other pages which jump into this one...
+    for (const BlockLink& link : page->incoming_links) {
+        if (link.source->page != page)
+            link.source->links[link.exit] = nullptr;
+    }
+
+    // ...and make sure that other pages won't try to unlink blocks of this page later on
+    for (TranslatedBlock* block : page->blocks) {
+        if (block == nullptr)
+            continue;
+
+        for (unsigned exit = 0; exit < NUM_BLOCK_EXITS; ++exit) {
+            TranslatedBlock* target = block->links[exit];
+            if (target != nullptr && target->page != page)
+                ForgetLink(block, static_cast<BlockExit>(exit));
+        }
+    }
+
+    page_table[page->index] = nullptr;
+    allocated_size -= page->size;
+}
+
+void TranslationCache::SaveProfile(const TranslationPage* page) {
+    for (const TranslatedBlock* block : page->blocks) {
+        if (block == nullptr || (block->exec_count == 0 && block->idle_cycles == 0))
+            continue;
+
+        BlockProfileEntry& entry = dropped_profile[block->start_addr];
+        entry.start_addr = block->start_addr;
+        entry.num_instructions = block->num_instructions;
+        entry.exec_count += block->exec_count;
+        entry.idle_cycles += block->idle_cycles;
+    }
+}
+
+std::vector<BlockProfileEntry> TranslationCache::GetProfile() const {
+    std::unordered_map<u32, BlockProfileEntry> profile = dropped_profile;
+
+    for (const auto& page : pages) {
+        for (const TranslatedBlock* block : page.second->blocks) {
+            if (block == nullptr || (block->exec_count == 0 && block->idle_cycles == 0))
+                continue;
+
+            BlockProfileEntry& entry = profile[block->start_addr];
+            entry.start_addr = block->start_addr;
+            entry.num_instructions = block->num_instructions;
+            entry.exec_count += block->exec_count;
+            entry.idle_cycles += block->idle_cycles;
+        }
+    }
+
+    std::vector<BlockProfileEntry> result;
+    result.reserve(profile.size());
+    for (const auto& entry : profile)
+        result.push_back(entry.second);
+    return result;
+}
+
+void TranslationCache::ResetProfile() {
+    dropped_profile.clear();
+
+    for (auto& page : pages) {
+        for (TranslatedBlock* block : page.second->blocks) {
+            if (block == nullptr)
+                continue;
+
+            block->exec_count = 0;
+            block->idle_cycles = 0;
+        }
+    }
+}
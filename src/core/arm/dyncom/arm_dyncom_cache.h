@@ -0,0 +1,195 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/arm/block_profiler.h"
+
+struct TranslationPage;
+
+/// Exits of a translated block that can be linked directly to their successor block
+enum BlockExit : unsigned {
+    EXIT_TAKEN       = 0, ///< Taken direct branch (B, BL and their Thumb counterparts)
+    EXIT_FALLTHROUGH = 1, ///< Not-taken branch, or sequential execution past the end of a page
+
+    NUM_BLOCK_EXITS
+};
+
+/// Start address given to invalidated blocks, which never matches a (halfword-aligned) PC
+const u32 INVALID_BLOCK_ADDR = 0xFFFFFFFF;
+
+/// Header placed in front of the instruction creams of every translated basic block
+struct TranslatedBlock {
+    u32 start_addr;         ///< Guest address of the first instruction of the block, INVALID_BLOCK_ADDR once invalidated
+    u32 num_instructions;   ///< Number of guest instructions in the block
+    u64 exec_count;         ///< Number of times the block was entered while profiling was enabled
+    u64 idle_cycles;        ///< Number of cycles skipped while the block was spinning as an idle loop
+    TranslationPage* page;  ///< Page arena owning the block
+
+    /// Successor blocks, if they were translated when the corresponding exit was last taken
+    TranslatedBlock* links[NUM_BLOCK_EXITS];
+
+    /// Whether the block is a busy-wait loop, which may be skipped until the next event (see IdleLoop)
+    bool is_idle_loop;
+
+    /// Returns a pointer to the first instruction cream of the block
+    u8* GetCreams() {
+        return reinterpret_cast<u8*>(this + 1);
+    }
+};
+
+/// log2 of the guest page size by which translated blocks are grouped
+const u32 TRANSLATION_PAGE_BITS = 12;
+const u32 TRANSLATION_PAGE_SIZE = 1 << TRANSLATION_PAGE_BITS;
+const u32 TRANSLATION_PAGE_MASK = TRANSLATION_PAGE_SIZE - 1;
+
+/// Identifies the exit of a block which has been linked to another block
+struct BlockLink {
+    TranslatedBlock* source;
+    BlockExit exit;
+};
+
+/// Arena holding all blocks which start in the same 4KB guest page
+struct TranslationPage {
+    u32 index;                                  ///< Guest page number (address >> 12)
+    u64 last_used;                              ///< Generation in which the page was last used
+    size_t size;                                ///< Total size of the page and its chunks, in bytes
+    size_t chunk_used;                          ///< Bytes used in the last chunk
+    size_t chunk_size;                          ///< Size of the last chunk, in bytes
+    std::vector<std::unique_ptr<u8[]>> chunks;  ///< Backing memory for the blocks
+    std::vector<BlockLink> incoming_links;      ///< Block exits linked to blocks of this page
+
+    /// Blocks starting in this page, indexed by their halfword offset inside the page
+    std::array<TranslatedBlock*, TRANSLATION_PAGE_SIZE / 2> blocks;
+};
+
+/**
+ * Storage for the instruction creams produced by the dyncom translator. Blocks are allocated from
+ * per-guest-page arenas, which allows keeping the cache within a fixed memory budget by discarding
+ * whole guest pages, least recently used first, instead of growing it without bounds.
+ *
+ * Lookups go through a flat table covering the whole 32-bit address space, which maps each guest
+ * page to its arena, and from there through the per-page block table. This keeps block lookups,
+ * which happen on every dispatch of the interpreter, down to two dependent loads.
+ */
+class TranslationCache : NonCopyable {
+public:
+    /// Default upper bound for the memory used by translated blocks, in bytes
+    static const size_t DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+    explicit TranslationCache(size_t capacity = DEFAULT_CAPACITY);
+    ~TranslationCache();
+
+    /**
+     * Looks up the translated block starting at the given address
+     * @param addr Guest address of the first instruction of the block
+     * @return The cached block, or nullptr if the address has not been translated yet
+     */
+    TranslatedBlock* Find(u32 addr) {
+        TranslationPage* page = page_table[addr >> TRANSLATION_PAGE_BITS];
+        if (page == nullptr)
+            return nullptr;
+
+        page->last_used = generation;
+        return page->blocks[(addr & TRANSLATION_PAGE_MASK) >> 1];
+    }
+
+    /**
+     * Copies a freshly translated block into the arena of the guest page it starts in. If this
+     * makes the cache exceed its capacity, the least recently used pages are evicted.
+     * @param addr Guest address of the first instruction of the block
+     * @param creams Translated instruction creams of the block
+     * @param size Size of the instruction creams, in bytes
+     * @param num_instructions Number of guest instructions in the block
+     * @param is_idle_loop Whether the block is a busy-wait loop
+     * @return The cached block
+     */
+    TranslatedBlock* Insert(u32 addr, const u8* creams, size_t size, u32 num_instructions, bool is_idle_loop);
+
+    /**
+     * Links an exit of a block to its successor, so that the interpreter can continue execution
+     * in the successor without looking it up. The link is removed when the successor is evicted.
+     * @param source Block to link from
+     * @param exit Exit of the source block to link
+     * @param target Block which execution continued in after taking the exit
+     */
+    void Link(TranslatedBlock* source, BlockExit exit, TranslatedBlock* target);
+
+    /**
+     * Discards all blocks starting in the guest pages overlapping the given address range. This is
+     * safe to call while one of the affected blocks is executing: its memory is only released on
+     * the next call to Insert(), and it won't be found or linked to anymore.
+     * @param addr Start address of the range
+     * @param size Size of the range, in bytes
+     */
+    void Invalidate(u32 addr, u32 size);
+
+    /// Discards all translated blocks
+    void Clear();
+
+    /// Returns the number of bytes currently allocated for translated blocks
+    size_t GetSize() const {
+        return allocated_size;
+    }
+
+    /**
+     * Enables or disables counting how often each block is entered. The interpreter checks this
+     * before incrementing TranslatedBlock::exec_count.
+     */
+    void SetProfilingEnabled(bool enable) {
+        profiling_enabled = enable;
+    }
+
+    bool IsProfilingEnabled() const {
+        return profiling_enabled;
+    }
+
+    /**
+     * Returns the execution counts of all blocks which were entered while profiling was enabled, as
+     * well as the cycles skipped in idle loops, including blocks which have since been evicted or
+     * invalidated
+     */
+    std::vector<BlockProfileEntry> GetProfile() const;
+
+    /// Resets all execution counts and skipped idle cycles to zero
+    void ResetProfile();
+
+private:
+    /// Evicts least recently used pages (except for `keep`) until the cache is back below budget
+    void EvictPages(const TranslationPage* keep);
+
+    /// Removes all blocks of the given page from the cache and releases its memory
+    void FreePage(TranslationPage* page);
+
+    /// Unlinks the blocks of the given page from other pages and removes the page from the lookup table
+    void UnmapPage(TranslationPage* page);
+
+    /// Removes the link of the given block exit from the incoming links of its target page
+    static void ForgetLink(TranslatedBlock* source, BlockExit exit);
+
+    /// Moves the execution counts of the blocks of the given page to `dropped_profile`
+    void SaveProfile(const TranslationPage* page);
+
+    /// Maps guest page numbers to the arena of the page, or nullptr if nothing was translated
+    std::unique_ptr<TranslationPage*[]> page_table;
+    std::unordered_map<u32, std::unique_ptr<TranslationPage>> pages;
+
+    /// Invalidated pages whose blocks might still be executing, released on the next translation
+    std::vector<std::unique_ptr<TranslationPage>> retired_pages;
+
+    /// Execution counts of blocks which were removed from the cache, indexed by start address
+    std::unordered_map<u32, BlockProfileEntry> dropped_profile;
+
+    size_t capacity;        ///< Maximum number of bytes allocated for translated blocks
+    size_t allocated_size;  ///< Number of bytes currently allocated for translated blocks
+    u64 generation;         ///< Incremented on every translation, used to age pages
+    bool profiling_enabled; ///< Whether the interpreter counts block executions
+};
@@ -2,6 +2,8 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <vector>
+
 #include "core/arm/skyeye_common/armdefs.h"
 #include "core/arm/dyncom/arm_dyncom_dec.h"
 
@@ -396,56 +398,115 @@ const ISEITEM arm_exclusion_code[] = {
     { "invalid", 0, INVALID, 0 }
 };
 
-int decode_arm_instr(uint32_t instr, int32_t *idx) {
-    int n = 0;
-    int base = 0;
-    int ret = DECODE_FAILURE;
-    int i = 0;
-    int instr_slots = sizeof(arm_instruction) / sizeof(ISEITEM);
+/// Number of entries of arm_instruction (and arm_exclusion_code)
+static const size_t NUM_INSTRUCTIONS = sizeof(arm_instruction) / sizeof(ISEITEM);
+static_assert(sizeof(arm_exclusion_code) >= sizeof(arm_instruction), "Every instruction needs an exclusion entry");
+
+/// Bit constraints of an ISEITEM, flattened to a single mask/value comparison
+struct DecodePattern {
+    u32 mask;
+    u32 value;
+};
 
-    for (i = 0; i < instr_slots; i++) {
-        n = arm_instruction[i].attribute_value;
-        base = 0;
+/**
+ * Flattens the "bits [a, b] equal c" constraints of an ISEITEM into a mask and a value. A range
+ * covering the whole word (as used by clrex) compares the whole instruction.
+ */
+static DecodePattern MakePattern(const ISEITEM& item) {
+    DecodePattern pattern = { 0, 0 };
+    for (int i = 0; i < item.attribute_value; ++i) {
+        const u32 low = item.content[i * 3];
+        const u32 high = item.content[i * 3 + 1];
+        const u32 value = item.content[i * 3 + 2];
 
-        while (n) {
-            if (arm_instruction[i].content[base + 1] == 31 && arm_instruction[i].content[base] == 0) {
-                // clrex
-                if (instr != arm_instruction[i].content[base + 2]) {
-                    break;
-                }
-            } else if (BITS(instr, arm_instruction[i].content[base], arm_instruction[i].content[base + 1]) != arm_instruction[i].content[base + 2]) {
-                break;
-            }
-            base += 3;
-            n--;
+        const u32 field_mask = (high - low == 31) ? 0xFFFFFFFF : ((1u << (high - low + 1)) - 1);
+        if ((value & ~field_mask) != 0) {
+            // The field can never hold the value, so make sure that the pattern never matches
+            pattern.mask = 0;
+            pattern.value = 1;
+            return pattern;
         }
 
-        // All conditions is satisfied.
-        if (n == 0)
-            ret = DECODE_SUCCESS;
+        pattern.mask |= field_mask << low;
+        pattern.value |= value << low;
+    }
+    return pattern;
+}
+
+/**
+ * Instructions are sorted into buckets by their bits 20-27 and 4-7, which select the instruction
+ * class and opcode in most of the ARM encoding space, and by whether their condition field is 0xF,
+ * which selects the unconditional instructions. Each bucket lists, in table order, the entries of
+ * arm_instruction which may match an instruction of the bucket, which is rarely more than a few.
+ */
+static const unsigned NUM_DECODE_BUCKETS = 1 << 13;
 
-        if (ret == DECODE_SUCCESS) {
-            n = arm_exclusion_code[i].attribute_value;
-            if (n != 0) {
-                base = 0;
-                while (n) {
-                    if (BITS(instr, arm_exclusion_code[i].content[base], arm_exclusion_code[i].content[base + 1]) != arm_exclusion_code[i].content[base + 2]) {
-                        break;
-                    }
-                    base += 3;
-                    n--;
-                }
+static unsigned GetDecodeBucket(u32 instr) {
+    return ((instr >> 16) & 0xFF0) | ((instr >> 4) & 0xF) | (((instr >> 28) == 0xF) ? 0x1000 : 0);
+}
+
+/// Lookup table replacing a linear scan of arm_instruction, built once at startup
+class DecodeTable {
+public:
+    DecodeTable() {
+        for (size_t i = 0; i < NUM_INSTRUCTIONS; ++i) {
+            patterns[i] = MakePattern(arm_instruction[i]);
+            exclusions[i] = MakePattern(arm_exclusion_code[i]);
+            has_exclusion[i] = arm_exclusion_code[i].attribute_value != 0;
+        }
 
-                // All conditions is satisfied.
-                if (n == 0)
-                    ret = DECODE_FAILURE;
+        for (unsigned bucket = 0; bucket < NUM_DECODE_BUCKETS; ++bucket) {
+            bucket_start[bucket] = static_cast<u32>(candidates.size());
+            for (size_t i = 0; i < NUM_INSTRUCTIONS; ++i) {
+                if (MayMatch(patterns[i], bucket))
+                    candidates.push_back(static_cast<u16>(i));
             }
         }
+        bucket_start[NUM_DECODE_BUCKETS] = static_cast<u32>(candidates.size());
+    }
+
+    int Decode(u32 instr, int32_t* idx) const {
+        const unsigned bucket = GetDecodeBucket(instr);
+        for (unsigned i = bucket_start[bucket]; i < bucket_start[bucket + 1]; ++i) {
+            const u16 index = candidates[i];
+            if ((instr & patterns[index].mask) != patterns[index].value)
+                continue;
+            if (has_exclusion[index] && (instr & exclusions[index].mask) == exclusions[index].value)
+                continue;
 
-        if (ret == DECODE_SUCCESS) {
-            *idx = i;
-            return ret;
+            *idx = index;
+            return DECODE_SUCCESS;
         }
+        return DECODE_FAILURE;
+    }
+
+private:
+    /// Returns whether the pattern matches at least one instruction of the given bucket
+    static bool MayMatch(const DecodePattern& pattern, unsigned bucket) {
+        // Bits 20-27 and 4-7 are fixed by the bucket
+        const u32 bucket_mask = 0x0FF000F0;
+        const u32 bucket_bits = ((bucket & 0xFF0) << 16) | ((bucket & 0xF) << 4);
+        if ((pattern.mask & bucket_mask & (pattern.value ^ bucket_bits)) != 0)
+            return false;
+
+        // Only the 0xF condition is fixed by the bucket, any other one may still match the pattern
+        const u32 cond_mask = pattern.mask >> 28;
+        const u32 cond_value = pattern.value >> 28;
+        if (bucket & 0x1000)
+            return (0xF & cond_mask) == cond_value;
+        return !(cond_mask == 0xF && cond_value == 0xF);
     }
-    return ret;
+
+    DecodePattern patterns[NUM_INSTRUCTIONS];
+    DecodePattern exclusions[NUM_INSTRUCTIONS];
+    bool has_exclusion[NUM_INSTRUCTIONS];
+
+    u32 bucket_start[NUM_DECODE_BUCKETS + 1];  ///< Offset of the candidates of each bucket
+    std::vector<u16> candidates;               ///< Indices into arm_instruction, grouped by bucket
+};
+
+static const DecodeTable decode_table;
+
+int decode_arm_instr(uint32_t instr, int32_t *idx) {
+    return decode_table.Decode(instr, idx);
 }
@@ -6,12 +6,14 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <vector>
 
 #include "common/logging/log.h"
 #include "common/profiler.h"
 
 #include "core/mem_map.h"
 #include "core/hle/svc.h"
+#include "core/arm/idle_loop.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/dyncom/arm_dyncom_interpreter.h"
 #include "core/arm/dyncom/arm_dyncom_thumb.h"
@@ -1106,17 +1108,16 @@ typedef struct _pkh_inst {
 
 typedef arm_inst * ARM_INST_PTR;
 
-#define CACHE_BUFFER_SIZE    (64 * 1024 * 2000)
-char inst_buf[CACHE_BUFFER_SIZE];
-int top = 0;
+// The instruction creams of the block being translated are assembled in this buffer, and moved
+// into the translation cache of the CPU once the block is complete.
+static std::vector<u8> trans_buf(64 * 1024);
+static size_t trans_top = 0;
 inline void *AllocBuffer(unsigned int size) {
-    int start = top;
-    top += size;
-    if (top > CACHE_BUFFER_SIZE) {
-        LOG_ERROR(Core_ARM11, "inst_buf is full");
-        CITRA_IGNORE_EXIT(-1);
-    }
-    return (void *)&inst_buf[start];
+    size_t start = trans_top;
+    trans_top += size;
+    if (trans_top > trans_buf.size())
+        trans_buf.resize(std::max(trans_top, trans_buf.size() * 2));
+    return (void *)&trans_buf[start];
 }
 
 int CondPassed(ARMul_State* cpu, unsigned int cond) {
@@ -3600,7 +3601,7 @@ typedef struct instruction_set_encoding_item ISEITEM;
 
 extern const ISEITEM arm_instruction[];
 
-static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
+static int InterpreterTranslate(ARMul_State* cpu, TranslatedBlock*& block, u32 addr) {
     Common::Profiling::ScopeTimer timer_decode(profile_decode);
 
     // Decode instruction, get index
@@ -3613,7 +3614,7 @@ static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
     int ret = NON_BRANCH;
     int thumb = 0;
     int size = 0; // instruction size of basic block
-    bb_start = top;
+    trans_top = 0;
 
     if (cpu->TFlag)
         thumb = THUMB;
@@ -3621,9 +3622,14 @@ static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
     u32 phys_addr = addr;
     u32 pc_start = cpu->Reg[15];
 
+    // The first ARM instructions of the block, to check whether it is an idle loop
+    u32 arm_insts[IdleLoop::MAX_INSTRUCTIONS];
+
     while(ret == NON_BRANCH) {
         inst = Memory::Read32(phys_addr & 0xFFFFFFFC);
 
+        if (!thumb && static_cast<unsigned>(size) < IdleLoop::MAX_INSTRUCTIONS)
+            arm_insts[size] = inst;
         size++;
         // If we are in thumb instruction, we will translate one thumb to one corresponding arm instruction
         if (cpu->TFlag) {
@@ -3655,7 +3661,11 @@ translated:
         ret = inst_base->br;
     };
 
-    cpu->instruction_cache[pc_start] = bb_start;
+    const bool is_idle_loop = !thumb && IdleLoop::IsIdleLoop(pc_start, arm_insts, size);
+    block = cpu->instruction_cache.Insert(pc_start, trans_buf.data(), trans_top, size, is_idle_loop);
+
+    // Watch the page for writes, so that the block gets discarded if the code is modified
+    Memory::MarkCodePage(pc_start);
 
     return KEEP_GOING;
 }
@@ -3693,8 +3703,12 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     #define SET_PC          (cpu->Reg[15] = cpu->Reg[15] + 8 + inst_cream->signed_immed_24)
     #define SHIFTER_OPERAND inst_cream->shtop_func(cpu, inst_cream->shifter_operand)
 
-    #define FETCH_INST if (inst_base->br != NON_BRANCH) goto DISPATCH; \
-                       inst_base = (arm_inst *)&inst_buf[ptr]
+    #define FETCH_INST if (inst_base->br != NON_BRANCH) GOTO_SUCCESSOR(EXIT_FALLTHROUGH); \
+                       inst_base = (arm_inst *)ptr
+
+    // Leaves the current block through one of its static exits, continuing directly in the
+    // successor block if it has been linked to that exit.
+    #define GOTO_SUCCESSOR(exit) { link_exit = exit; goto FOLLOW_LINK; }
 
     #define INC_PC(l) ptr += sizeof(arm_inst) + l
 
@@ -3963,7 +3977,14 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     unsigned int phys_addr;
     unsigned int num_instrs = 0;
 
-    int ptr;
+    u8* ptr;
+    TranslatedBlock* block = nullptr;
+
+    // Exit through which the previous block was left, if the next block should be linked to it
+    static const int NO_LINK = -1;
+    int link_exit = NO_LINK;
+
+    cpu->IdleLoopBlock = nullptr;
 
     LOAD_NZCVT;
     DISPATCH:
@@ -3982,15 +4003,50 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         phys_addr = cpu->Reg[15];
 
         // Find the cached instruction cream, otherwise translate it...
-        auto itr = cpu->instruction_cache.find(cpu->Reg[15]);
-        if (itr != cpu->instruction_cache.end()) {
-            ptr = itr->second;
-        } else {
-            if (InterpreterTranslate(cpu, ptr, cpu->Reg[15]) == FETCH_EXCEPTION)
-                goto END;
+        // Tight loops usually branch back to the start of the block that just finished, so check
+        // the previous block before going through the cache.
+        TranslatedBlock* next_block = block;
+        if (next_block == nullptr || next_block->start_addr != cpu->Reg[15]) {
+            next_block = cpu->instruction_cache.Find(cpu->Reg[15]);
+            if (next_block == nullptr) {
+                // Translating may evict the page of the previous block, so don't link to it
+                link_exit = NO_LINK;
+                if (InterpreterTranslate(cpu, next_block, cpu->Reg[15]) == FETCH_EXCEPTION)
+                    goto END;
+            }
+        }
+
+        if (link_exit != NO_LINK) {
+            cpu->instruction_cache.Link(block, static_cast<BlockExit>(link_exit), next_block);
+            link_exit = NO_LINK;
         }
 
-        inst_base = (arm_inst *)&inst_buf[ptr];
+        block = next_block;
+        if (cpu->instruction_cache.IsProfilingEnabled())
+            ++block->exec_count;
+        ptr = block->GetCreams();
+        inst_base = (arm_inst *)ptr;
+        GOTO_NEXT_INST;
+    }
+    FOLLOW_LINK:
+    {
+        // An idle loop which branched back to its start will keep doing so until the next event,
+        // so stop here and let the caller skip ahead to it
+        if (block->is_idle_loop && cpu->Reg[15] == block->start_addr) {
+            cpu->IdleLoopBlock = block;
+            goto END;
+        }
+
+        TranslatedBlock* next_block = block->links[link_exit];
+        if (next_block == nullptr || next_block->start_addr != cpu->Reg[15])
+            goto DISPATCH;
+
+        link_exit = NO_LINK;
+        block = next_block;
+        if (cpu->instruction_cache.IsProfilingEnabled())
+            ++block->exec_count;
+        ptr = block->GetCreams();
+        inst_base = (arm_inst *)ptr;
         GOTO_NEXT_INST;
     }
     ADC_INST:
@@ -3998,9 +4054,13 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             adc_inst* const inst_cream = (adc_inst*)inst_base->component;
 
+            u32 rn_val = RN;
+            if (inst_cream->Rn == 15)
+                rn_val += 2 * GET_INST_SIZE(cpu);
+
             bool carry;
             bool overflow;
-            RD = AddWithCarry(RN, SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
+            RD = AddWithCarry(rn_val, SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -4064,6 +4124,8 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         and_inst *inst_cream = (and_inst *)inst_base->component;
         if ((inst_base->cond == 0xe) || CondPassed(cpu, inst_base->cond)) {
             u32 lop = RN;
+            if (inst_cream->Rn == 15)
+                lop += 2 * GET_INST_SIZE(cpu);
             u32 rop = SHIFTER_OPERAND;
             RD = lop & rop;
             if (inst_cream->S && (inst_cream->Rd == 15)) {
@@ -4096,11 +4158,11 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             }
             SET_PC;
             INC_PC(sizeof(bbl_inst));
-            goto DISPATCH;
+            GOTO_SUCCESSOR(EXIT_TAKEN);
         }
         cpu->Reg[15] += GET_INST_SIZE(cpu);
         INC_PC(sizeof(bbl_inst));
-        goto DISPATCH;
+        GOTO_SUCCESSOR(EXIT_FALLTHROUGH);
     }
     BIC_INST:
     {
@@ -4238,9 +4300,13 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             cmn_inst* const inst_cream = (cmn_inst*)inst_base->component;
 
+            u32 rn_val = RN;
+            if (inst_cream->Rn == 15)
+                rn_val += 2 * GET_INST_SIZE(cpu);
+
             bool carry;
             bool overflow;
-            u32 result = AddWithCarry(RN, SHIFTER_OPERAND, 0, &carry, &overflow);
+            u32 result = AddWithCarry(rn_val, SHIFTER_OPERAND, 0, &carry, &overflow);
 
             UPDATE_NFLAG(result);
             UPDATE_ZFLAG(result);
@@ -4948,6 +5014,8 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             orr_inst* const inst_cream = (orr_inst*)inst_base->component;
 
             u32 lop = RN;
+            if (inst_cream->Rn == 15)
+                lop += 2 * GET_INST_SIZE(cpu);
             u32 rop = SHIFTER_OPERAND;
             RD = lop | rop;
 
@@ -5231,9 +5299,13 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             rsc_inst* const inst_cream = (rsc_inst*)inst_base->component;
 
+            u32 rn_val = RN;
+            if (inst_cream->Rn == 15)
+                rn_val += 2 * GET_INST_SIZE(cpu);
+
             bool carry;
             bool overflow;
-            RD = AddWithCarry(~RN, SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
+            RD = AddWithCarry(~rn_val, SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -5371,9 +5443,13 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             sbc_inst* const inst_cream = (sbc_inst*)inst_base->component;
 
+            u32 rn_val = RN;
+            if (inst_cream->Rn == 15)
+                rn_val += 2 * GET_INST_SIZE(cpu);
+
             bool carry;
             bool overflow;
-            RD = AddWithCarry(RN, ~SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
+            RD = AddWithCarry(rn_val, ~SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -6698,19 +6774,21 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         b_2_thumb* inst_cream = (b_2_thumb*)inst_base->component;
         cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
         INC_PC(sizeof(b_2_thumb));
-        goto DISPATCH;
+        GOTO_SUCCESSOR(EXIT_TAKEN);
     }
     B_COND_THUMB:
     {
         b_cond_thumb* inst_cream = (b_cond_thumb*)inst_base->component;
 
-        if(CondPassed(cpu, inst_cream->cond))
+        if(CondPassed(cpu, inst_cream->cond)) {
             cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
-        else
-            cpu->Reg[15] += 2;
+            INC_PC(sizeof(b_cond_thumb));
+            GOTO_SUCCESSOR(EXIT_TAKEN);
+        }
 
+        cpu->Reg[15] += 2;
         INC_PC(sizeof(b_cond_thumb));
-        goto DISPATCH;
+        GOTO_SUCCESSOR(EXIT_FALLTHROUGH);
     }
     BL_1_THUMB:
     {
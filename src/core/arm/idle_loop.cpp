@@ -0,0 +1,215 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "core/arm/idle_loop.h"
+
+namespace IdleLoop {
+
+/// Indices of the status flags, tracked alongside the 16 general purpose registers
+enum : unsigned {
+    FLAG_N = 16, FLAG_Z, FLAG_C, FLAG_V,
+};
+
+/// Condition code of instructions which are always executed
+static const u32 COND_AL = 0xE;
+
+/**
+ * Tracks which registers and flags the loop reads before writing them itself. Those carry state
+ * over from the previous iteration, which is fine as long as the loop never modifies them.
+ */
+class Dependencies {
+public:
+    Dependencies() : carried_over(0), written(0) {
+    }
+
+    void Read(unsigned index) {
+        if (!(written & (1 << index)))
+            carried_over |= 1 << index;
+    }
+
+    void Write(unsigned index) {
+        written |= 1 << index;
+    }
+
+    /// Writes a register or flag which may also keep its previous value, e.g. if a condition fails
+    void MaybeWrite(unsigned index) {
+        Read(index);
+        Write(index);
+    }
+
+    void ReadFlags() {
+        Read(FLAG_N);
+        Read(FLAG_Z);
+        Read(FLAG_C);
+        Read(FLAG_V);
+    }
+
+    /// Returns whether every iteration of the loop starts with the same registers and flags
+    bool IsStateless() const {
+        return (carried_over & written) == 0;
+    }
+
+private:
+    u32 carried_over;  ///< Registers and flags whose value at the start of the iteration is used
+    u32 written;       ///< Registers and flags written so far in the iteration
+};
+
+/// Effect of a shifter operand on the carry flag, when used by a flag-setting logical instruction
+enum class CarryOut {
+    Unchanged,
+    Written,
+    MaybeWritten, ///< Shifts by a register leave the carry unchanged when the register holds zero
+};
+
+/// Handles the registers read by a (possibly shifted) register operand
+static CarryOut ReadShiftedRegister(u32 inst, Dependencies& deps) {
+    const u32 shift_type = (inst >> 5) & 3;
+    const u32 shift_imm = (inst >> 7) & 0x1F;
+
+    deps.Read(inst & 0xF);
+
+    if (inst & (1 << 4)) {
+        deps.Read((inst >> 8) & 0xF);
+        return CarryOut::MaybeWritten;
+    }
+
+    // RRX (encoded as ROR #0) shifts the carry in
+    if (shift_type == 3 && shift_imm == 0)
+        deps.Read(FLAG_C);
+
+    return (shift_type != 0 || shift_imm != 0) ? CarryOut::Written : CarryOut::Unchanged;
+}
+
+/// Handles a load instruction, returns false if it doesn't belong in an idle loop
+static bool AnalyzeLoad(u32 inst, Dependencies& deps) {
+    const bool pre_indexed = (inst & (1 << 24)) != 0;
+    const bool writeback = (inst & (1 << 21)) != 0;
+    const unsigned rd = (inst >> 12) & 0xF;
+
+    if (!pre_indexed || writeback || rd == 15)
+        return false;
+
+    deps.Read((inst >> 16) & 0xF);
+
+    if ((inst & 0x0C000000) == 0x04000000) {
+        // LDR, LDRB: register offsets may be shifted
+        if (inst & (1 << 25))
+            ReadShiftedRegister(inst, deps);
+    } else {
+        // LDRH, LDRSB, LDRSH: the register offset is unshifted
+        if (!(inst & (1 << 22)))
+            deps.Read(inst & 0xF);
+    }
+
+    if ((inst >> 28) == COND_AL)
+        deps.Write(rd);
+    else
+        deps.MaybeWrite(rd);
+    return true;
+}
+
+/// Handles a data processing instruction, returns false if it doesn't belong in an idle loop
+static bool AnalyzeDataProcessing(u32 inst, Dependencies& deps) {
+    const u32 opcode = (inst >> 21) & 0xF;
+    const bool set_flags = (inst & (1 << 20)) != 0;
+    const bool is_compare = opcode >= 0x8 && opcode <= 0xB;
+    const bool is_move = opcode == 0xD || opcode == 0xF;
+    const bool is_logical = opcode == 0x0 || opcode == 0x1 || opcode == 0x8 || opcode == 0x9 ||
+                            opcode == 0xC || opcode == 0xD || opcode == 0xE || opcode == 0xF;
+    const unsigned rd = (inst >> 12) & 0xF;
+
+    // Compare opcodes without the S bit encode MRS, MSR, BX and friends
+    if (is_compare && !set_flags)
+        return false;
+    if (!is_compare && rd == 15)
+        return false;
+
+    if (!is_move)
+        deps.Read((inst >> 16) & 0xF);
+
+    CarryOut carry_out;
+    if (inst & (1 << 25)) {
+        // Immediates only update the carry if they are rotated
+        carry_out = ((inst >> 8) & 0xF) != 0 ? CarryOut::Written : CarryOut::Unchanged;
+    } else {
+        carry_out = ReadShiftedRegister(inst, deps);
+    }
+
+    // ADC, SBC, RSC
+    if (opcode >= 0x5 && opcode <= 0x7)
+        deps.Read(FLAG_C);
+
+    const bool conditional = (inst >> 28) != COND_AL;
+    auto write = [&](unsigned index) {
+        if (conditional)
+            deps.MaybeWrite(index);
+        else
+            deps.Write(index);
+    };
+
+    if (!is_compare)
+        write(rd);
+
+    if (set_flags) {
+        write(FLAG_N);
+        write(FLAG_Z);
+        if (!is_logical) {
+            write(FLAG_C);
+            write(FLAG_V);
+        } else if (carry_out == CarryOut::Written) {
+            write(FLAG_C);
+        } else if (carry_out == CarryOut::MaybeWritten) {
+            deps.MaybeWrite(FLAG_C);
+        }
+    }
+
+    return true;
+}
+
+bool IsIdleLoop(u32 start_addr, const u32* instructions, unsigned count) {
+    if (count == 0 || count > MAX_INSTRUCTIONS)
+        return false;
+
+    // The block has to end with a branch (without link) back to its start
+    const u32 branch = instructions[count - 1];
+    const u32 branch_addr = start_addr + (count - 1) * 4;
+    const s32 offset = static_cast<s32>(branch << 8) >> 6;
+    if ((branch >> 28) == 0xF || (branch & 0x0F000000) != 0x0A000000 || branch_addr + 8 + offset != start_addr)
+        return false;
+
+    Dependencies deps;
+    for (unsigned i = 0; i < count - 1; ++i) {
+        const u32 inst = instructions[i];
+        const u32 cond = inst >> 28;
+
+        if (cond == 0xF)
+            return false;
+        if (cond != COND_AL)
+            deps.ReadFlags();
+
+        bool accepted;
+        if ((inst & 0x0C100000) == 0x04100000 && (inst & 0x02000010) != 0x02000010) {
+            // LDR, LDRB
+            accepted = AnalyzeLoad(inst, deps);
+        } else if ((inst & 0x0E100090) == 0x00100090 && (inst & 0x60) != 0) {
+            // LDRH, LDRSB, LDRSH
+            accepted = AnalyzeLoad(inst, deps);
+        } else if ((inst & 0x0C000000) == 0 && (inst & 0x02000090) != 0x00000090) {
+            // Data processing, excluding multiplies and extra load/stores
+            accepted = AnalyzeDataProcessing(inst, deps);
+        } else {
+            accepted = false;
+        }
+
+        if (!accepted)
+            return false;
+    }
+
+    if ((branch >> 28) != COND_AL)
+        deps.ReadFlags();
+
+    return deps.IsStateless();
+}
+
+} // namespace
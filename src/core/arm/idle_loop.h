@@ -0,0 +1,32 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace IdleLoop {
+
+/// Maximum number of instructions (including the branch) of a block recognised as an idle loop
+const unsigned MAX_INSTRUCTIONS = 8;
+
+/**
+ * Checks whether a block of ARM code is a busy-wait loop, i.e. a loop which only polls memory and
+ * branches back to its own start. Such a loop recomputes the same registers and flags on every
+ * iteration, so it keeps spinning until memory is modified, which (as guest threads are not
+ * preempted) only happens when an event fires. It is thus safe to skip ahead to the next event
+ * as soon as the loop has branched back to its start once.
+ *
+ * The body may only contain unconditional loads without writeback and data processing
+ * instructions, and no register (or flag) may be read before the loop itself writes it if it is
+ * written anywhere in the loop. The last instruction must be a branch to `start_addr`.
+ *
+ * @param start_addr Guest address of the first instruction of the block
+ * @param instructions ARM instructions of the block
+ * @param count Number of instructions of the block
+ * @return True if the block is an idle loop
+ */
+bool IsIdleLoop(u32 start_addr, const u32* instructions, unsigned count);
+
+} // namespace
@@ -32,6 +32,8 @@ ARMul_State* ARMul_NewState(ARMul_State* state)
     state->lateabtSig = HIGH;
     state->bigendSig = LOW;
 
+    state->IdleLoopBlock = nullptr;
+
     return state;
 }
 
@@ -0,0 +1,818 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "common/common_funcs.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/memory_util.h"
+
+#include "core/mem_map.h"
+#include "core/arm/idle_loop.h"
+#include "core/arm/disassembler/arm_disasm.h"
+#include "core/arm/dyncom/arm_dyncom_interpreter.h"
+#include "core/arm/jit/arm_jit.h"
+#include "common/x64_emitter.h"
+#include "core/arm/skyeye_common/armmmu.h"
+
+using namespace X64;
+
+/// Size of the executable memory holding the generated code
+static const size_t CODE_BUFFER_SIZE = 32 * 1024 * 1024;
+
+/// Upper bound for the size of the code generated for a single block
+static const size_t MAX_BLOCK_CODE_SIZE = 64 * 1024;
+
+/// Maximum number of guest instructions compiled into a single block
+static const u32 MAX_BLOCK_INSTRUCTIONS = 64;
+
+/// Maximum number of instructions handed to the interpreter at once when a block can't be compiled
+static const u32 MAX_INTERPRETED_INSTRUCTIONS = 16;
+
+/// Stack space reserved by the prologue of the generated code, keeping RSP 16-byte aligned for calls
+static const u32 STACK_ADJUSTMENT = ABI_SHADOW_SPACE + 8;
+
+// Bits of the CPSR
+static const u32 CPSR_N = 1u << 31;
+static const u32 CPSR_Z = 1u << 30;
+static const u32 CPSR_C = 1u << 29;
+static const u32 CPSR_V = 1u << 28;
+static const u32 CPSR_T = 1u << 5;
+
+/// Offset of a field of ARMul_State, as used for addressing it from the generated code
+#define STATE_OFFSET(field) \
+    static_cast<s32>(reinterpret_cast<const u8*>(&state->field) - reinterpret_cast<const u8*>(state.get()))
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory access helpers called by the generated code
+
+/// Memory write performed by a block, recorded to check it against the interpreter in lockstep mode
+struct StoreRecord {
+    u32 addr;
+    u32 size;
+    u32 old_value;  ///< Value before the write
+    u32 new_value;  ///< Value at the end of the block, which later writes may have overlapped
+};
+
+/// Writes performed by the block being checked in lockstep mode, nullptr when not checking a block
+static std::vector<StoreRecord>* store_log = nullptr;
+
+static u32 ReadWord(ARMul_State* cpu, u32 addr) {
+    return ReadMemory32(cpu, addr);
+}
+
+static u32 ReadByte(ARMul_State* cpu, u32 addr) {
+    return Memory::Read8(addr);
+}
+
+static void WriteWord(ARMul_State* cpu, u32 addr, u32 value) {
+    if (store_log == nullptr) {
+        WriteMemory32(cpu, addr, value);
+        return;
+    }
+
+    const u32 old_value = Memory::Read32(addr);
+    WriteMemory32(cpu, addr, value);
+    store_log->push_back({ addr, 4, old_value, 0 });
+}
+
+static void WriteByte(ARMul_State* cpu, u32 addr, u32 value) {
+    if (store_log == nullptr) {
+        Memory::Write8(addr, value);
+        return;
+    }
+
+    const u32 old_value = Memory::Read8(addr);
+    Memory::Write8(addr, value);
+    store_log->push_back({ addr, 1, old_value, 0 });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Returns a mask with bit n set if an instruction with the given condition code executes when the
+ * NZCV flags (bits 31-28 of the CPSR) are equal to n.
+ */
+static u32 ConditionMask(unsigned cond) {
+    u32 mask = 0;
+    for (unsigned flags = 0; flags < 16; ++flags) {
+        const bool n = (flags & 8) != 0, z = (flags & 4) != 0, c = (flags & 2) != 0, v = (flags & 1) != 0;
+        bool passed;
+        switch (cond) {
+        case 0x0: passed = z; break;
+        case 0x1: passed = !z; break;
+        case 0x2: passed = c; break;
+        case 0x3: passed = !c; break;
+        case 0x4: passed = n; break;
+        case 0x5: passed = !n; break;
+        case 0x6: passed = v; break;
+        case 0x7: passed = !v; break;
+        case 0x8: passed = c && !z; break;
+        case 0x9: passed = !c || z; break;
+        case 0xA: passed = n == v; break;
+        case 0xB: passed = n != v; break;
+        case 0xC: passed = !z && n == v; break;
+        case 0xD: passed = z || n != v; break;
+        default:  passed = true; break;
+        }
+
+        if (passed)
+            mask |= 1 << flags;
+    }
+    return mask;
+}
+
+/// Returns the number of set bits in the given register list
+static unsigned CountRegisters(u32 list) {
+    unsigned count = 0;
+    for (; list != 0; list &= list - 1)
+        ++count;
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ARM_JIT::ARM_JIT(PrivilegeMode initial_mode, bool lockstep)
+    : ARM_DynCom(initial_mode), lockstep(lockstep), lockstep_mismatches(0), reschedule_pending(false),
+      profiling_enabled(false) {
+
+    code_buffer = static_cast<u8*>(AllocateExecutableMemory(CODE_BUFFER_SIZE, false));
+    emit = Common::make_unique<Emitter>(code_buffer, CODE_BUFFER_SIZE);
+}
+
+ARM_JIT::~ARM_JIT() {
+    FreeMemoryPages(code_buffer, CODE_BUFFER_SIZE);
+}
+
+void ARM_JIT::PrepareReschedule() {
+    reschedule_pending = true;
+    ARM_DynCom::PrepareReschedule();
+}
+
+void ARM_JIT::ClearInstructionCache(u32 addr, u32 size) {
+    ARM_DynCom::ClearInstructionCache(addr, size);
+
+    if (size == 0)
+        return;
+
+    // Only the block table entries are removed here, the generated code may still be executing
+    // (if the write came from it) and is only released once the code buffer is reset.
+    const u32 first_page = addr >> 12;
+    const u32 last_page = static_cast<u32>((u64(addr) + size - 1) >> 12);
+    for (u32 page = first_page; page <= last_page && page <= 0xFFFFF; ++page) {
+        auto it = page_blocks.find(page);
+        if (it == page_blocks.end())
+            continue;
+
+        for (u32 start_addr : it->second)
+            blocks.erase(start_addr);
+        page_blocks.erase(it);
+    }
+}
+
+void ARM_JIT::SetBlockProfilingEnabled(bool enable) {
+    ARM_DynCom::SetBlockProfilingEnabled(enable);
+    profiling_enabled = enable;
+}
+
+std::vector<BlockProfileEntry> ARM_JIT::GetBlockProfile() const {
+    // Code run by the interpreter is counted separately, so a block may show up twice
+    std::vector<BlockProfileEntry> result = ARM_DynCom::GetBlockProfile();
+    for (const auto& entry : profile)
+        result.push_back(entry.second);
+    return result;
+}
+
+void ARM_JIT::ExecuteInstructions(int num_instructions) {
+    reschedule_pending = false;
+    state->IdleLoopBlock = nullptr;
+
+    // Start address of the compiled idle loop execution stopped in, if any
+    u32 idle_loop_addr = INVALID_BLOCK_ADDR;
+
+    // Like dyncom, this only checks the instruction budget between blocks, so more instructions
+    // than specified may actually be executed.
+    unsigned ticks_executed = 0;
+    while (ticks_executed < static_cast<unsigned>(num_instructions) && !reschedule_pending) {
+        const unsigned remaining = num_instructions - ticks_executed;
+        unsigned executed;
+
+        if (state->Cpsr & CPSR_T) {
+            // Thumb code is left to the interpreter
+            state->NumInstrsToExecute = remaining;
+            executed = InterpreterMainLoop(state.get());
+        } else {
+            state->Reg[15] &= 0xFFFFFFFC;
+
+            const Block& block = GetBlock(state->Reg[15]);
+            const u32 start_addr = block.start_addr;
+            const bool is_idle_loop = block.is_idle_loop;
+            executed = block.num_instructions;
+
+            if (block.num_instructions != 0 && profiling_enabled) {
+                BlockProfileEntry& entry = profile[block.start_addr];
+                entry.start_addr = block.start_addr;
+                entry.num_instructions = block.num_instructions;
+                ++entry.exec_count;
+            }
+
+            if (block.num_instructions == 0) {
+                state->NumInstrsToExecute = std::min(block.num_interpreted, remaining);
+                executed = InterpreterMainLoop(state.get());
+            } else if (lockstep) {
+                RunBlockLockstep(block);
+            } else {
+                // The block may be invalidated by the code it runs, so don't touch it afterwards
+                block.code(state.get());
+            }
+
+            if (is_idle_loop && state->Reg[15] == start_addr)
+                idle_loop_addr = start_addr;
+        }
+
+        if (executed == 0)
+            break;
+        ticks_executed += executed;
+
+        if (idle_loop_addr != INVALID_BLOCK_ADDR || state->IdleLoopBlock != nullptr)
+            break;
+    }
+
+    if (idle_loop_addr != INVALID_BLOCK_ADDR || state->IdleLoopBlock != nullptr) {
+        down_count -= ticks_executed;
+        ticks_executed = 0;
+
+        const u64 idle_cycles = SkipIdleLoop();
+        if (state->IdleLoopBlock != nullptr) {
+            state->IdleLoopBlock->idle_cycles += idle_cycles;
+            state->IdleLoopBlock = nullptr;
+        } else if (profiling_enabled) {
+            profile[idle_loop_addr].idle_cycles += idle_cycles;
+        }
+    }
+
+    AddTicks(ticks_executed);
+}
+
+const ARM_JIT::Block& ARM_JIT::GetBlock(u32 addr) {
+    auto it = blocks.find(addr);
+    if (it != blocks.end())
+        return it->second;
+
+    if (emit->GetSpaceLeft() < MAX_BLOCK_CODE_SIZE) {
+        LOG_DEBUG(Core_ARM11, "JIT code buffer full, discarding all blocks");
+        ClearBlocks();
+    }
+
+    Block& block = blocks[addr];
+    block.start_addr = addr;
+    CompileBlock(block);
+
+    // Watch the page for writes, so that the block gets discarded if the code is modified
+    Memory::MarkCodePage(addr);
+    page_blocks[addr >> 12].push_back(addr);
+
+    return block;
+}
+
+void ARM_JIT::ClearBlocks() {
+    blocks.clear();
+    page_blocks.clear();
+    emit->SetCodePtr(code_buffer);
+}
+
+void ARM_JIT::CompileBlock(Block& block) {
+    u8* const entry = emit->GetCodePtr();
+
+    // The generated code addresses the CPU state through RBX, and LDM/STM keep the address in R12
+    emit->PUSH(RBX);
+    emit->PUSH(X64::R12);
+    emit->ALU64(ALU_SUB, RSP, STACK_ADJUSTMENT);
+    emit->MOV64(RBX, ABI_PARAM1);
+
+    u32 addr = block.start_addr;
+    u32 num_instructions = 0;
+    CompileResult result = CompileResult::Continue;
+
+    while (num_instructions < MAX_BLOCK_INSTRUCTIONS) {
+        result = CompileInstruction(Memory::Read32(addr), addr);
+        if (result == CompileResult::Unhandled)
+            break;
+
+        ++num_instructions;
+        addr += 4;
+
+        // Blocks don't cross pages, so that they can be invalidated page by page
+        if (result == CompileResult::EndBlock || (addr & 0xFFF) == 0)
+            break;
+    }
+
+    if (num_instructions == 0) {
+        emit->SetCodePtr(entry);
+
+        // Let the interpreter handle the whole run of instructions the recompiler can't handle
+        u32 num_interpreted = 1;
+        for (addr += 4; (addr & 0xFFF) != 0 && num_interpreted < MAX_INTERPRETED_INSTRUCTIONS; addr += 4) {
+            if (CompileInstruction(Memory::Read32(addr), addr) != CompileResult::Unhandled)
+                break;
+            ++num_interpreted;
+        }
+        emit->SetCodePtr(entry);
+
+        block.num_instructions = 0;
+        block.num_interpreted = num_interpreted;
+        block.is_idle_loop = false;
+        block.code = nullptr;
+        return;
+    }
+
+    if (result != CompileResult::EndBlock)
+        EmitExit(addr);
+
+    block.num_instructions = num_instructions;
+    block.num_interpreted = 0;
+    block.is_idle_loop = false;
+    block.code = reinterpret_cast<BlockCode>(entry);
+
+    if (num_instructions <= IdleLoop::MAX_INSTRUCTIONS) {
+        u32 instructions[IdleLoop::MAX_INSTRUCTIONS];
+        for (u32 i = 0; i < num_instructions; ++i)
+            instructions[i] = Memory::Read32(block.start_addr + i * 4);
+        block.is_idle_loop = IdleLoop::IsIdleLoop(block.start_addr, instructions, num_instructions);
+    }
+}
+
+void ARM_JIT::EmitExit(u32 next_addr) {
+    emit->MOV(RBX, STATE_OFFSET(Reg[15]), next_addr);
+    emit->ALU64(ALU_ADD, RSP, STACK_ADJUSTMENT);
+    emit->POP(X64::R12);
+    emit->POP(RBX);
+    emit->RET();
+}
+
+void ARM_JIT::EmitIndirectExit() {
+    // Bit 0 of the target address selects the instruction set, like in the interpreter
+    emit->TEST(RAX, 1u);
+    u8* const arm_target = emit->Jcc(CC_Z);
+    emit->ALU(ALU_OR, RBX, STATE_OFFSET(Cpsr), CPSR_T);
+    emit->ALU(ALU_AND, RAX, 0xFFFFFFFEu);
+    emit->SetJumpTarget(arm_target);
+
+    emit->MOV(RBX, STATE_OFFSET(Reg[15]), RAX);
+    emit->ALU64(ALU_ADD, RSP, STACK_ADJUSTMENT);
+    emit->POP(X64::R12);
+    emit->POP(RBX);
+    emit->RET();
+}
+
+void ARM_JIT::EmitLoadReg(u8 reg, unsigned guest_reg, u32 addr) {
+    if (guest_reg == 15)
+        emit->MOV(static_cast<Reg>(reg), addr + 8);
+    else
+        emit->MOV(static_cast<Reg>(reg), RBX, STATE_OFFSET(Reg[guest_reg]));
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileInstruction(u32 inst, u32 addr) {
+    const unsigned cond = inst >> 28;
+    if (cond == 0xF)
+        return CompileResult::Unhandled;
+
+    u8* const start = emit->GetCodePtr();
+
+    // Skip the instruction if its condition doesn't hold
+    u8* skip = nullptr;
+    if (cond != 0xE) {
+        emit->MOV(RAX, RBX, STATE_OFFSET(Cpsr));
+        emit->SHIFT(SHIFT_SHR, RAX, 28);
+        emit->MOV(RCX, ConditionMask(cond));
+        emit->BT(RCX, RAX);
+        skip = emit->Jcc(CC_NC);
+    }
+
+    CompileResult result;
+    if ((inst & 0x0FFFFFD0) == 0x012FFF10) {
+        result = CompileBranchExchange(inst, addr);
+    } else if ((inst & 0x0FC000F0) == 0x00000090) {
+        result = CompileMultiply(inst);
+    } else if ((inst & 0x0C000000) == 0x00000000) {
+        result = CompileDataProcessing(inst, addr);
+    } else if ((inst & 0x0C000000) == 0x04000000) {
+        result = CompileLoadStore(inst, addr);
+    } else if ((inst & 0x0E000000) == 0x08000000) {
+        result = CompileLoadStoreMultiple(inst);
+    } else if ((inst & 0x0E000000) == 0x0A000000) {
+        result = CompileBranch(inst, addr);
+    } else {
+        result = CompileResult::Unhandled;
+    }
+
+    if (result == CompileResult::Unhandled) {
+        emit->SetCodePtr(start);
+        return result;
+    }
+
+    if (skip != nullptr) {
+        emit->SetJumpTarget(skip);
+        if (result == CompileResult::EndBlock)
+            EmitExit(addr + 4);
+    }
+
+    return result;
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileDataProcessing(u32 inst, u32 addr) {
+    const bool immediate = (inst >> 25) & 1;
+    const unsigned opcode = (inst >> 21) & 0xF;
+    const bool set_flags = (inst >> 20) & 1;
+    const unsigned rn = (inst >> 16) & 0xF;
+    const unsigned rd = (inst >> 12) & 0xF;
+
+    const bool is_test = opcode >= 0x8 && opcode <= 0xB;
+    const bool is_logical = opcode == 0x0 || opcode == 0x1 || opcode == 0x8 || opcode == 0x9 || opcode >= 0xC;
+
+    // TST/TEQ/CMP/CMN without S are miscellaneous instructions (MRS, MSR, ...), and writes to the
+    // PC are branches which may also change the mode.
+    if ((is_test && !set_flags) || (!is_test && rd == 15))
+        return CompileResult::Unhandled;
+
+    // Register-shifted register operands and the extra load/store space are left to the interpreter
+    if (!immediate && ((inst >> 4) & 1))
+        return CompileResult::Unhandled;
+
+    // Where the carry flag comes from for logical operations with S set
+    enum { CARRY_UNCHANGED, CARRY_CLEAR, CARRY_SET, CARRY_FROM_R10 } shifter_carry = CARRY_UNCHANGED;
+
+    // Second operand into ECX
+    if (immediate) {
+        const unsigned rotate = ((inst >> 8) & 0xF) * 2;
+        const u32 value = _rotr(inst & 0xFF, rotate);
+        emit->MOV(RCX, value);
+        if (rotate != 0)
+            shifter_carry = (value >> 31) ? CARRY_SET : CARRY_CLEAR;
+    } else {
+        const unsigned shift_type = (inst >> 5) & 3;
+        const unsigned amount = (inst >> 7) & 0x1F;
+
+        // LSR #32, ASR #32 and RRX
+        if (amount == 0 && shift_type != 0)
+            return CompileResult::Unhandled;
+
+        EmitLoadReg(RCX, inst & 0xF, addr);
+        if (amount != 0) {
+            static const ShiftOp shift_ops[] = { SHIFT_SHL, SHIFT_SHR, SHIFT_SAR, SHIFT_ROR };
+            emit->SHIFT(shift_ops[shift_type], RCX, amount);
+            if (set_flags && is_logical) {
+                emit->SETcc(CC_C, X64::R10);
+                shifter_carry = CARRY_FROM_R10;
+            }
+        }
+    }
+
+    // First operand into EAX
+    if (opcode != 0xD && opcode != 0xF)
+        EmitLoadReg(RAX, rn, addr);
+
+    // Result into EAX. For arithmetic operations, `carry` is the x86 condition matching the ARM carry flag.
+    Cond carry = CC_C;
+    switch (opcode) {
+    case 0x0: emit->ALU(ALU_AND, RAX, RCX); break;                                        // AND
+    case 0x1: emit->ALU(ALU_XOR, RAX, RCX); break;                                        // EOR
+    case 0x2: emit->ALU(ALU_SUB, RAX, RCX); carry = CC_NC; break;                         // SUB
+    case 0x3: emit->ALU(ALU_SUB, RCX, RAX); emit->MOV(RAX, RCX); carry = CC_NC; break;    // RSB
+    case 0x4: emit->ALU(ALU_ADD, RAX, RCX); break;                                        // ADD
+    case 0x5:                                                                             // ADC
+        emit->BT(RBX, STATE_OFFSET(Cpsr), 29);
+        emit->ALU(ALU_ADC, RAX, RCX);
+        break;
+    case 0x6:                                                                             // SBC
+        emit->BT(RBX, STATE_OFFSET(Cpsr), 29);
+        emit->CMC();
+        emit->ALU(ALU_SBB, RAX, RCX);
+        carry = CC_NC;
+        break;
+    case 0x7:                                                                             // RSC
+        emit->BT(RBX, STATE_OFFSET(Cpsr), 29);
+        emit->CMC();
+        emit->ALU(ALU_SBB, RCX, RAX);
+        emit->MOV(RAX, RCX);
+        carry = CC_NC;
+        break;
+    case 0x8: emit->TEST(RAX, RCX); break;                                                // TST
+    case 0x9: emit->ALU(ALU_XOR, RAX, RCX); break;                                        // TEQ
+    case 0xA: emit->ALU(ALU_CMP, RAX, RCX); carry = CC_NC; break;                         // CMP
+    case 0xB: emit->ALU(ALU_ADD, RAX, RCX); break;                                        // CMN
+    case 0xC: emit->ALU(ALU_OR, RAX, RCX); break;                                         // ORR
+    case 0xD:                                                                             // MOV
+        emit->MOV(RAX, RCX);
+        if (set_flags)
+            emit->TEST(RAX, RAX);
+        break;
+    case 0xE: emit->NOT(RCX); emit->ALU(ALU_AND, RAX, RCX); break;                        // BIC
+    case 0xF:                                                                             // MVN
+        emit->NOT(RCX);
+        emit->MOV(RAX, RCX);
+        if (set_flags)
+            emit->TEST(RAX, RAX);
+        break;
+    }
+
+    if (set_flags) {
+        emit->SETcc(CC_S, X64::R8);
+        emit->SETcc(CC_Z, X64::R9);
+
+        u32 written = CPSR_N | CPSR_Z;
+        if (!is_logical) {
+            emit->SETcc(carry, X64::R10);
+            emit->SETcc(CC_O, X64::R11);
+            written |= CPSR_C | CPSR_V;
+        } else if (shifter_carry != CARRY_UNCHANGED) {
+            written |= CPSR_C;
+        }
+
+        emit->MOV(RDX, RBX, STATE_OFFSET(Cpsr));
+        emit->ALU(ALU_AND, RDX, ~written);
+
+        emit->MOVZX8(RCX, X64::R8);
+        emit->SHIFT(SHIFT_SHL, RCX, 31);
+        emit->ALU(ALU_OR, RDX, RCX);
+        emit->MOVZX8(RCX, X64::R9);
+        emit->SHIFT(SHIFT_SHL, RCX, 30);
+        emit->ALU(ALU_OR, RDX, RCX);
+
+        if (!is_logical || shifter_carry == CARRY_FROM_R10) {
+            emit->MOVZX8(RCX, X64::R10);
+            emit->SHIFT(SHIFT_SHL, RCX, 29);
+            emit->ALU(ALU_OR, RDX, RCX);
+        } else if (shifter_carry == CARRY_SET) {
+            emit->ALU(ALU_OR, RDX, CPSR_C);
+        }
+
+        if (!is_logical) {
+            emit->MOVZX8(RCX, X64::R11);
+            emit->SHIFT(SHIFT_SHL, RCX, 28);
+            emit->ALU(ALU_OR, RDX, RCX);
+        }
+
+        emit->MOV(RBX, STATE_OFFSET(Cpsr), RDX);
+    }
+
+    if (!is_test)
+        emit->MOV(RBX, STATE_OFFSET(Reg[rd]), RAX);
+
+    return CompileResult::Continue;
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileMultiply(u32 inst) {
+    const bool accumulate = (inst >> 21) & 1;
+    const bool set_flags = (inst >> 20) & 1;
+    const unsigned rd = (inst >> 16) & 0xF;
+    const unsigned rn = (inst >> 12) & 0xF;
+    const unsigned rs = (inst >> 8) & 0xF;
+    const unsigned rm = inst & 0xF;
+
+    if (set_flags || rd == 15 || rs == 15 || rm == 15 || (accumulate && rn == 15))
+        return CompileResult::Unhandled;
+
+    emit->MOV(RAX, RBX, STATE_OFFSET(Reg[rm]));
+    emit->MOV(RCX, RBX, STATE_OFFSET(Reg[rs]));
+    emit->IMUL(RAX, RCX);
+    if (accumulate) {
+        emit->MOV(RCX, RBX, STATE_OFFSET(Reg[rn]));
+        emit->ALU(ALU_ADD, RAX, RCX);
+    }
+    emit->MOV(RBX, STATE_OFFSET(Reg[rd]), RAX);
+
+    return CompileResult::Continue;
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileLoadStore(u32 inst, u32 addr) {
+    const bool register_offset = (inst >> 25) & 1;
+    const bool pre_index = (inst >> 24) & 1;
+    const bool add = (inst >> 23) & 1;
+    const bool byte = (inst >> 22) & 1;
+    const bool write_back = (inst >> 21) & 1;
+    const bool load = (inst >> 20) & 1;
+    const unsigned rn = (inst >> 16) & 0xF;
+    const unsigned rd = (inst >> 12) & 0xF;
+
+    // Media instructions, LDRT/STRT, and LDRB/STRB/STR involving the PC
+    if ((register_offset && ((inst >> 4) & 1)) || (!pre_index && write_back) || (rd == 15 && (!load || byte)))
+        return CompileResult::Unhandled;
+
+    const bool update_base = !pre_index || write_back;
+    if (update_base && (rn == 15 || (load && rn == rd)))
+        return CompileResult::Unhandled;
+
+    if (register_offset) {
+        const unsigned shift_type = (inst >> 5) & 3;
+        const unsigned amount = (inst >> 7) & 0x1F;
+        if ((inst & 0xF) == 15 || (amount == 0 && shift_type != 0))
+            return CompileResult::Unhandled;
+    }
+
+    // Value to store into ECX, before the base register gets updated
+    if (!load)
+        emit->MOV(RCX, RBX, STATE_OFFSET(Reg[rd]));
+
+    // Offset into EDX
+    if (register_offset) {
+        static const ShiftOp shift_ops[] = { SHIFT_SHL, SHIFT_SHR, SHIFT_SAR, SHIFT_ROR };
+        const unsigned amount = (inst >> 7) & 0x1F;
+        emit->MOV(RDX, RBX, STATE_OFFSET(Reg[inst & 0xF]));
+        if (amount != 0)
+            emit->SHIFT(shift_ops[(inst >> 5) & 3], RDX, amount);
+    } else {
+        emit->MOV(RDX, inst & 0xFFF);
+    }
+
+    // Address into EAX
+    EmitLoadReg(RAX, rn, addr);
+    if (pre_index) {
+        emit->ALU(add ? ALU_ADD : ALU_SUB, RAX, RDX);
+        if (write_back)
+            emit->MOV(RBX, STATE_OFFSET(Reg[rn]), RAX);
+    } else {
+        emit->MOV(X64::R9, RAX);
+        emit->ALU(add ? ALU_ADD : ALU_SUB, X64::R9, RDX);
+        emit->MOV(RBX, STATE_OFFSET(Reg[rn]), X64::R9);
+    }
+
+    if (load) {
+        emit->MOV(ABI_PARAM2, RAX);
+        emit->MOV64(ABI_PARAM1, RBX);
+        emit->CALL(reinterpret_cast<const void*>(byte ? &ReadByte : &ReadWord));
+
+        if (rd == 15) {
+            EmitIndirectExit();
+            return CompileResult::EndBlock;
+        }
+        emit->MOV(RBX, STATE_OFFSET(Reg[rd]), RAX);
+    } else {
+        emit->MOV(ABI_PARAM3, RCX);
+        emit->MOV(ABI_PARAM2, RAX);
+        emit->MOV64(ABI_PARAM1, RBX);
+        emit->CALL(reinterpret_cast<const void*>(byte ? &WriteByte : &WriteWord));
+    }
+
+    return CompileResult::Continue;
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileLoadStoreMultiple(u32 inst) {
+    const bool pre_index = (inst >> 24) & 1;
+    const bool add = (inst >> 23) & 1;
+    const bool user_bank = (inst >> 22) & 1;
+    const bool write_back = (inst >> 21) & 1;
+    const bool load = (inst >> 20) & 1;
+    const unsigned rn = (inst >> 16) & 0xF;
+    const u32 list = inst & 0xFFFF;
+
+    if (user_bank || rn == 15 || list == 0 || (list & (1 << rn)) || (!load && (list & 0x8000)))
+        return CompileResult::Unhandled;
+
+    const u32 size = CountRegisters(list) * 4;
+    u32 start_offset;
+    if (add)
+        start_offset = pre_index ? 4 : 0;
+    else
+        start_offset = pre_index ? -size : -size + 4;
+
+    emit->MOV(RAX, RBX, STATE_OFFSET(Reg[rn]));
+    emit->MOV(X64::R12, RAX);
+    if (start_offset != 0)
+        emit->ALU(ALU_ADD, X64::R12, start_offset);
+    if (write_back) {
+        emit->ALU(add ? ALU_ADD : ALU_SUB, RAX, size);
+        emit->MOV(RBX, STATE_OFFSET(Reg[rn]), RAX);
+    }
+
+    for (unsigned reg = 0; reg < 16; ++reg) {
+        if (!(list & (1 << reg)))
+            continue;
+
+        if (load) {
+            emit->MOV(ABI_PARAM2, X64::R12);
+            emit->MOV64(ABI_PARAM1, RBX);
+            emit->CALL(reinterpret_cast<const void*>(&ReadWord));
+            if (reg != 15)
+                emit->MOV(RBX, STATE_OFFSET(Reg[reg]), RAX);
+        } else {
+            emit->MOV(ABI_PARAM3, RBX, STATE_OFFSET(Reg[reg]));
+            emit->MOV(ABI_PARAM2, X64::R12);
+            emit->MOV64(ABI_PARAM1, RBX);
+            emit->CALL(reinterpret_cast<const void*>(&WriteWord));
+        }
+        emit->ALU(ALU_ADD, X64::R12, 4u);
+    }
+
+    if (load && (list & 0x8000)) {
+        EmitIndirectExit();
+        return CompileResult::EndBlock;
+    }
+
+    return CompileResult::Continue;
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileBranch(u32 inst, u32 addr) {
+    const bool link = (inst >> 24) & 1;
+    const u32 offset = static_cast<u32>(static_cast<s32>(inst << 8) >> 6);
+
+    if (link)
+        emit->MOV(RBX, STATE_OFFSET(Reg[14]), addr + 4);
+    EmitExit(addr + 8 + offset);
+
+    return CompileResult::EndBlock;
+}
+
+ARM_JIT::CompileResult ARM_JIT::CompileBranchExchange(u32 inst, u32 addr) {
+    const bool link = (inst >> 5) & 1;
+    const unsigned rm = inst & 0xF;
+
+    // The interpreter reads the target of BLX after updating LR, don't try to match that
+    if (rm == 15 || (link && rm == 14))
+        return CompileResult::Unhandled;
+
+    emit->MOV(RAX, RBX, STATE_OFFSET(Reg[rm]));
+    if (link)
+        emit->MOV(RBX, STATE_OFFSET(Reg[14]), addr + 4);
+    EmitIndirectExit();
+
+    return CompileResult::EndBlock;
+}
+
+void ARM_JIT::RunBlockLockstep(const Block& block) {
+    // The block may be invalidated by its own stores, so copy what's needed up front
+    const u32 start_addr = block.start_addr;
+    const u32 num_instructions = block.num_instructions;
+
+    u32 regs_before[16];
+    std::memcpy(regs_before, state->Reg, sizeof(regs_before));
+    const u32 cpsr_before = state->Cpsr;
+
+    std::vector<StoreRecord> stores;
+    store_log = &stores;
+    block.code(state.get());
+    store_log = nullptr;
+
+    for (StoreRecord& store : stores)
+        store.new_value = store.size == 1 ? Memory::Read8(store.addr) : Memory::Read32(store.addr);
+
+    u32 jit_regs[16];
+    std::memcpy(jit_regs, state->Reg, sizeof(jit_regs));
+    const u32 jit_cpsr = state->Cpsr;
+
+    // Undo the memory writes of the block, then run it again through the interpreter
+    for (auto it = stores.rbegin(); it != stores.rend(); ++it) {
+        if (it->size == 1)
+            Memory::Write8(it->addr, it->old_value);
+        else
+            Memory::Write32(it->addr, it->old_value);
+    }
+
+    std::memcpy(state->Reg, regs_before, sizeof(regs_before));
+    state->Cpsr = cpsr_before;
+    state->NumInstrsToExecute = num_instructions;
+    InterpreterMainLoop(state.get());
+    // Idle loops are detected by ExecuteInstructions for the compiled block already
+    state->IdleLoopBlock = nullptr;
+
+    // Compare the final value of every written location
+    std::map<u32, StoreRecord> final_stores;
+    for (const StoreRecord& store : stores)
+        final_stores[store.addr] = store;
+
+    bool mismatch = false;
+    for (int reg = 0; reg < 16; ++reg)
+        mismatch |= jit_regs[reg] != state->Reg[reg];
+    mismatch |= ((jit_cpsr ^ state->Cpsr) & (CPSR_N | CPSR_Z | CPSR_C | CPSR_V | CPSR_T)) != 0;
+    for (const auto& entry : final_stores) {
+        const StoreRecord& store = entry.second;
+        mismatch |= (store.size == 1 ? Memory::Read8(store.addr) : Memory::Read32(store.addr)) != store.new_value;
+    }
+
+    if (!mismatch)
+        return;
+
+    // Execution continues with the state computed by the interpreter
+    ++lockstep_mismatches;
+    LOG_CRITICAL(Core_ARM11, "JIT and interpreter disagree on the block at 0x%08X:", start_addr);
+    for (u32 i = 0; i < num_instructions; ++i) {
+        const u32 addr = start_addr + i * 4;
+        LOG_CRITICAL(Core_ARM11, "    0x%08X: %s", addr, ARM_Disasm::Disassemble(addr, Memory::Read32(addr)).c_str());
+    }
+    for (int reg = 0; reg < 16; ++reg) {
+        if (jit_regs[reg] != state->Reg[reg])
+            LOG_CRITICAL(Core_ARM11, "    r%d: jit=0x%08X interpreter=0x%08X", reg, jit_regs[reg], state->Reg[reg]);
+    }
+    if (((jit_cpsr ^ state->Cpsr) & (CPSR_N | CPSR_Z | CPSR_C | CPSR_V | CPSR_T)) != 0)
+        LOG_CRITICAL(Core_ARM11, "    cpsr: jit=0x%08X interpreter=0x%08X", jit_cpsr, state->Cpsr);
+    for (const auto& entry : final_stores) {
+        const StoreRecord& store = entry.second;
+        const u32 value = store.size == 1 ? Memory::Read8(store.addr) : Memory::Read32(store.addr);
+        if (value != store.new_value)
+            LOG_CRITICAL(Core_ARM11, "    [0x%08X]: jit=0x%08X interpreter=0x%08X", store.addr, store.new_value, value);
+    }
+}
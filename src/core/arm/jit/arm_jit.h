@@ -0,0 +1,104 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/arm/dyncom/arm_dyncom.h"
+
+namespace X64 {
+class Emitter;
+}
+
+/**
+ * ARM11 core which recompiles basic blocks of ARM code to x86-64 code. Instructions the recompiler
+ * does not handle (as well as all Thumb code) are executed by the dyncom interpreter, which shares
+ * its CPU state with the recompiled code.
+ *
+ * In lockstep mode, every recompiled block is executed a second time by the interpreter, and the
+ * resulting CPU state and memory writes are compared against the ones of the recompiled code.
+ */
+class ARM_JIT final : public ARM_DynCom {
+public:
+    /**
+     * @param initial_mode Initial privilege mode of the CPU
+     * @param lockstep Whether to check every recompiled block against the interpreter
+     */
+    ARM_JIT(PrivilegeMode initial_mode, bool lockstep);
+    ~ARM_JIT();
+
+    void PrepareReschedule() override;
+    void ClearInstructionCache(u32 addr, u32 size) override;
+    void SetBlockProfilingEnabled(bool enable) override;
+    std::vector<BlockProfileEntry> GetBlockProfile() const override;
+    void ExecuteInstructions(int num_instructions) override;
+
+    /// Returns the number of blocks in which the recompiled code and the interpreter disagreed
+    unsigned GetLockstepMismatches() const {
+        return lockstep_mismatches;
+    }
+
+private:
+    typedef void (*BlockCode)(ARMul_State* state);
+
+    /// Code generated for a guest basic block
+    struct Block {
+        u32 start_addr;            ///< Guest address of the first instruction
+        u32 num_instructions;      ///< Number of guest instructions in the block, 0 if it could not be compiled
+        u32 num_interpreted;       ///< If the block could not be compiled, instructions to leave to the interpreter
+        bool is_idle_loop;         ///< Whether the block is a busy-wait loop (see IdleLoop)
+        BlockCode code;            ///< Entry point of the generated code
+    };
+
+    /// Result of compiling a single guest instruction
+    enum class CompileResult {
+        Unhandled,  ///< Instruction is not handled by the recompiler, nothing was emitted
+        Continue,   ///< Instruction was compiled and execution continues with the next one
+        EndBlock,   ///< Instruction was compiled and leaves the block (e.g. a branch)
+    };
+
+    /// Returns the block starting at the given address, compiling it if needed
+    const Block& GetBlock(u32 addr);
+
+    /// Compiles the basic block starting at the given address
+    void CompileBlock(Block& block);
+
+    CompileResult CompileInstruction(u32 inst, u32 addr);
+    CompileResult CompileDataProcessing(u32 inst, u32 addr);
+    CompileResult CompileMultiply(u32 inst);
+    CompileResult CompileLoadStore(u32 inst, u32 addr);
+    CompileResult CompileLoadStoreMultiple(u32 inst);
+    CompileResult CompileBranch(u32 inst, u32 addr);
+    CompileResult CompileBranchExchange(u32 inst, u32 addr);
+
+    /// Emits code leaving the block and continuing execution at the given address
+    void EmitExit(u32 next_addr);
+    /// Emits code leaving the block and continuing execution at the address held in EAX
+    void EmitIndirectExit();
+    /// Emits code loading the value of a guest register (as seen by the instruction at `addr`) into `reg`
+    void EmitLoadReg(u8 reg, unsigned guest_reg, u32 addr);
+
+    /// Runs a compiled block, then runs the same instructions again with the interpreter and reports differences
+    void RunBlockLockstep(const Block& block);
+
+    /// Discards all compiled blocks and resets the code buffer
+    void ClearBlocks();
+
+    bool lockstep;                      ///< Whether compiled blocks are checked against the interpreter
+    unsigned lockstep_mismatches;       ///< Number of blocks which failed the lockstep check
+    bool reschedule_pending;            ///< Set when a thread switch was requested during execution
+    bool profiling_enabled;             ///< Whether executions of compiled blocks are counted
+
+    u8* code_buffer;                    ///< Executable memory holding the generated code
+    std::unique_ptr<X64::Emitter> emit;
+
+    std::unordered_map<u32, Block> blocks;                  ///< Blocks indexed by start address
+    std::unordered_map<u32, std::vector<u32>> page_blocks;  ///< Start addresses of the blocks of each 4KB page
+    std::unordered_map<u32, BlockProfileEntry> profile;     ///< Execution counts of compiled blocks
+};
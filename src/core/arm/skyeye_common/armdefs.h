@@ -17,9 +17,8 @@
 
 #pragma once
 
-#include <unordered_map>
-
 #include "common/common_types.h"
+#include "core/arm/dyncom/arm_dyncom_cache.h"
 #include "core/arm/skyeye_common/arm_regformat.h"
 
 #define BITS(s, a, b) ((s << ((sizeof(s) * 8 - 1) - b)) >> (sizeof(s) * 8 - b + a - 1))
@@ -97,6 +96,7 @@ struct ARMul_State
 
     unsigned long long NumInstrs; // The number of instructions executed
     unsigned NumInstrsToExecute;
+    TranslatedBlock* IdleLoopBlock; // Idle loop the last InterpreterMainLoop call stopped in, if any
 
     unsigned NresetSig; // Reset the processor
     unsigned NfiqSig;
@@ -153,7 +153,7 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
 
     // TODO(bunnei): Move this cache to a better place - it should be per codeset (likely per
     // process for our purposes), not per ARMul_State (which tracks CPU core state).
-    std::unordered_map<u32, int> instruction_cache;
+    TranslationCache instruction_cache;
 };
 
 /***************************************************************************\
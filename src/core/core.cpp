@@ -2,7 +2,11 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <string>
+#include <vector>
+
 #include "common/common_types.h"
+#include "common/file_util.h"
 #include "common/logging/log.h"
 
 #include "core/core.h"
@@ -11,8 +15,10 @@
 #include "core/mem_map.h"
 #include "core/settings.h"
 #include "core/arm/arm_interface.h"
+#include "core/arm/block_profiler.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/dyncom/arm_dyncom.h"
+#include "core/arm/jit/arm_jit.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/thread.h"
 #include "core/hw/hw.h"
@@ -59,7 +65,22 @@ void Stop() {
 /// Initialize the core
 int Init() {
     g_sys_core = new ARM_DynCom(USER32MODE);
-    g_app_core = new ARM_DynCom(USER32MODE);
+
+    switch (Settings::values.cpu_core) {
+#if defined(__x86_64__) || defined(_M_X64)
+    case Settings::CPU_CORE_JIT:
+    case Settings::CPU_CORE_JIT_LOCKSTEP:
+        g_app_core = new ARM_JIT(USER32MODE, Settings::values.cpu_core == Settings::CPU_CORE_JIT_LOCKSTEP);
+        break;
+#endif
+    default:
+        if (Settings::values.cpu_core != Settings::CPU_CORE_INTERPRETER)
+            LOG_ERROR(Core, "CPU core %d is not available, using the interpreter", Settings::values.cpu_core);
+        g_app_core = new ARM_DynCom(USER32MODE);
+        break;
+    }
+
+    g_app_core->SetBlockProfilingEnabled(Settings::values.profile_blocks);
 
     // TODO: Whenever TLS is implemented, this should contain
     // the address of the 0x200-byte TLS
@@ -69,7 +90,21 @@ int Init() {
     return 0;
 }
 
+/// Writes the reports of the block profiler to the log directory
+static void WriteBlockProfile() {
+    const std::vector<BlockProfileEntry> profile = g_app_core->GetBlockProfile();
+    const std::string path = FileUtil::GetUserPath(D_LOGS_IDX);
+    FileUtil::CreateFullPath(path);
+
+    FileUtil::WriteStringToFile(true, BlockProfiler::FormatReport(profile, 50), (path + "hot_blocks.txt").c_str());
+    FileUtil::WriteStringToFile(true, BlockProfiler::FormatCollapsedStacks(profile), (path + "hot_blocks.folded").c_str());
+    LOG_INFO(Core, "Wrote the profile of %u blocks to %s", (unsigned)profile.size(), path.c_str());
+}
+
 void Shutdown() {
+    if (Settings::values.profile_blocks)
+        WriteBlockProfile();
+
     delete g_app_core;
     delete g_sys_core;
 
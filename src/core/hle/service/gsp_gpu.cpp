@@ -16,7 +16,6 @@
 #include "video_core/gpu_debugger.h"
 
 #include "video_core/video_core.h"
-#include "video_core/renderer_opengl/renderer_opengl.h"
 
 // Main graphics debugger object - TODO: Here is probably not the best place for this
 GraphicsDebugger g_debugger;
@@ -251,7 +250,8 @@ static void SetBufferSwap(Service::Interface* self) {
 /**
  * GSP_GPU::FlushDataCache service function
  *
- * This Function is a no-op, We aren't emulating the CPU cache any time soon.
+ * We aren't emulating the CPU cache any time soon, but games flush it after writing data for the
+ * GPU, so this is where textures decoded from the flushed region are discarded.
  *
  *  Inputs:
  *      1 : Address
@@ -267,11 +267,13 @@ static void FlushDataCache(Service::Interface* self) {
     u32 size    = cmd_buff[2];
     u32 process = cmd_buff[4];
 
+    VideoCore::InvalidateTextures(Memory::VirtualToPhysicalAddress(address), size);
+
     // TODO(purpasmart96): Verify return header on HW
 
     cmd_buff[1] = RESULT_SUCCESS.raw; // No error
 
-    LOG_DEBUG(Service_GSP, "(STUBBED) called address=0x%08X, size=0x%08X, process=0x%08X",
+    LOG_DEBUG(Service_GSP, "called address=0x%08X, size=0x%08X, process=0x%08X",
               address, size, process);
 }
 
@@ -359,8 +361,8 @@ static void ExecuteCommand(const Command& command, u32 thread_id) {
                command.dma_request.size);
         SignalInterrupt(InterruptId::DMA);
 
-        // TODO: Hook FlushDataCache() instead once mapping between address and texture data is discovered
-        ((RendererOpenGL *)VideoCore::g_renderer)->NotifyDMACopy(Memory::VirtualToPhysicalAddress(command.dma_request.dest_address), command.dma_request.size);
+        VideoCore::InvalidateTextures(Memory::VirtualToPhysicalAddress(command.dma_request.dest_address),
+                                      command.dma_request.size);
 
         break;
 
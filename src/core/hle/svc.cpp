@@ -608,6 +608,16 @@ static ResultCode CreateMemoryBlock(Handle* out_handle, u32 addr, u32 size, u32
     return RESULT_SUCCESS;
 }
 
+/// Flushes the data cache for a memory range, which applications do after writing code to memory
+static ResultCode FlushProcessDataCache(Handle process, u32 addr, u32 size) {
+    LOG_TRACE(Kernel_SVC, "called process=0x%08X, addr=0x%08X, size=0x%08X", process, addr, size);
+
+    // TODO: Check the process handle once more than a single process is emulated. Code written
+    // without going through Memory::Write* (e.g. by DMA or HLE services) is only picked up here.
+    Core::g_app_core->ClearInstructionCache(addr, size);
+    return RESULT_SUCCESS;
+}
+
 namespace {
     struct FunctionDef {
         using Func = void();
@@ -703,7 +713,7 @@ static const FunctionDef SVC_Table[] = {
     {0x51, nullptr,                         "UnbindInterrupt"},
     {0x52, nullptr,                         "InvalidateProcessDataCache"},
     {0x53, nullptr,                         "StoreProcessDataCache"},
-    {0x54, nullptr,                         "FlushProcessDataCache"},
+    {0x54, HLE::Wrap<FlushProcessDataCache>, "FlushProcessDataCache"},
     {0x55, nullptr,                         "StartInterProcessDma"},
     {0x56, nullptr,                         "StopDma"},
     {0x57, nullptr,                         "GetDmaState"},
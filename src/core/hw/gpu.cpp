@@ -96,6 +96,9 @@ inline void Write(u32 addr, const T data) {
                     *ptr = config.value_16bit;
             }
 
+            VideoCore::InvalidateTextures(config.GetStartAddress(),
+                                          config.GetEndAddress() - config.GetStartAddress());
+
             LOG_TRACE(HW_GPU, "MemoryFill from 0x%08x to 0x%08x", config.GetStartAddress(), config.GetEndAddress());
 
             config.trigger = 0;
@@ -123,6 +126,10 @@ inline void Write(u32 addr, const T data) {
                 break;
             }
 
+            VideoCore::InvalidateTextures(config.GetPhysicalOutputAddress(),
+                                          config.output_width * config.output_height *
+                                          GPU::Regs::BytesPerPixel(config.output_format));
+
             unsigned horizontal_scale = (config.scaling != config.NoScale) ? 2 : 1;
             unsigned vertical_scale = (config.scaling == config.ScaleXY) ? 2 : 1;
 
@@ -4,6 +4,8 @@
 
 #include "common/common_types.h"
 #include "common/logging/log.h"
+#include "common/mem_arena.h"
+#include "common/platform.h"
 
 #include "core/mem_map.h"
 
@@ -11,6 +13,9 @@
 
 namespace Memory {
 
+u8* g_base;          ///< Host address of guest virtual address 0
+u8* g_physical_base; ///< Host address of guest physical address 0
+
 u8* g_exefs_code;  ///< ExeFS:/.code is loaded here
 u8* g_heap;        ///< Application heap (main memory)
 u8* g_shared_mem;  ///< Shared memory
@@ -23,36 +28,112 @@ namespace {
 
 struct MemoryArea {
     u8** ptr;
+    VAddr vaddr;
     size_t size;
+    PAddr paddr; ///< Physical address the area is also visible at, 0 if it has none
 };
 
 // We don't declare the IO regions in here since its handled by other means.
 static MemoryArea memory_areas[] = {
-    {&g_exefs_code,  PROCESS_IMAGE_MAX_SIZE},
-    {&g_heap,        HEAP_SIZE             },
-    {&g_shared_mem,  SHARED_MEMORY_SIZE    },
-    {&g_heap_linear, LINEAR_HEAP_SIZE      },
-    {&g_vram,        VRAM_SIZE             },
-    {&g_dsp_mem,     DSP_RAM_SIZE          },
-    {&g_tls_mem,     TLS_AREA_SIZE         },
+    {&g_exefs_code,  PROCESS_IMAGE_VADDR, PROCESS_IMAGE_MAX_SIZE, 0            },
+    {&g_heap,        HEAP_VADDR,          HEAP_SIZE,              0            },
+    {&g_shared_mem,  SHARED_MEMORY_VADDR, SHARED_MEMORY_SIZE,     0            },
+    {&g_heap_linear, LINEAR_HEAP_VADDR,   LINEAR_HEAP_SIZE,       FCRAM_PADDR  },
+    {&g_vram,        VRAM_VADDR,          VRAM_SIZE,              VRAM_PADDR   },
+    {&g_dsp_mem,     DSP_RAM_VADDR,       DSP_RAM_SIZE,           DSP_RAM_PADDR},
+    {&g_tls_mem,     TLS_AREA_VADDR,      TLS_AREA_SIZE,          0            },
 };
 
+/// Size of the host address space reserved for the guest virtual address space
+const u64 VIRTUAL_SPACE_SIZE = u64(1) << 32;
+/// Size of the host address space reserved for the guest physical address space
+const u64 PHYSICAL_SPACE_SIZE = FCRAM_PADDR_END;
+
+static MemArena arena;
+
+/**
+ * Backs all memory areas with a single shared memory segment, mapped once at their virtual address
+ * relative to g_base, and once more at their physical address relative to g_physical_base.
+ * @return True on success, false if the host doesn't allow setting this up
+ */
+static bool InitArena() {
+#if EMU_ARCH_BITS == 64
+    size_t arena_size = 0;
+    for (const MemoryArea& area : memory_areas)
+        arena_size += area.size;
+
+    if (!arena.GrabSHMSegment(arena_size))
+        return false;
+
+    g_base = MemArena::ReserveAddressSpace(VIRTUAL_SPACE_SIZE);
+    g_physical_base = MemArena::ReserveAddressSpace(PHYSICAL_SPACE_SIZE);
+    if (g_base == nullptr || g_physical_base == nullptr)
+        return false;
+
+    size_t offset = 0;
+    for (MemoryArea& area : memory_areas) {
+        *area.ptr = static_cast<u8*>(arena.CreateView(offset, area.size, g_base + area.vaddr));
+        if (*area.ptr == nullptr)
+            return false;
+
+        if (area.paddr != 0 && arena.CreateView(offset, area.size, g_physical_base + area.paddr) == nullptr)
+            return false;
+
+        offset += area.size;
+    }
+    return true;
+#else
+    // There isn't enough address space to reserve a whole guest address space
+    return false;
+#endif
 }
 
-void Init() {
+/// Releases everything set up by InitArena(), including after a partial failure
+static void ShutdownArena() {
     for (MemoryArea& area : memory_areas) {
-        *area.ptr = new u8[area.size];
+        if (*area.ptr != nullptr) {
+            arena.ReleaseView(*area.ptr, area.size);
+            if (area.paddr != 0)
+                arena.ReleaseView(g_physical_base + area.paddr, area.size);
+        }
+        *area.ptr = nullptr;
+    }
+
+    if (g_base != nullptr)
+        MemArena::ReleaseAddressSpace(g_base, VIRTUAL_SPACE_SIZE);
+    if (g_physical_base != nullptr)
+        MemArena::ReleaseAddressSpace(g_physical_base, PHYSICAL_SPACE_SIZE);
+    g_base = nullptr;
+    g_physical_base = nullptr;
+
+    arena.ReleaseSHMSegment();
+}
+
+}
+
+void Init() {
+    if (!InitArena()) {
+        LOG_WARNING(HW_Memory, "Could not map guest memory into a shared arena, falling back to separate allocations");
+        ShutdownArena();
+
+        for (MemoryArea& area : memory_areas) {
+            *area.ptr = new u8[area.size];
+        }
     }
     MemBlock_Init();
 
-    LOG_DEBUG(HW_Memory, "initialized OK, RAM at %p", g_heap);
+    LOG_DEBUG(HW_Memory, "initialized OK, RAM at %p (address space at %p)", g_heap, g_base);
 }
 
 void Shutdown() {
     MemBlock_Shutdown();
-    for (MemoryArea& area : memory_areas) {
-        delete[] *area.ptr;
-        *area.ptr = nullptr;
+    if (g_base != nullptr) {
+        ShutdownArena();
+    } else {
+        for (MemoryArea& area : memory_areas) {
+            delete[] *area.ptr;
+            *area.ptr = nullptr;
+        }
     }
 
     LOG_DEBUG(HW_Memory, "shutdown OK");
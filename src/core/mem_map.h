@@ -121,6 +121,16 @@ struct MemoryBlock {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Host addresses of guest virtual and physical address 0, such that the RAM-backed regions can be
+ * accessed at g_base + vaddr (respectively g_physical_base + paddr). Regions which alias each other
+ * (e.g. the linear heap and FCRAM) share their backing memory. Accesses to any other address fault.
+ * Both are nullptr if the host doesn't allow setting up this mapping, in which case the regions are
+ * only accessible through the pointers below.
+ */
+extern u8* g_base;
+extern u8* g_physical_base;
+
 extern u8* g_exefs_code;  ///< ExeFS:/.code is loaded here
 extern u8* g_heap;        ///< Application heap (main memory)
 extern u8* g_shared_mem;  ///< Shared memory
@@ -155,6 +165,22 @@ void WriteBlock(VAddr addr, const u8* data, size_t size);
 
 u8* GetPointer(VAddr virtual_address);
 
+/**
+ * Marks the page containing the given address as holding code translated by the CPU. The next
+ * write to the page through Write8/16/32/64 discards the cached translations of the whole page.
+ * @param addr Address of the translated code
+ */
+void MarkCodePage(VAddr addr);
+
+/**
+ * Marks the pages overlapping the given physical memory region as holding a texture decoded by the
+ * software rasterizer. The next write to one of the pages through Write8/16/32/64 discards the
+ * decoded textures of the whole page.
+ * @param addr Physical address of the texture
+ * @param size Size of the texture in bytes
+ */
+void MarkTextureRegion(PAddr addr, u32 size);
+
 /**
  * Maps a block of memory on the heap
  * @param size Size of block in bytes
@@ -194,10 +220,13 @@ VAddr PhysicalToVirtualAddress(PAddr addr);
 
 /**
  * Gets a pointer to the memory region beginning at the specified physical address.
- *
- * @note This is currently implemented using PhysicalToVirtualAddress().
  */
 inline u8* GetPhysicalPointer(PAddr address) {
+    if (g_physical_base != nullptr && ((address >= FCRAM_PADDR && address < FCRAM_PADDR_END) ||
+                                       (address >= VRAM_PADDR && address < VRAM_PADDR_END) ||
+                                       (address >= DSP_RAM_PADDR && address < DSP_RAM_PADDR_END))) {
+        return g_physical_base + address;
+    }
     return GetPointer(PhysicalToVirtualAddress(address));
 }
 
@@ -2,22 +2,72 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <bitset>
+#include <iterator>
 #include <map>
 
 #include "common/common_types.h"
 #include "common/logging/log.h"
 #include "common/swap.h"
 
+#include "core/core.h"
 #include "core/mem_map.h"
+#include "core/arm/arm_interface.h"
 #include "core/hw/hw.h"
 #include "hle/config_mem.h"
 #include "hle/shared_page.h"
 
+#include "video_core/video_core.h"
+
 namespace Memory {
 
 static std::map<u32, MemoryBlock> heap_map;
 static std::map<u32, MemoryBlock> heap_linear_map;
 
+const u32 PAGE_BITS = 12;
+const u32 PAGE_MASK = PAGE_SIZE - 1;
+const u32 NUM_PAGES = 1 << (32 - PAGE_BITS);
+
+/**
+ * Host pointers to the memory backing each virtual page, indexed by virtual page number. Pages
+ * which are unmapped, or which need special handling on every access (config memory, the shared
+ * page), have no entry and go through the slow path of Read/Write.
+ */
+static u8* page_table[NUM_PAGES];
+
+/// Pages holding code translated by the CPU, indexed by virtual page number
+static std::bitset<NUM_PAGES> code_pages;
+
+/// Pages holding textures decoded by the software rasterizer, indexed by virtual page number
+static std::bitset<NUM_PAGES> texture_pages;
+
+/// Pages in any of the sets above, whose cached contents have to be discarded when written to
+static std::bitset<NUM_PAGES> watched_pages;
+
+/**
+ * Discards the translated code and decoded textures of the given page. Kept out of line so that
+ * Write stays cheap.
+ */
+#ifdef _MSC_VER
+__declspec(noinline)
+#else
+__attribute__((noinline, cold))
+#endif
+static void InvalidatePage(const u32 page) {
+    watched_pages[page] = false;
+
+    if (code_pages[page]) {
+        code_pages[page] = false;
+        Core::g_app_core->ClearInstructionCache(page * PAGE_SIZE, PAGE_SIZE);
+    }
+
+    if (texture_pages[page]) {
+        texture_pages[page] = false;
+        VideoCore::InvalidateTextures(VirtualToPhysicalAddress(page * PAGE_SIZE), PAGE_SIZE);
+    }
+}
+
 PAddr VirtualToPhysicalAddress(const VAddr addr) {
     if (addr == 0) {
         return 0;
@@ -56,46 +106,20 @@ VAddr PhysicalToVirtualAddress(const PAddr addr) {
 
 template <typename T>
 inline void Read(T &var, const VAddr vaddr) {
-    // TODO: Figure out the fastest order of tests for both read and write (they are probably different).
-    // TODO: Make sure this represents the mirrors in a correct way.
-    // Could just do a base-relative read, too.... TODO
-
-    // Kernel memory command buffer
-    if (vaddr >= TLS_AREA_VADDR && vaddr < TLS_AREA_VADDR_END) {
-        var = *((const T*)&g_tls_mem[vaddr - TLS_AREA_VADDR]);
-
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= PROCESS_IMAGE_VADDR)  && (vaddr < PROCESS_IMAGE_VADDR_END)) {
-        var = *((const T*)&g_exefs_code[vaddr - PROCESS_IMAGE_VADDR]);
-
-    // FCRAM - linear heap
-    } else if ((vaddr >= LINEAR_HEAP_VADDR) && (vaddr < LINEAR_HEAP_VADDR_END)) {
-        var = *((const T*)&g_heap_linear[vaddr - LINEAR_HEAP_VADDR]);
-
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        var = *((const T*)&g_heap[vaddr - HEAP_VADDR]);
-
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        var = *((const T*)&g_shared_mem[vaddr - SHARED_MEMORY_VADDR]);
+    const u8* page_pointer = page_table[vaddr >> PAGE_BITS];
+    if (page_pointer != nullptr) {
+        var = *((const T*)&page_pointer[vaddr & PAGE_MASK]);
+        return;
+    }
 
     // Config memory
-    } else if ((vaddr >= CONFIG_MEMORY_VADDR)  && (vaddr < CONFIG_MEMORY_VADDR_END)) {
+    if ((vaddr >= CONFIG_MEMORY_VADDR)  && (vaddr < CONFIG_MEMORY_VADDR_END)) {
         ConfigMem::Read<T>(var, vaddr);
 
     // Shared page
     } else if ((vaddr >= SHARED_PAGE_VADDR)  && (vaddr < SHARED_PAGE_VADDR_END)) {
         SharedPage::Read<T>(var, vaddr);
 
-    // DSP memory
-    } else if ((vaddr >= DSP_RAM_VADDR)  && (vaddr < DSP_RAM_VADDR_END)) {
-        var = *((const T*)&g_dsp_mem[vaddr - DSP_RAM_VADDR]);
-
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        var = *((const T*)&g_vram[vaddr - VRAM_VADDR]);
-
     } else {
         LOG_ERROR(HW_Memory, "unknown Read%lu @ 0x%08X", sizeof(var) * 8, vaddr);
     }
@@ -103,77 +127,60 @@ inline void Read(T &var, const VAddr vaddr) {
 
 template <typename T>
 inline void Write(const VAddr vaddr, const T data) {
+    // Self-modifying code and texture updates: throw away stale copies of the data being overwritten
+    const u32 page = vaddr >> PAGE_BITS;
+    if (watched_pages[page])
+        InvalidatePage(page);
+    const u32 last_page = (vaddr + sizeof(T) - 1) >> PAGE_BITS;
+    if (last_page != page && watched_pages[last_page])
+        InvalidatePage(last_page);
+
+    u8* page_pointer = page_table[page];
+    if (page_pointer != nullptr) {
+        *(T*)&page_pointer[vaddr & PAGE_MASK] = data;
+        return;
+    }
 
-    // Kernel memory command buffer
-    if (vaddr >= TLS_AREA_VADDR && vaddr < TLS_AREA_VADDR_END) {
-        *(T*)&g_tls_mem[vaddr - TLS_AREA_VADDR] = data;
-
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= PROCESS_IMAGE_VADDR)  && (vaddr < PROCESS_IMAGE_VADDR_END)) {
-        *(T*)&g_exefs_code[vaddr - PROCESS_IMAGE_VADDR] = data;
-
-    // FCRAM - linear heap
-    } else if ((vaddr >= LINEAR_HEAP_VADDR)  && (vaddr < LINEAR_HEAP_VADDR_END)) {
-        *(T*)&g_heap_linear[vaddr - LINEAR_HEAP_VADDR] = data;
-
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        *(T*)&g_heap[vaddr - HEAP_VADDR] = data;
-
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        *(T*)&g_shared_mem[vaddr - SHARED_MEMORY_VADDR] = data;
-
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        *(T*)&g_vram[vaddr - VRAM_VADDR] = data;
-
-    // DSP memory
-    } else if ((vaddr >= DSP_RAM_VADDR)  && (vaddr < DSP_RAM_VADDR_END)) {
-        *(T*)&g_dsp_mem[vaddr - DSP_RAM_VADDR] = data;
-
-    //} else if ((vaddr & 0xFFFF0000) == 0x1FF80000) {
+    //if ((vaddr & 0xFFFF0000) == 0x1FF80000) {
     //    ASSERT_MSG(MEMMAP, false, "umimplemented write to Configuration Memory");
     //} else if ((vaddr & 0xFFFFF000) == 0x1FF81000) {
     //    ASSERT_MSG(MEMMAP, false, "umimplemented write to shared page");
+    //}
 
-    // Error out...
-    } else {
-        LOG_ERROR(HW_Memory, "unknown Write%lu 0x%08X @ 0x%08X", sizeof(data) * 8, (u32)data, vaddr);
-    }
+    LOG_ERROR(HW_Memory, "unknown Write%lu 0x%08X @ 0x%08X", sizeof(data) * 8, (u32)data, vaddr);
 }
 
 u8 *GetPointer(const VAddr vaddr) {
-    // Kernel memory command buffer
-    if (vaddr >= TLS_AREA_VADDR && vaddr < TLS_AREA_VADDR_END) {
-        return g_tls_mem + (vaddr - TLS_AREA_VADDR);
+    u8* page_pointer = page_table[vaddr >> PAGE_BITS];
+    if (page_pointer != nullptr)
+        return page_pointer + (vaddr & PAGE_MASK);
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= PROCESS_IMAGE_VADDR)  && (vaddr < PROCESS_IMAGE_VADDR_END)) {
-        return g_exefs_code + (vaddr - PROCESS_IMAGE_VADDR);
-
-    // FCRAM - linear heap
-    } else if ((vaddr >= LINEAR_HEAP_VADDR)  && (vaddr < LINEAR_HEAP_VADDR_END)) {
-        return g_heap_linear + (vaddr - LINEAR_HEAP_VADDR);
-
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        return g_heap + (vaddr - HEAP_VADDR);
+    LOG_ERROR(HW_Memory, "unknown GetPointer @ 0x%08x", vaddr);
+    return 0;
+}
 
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        return g_shared_mem + (vaddr - SHARED_MEMORY_VADDR);
+void MarkCodePage(const VAddr addr) {
+    code_pages[addr >> PAGE_BITS] = true;
+    watched_pages[addr >> PAGE_BITS] = true;
+}
 
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        return g_vram + (vaddr - VRAM_VADDR);
+void MarkTextureRegion(const PAddr addr, const u32 size) {
+    if (size == 0)
+        return;
 
-    } else {
-        LOG_ERROR(HW_Memory, "unknown GetPointer @ 0x%08x", vaddr);
-        return 0;
+    const VAddr vaddr = PhysicalToVirtualAddress(addr);
+    for (u32 page = vaddr >> PAGE_BITS; page <= (vaddr + size - 1) >> PAGE_BITS; ++page) {
+        texture_pages[page] = true;
+        watched_pages[page] = true;
     }
 }
 
+/// Points the page table entries of the given virtual memory region to the host memory backing it
+static void MapRegion(const VAddr base, const u32 size, u8* const memory) {
+    for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+        page_table[(base + offset) >> PAGE_BITS] = memory + offset;
+}
+
 u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions) {
     MemoryBlock block;
 
@@ -209,11 +216,22 @@ u32 MapBlock_HeapLinear(u32 size, u32 operation, u32 permissions) {
 }
 
 void MemBlock_Init() {
+    MapRegion(PROCESS_IMAGE_VADDR, PROCESS_IMAGE_MAX_SIZE, g_exefs_code);
+    MapRegion(HEAP_VADDR, HEAP_SIZE, g_heap);
+    MapRegion(SHARED_MEMORY_VADDR, SHARED_MEMORY_SIZE, g_shared_mem);
+    MapRegion(LINEAR_HEAP_VADDR, LINEAR_HEAP_SIZE, g_heap_linear);
+    MapRegion(VRAM_VADDR, VRAM_SIZE, g_vram);
+    MapRegion(DSP_RAM_VADDR, DSP_RAM_SIZE, g_dsp_mem);
+    MapRegion(TLS_AREA_VADDR, TLS_AREA_SIZE, g_tls_mem);
 }
 
 void MemBlock_Shutdown() {
     heap_map.clear();
     heap_linear_map.clear();
+    std::fill(std::begin(page_table), std::end(page_table), nullptr);
+    code_pages.reset();
+    texture_pages.reset();
+    watched_pages.reset();
 }
 
 u8 Read8(const VAddr addr) {
@@ -8,6 +8,20 @@
 
 namespace Settings {
 
+/// Implementations of the emulated ARM11 application core
+enum CpuCore {
+    CPU_CORE_INTERPRETER  = 0, ///< dyncom interpreter
+    CPU_CORE_JIT          = 1, ///< x86-64 recompiler, falling back to the interpreter
+    CPU_CORE_JIT_LOCKSTEP = 2, ///< x86-64 recompiler, checked against the interpreter after every block
+};
+
+/// Implementations of the vertex shader used when vertices are processed on the CPU
+enum ShaderEngine {
+    SHADER_ENGINE_INTERPRETER  = 0, ///< Interpreter of the decoded program
+    SHADER_ENGINE_JIT          = 1, ///< x86-64 recompiler, falling back to the interpreter
+    SHADER_ENGINE_JIT_VALIDATE = 2, ///< x86-64 recompiler, checked against the interpreter for every vertex
+};
+
 struct Values {
     // Controls
     int pad_a_key;
@@ -35,6 +49,9 @@ struct Values {
     int pad_cright_key;
 
     // Core
+    int cpu_core;
+    bool profile_blocks;
+    int shader_engine;
     int gpu_refresh_rate;
     int frame_skip;
 
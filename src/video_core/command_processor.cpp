@@ -2,6 +2,8 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
 #include <boost/range/algorithm/fill.hpp>
 
 #include "common/profiler.h"
@@ -11,6 +13,8 @@
 #include "math.h"
 #include "pica.h"
 #include "primitive_assembly.h"
+#include "rasterizer.h"
+#include "vertex_cache.h"
 #include "vertex_shader.h"
 #include "core/hle/service/gsp_gpu.h"
 #include "core/hw/gpu.h"
@@ -34,10 +38,191 @@ static int default_attr_counter = 0;
 
 static u32 default_attr_write_buffer[3];
 
+/// Whether shader code or swizzle patterns were uploaded since the last register write of another kind
+static bool shader_upload_pending = false;
+
 Common::Profiling::TimingCategory category_drawing("Drawing");
+Common::Profiling::Counter counter_vertex_cache_hits("Vertex cache hits");
+Common::Profiling::Counter counter_vertex_cache_misses("Vertex cache misses");
+
+static bool IsShaderUploadRegister(u32 id) {
+    return (id >= PICA_REG_INDEX_WORKAROUND(vs_program.set_word[0], 0x2cc) &&
+            id <= PICA_REG_INDEX_WORKAROUND(vs_program.set_word[7], 0x2d3)) ||
+           (id >= PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[0], 0x2d6) &&
+            id <= PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[7], 0x2dd));
+}
+
+/// Result of processing a vertex on the CPU, as stored in the vertex cache
+struct ProcessedVertex {
+    VertexShader::OutputVertex output;
+    DebugUtils::GeometryDumper::Vertex dumped;  ///< Position of the vertex as seen by the geometry dumper
+};
+
+/// Where the vertices of a draw are read from, as set up by the attribute loaders and index array
+struct VertexLoader {
+    u32 base_address;
+
+    // Information about internal vertex attributes
+    u32 attribute_sources[16];
+    u32 attribute_strides[16];
+    Regs::VertexAttributeFormat attribute_formats[16];
+    u32 attribute_elements[16];
+    u32 attribute_element_sizes[16];
+
+    bool is_indexed;
+    bool index_u16;
+    const u8* index_address;
+
+    /// Returns the vertex which the given index of the draw refers to
+    unsigned int GetVertex(unsigned int index) const {
+        if (!is_indexed)
+            return index;
+
+        return index_u16 ? reinterpret_cast<const u16*>(index_address)[index] : index_address[index];
+    }
+
+    /// Returns the physical address of a component of an input attribute of a vertex
+    u32 GetAttributeAddress(int attribute, unsigned int vertex, unsigned int comp) const {
+        return attribute_sources[attribute] + attribute_strides[attribute] * vertex + comp * attribute_element_sizes[attribute];
+    }
+};
+
+/**
+ * Loads and shades the vertices of a draw on the CPU. Vertices which miss the vertex cache are
+ * loaded first and then shaded all at once, in batches of VertexShader::BATCH_SIZE. Each vertex of
+ * the draw is then passed in order to emit_vertex, along with its index within the draw.
+ */
+template <typename EmitVertex>
+static void ProcessVertices(const VertexLoader& loader, unsigned int num_vertices,
+                            DebugUtils::GeometryDumper& geometry_dumper, EmitVertex emit_vertex) {
+    const auto& attribute_config = registers.vertex_attributes;
+
+    static VertexCache<ProcessedVertex> vertex_cache;
+    vertex_cache.Clear();
+
+    PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex> dumping_primitive_assembler(registers.triangle_topology.Value());
+
+    for (unsigned int batch_start = 0; batch_start < num_vertices; batch_start += VertexShader::BATCH_SIZE)
+    {
+        const unsigned int batch_size = std::min<unsigned int>(VertexShader::BATCH_SIZE, num_vertices - batch_start);
+
+        ProcessedVertex processed[VertexShader::BATCH_SIZE];
+
+        // Vertices which need to be shaded, and which of them each index of the batch refers to
+        VertexShader::InputVertex inputs[VertexShader::BATCH_SIZE];
+        ProcessedVertex shaded[VertexShader::BATCH_SIZE];
+        unsigned int shaded_vertices[VertexShader::BATCH_SIZE];
+        unsigned int shaded_slots[VertexShader::BATCH_SIZE];
+        unsigned int num_shaded = 0;
+
+        for (unsigned int batch_index = 0; batch_index < batch_size; ++batch_index) {
+            unsigned int index = batch_start + batch_index;
+            unsigned int vertex = loader.GetVertex(index);
+
+            const ProcessedVertex* cached_vertex = loader.is_indexed ? vertex_cache.Find(vertex) : nullptr;
+            if (cached_vertex != nullptr) {
+                processed[batch_index] = *cached_vertex;
+                shaded_slots[batch_index] = VertexShader::BATCH_SIZE;
+                continue;
+            }
+
+            // Indices repeated within the batch only need to be loaded and shaded once
+            const unsigned int* repeated = std::find(shaded_vertices, shaded_vertices + num_shaded, vertex);
+            if (repeated != shaded_vertices + num_shaded) {
+                shaded_slots[batch_index] = static_cast<unsigned int>(repeated - shaded_vertices);
+                continue;
+            }
+
+            // Initialize data for the current vertex
+            VertexShader::InputVertex& input = inputs[num_shaded];
+
+            // Load a debugging token to check whether this gets loaded by the running
+            // application or not.
+            static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
+            input.attr[0].w = debug_token;
+
+            for (int i = 0; i < attribute_config.GetNumTotalAttributes(); ++i) {
+                if (attribute_config.IsDefaultAttribute(i)) {
+                    input.attr[i] = VertexShader::GetDefaultAttribute(i);
+                    LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x (index %x): (%f, %f, %f, %f)",
+                              i, vertex, index,
+                              input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
+                              input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
+                } else {
+                    for (unsigned int comp = 0; comp < loader.attribute_elements[i]; ++comp) {
+                        const u8* srcdata = Memory::GetPhysicalPointer(loader.GetAttributeAddress(i, vertex, comp));
+
+                        // TODO(neobrain): Ocarina of Time 3D has GetNumTotalAttributes return 8,
+                        // yet only provides 2 valid source data addresses. Need to figure out
+                        // what's wrong there, until then we just continue when address lookup fails
+                        if (srcdata == nullptr)
+                            continue;
+
+                        const float srcval = (loader.attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
+                            (loader.attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
+                            (loader.attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
+                            *(float*)srcdata;
+
+                        input.attr[i][comp] = float24::FromFloat32(srcval);
+                        LOG_TRACE(HW_GPU, "Loaded component %x of attribute %x for vertex %x (index %x) from 0x%08x + 0x%08lx + 0x%04lx: %f",
+                                  comp, i, vertex, index,
+                                  loader.base_address,
+                                  loader.attribute_sources[i] - loader.base_address,
+                                  loader.GetAttributeAddress(i, vertex, comp) - loader.attribute_sources[i],
+                                  input.attr[i][comp].ToFloat32());
+                    }
+                }
+            }
+
+            // HACK: Some games do not initialize the vertex position's w component. This leads
+            //       to critical issues since it messes up perspective division. As a
+            //       workaround, we force the fourth component to 1.0 if we find this to be the
+            //       case.
+            //       To do this, we additionally have to assume that the first input attribute
+            //       is the vertex position, since there's no information about this other than
+            //       the empiric observation that this is usually the case.
+            if (input.attr[0].w == debug_token)
+                input.attr[0].w = float24::FromFloat32(1.0);
 
-void ProcessHWTriangle(const RawVertex& v0, const RawVertex& v1, const RawVertex& v2) {
-    ((RendererOpenGL *)VideoCore::g_renderer)->DrawTriangle(v0, v1, v2);
+            if (g_debug_context)
+                g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
+
+            // NOTE: When dumping geometry, we simply assume that the first input attribute
+            //       corresponds to the position for now.
+            DebugUtils::GeometryDumper::Vertex dumped_vertex = {
+                input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
+            };
+            shaded[num_shaded].dumped = dumped_vertex;
+
+            shaded_vertices[num_shaded] = vertex;
+            shaded_slots[batch_index] = num_shaded++;
+        }
+
+        // Send to vertex shader
+        VertexShader::OutputVertex outputs[VertexShader::BATCH_SIZE];
+        VertexShader::RunShaderBatch(inputs, outputs, num_shaded, attribute_config.GetNumTotalAttributes());
+
+        for (unsigned int slot = 0; slot < num_shaded; ++slot) {
+            shaded[slot].output = outputs[slot];
+            if (loader.is_indexed)
+                vertex_cache.Insert(shaded_vertices[slot], shaded[slot]);
+        }
+
+        for (unsigned int batch_index = 0; batch_index < batch_size; ++batch_index) {
+            const unsigned int slot = shaded_slots[batch_index];
+            ProcessedVertex& processed_vertex = (slot != VertexShader::BATCH_SIZE) ? shaded[slot] : processed[batch_index];
+
+            using namespace std::placeholders;
+            dumping_primitive_assembler.SubmitVertex(processed_vertex.dumped,
+                                                     std::bind(&DebugUtils::GeometryDumper::AddTriangle,
+                                                               &geometry_dumper, _1, _2, _3));
+
+            emit_vertex(batch_start + batch_index, processed_vertex.output);
+        }
+    }
+
+    counter_vertex_cache_hits.Add(vertex_cache.GetHits());
+    counter_vertex_cache_misses.Add(vertex_cache.GetMisses());
 }
 
 static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
@@ -58,6 +243,18 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
 
     DebugUtils::OnPicaRegWrite(id, registers[id]);
 
+    // Shader code is uploaded one word at a time, so the first write to any other register is
+    // taken as the end of the upload. The new shader is then translated in the background, ideally
+    // before the next draw needs it.
+    if (IsShaderUploadRegister(id)) {
+        shader_upload_pending = true;
+    } else if (shader_upload_pending) {
+        shader_upload_pending = false;
+#ifdef USE_OGL_VTXSHADER
+        ((RendererOpenGL *)VideoCore::g_renderer)->PrefetchVertexShader();
+#endif
+    }
+
     switch(id) {
         // Trigger IRQ
         case PICA_REG_INDEX(trigger_irq):
@@ -76,254 +273,95 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
                 g_debug_context->OnEvent(DebugContext::Event::IncomingPrimitiveBatch, nullptr);
 
             const auto& attribute_config = registers.vertex_attributes;
-            const u32 base_address = attribute_config.GetPhysicalBaseAddress();
-
-            // Information about internal vertex attributes
-            u32 vertex_attribute_sources[16];
-            boost::fill(vertex_attribute_sources, 0xdeadbeef);
-            u32 vertex_attribute_strides[16];
-            Regs::VertexAttributeFormat vertex_attribute_formats[16];
 
-            u32 vertex_attribute_elements[16];
-            u32 vertex_attribute_element_size[16];
+            VertexLoader loader;
+            loader.base_address = attribute_config.GetPhysicalBaseAddress();
+            boost::fill(loader.attribute_sources, 0xdeadbeef);
 
             // Setup attribute data from loaders
-            for (int loader = 0; loader < 12; ++loader) {
-                const auto& loader_config = attribute_config.attribute_loaders[loader];
+            for (int loader_index = 0; loader_index < 12; ++loader_index) {
+                const auto& loader_config = attribute_config.attribute_loaders[loader_index];
 
-                u32 load_address = base_address + loader_config.data_offset;
+                u32 load_address = loader.base_address + loader_config.data_offset;
 
                 // TODO: What happens if a loader overwrites a previous one's data?
                 for (unsigned component = 0; component < loader_config.component_count; ++component) {
                     u32 attribute_index = loader_config.GetComponent(component);
-                    vertex_attribute_sources[attribute_index] = load_address;
-                    vertex_attribute_strides[attribute_index] = static_cast<u32>(loader_config.byte_count);
-                    vertex_attribute_formats[attribute_index] = attribute_config.GetFormat(attribute_index);
-                    vertex_attribute_elements[attribute_index] = attribute_config.GetNumElements(attribute_index);
-                    vertex_attribute_element_size[attribute_index] = attribute_config.GetElementSizeInBytes(attribute_index);
+                    loader.attribute_sources[attribute_index] = load_address;
+                    loader.attribute_strides[attribute_index] = static_cast<u32>(loader_config.byte_count);
+                    loader.attribute_formats[attribute_index] = attribute_config.GetFormat(attribute_index);
+                    loader.attribute_elements[attribute_index] = attribute_config.GetNumElements(attribute_index);
+                    loader.attribute_element_sizes[attribute_index] = attribute_config.GetElementSizeInBytes(attribute_index);
                     load_address += attribute_config.GetStride(attribute_index);
                 }
             }
 
             // Load vertices
-            bool is_indexed = (id == PICA_REG_INDEX(trigger_draw_indexed));
-
             const auto& index_info = registers.index_array;
-            const u8* index_address_8 = Memory::GetPhysicalPointer(base_address + index_info.offset);
-            const u16* index_address_16 = (u16*)index_address_8;
-            bool index_u16 = index_info.format != 0;
+            loader.is_indexed = (id == PICA_REG_INDEX(trigger_draw_indexed));
+            loader.index_u16 = index_info.format != 0;
+            loader.index_address = Memory::GetPhysicalPointer(loader.base_address + index_info.offset);
 
             DebugUtils::GeometryDumper geometry_dumper;
-            PrimitiveAssembler<VertexShader::OutputVertex> clipper_primitive_assembler(registers.triangle_topology.Value());
-            PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex> dumping_primitive_assembler(registers.triangle_topology.Value());
-            PrimitiveAssembler<RawVertex> ogl_primitive_assembler(registers.triangle_topology.Value());
 
 #ifndef USE_OGL_RENDERER
-            for (unsigned int index = 0; index < registers.num_vertices; ++index)
-            {
-                unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
-
-                if (is_indexed) {
-                    // TODO: Implement some sort of vertex cache!
-                }
-
-                // Initialize data for the current vertex
-                VertexShader::InputVertex input;
-
-                // Load a debugging token to check whether this gets loaded by the running
-                // application or not.
-                static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
-                input.attr[0].w = debug_token;
-
-                for (int i = 0; i < attribute_config.GetNumTotalAttributes(); ++i) {
-                    if (attribute_config.IsDefaultAttribute(i)) {
-                        input.attr[i] = VertexShader::GetDefaultAttribute(i);
-                        LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x (index %x): (%f, %f, %f, %f)",
-                                  i, vertex, index,
-                                  input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
-                                  input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
-                    } else {
-                        for (unsigned int comp = 0; comp < vertex_attribute_elements[i]; ++comp) {
-                            const u8* srcdata = Memory::GetPhysicalPointer(vertex_attribute_sources[i] + vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i]);
-
-                            const float srcval = (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
-                                (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
-                                (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
-                                *(float*)srcdata;
-
-                            input.attr[i][comp] = float24::FromFloat32(srcval);
-                            LOG_TRACE(HW_GPU, "Loaded component %x of attribute %x for vertex %x (index %x) from 0x%08x + 0x%08lx + 0x%04lx: %f",
-                                      comp, i, vertex, index,
-                                      attribute_config.GetPhysicalBaseAddress(),
-                                      vertex_attribute_sources[i] - base_address,
-                                      vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i],
-                                      input.attr[i][comp].ToFloat32());
-                        }
-                    }
-                }
-
-                // HACK: Some games do not initialize the vertex position's w component. This leads
-                //       to critical issues since it messes up perspective division. As a
-                //       workaround, we force the fourth component to 1.0 if we find this to be the
-                //       case.
-                //       To do this, we additionally have to assume that the first input attribute
-                //       is the vertex position, since there's no information about this other than
-                //       the empiric observation that this is usually the case.
-                if (input.attr[0].w == debug_token)
-                    input.attr[0].w = float24::FromFloat32(1.0);
-
-                if (g_debug_context)
-                    g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
-
-                // NOTE: When dumping geometry, we simply assume that the first input attribute
-                //       corresponds to the position for now.
-                DebugUtils::GeometryDumper::Vertex dumped_vertex = {
-                    input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
-                };
-                using namespace std::placeholders;
-                dumping_primitive_assembler.SubmitVertex(dumped_vertex,
-                                                         std::bind(&DebugUtils::GeometryDumper::AddTriangle,
-                                                                   &geometry_dumper, _1, _2, _3));
-
-                // Send to vertex shader
-                VertexShader::OutputVertex output = VertexShader::RunShader(input, attribute_config.GetNumTotalAttributes());
-
-                if (is_indexed) {
-                    // TODO: Add processed vertex to vertex cache!
-                }
+            PrimitiveAssembler<VertexShader::OutputVertex> clipper_primitive_assembler(registers.triangle_topology.Value());
 
+            ProcessVertices(loader, registers.num_vertices, geometry_dumper,
+                            [&](unsigned int index, VertexShader::OutputVertex& output) {
                 // Send to triangle clipper
                 clipper_primitive_assembler.SubmitVertex(output, Clipper::ProcessTriangle);
-            }
-#else // #ifndef USE_OGL_RENDERER
-            // TODO: pass in registers.triangle_topology.Value(), use that instead of splitting into triangles always
-#ifdef USE_OGL_VTXSHADER
-            ((RendererOpenGL *)VideoCore::g_renderer)->BeginBatch();
-
-            for (unsigned int index = 0; index < registers.num_vertices; ++index)
-            {
-                unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
-
-                RawVertex new_vert;
-
-                int num_attributes = attribute_config.GetNumTotalAttributes();
-                const auto& attribute_register_map = registers.vs_input_register_map;
+            });
 
-                RawVertex temp_vertex;
-
-                // Load a debugging token to check whether this gets loaded by the running
-                // application or not.
-                static const float debug_token = 123.456f;
-                temp_vertex.attribs[0][3] = debug_token;
-
-                for (int i = 0; i < num_attributes; ++i) {
-                    for (unsigned int comp = 0; comp < vertex_attribute_elements[i]; ++comp) {
-                        const u8* srcdata = Memory::GetPointer(PAddrToVAddr(vertex_attribute_sources[i] + vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i]));
-
-                        // TODO(neobrain): Ocarina of Time 3D has GetNumTotalAttributes return 8,
-                        // yet only provides 2 valid source data addresses. Need to figure out
-                        // what's wrong there, until then we just continue when address lookup fails
-                        if (srcdata == nullptr)
-                            continue;
-
-                        temp_vertex.attribs[i][comp] = (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
-                            (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
-                            (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
-                            *(float*)srcdata;
+            Rasterizer::Flush();
+#else // #ifndef USE_OGL_RENDERER
+            RendererOpenGL* renderer = (RendererOpenGL *)VideoCore::g_renderer;
+
+            // Vertices are written straight to the renderer's vertex stream and drawn with the
+            // PICA topology. Until the hardware vertex shader is available, they are shaded on the CPU.
+            if (renderer->BeginBatch()) {
+                // Indexed batches load the range of referenced vertices once and hand the indices to
+                // OpenGL, unless they are spread out so far that loading each index is cheaper
+                u32 first_vertex = 0;
+                u32 num_loaded_vertices = registers.num_vertices;
+                bool upload_indices = false;
+                if (loader.is_indexed && registers.num_vertices != 0) {
+                    u32 min_index = 0xFFFF;
+                    u32 max_index = 0;
+                    for (unsigned int index = 0; index < registers.num_vertices; ++index) {
+                        u32 vertex = loader.GetVertex(index);
+                        min_index = std::min(min_index, vertex);
+                        max_index = std::max(max_index, vertex);
                     }
-                }
 
-                // HACK: Some games do not initialize the vertex position's w component. This leads
-                //       to critical issues since it messes up perspective division. As a
-                //       workaround, we force the fourth component to 1.0 if we find this to be the
-                //       case.
-                //       To do this, we additionally have to assume that the first input attribute
-                //       is the vertex position, since there's no information about this other than
-                //       the empiric observation that this is usually the case.
-                if (temp_vertex.attribs[0][3] == debug_token)
-                    temp_vertex.attribs[0][3] = 1.0f;
-
-                if (num_attributes > 0) {
-                    new_vert.attribs[attribute_register_map.attribute0_register][0] = temp_vertex.attribs[0][0];
-                    new_vert.attribs[attribute_register_map.attribute0_register][1] = temp_vertex.attribs[0][1];
-                    new_vert.attribs[attribute_register_map.attribute0_register][2] = temp_vertex.attribs[0][2];
-                    new_vert.attribs[attribute_register_map.attribute0_register][3] = temp_vertex.attribs[0][3];
-                }
-                if (num_attributes > 1) {
-                    new_vert.attribs[attribute_register_map.attribute1_register][0] = temp_vertex.attribs[1][0];
-                    new_vert.attribs[attribute_register_map.attribute1_register][1] = temp_vertex.attribs[1][1];
-                    new_vert.attribs[attribute_register_map.attribute1_register][2] = temp_vertex.attribs[1][2];
-                    new_vert.attribs[attribute_register_map.attribute1_register][3] = temp_vertex.attribs[1][3];
-                }
-                if (num_attributes > 2) {
-                    new_vert.attribs[attribute_register_map.attribute2_register][0] = temp_vertex.attribs[2][0];
-                    new_vert.attribs[attribute_register_map.attribute2_register][1] = temp_vertex.attribs[2][1];
-                    new_vert.attribs[attribute_register_map.attribute2_register][2] = temp_vertex.attribs[2][2];
-                    new_vert.attribs[attribute_register_map.attribute2_register][3] = temp_vertex.attribs[2][3];
-                }
-                if (num_attributes > 3) {
-                    new_vert.attribs[attribute_register_map.attribute3_register][0] = temp_vertex.attribs[3][0];
-                    new_vert.attribs[attribute_register_map.attribute3_register][1] = temp_vertex.attribs[3][1];
-                    new_vert.attribs[attribute_register_map.attribute3_register][2] = temp_vertex.attribs[3][2];
-                    new_vert.attribs[attribute_register_map.attribute3_register][3] = temp_vertex.attribs[3][3];
-                }
-                if (num_attributes > 4) {
-                    new_vert.attribs[attribute_register_map.attribute4_register][0] = temp_vertex.attribs[4][0];
-                    new_vert.attribs[attribute_register_map.attribute4_register][1] = temp_vertex.attribs[4][1];
-                    new_vert.attribs[attribute_register_map.attribute4_register][2] = temp_vertex.attribs[4][2];
-                    new_vert.attribs[attribute_register_map.attribute4_register][3] = temp_vertex.attribs[4][3];
-                }
-                if (num_attributes > 5) {
-                    new_vert.attribs[attribute_register_map.attribute5_register][0] = temp_vertex.attribs[5][0];
-                    new_vert.attribs[attribute_register_map.attribute5_register][1] = temp_vertex.attribs[5][1];
-                    new_vert.attribs[attribute_register_map.attribute5_register][2] = temp_vertex.attribs[5][2];
-                    new_vert.attribs[attribute_register_map.attribute5_register][3] = temp_vertex.attribs[5][3];
-                }
-                if (num_attributes > 6) {
-                    new_vert.attribs[attribute_register_map.attribute6_register][0] = temp_vertex.attribs[6][0];
-                    new_vert.attribs[attribute_register_map.attribute6_register][1] = temp_vertex.attribs[6][1];
-                    new_vert.attribs[attribute_register_map.attribute6_register][2] = temp_vertex.attribs[6][2];
-                    new_vert.attribs[attribute_register_map.attribute6_register][3] = temp_vertex.attribs[6][3];
-                }
-                if (num_attributes > 7) {
-                    new_vert.attribs[attribute_register_map.attribute7_register][0] = temp_vertex.attribs[7][0];
-                    new_vert.attribs[attribute_register_map.attribute7_register][1] = temp_vertex.attribs[7][1];
-                    new_vert.attribs[attribute_register_map.attribute7_register][2] = temp_vertex.attribs[7][2];
-                    new_vert.attribs[attribute_register_map.attribute7_register][3] = temp_vertex.attribs[7][3];
+                    if (max_index - min_index < 2 * registers.num_vertices) {
+                        first_vertex = min_index;
+                        num_loaded_vertices = max_index - min_index + 1;
+                        upload_indices = true;
+                    }
                 }
 
-                ogl_primitive_assembler.SubmitVertex(new_vert, ProcessHWTriangle);
-            }
-
-            ((RendererOpenGL *)VideoCore::g_renderer)->EndBatch();
-#else 
-            ((RendererOpenGL *)VideoCore::g_renderer)->BeginBatch();
-
-            std::unordered_map<unsigned int, VertexShader::OutputVertex> vcache;
+                RawVertex* vertices = renderer->AllocateVertices(num_loaded_vertices);
 
-            for (unsigned int index = 0; index < registers.num_vertices; ++index)
-            {
-                unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+                for (unsigned int index = 0; index < num_loaded_vertices; ++index)
+                {
+                    unsigned int vertex = upload_indices ? first_vertex + index : loader.GetVertex(index);
 
-                VertexShader::OutputVertex output;
+                    RawVertex new_vert;
 
-                std::unordered_map<unsigned int, VertexShader::OutputVertex>::iterator cached_vert = vcache.find(vertex);
+                    int num_attributes = attribute_config.GetNumTotalAttributes();
+                    const auto& attribute_register_map = registers.vs_input_register_map;
 
-                if (is_indexed && cached_vert != vcache.end()) {
-                    // TODO: Implement some sort of vertex cache!
-                    output = cached_vert->second;
-                } else {
-                    // Initialize data for the current vertex
-                    VertexShader::InputVertex input;
+                    RawVertex temp_vertex;
 
                     // Load a debugging token to check whether this gets loaded by the running
                     // application or not.
-                    static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
-                    input.attr[0].w = debug_token;
+                    static const float debug_token = 123.456f;
+                    temp_vertex.attribs[0][3] = debug_token;
 
-                    for (int i = 0; i < attribute_config.GetNumTotalAttributes(); ++i) {
-                        for (unsigned int comp = 0; comp < vertex_attribute_elements[i]; ++comp) {
-                            const u8* srcdata = Memory::GetPointer(PAddrToVAddr(vertex_attribute_sources[i] + vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i]));
+                    for (int i = 0; i < num_attributes; ++i) {
+                        for (unsigned int comp = 0; comp < loader.attribute_elements[i]; ++comp) {
+                            const u8* srcdata = Memory::GetPhysicalPointer(loader.GetAttributeAddress(i, vertex, comp));
 
                             // TODO(neobrain): Ocarina of Time 3D has GetNumTotalAttributes return 8,
                             // yet only provides 2 valid source data addresses. Need to figure out
@@ -331,17 +369,10 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
                             if (srcdata == nullptr)
                                 continue;
 
-                            const float srcval = (vertex_attribute_formats[i] == 0) ? *(s8*)srcdata :
-                                (vertex_attribute_formats[i] == 1) ? *(u8*)srcdata :
-                                (vertex_attribute_formats[i] == 2) ? *(s16*)srcdata :
+                            temp_vertex.attribs[i][comp] = (loader.attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
+                                (loader.attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
+                                (loader.attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
                                 *(float*)srcdata;
-                            input.attr[i][comp] = float24::FromFloat32(srcval);
-                            LOG_TRACE(HW_GPU, "Loaded component %x of attribute %x for vertex %x (index %x) from 0x%08x + 0x%08lx + 0x%04lx: %f",
-                                comp, i, vertex, index,
-                                attribute_config.GetPhysicalBaseAddress(),
-                                vertex_attribute_sources[i] - base_address,
-                                vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i],
-                                input.attr[i][comp].ToFloat32());
                         }
                     }
 
@@ -352,48 +383,89 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
                     //       To do this, we additionally have to assume that the first input attribute
                     //       is the vertex position, since there's no information about this other than
                     //       the empiric observation that this is usually the case.
-                    if (input.attr[0].w == debug_token)
-                        input.attr[0].w = float24::FromFloat32(1.0);
-
-                    if (g_debug_context)
-                        g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
-
-                    // NOTE: When dumping geometry, we simply assume that the first input attribute
-                    //       corresponds to the position for now.
-                    DebugUtils::GeometryDumper::Vertex dumped_vertex = {
-                        input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
-                    };
-                    using namespace std::placeholders;
-                    dumping_primitive_assembler.SubmitVertex(dumped_vertex,
-                        std::bind(&DebugUtils::GeometryDumper::AddTriangle,
-                        &geometry_dumper, _1, _2, _3));
-
-                    // Send to vertex shader
-                    output = VertexShader::RunShader(input, attribute_config.GetNumTotalAttributes());
-
-                    if (is_indexed) {
-                        // TODO: Add processed vertex to vertex cache!
-                        vcache.emplace(vertex, output);
+                    if (temp_vertex.attribs[0][3] == debug_token)
+                        temp_vertex.attribs[0][3] = 1.0f;
+
+                    if (num_attributes > 0) {
+                        new_vert.attribs[attribute_register_map.attribute0_register][0] = temp_vertex.attribs[0][0];
+                        new_vert.attribs[attribute_register_map.attribute0_register][1] = temp_vertex.attribs[0][1];
+                        new_vert.attribs[attribute_register_map.attribute0_register][2] = temp_vertex.attribs[0][2];
+                        new_vert.attribs[attribute_register_map.attribute0_register][3] = temp_vertex.attribs[0][3];
                     }
+                    if (num_attributes > 1) {
+                        new_vert.attribs[attribute_register_map.attribute1_register][0] = temp_vertex.attribs[1][0];
+                        new_vert.attribs[attribute_register_map.attribute1_register][1] = temp_vertex.attribs[1][1];
+                        new_vert.attribs[attribute_register_map.attribute1_register][2] = temp_vertex.attribs[1][2];
+                        new_vert.attribs[attribute_register_map.attribute1_register][3] = temp_vertex.attribs[1][3];
+                    }
+                    if (num_attributes > 2) {
+                        new_vert.attribs[attribute_register_map.attribute2_register][0] = temp_vertex.attribs[2][0];
+                        new_vert.attribs[attribute_register_map.attribute2_register][1] = temp_vertex.attribs[2][1];
+                        new_vert.attribs[attribute_register_map.attribute2_register][2] = temp_vertex.attribs[2][2];
+                        new_vert.attribs[attribute_register_map.attribute2_register][3] = temp_vertex.attribs[2][3];
+                    }
+                    if (num_attributes > 3) {
+                        new_vert.attribs[attribute_register_map.attribute3_register][0] = temp_vertex.attribs[3][0];
+                        new_vert.attribs[attribute_register_map.attribute3_register][1] = temp_vertex.attribs[3][1];
+                        new_vert.attribs[attribute_register_map.attribute3_register][2] = temp_vertex.attribs[3][2];
+                        new_vert.attribs[attribute_register_map.attribute3_register][3] = temp_vertex.attribs[3][3];
+                    }
+                    if (num_attributes > 4) {
+                        new_vert.attribs[attribute_register_map.attribute4_register][0] = temp_vertex.attribs[4][0];
+                        new_vert.attribs[attribute_register_map.attribute4_register][1] = temp_vertex.attribs[4][1];
+                        new_vert.attribs[attribute_register_map.attribute4_register][2] = temp_vertex.attribs[4][2];
+                        new_vert.attribs[attribute_register_map.attribute4_register][3] = temp_vertex.attribs[4][3];
+                    }
+                    if (num_attributes > 5) {
+                        new_vert.attribs[attribute_register_map.attribute5_register][0] = temp_vertex.attribs[5][0];
+                        new_vert.attribs[attribute_register_map.attribute5_register][1] = temp_vertex.attribs[5][1];
+                        new_vert.attribs[attribute_register_map.attribute5_register][2] = temp_vertex.attribs[5][2];
+                        new_vert.attribs[attribute_register_map.attribute5_register][3] = temp_vertex.attribs[5][3];
+                    }
+                    if (num_attributes > 6) {
+                        new_vert.attribs[attribute_register_map.attribute6_register][0] = temp_vertex.attribs[6][0];
+                        new_vert.attribs[attribute_register_map.attribute6_register][1] = temp_vertex.attribs[6][1];
+                        new_vert.attribs[attribute_register_map.attribute6_register][2] = temp_vertex.attribs[6][2];
+                        new_vert.attribs[attribute_register_map.attribute6_register][3] = temp_vertex.attribs[6][3];
+                    }
+                    if (num_attributes > 7) {
+                        new_vert.attribs[attribute_register_map.attribute7_register][0] = temp_vertex.attribs[7][0];
+                        new_vert.attribs[attribute_register_map.attribute7_register][1] = temp_vertex.attribs[7][1];
+                        new_vert.attribs[attribute_register_map.attribute7_register][2] = temp_vertex.attribs[7][2];
+                        new_vert.attribs[attribute_register_map.attribute7_register][3] = temp_vertex.attribs[7][3];
+                    }
+
+                    // Built on the stack so that the mapped memory is written sequentially
+                    vertices[index] = new_vert;
                 }
-                
-                RawVertex new_vert;
-                new_vert.attribs[0][0] = output.pos.x.ToFloat32();
-                new_vert.attribs[0][1] = -output.pos.y.ToFloat32();
-                new_vert.attribs[0][2] = -output.pos.z.ToFloat32();
-                new_vert.attribs[0][3] = output.pos.w.ToFloat32();
-                new_vert.attribs[1][0] = output.color.x.ToFloat32();
-                new_vert.attribs[1][1] = output.color.y.ToFloat32();
-                new_vert.attribs[1][2] = output.color.z.ToFloat32();
-                new_vert.attribs[1][3] = output.color.w.ToFloat32();
-                new_vert.attribs[2][0] = output.tc0.x.ToFloat32();
-                new_vert.attribs[2][1] = output.tc0.y.ToFloat32();
-
-                ogl_primitive_assembler.SubmitVertex(new_vert, ProcessHWTriangle);
+
+                if (upload_indices) {
+                    u16* indices = renderer->AllocateIndices(registers.num_vertices);
+                    for (unsigned int index = 0; index < registers.num_vertices; ++index)
+                        indices[index] = loader.GetVertex(index) - first_vertex;
+                }
+            } else {
+                RawVertex* vertices = renderer->AllocateVertices(registers.num_vertices);
+
+                ProcessVertices(loader, registers.num_vertices, geometry_dumper,
+                                [&](unsigned int index, VertexShader::OutputVertex& output) {
+                    RawVertex new_vert;
+                    new_vert.attribs[0][0] = output.pos.x.ToFloat32();
+                    new_vert.attribs[0][1] = -output.pos.y.ToFloat32();
+                    new_vert.attribs[0][2] = -output.pos.z.ToFloat32();
+                    new_vert.attribs[0][3] = output.pos.w.ToFloat32();
+                    new_vert.attribs[1][0] = output.color.x.ToFloat32();
+                    new_vert.attribs[1][1] = output.color.y.ToFloat32();
+                    new_vert.attribs[1][2] = output.color.z.ToFloat32();
+                    new_vert.attribs[1][3] = output.color.w.ToFloat32();
+                    new_vert.attribs[2][0] = output.tc0.x.ToFloat32();
+                    new_vert.attribs[2][1] = output.tc0.y.ToFloat32();
+
+                    vertices[index] = new_vert;
+                });
             }
 
-            ((RendererOpenGL *)VideoCore::g_renderer)->EndBatch();
-#endif
+            renderer->EndBatch();
 #endif // #ifndef USE_OGL_RENDERER
 
             geometry_dumper.Dump();
@@ -177,11 +177,13 @@ struct Regs {
             return 4;
 
         case TextureFormat::A4:
+        case TextureFormat::ETC1:  // 4x4 texel blocks of 8 bytes
             return 1;
 
         case TextureFormat::I8:
         case TextureFormat::A8:
         case TextureFormat::IA4:
+        case TextureFormat::ETC1A4:  // 4x4 texel blocks of 8 bytes, plus 8 bytes of alpha
         default:  // placeholder for yet unknown formats
             return 2;
         }
@@ -0,0 +1,624 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "common/logging/log.h"
+#include "common/math_util.h"
+
+#include "pixel_pipeline.h"
+
+namespace Pica {
+
+namespace Rasterizer {
+
+using Source = Regs::TevStageConfig::Source;
+using ColorModifier = Regs::TevStageConfig::ColorModifier;
+using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
+using Operation = Regs::TevStageConfig::Operation;
+using CompareFunc = decltype(Regs::output_merger)::CompareFunc;
+using BlendFactor = decltype(Regs::output_merger.alpha_blending)::BlendFactor;
+using BlendEquation = decltype(Regs::output_merger.alpha_blending)::BlendEquation;
+
+Math::Vec4<u8> PixelPipeline::Combine(const CombinerInputs& inputs) const {
+    Math::Vec4<u8> values[NumCombinerSlots];
+    values[PrimaryColorSlot] = inputs.primary_color;
+    values[Texture0Slot] = inputs.texture_color[0];
+    values[Texture1Slot] = inputs.texture_color[1];
+    values[Texture2Slot] = inputs.texture_color[2];
+    values[BufferSlot] = buffer_color;
+    values[PreviousSlot] = Math::MakeVec<u8>(0, 0, 0, 0);
+    values[ZeroSlot] = Math::MakeVec<u8>(0, 0, 0, 0);
+
+    for (unsigned stage_index = 0; stage_index < num_stages; ++stage_index) {
+        const auto& stage = stages[stage_index];
+        values[ConstantSlot] = stage.constant;
+
+        Math::Vec3<u8> color_input[3];
+        u8 alpha_input[3];
+        for (int i = 0; i < 3; ++i) {
+            const auto& color_operand = stage.color_operands[i];
+            const auto& color_value = values[color_operand.slot];
+            color_input[i] = Math::MakeVec<u8>(color_value[color_operand.selectors[0]] ^ color_operand.invert,
+                                               color_value[color_operand.selectors[1]] ^ color_operand.invert,
+                                               color_value[color_operand.selectors[2]] ^ color_operand.invert);
+
+            const auto& alpha_operand = stage.alpha_operands[i];
+            alpha_input[i] = values[alpha_operand.slot][alpha_operand.selectors[0]] ^ alpha_operand.invert;
+        }
+
+        auto color_output = stage.color_combine(color_input);
+        u8 alpha_output = stage.alpha_combine(alpha_input);
+
+        auto& output = values[PreviousSlot];
+        output.r() = std::min(255u, color_output.r() * stage.color_multiplier);
+        output.g() = std::min(255u, color_output.g() * stage.color_multiplier);
+        output.b() = std::min(255u, color_output.b() * stage.color_multiplier);
+        output.a() = std::min(255u, alpha_output * stage.alpha_multiplier);
+
+        if (stage.update_buffer_color) {
+            values[BufferSlot].r() = output.r();
+            values[BufferSlot].g() = output.g();
+            values[BufferSlot].b() = output.b();
+        }
+
+        if (stage.update_buffer_alpha)
+            values[BufferSlot].a() = output.a();
+    }
+
+    return values[PreviousSlot];
+}
+
+template <Operation op>
+static Math::Vec3<u8> ColorCombine(const Math::Vec3<u8> input[3]) {
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
+
+    case Operation::Modulate:
+        return ((input[0] * input[1]) / 255).Cast<u8>();
+
+    case Operation::Add:
+    {
+        auto result = input[0] + input[1];
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        return result.Cast<u8>();
+    }
+
+    case Operation::AddSigned:
+    {
+        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
+        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
+        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
+        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
+        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
+        return result.Cast<u8>();
+    }
+
+    case Operation::Lerp:
+        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
+
+    case Operation::Subtract:
+    {
+        auto result = input[0].Cast<int>() - input[1].Cast<int>();
+        result.r() = std::max(0, result.r());
+        result.g() = std::max(0, result.g());
+        result.b() = std::max(0, result.b());
+        return result.Cast<u8>();
+    }
+
+    case Operation::MultiplyThenAdd:
+    {
+        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        return result.Cast<u8>();
+    }
+
+    case Operation::AddThenMultiply:
+    {
+        auto result = input[0] + input[1];
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        result = (result * input[2].Cast<int>()) / 255;
+        return result.Cast<u8>();
+    }
+
+    default:
+        // Unknown operations are reported when decoding
+        return {0, 0, 0};
+    }
+}
+
+template <Operation op>
+static u8 AlphaCombine(const u8 input[3]) {
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
+
+    case Operation::Modulate:
+        return input[0] * input[1] / 255;
+
+    case Operation::Add:
+        return std::min(255, input[0] + input[1]);
+
+    case Operation::Lerp:
+        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
+
+    case Operation::Subtract:
+        return std::max(0, (int)input[0] - (int)input[1]);
+
+    case Operation::MultiplyThenAdd:
+        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
+
+    case Operation::AddThenMultiply:
+        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
+
+    default:
+        // Unknown operations are reported when decoding
+        return 0;
+    }
+}
+
+static PixelPipeline::Operand DecodeSource(Source source) {
+    PixelPipeline::Operand operand = {};
+
+    switch (source) {
+    // TODO: What's the difference between these two?
+    case Source::PrimaryColor:
+    case Source::PrimaryFragmentColor:
+        operand.slot = PixelPipeline::PrimaryColorSlot;
+        break;
+
+    case Source::Texture0:
+        operand.slot = PixelPipeline::Texture0Slot;
+        break;
+
+    case Source::Texture1:
+        operand.slot = PixelPipeline::Texture1Slot;
+        break;
+
+    case Source::Texture2:
+        operand.slot = PixelPipeline::Texture2Slot;
+        break;
+
+    case Source::PreviousBuffer:
+        operand.slot = PixelPipeline::BufferSlot;
+        break;
+
+    case Source::Constant:
+        operand.slot = PixelPipeline::ConstantSlot;
+        break;
+
+    case Source::Previous:
+        operand.slot = PixelPipeline::PreviousSlot;
+        break;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
+        UNIMPLEMENTED();
+        operand.slot = PixelPipeline::ZeroSlot;
+        break;
+    }
+
+    return operand;
+}
+
+static PixelPipeline::Operand DecodeColorOperand(Source source, ColorModifier modifier) {
+    PixelPipeline::Operand operand = DecodeSource(source);
+
+    // Bit 0 selects the "one minus" variant of each modifier
+    operand.invert = ((u32)modifier & 1) ? 0xFF : 0;
+
+    u8 component;
+    switch (modifier) {
+    case ColorModifier::SourceColor:
+    case ColorModifier::OneMinusSourceColor:
+        operand.selectors[0] = 0;
+        operand.selectors[1] = 1;
+        operand.selectors[2] = 2;
+        return operand;
+
+    case ColorModifier::SourceAlpha:
+    case ColorModifier::OneMinusSourceAlpha:
+        component = 3;
+        break;
+
+    case ColorModifier::SourceRed:
+    case ColorModifier::OneMinusSourceRed:
+        component = 0;
+        break;
+
+    case ColorModifier::SourceGreen:
+    case ColorModifier::OneMinusSourceGreen:
+        component = 1;
+        break;
+
+    case ColorModifier::SourceBlue:
+    case ColorModifier::OneMinusSourceBlue:
+        component = 2;
+        break;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color modifier %d", (int)modifier);
+        UNIMPLEMENTED();
+        operand.slot = PixelPipeline::ZeroSlot;
+        operand.invert = 0;
+        component = 0;
+        break;
+    }
+
+    operand.selectors[0] = operand.selectors[1] = operand.selectors[2] = component;
+    return operand;
+}
+
+static PixelPipeline::Operand DecodeAlphaOperand(Source source, AlphaModifier modifier) {
+    PixelPipeline::Operand operand = DecodeSource(source);
+
+    // Modifiers come in pairs of a component and its "one minus" variant
+    static const u8 components[4] = { 3, 0, 1, 2 };
+    operand.selectors[0] = components[(u32)modifier / 2];
+    operand.invert = ((u32)modifier & 1) ? 0xFF : 0;
+    return operand;
+}
+
+static decltype(PixelPipeline::CombinerStage::color_combine) DecodeColorCombine(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return ColorCombine<Operation::Replace>;
+    case Operation::Modulate:        return ColorCombine<Operation::Modulate>;
+    case Operation::Add:             return ColorCombine<Operation::Add>;
+    case Operation::AddSigned:       return ColorCombine<Operation::AddSigned>;
+    case Operation::Lerp:            return ColorCombine<Operation::Lerp>;
+    case Operation::Subtract:        return ColorCombine<Operation::Subtract>;
+    case Operation::MultiplyThenAdd: return ColorCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return ColorCombine<Operation::AddThenMultiply>;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
+        UNIMPLEMENTED();
+        return ColorCombine<static_cast<Operation>(0xF)>;
+    }
+}
+
+static decltype(PixelPipeline::CombinerStage::alpha_combine) DecodeAlphaCombine(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return AlphaCombine<Operation::Replace>;
+    case Operation::Modulate:        return AlphaCombine<Operation::Modulate>;
+    case Operation::Add:             return AlphaCombine<Operation::Add>;
+    case Operation::Lerp:            return AlphaCombine<Operation::Lerp>;
+    case Operation::Subtract:        return AlphaCombine<Operation::Subtract>;
+    case Operation::MultiplyThenAdd: return AlphaCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return AlphaCombine<Operation::AddThenMultiply>;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
+        UNIMPLEMENTED();
+        return AlphaCombine<static_cast<Operation>(0xF)>;
+    }
+}
+
+/// Returns true if the stage outputs the result of the previous stage unchanged
+static bool IsPassThroughStage(const Regs::TevStageConfig& tev_stage) {
+    return tev_stage.color_op == Operation::Replace && tev_stage.alpha_op == Operation::Replace &&
+           tev_stage.color_source1 == Source::Previous && tev_stage.alpha_source1 == Source::Previous &&
+           tev_stage.color_modifier1 == ColorModifier::SourceColor &&
+           tev_stage.alpha_modifier1 == AlphaModifier::SourceAlpha &&
+           tev_stage.GetColorMultiplier() == 1 && tev_stage.GetAlphaMultiplier() == 1;
+}
+
+static bool CompareValues(CompareFunc func, u32 value, u32 ref) {
+    switch (func) {
+    case CompareFunc::Never:
+        return false;
+
+    case CompareFunc::Always:
+        return true;
+
+    case CompareFunc::Equal:
+        return value == ref;
+
+    case CompareFunc::NotEqual:
+        return value != ref;
+
+    case CompareFunc::LessThan:
+        return value < ref;
+
+    case CompareFunc::LessThanOrEqual:
+        return value <= ref;
+
+    case CompareFunc::GreaterThan:
+        return value > ref;
+
+    case CompareFunc::GreaterThanOrEqual:
+        return value >= ref;
+    }
+
+    return false;
+}
+
+template <CompareFunc func>
+static bool DepthTest(u32 z, u32 ref_z) {
+    return CompareValues(func, z, ref_z);
+}
+
+static decltype(PixelPipeline::depth_test) DecodeDepthTest(CompareFunc func) {
+    static const decltype(PixelPipeline::depth_test) depth_tests[8] = {
+        DepthTest<CompareFunc::Never>,
+        DepthTest<CompareFunc::Always>,
+        DepthTest<CompareFunc::Equal>,
+        DepthTest<CompareFunc::NotEqual>,
+        DepthTest<CompareFunc::LessThan>,
+        DepthTest<CompareFunc::LessThanOrEqual>,
+        DepthTest<CompareFunc::GreaterThan>,
+        DepthTest<CompareFunc::GreaterThanOrEqual>,
+    };
+    return depth_tests[func];
+}
+
+static PixelPipeline::Operand DecodeBlendFactorRGB(BlendFactor factor) {
+    PixelPipeline::Operand operand = {};
+    operand.slot = PixelPipeline::BlendZeroSlot;
+
+    u8 component = 0;
+    switch (factor) {
+    case BlendFactor::Zero:
+    case BlendFactor::One:
+        break;
+
+    case BlendFactor::SourceColor:
+    case BlendFactor::OneMinusSourceColor:
+        operand.slot = PixelPipeline::SourceSlot;
+        break;
+
+    case BlendFactor::DestColor:
+    case BlendFactor::OneMinusDestColor:
+        operand.slot = PixelPipeline::DestSlot;
+        break;
+
+    case BlendFactor::SourceAlpha:
+    case BlendFactor::OneMinusSourceAlpha:
+        operand.slot = PixelPipeline::SourceSlot;
+        component = 3;
+        break;
+
+    case BlendFactor::DestAlpha:
+    case BlendFactor::OneMinusDestAlpha:
+        operand.slot = PixelPipeline::DestSlot;
+        component = 3;
+        break;
+
+    case BlendFactor::ConstantColor:
+    case BlendFactor::OneMinusConstantColor:
+        operand.slot = PixelPipeline::BlendConstantSlot;
+        break;
+
+    case BlendFactor::ConstantAlpha:
+    case BlendFactor::OneMinusConstantAlpha:
+        operand.slot = PixelPipeline::BlendConstantSlot;
+        component = 3;
+        break;
+
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
+        UNIMPLEMENTED();
+        return operand;
+    }
+
+    // Factors come in pairs of a value and its "one minus" variant
+    operand.invert = (factor & 1) ? 0xFF : 0;
+    for (int i = 0; i < 3; ++i)
+        operand.selectors[i] = (component == 3) ? 3 : i;
+    return operand;
+}
+
+static PixelPipeline::Operand DecodeBlendFactorA(BlendFactor factor) {
+    PixelPipeline::Operand operand = {};
+    operand.slot = PixelPipeline::BlendZeroSlot;
+    operand.selectors[3] = 3;
+
+    switch (factor) {
+    case BlendFactor::Zero:
+    case BlendFactor::One:
+        break;
+
+    case BlendFactor::SourceAlpha:
+    case BlendFactor::OneMinusSourceAlpha:
+        operand.slot = PixelPipeline::SourceSlot;
+        break;
+
+    case BlendFactor::DestAlpha:
+    case BlendFactor::OneMinusDestAlpha:
+        operand.slot = PixelPipeline::DestSlot;
+        break;
+
+    case BlendFactor::ConstantAlpha:
+    case BlendFactor::OneMinusConstantAlpha:
+        operand.slot = PixelPipeline::BlendConstantSlot;
+        break;
+
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
+        UNIMPLEMENTED();
+        return operand;
+    }
+
+    operand.invert = (factor & 1) ? 0xFF : 0;
+    return operand;
+}
+
+template <BlendEquation equation>
+static int BlendComponent(u8 src, u8 srcfactor, u8 dest, u8 destfactor) {
+    int src_result = src * srcfactor;
+    int dst_result = dest * destfactor;
+
+    switch (equation) {
+    case BlendEquation::Add:
+        return std::min(255, (src_result + dst_result) / 255);
+
+    case BlendEquation::Subtract:
+        return std::max(0, (src_result - dst_result) / 255);
+
+    case BlendEquation::ReverseSubtract:
+        return std::max(0, (dst_result - src_result) / 255);
+
+    // TODO: How do these two actually work?
+    //       OpenGL doesn't include the blend factors in the min/max computations,
+    //       but is this what the 3DS actually does?
+    case BlendEquation::Min:
+        return std::min(src, dest);
+
+    case BlendEquation::Max:
+        return std::max(src, dest);
+
+    default:
+        // Unknown equations are reported when decoding
+        return 0;
+    }
+}
+
+template <BlendEquation equation_rgb, BlendEquation equation_a>
+static Math::Vec4<u8> Blend(const PixelPipeline& pipeline, const Math::Vec4<u8>& source,
+                            const Math::Vec4<u8>& dest) {
+    const Math::Vec4<u8> values[PixelPipeline::NumBlendSlots] = {
+        source, dest, pipeline.blend_constant, Math::MakeVec<u8>(0, 0, 0, 0)
+    };
+
+    Math::Vec4<u8> blend_output;
+    for (int i = 0; i < 4; ++i) {
+        const auto& src_operand = pipeline.source_factor[i];
+        const auto& dst_operand = pipeline.dest_factor[i];
+        u8 srcfactor = values[src_operand.slot][src_operand.selectors[i]] ^ src_operand.invert;
+        u8 dstfactor = values[dst_operand.slot][dst_operand.selectors[i]] ^ dst_operand.invert;
+
+        if (i < 3)
+            blend_output[i] = BlendComponent<equation_rgb>(source[i], srcfactor, dest[i], dstfactor);
+        else
+            blend_output[i] = BlendComponent<equation_a>(source[i], srcfactor, dest[i], dstfactor);
+    }
+
+    return Math::MakeVec<u8>((blend_output.r() & pipeline.write_mask.r()) | (dest.r() & ~pipeline.write_mask.r()),
+                             (blend_output.g() & pipeline.write_mask.g()) | (dest.g() & ~pipeline.write_mask.g()),
+                             (blend_output.b() & pipeline.write_mask.b()) | (dest.b() & ~pipeline.write_mask.b()),
+                             (blend_output.a() & pipeline.write_mask.a()) | (dest.a() & ~pipeline.write_mask.a()));
+}
+
+/// Used instead of blending when logic ops are enabled, which aren't implemented
+static Math::Vec4<u8> NoBlend(const PixelPipeline& pipeline, const Math::Vec4<u8>& source,
+                              const Math::Vec4<u8>& dest) {
+    return Math::MakeVec<u8>((source.r() & pipeline.write_mask.r()) | (dest.r() & ~pipeline.write_mask.r()),
+                             (source.g() & pipeline.write_mask.g()) | (dest.g() & ~pipeline.write_mask.g()),
+                             (source.b() & pipeline.write_mask.b()) | (dest.b() & ~pipeline.write_mask.b()),
+                             (source.a() & pipeline.write_mask.a()) | (dest.a() & ~pipeline.write_mask.a()));
+}
+
+template <BlendEquation equation_rgb>
+static decltype(PixelPipeline::blend) DecodeBlend(BlendEquation equation_a) {
+    switch (equation_a) {
+    case BlendEquation::Add:             return Blend<equation_rgb, BlendEquation::Add>;
+    case BlendEquation::Subtract:        return Blend<equation_rgb, BlendEquation::Subtract>;
+    case BlendEquation::ReverseSubtract: return Blend<equation_rgb, BlendEquation::ReverseSubtract>;
+    case BlendEquation::Min:             return Blend<equation_rgb, BlendEquation::Min>;
+    case BlendEquation::Max:             return Blend<equation_rgb, BlendEquation::Max>;
+
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown alpha blend equation %x", (u32)equation_a);
+        UNIMPLEMENTED();
+        return Blend<equation_rgb, static_cast<BlendEquation>(0xFF)>;
+    }
+}
+
+static decltype(PixelPipeline::blend) DecodeBlend(BlendEquation equation_rgb, BlendEquation equation_a) {
+    switch (equation_rgb) {
+    case BlendEquation::Add:             return DecodeBlend<BlendEquation::Add>(equation_a);
+    case BlendEquation::Subtract:        return DecodeBlend<BlendEquation::Subtract>(equation_a);
+    case BlendEquation::ReverseSubtract: return DecodeBlend<BlendEquation::ReverseSubtract>(equation_a);
+    case BlendEquation::Min:             return DecodeBlend<BlendEquation::Min>(equation_a);
+    case BlendEquation::Max:             return DecodeBlend<BlendEquation::Max>(equation_a);
+
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", (u32)equation_rgb);
+        UNIMPLEMENTED();
+        return DecodeBlend<static_cast<BlendEquation>(0xFF)>(equation_a);
+    }
+}
+
+void DecodePixelPipeline(PixelPipeline& pipeline, const Regs& regs) {
+    const auto tev_stages = regs.GetTevStages();
+
+    pipeline.num_stages = 0;
+    for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
+        const auto& tev_stage = tev_stages[tev_stage_index];
+        const bool update_buffer_color = regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index);
+        const bool update_buffer_alpha = regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index);
+
+        // Most stages of typical setups just pass on the previous output
+        if (IsPassThroughStage(tev_stage) && !update_buffer_color && !update_buffer_alpha)
+            continue;
+
+        auto& stage = pipeline.stages[pipeline.num_stages++];
+        stage.color_operands[0] = DecodeColorOperand(tev_stage.color_source1, tev_stage.color_modifier1);
+        stage.color_operands[1] = DecodeColorOperand(tev_stage.color_source2, tev_stage.color_modifier2);
+        stage.color_operands[2] = DecodeColorOperand(tev_stage.color_source3, tev_stage.color_modifier3);
+        stage.alpha_operands[0] = DecodeAlphaOperand(tev_stage.alpha_source1, tev_stage.alpha_modifier1);
+        stage.alpha_operands[1] = DecodeAlphaOperand(tev_stage.alpha_source2, tev_stage.alpha_modifier2);
+        stage.alpha_operands[2] = DecodeAlphaOperand(tev_stage.alpha_source3, tev_stage.alpha_modifier3);
+
+        stage.constant = Math::MakeVec<u8>(tev_stage.const_r, tev_stage.const_g, tev_stage.const_b, tev_stage.const_a);
+        stage.color_multiplier = tev_stage.GetColorMultiplier();
+        stage.alpha_multiplier = tev_stage.GetAlphaMultiplier();
+        stage.update_buffer_color = update_buffer_color;
+        stage.update_buffer_alpha = update_buffer_alpha;
+
+        stage.color_combine = DecodeColorCombine(tev_stage.color_op);
+        stage.alpha_combine = DecodeAlphaCombine(tev_stage.alpha_op);
+    }
+
+    pipeline.buffer_color = Math::MakeVec<u8>(regs.tev_combiner_buffer_color.r, regs.tev_combiner_buffer_color.g,
+                                              regs.tev_combiner_buffer_color.b, regs.tev_combiner_buffer_color.a);
+
+    const auto& output_merger = regs.output_merger;
+    for (unsigned alpha = 0; alpha < pipeline.alpha_test_pass.size(); ++alpha) {
+        pipeline.alpha_test_pass[alpha] = !output_merger.alpha_test.enable ||
+                                          CompareValues(output_merger.alpha_test.func, alpha, output_merger.alpha_test.ref);
+    }
+
+    pipeline.depth_test_enable = output_merger.depth_test_enable != 0;
+    pipeline.depth_write_enable = output_merger.depth_write_enable != 0;
+    pipeline.depth_test = DecodeDepthTest(output_merger.depth_test_func);
+    if (pipeline.depth_test_enable)
+        pipeline.depth_max = (1 << Regs::DepthBitsPerPixel(regs.framebuffer.depth_format)) - 1;
+    else
+        pipeline.depth_max = 0;
+
+    pipeline.write_mask = Math::MakeVec<u8>(output_merger.red_enable ? 0xFF : 0, output_merger.green_enable ? 0xFF : 0,
+                                            output_merger.blue_enable ? 0xFF : 0, output_merger.alpha_enable ? 0xFF : 0);
+
+    if (output_merger.alphablend_enable) {
+        const auto& params = output_merger.alpha_blending;
+        const auto source_factor_rgb = DecodeBlendFactorRGB(params.factor_source_rgb);
+        const auto dest_factor_rgb = DecodeBlendFactorRGB(params.factor_dest_rgb);
+        for (int i = 0; i < 3; ++i) {
+            pipeline.source_factor[i] = source_factor_rgb;
+            pipeline.dest_factor[i] = dest_factor_rgb;
+        }
+        pipeline.source_factor[3] = DecodeBlendFactorA(params.factor_source_a);
+        pipeline.dest_factor[3] = DecodeBlendFactorA(params.factor_dest_a);
+
+        pipeline.blend_constant = Math::MakeVec<u8>(output_merger.blend_const.r, output_merger.blend_const.g,
+                                                    output_merger.blend_const.b, output_merger.blend_const.a);
+        pipeline.blend = DecodeBlend(params.blend_equation_rgb, params.blend_equation_a);
+    } else {
+        LOG_CRITICAL(HW_GPU, "logic op: %x", (u32)output_merger.logic_op.op.Value());
+        UNIMPLEMENTED();
+        pipeline.blend = NoBlend;
+    }
+}
+
+} // namespace
+
+} // namespace
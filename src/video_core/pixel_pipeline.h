@@ -0,0 +1,120 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+#include "math.h"
+#include "pica.h"
+
+namespace Pica {
+
+namespace Rasterizer {
+
+/// Per-pixel inputs of the texture combiners
+struct CombinerInputs {
+    Math::Vec4<u8> primary_color;
+    Math::Vec4<u8> texture_color[3];
+};
+
+/**
+ * Texture combiner and output merger configuration, decoded from the registers. Operands are
+ * turned into table lookups and operations into functions specialized for them, so that shading a
+ * pixel doesn't need to look at the register encoding anymore.
+ */
+struct PixelPipeline {
+    /// Values texture combiner operands are read from
+    enum CombinerSlot : u8 {
+        PrimaryColorSlot,
+        Texture0Slot,
+        Texture1Slot,
+        Texture2Slot,
+        BufferSlot,
+        ConstantSlot,
+        PreviousSlot,
+        ZeroSlot,           ///< Used for unknown sources
+
+        NumCombinerSlots
+    };
+
+    /// Values blend factors are read from
+    enum BlendSlot : u8 {
+        SourceSlot,
+        DestSlot,
+        BlendConstantSlot,
+        BlendZeroSlot,
+
+        NumBlendSlots
+    };
+
+    /**
+     * Operand of a combiner stage or blend factor. Component i of the operand is component
+     * selectors[i] of the slot, xor'ed with invert (0xFF for "one minus" modifiers, 0 otherwise).
+     */
+    struct Operand {
+        u8 slot;
+        u8 selectors[4];
+        u8 invert;
+    };
+
+    struct CombinerStage {
+        Operand color_operands[3];
+        Operand alpha_operands[3];  ///< Only the first selector is used
+
+        Math::Vec4<u8> constant;
+        unsigned color_multiplier;
+        unsigned alpha_multiplier;
+
+        bool update_buffer_color;
+        bool update_buffer_alpha;
+
+        Math::Vec3<u8> (*color_combine)(const Math::Vec3<u8> input[3]);
+        u8 (*alpha_combine)(const u8 input[3]);
+    };
+
+    /// Combiner stages which don't just pass on the output of the previous stage
+    std::array<CombinerStage, 6> stages;
+    unsigned num_stages;
+
+    /// Initial contents of the combiner buffer
+    Math::Vec4<u8> buffer_color;
+
+    /// Alpha test result for each combiner output alpha, true for all of them if the test is disabled
+    std::array<bool, 256> alpha_test_pass;
+
+    bool depth_test_enable;
+    bool depth_write_enable;
+    int depth_max;                  ///< Largest value of the depth format
+    bool (*depth_test)(u32 z, u32 ref_z);
+
+    Operand source_factor[4];       ///< Blend factor of each component of the combiner output
+    Operand dest_factor[4];         ///< Blend factor of each component of the framebuffer color
+    Math::Vec4<u8> blend_constant;
+    Math::Vec4<u8> write_mask;      ///< 0xFF for components written to the framebuffer, 0 otherwise
+
+    Math::Vec4<u8> (*blend)(const PixelPipeline& pipeline, const Math::Vec4<u8>& source,
+                            const Math::Vec4<u8>& dest);
+
+    /// Runs the texture combiners, returning the output of the last stage
+    Math::Vec4<u8> Combine(const CombinerInputs& inputs) const;
+
+    /// Returns the color to write to the framebuffer given the combiner output and the current color
+    Math::Vec4<u8> Blend(const Math::Vec4<u8>& source, const Math::Vec4<u8>& dest) const {
+        return blend(*this, source, dest);
+    }
+};
+
+/**
+ * Decodes the pixel pipeline configured in the given registers.
+ * @param pipeline Pipeline to decode to
+ * @param regs Registers with the texture combiner, output merger and framebuffer setup
+ */
+void DecodePixelPipeline(PixelPipeline& pipeline, const Regs& regs);
+
+} // namespace
+
+} // namespace
@@ -6,9 +6,6 @@
 #include "primitive_assembly.h"
 #include "vertex_shader.h"
 
-#include "video_core.h"
-#include "renderer_opengl/renderer_opengl.h"
-
 #include "common/logging/log.h"
 #include "video_core/debug_utils/debug_utils.h"
 
@@ -58,8 +55,6 @@ void PrimitiveAssembler<VertexType>::SubmitVertex(VertexType& vtx, TriangleHandl
 
 // explicitly instantiate use cases
 template
-struct PrimitiveAssembler<RawVertex>;
-template
 struct PrimitiveAssembler<VertexShader::OutputVertex>;
 template
 struct PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex>;
@@ -3,16 +3,27 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "common/common_types.h"
+#include "common/hash.h"
+#include "common/make_unique.h"
 #include "common/math_util.h"
+#include "common/thread.h"
 
 #include "core/hw/gpu.h"
-#include "debug_utils/debug_utils.h"
 #include "math.h"
 #include "color.h"
 #include "pica.h"
+#include "pixel_pipeline.h"
 #include "rasterizer.h"
+#include "texture_cache.h"
 #include "vertex_shader.h"
 #include "video_core/utils.h"
 
@@ -20,134 +31,183 @@ namespace Pica {
 
 namespace Rasterizer {
 
-static void DrawPixel(int x, int y, const Math::Vec4<u8>& color) {
-    const PAddr addr = registers.framebuffer.GetColorBufferPhysicalAddress();
+/// Color and depth buffers of the current flush, resolved to host memory
+struct RenderTarget {
+    u8* color_buffer;
+    u8* depth_buffer;       ///< Only set if depth testing is enabled
 
-    // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
-    // NOTE: The framebuffer height register contains the actual FB height minus one.
-    y = (registers.framebuffer.height - y);
+    u32 width;
+    u32 height;
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(registers.framebuffer.color_format.Value()));
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * registers.framebuffer.width * bytes_per_pixel;
-    u8* dst_pixel = Memory::GetPhysicalPointer(addr) + dst_offset;
+    /// Whether 2x2 pixel quads starting at even coordinates are 2x2 Morton quads of the buffers as well
+    bool quads_aligned;
 
-    switch (registers.framebuffer.color_format) {
-    case registers.framebuffer.RGBA8:
-        Color::EncodeRGBA8(color, dst_pixel);
-        break;
+    // Accessors for the four pixels of a quad, specialized for the buffer formats. Writes only
+    // modify the pixels whose bit is set in the given mask.
+    void (*read_colors)(const u8* buffer, const u32 indices[4], Math::Vec4<u8> colors[4]);
+    void (*write_colors)(u8* buffer, const u32 indices[4], const Math::Vec4<u8> colors[4], unsigned mask);
+    void (*read_depths)(const u8* buffer, const u32 indices[4], u32 depths[4]);
+    void (*write_depths)(u8* buffer, const u32 indices[4], const u32 depths[4], unsigned mask);
 
-    case registers.framebuffer.RGB8:
-        Color::EncodeRGB8(color, dst_pixel);
-        break;
+    /// Returns the position of the given pixel in the buffers, counted in pixels
+    u32 GetPixelIndex(int x, int y) const {
+        // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
+        y = height - 1 - y;
 
-    case registers.framebuffer.RGB5A1:
-        Color::EncodeRGB5A1(color, dst_pixel);
-        break;
+        const u32 coarse_y = y & ~7;
+        return VideoCore::GetMortonOffset(x, y, 1) + coarse_y * width;
+    }
 
-    case registers.framebuffer.RGB565:
-        Color::EncodeRGB565(color, dst_pixel);
-        break;
+    /**
+     * Returns the positions of the pixels of a quad in the buffers.
+     * @param x, y Position of the first pixel of the quad, in pixels. Both are even.
+     * @param indices Position of pixel (x + i % 2, y + i / 2) is written to indices[i]
+     */
+    void GetQuadIndices(int x, int y, u32 indices[4]) const {
+        if (quads_aligned) {
+            // The two rows of the quad are the upper and lower half of a Morton quad
+            const u32 base = GetPixelIndex(x, y + 1);
+            indices[0] = base + 2;
+            indices[1] = base + 3;
+            indices[2] = base;
+            indices[3] = base + 1;
+        } else {
+            // Quads can overhang the last row of buffers with odd heights
+            const int next_y = std::min<int>(y + 1, height - 1);
+            indices[0] = GetPixelIndex(x, y);
+            indices[1] = GetPixelIndex(x + 1, y);
+            indices[2] = GetPixelIndex(x, next_y);
+            indices[3] = GetPixelIndex(x + 1, next_y);
+        }
+    }
+};
 
-    case registers.framebuffer.RGBA4:
-        Color::EncodeRGBA4(color, dst_pixel);
-        break;
+template <const Math::Vec4<u8> (*Decode)(const u8*), u32 bytes_per_pixel>
+static void ReadColors(const u8* buffer, const u32 indices[4], Math::Vec4<u8> colors[4]) {
+    for (int i = 0; i < 4; ++i)
+        colors[i] = Decode(buffer + indices[i] * bytes_per_pixel);
+}
 
-    default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", registers.framebuffer.color_format.Value());
-        UNIMPLEMENTED();
+template <void (*Encode)(const Math::Vec4<u8>&, u8*), u32 bytes_per_pixel>
+static void WriteColors(u8* buffer, const u32 indices[4], const Math::Vec4<u8> colors[4], unsigned mask) {
+    for (int i = 0; i < 4; ++i) {
+        if (mask & (1 << i))
+            Encode(colors[i], buffer + indices[i] * bytes_per_pixel);
     }
 }
 
-static const Math::Vec4<u8> GetPixel(int x, int y) {
-    const PAddr addr = registers.framebuffer.GetColorBufferPhysicalAddress();
+template <u32 (*Decode)(const u8*), u32 bytes_per_pixel>
+static void ReadDepths(const u8* buffer, const u32 indices[4], u32 depths[4]) {
+    for (int i = 0; i < 4; ++i)
+        depths[i] = Decode(buffer + indices[i] * bytes_per_pixel);
+}
 
-    y = (registers.framebuffer.height - y);
+template <void (*Encode)(u32, u8*), u32 bytes_per_pixel>
+static void WriteDepths(u8* buffer, const u32 indices[4], const u32 depths[4], unsigned mask) {
+    for (int i = 0; i < 4; ++i) {
+        if (mask & (1 << i))
+            Encode(depths[i], buffer + indices[i] * bytes_per_pixel);
+    }
+}
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(registers.framebuffer.color_format.Value()));
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * registers.framebuffer.width * bytes_per_pixel;
-    u8* src_pixel = Memory::GetPhysicalPointer(addr) + src_offset;
+static u32 DecodeD24S8Depth(const u8* bytes) {
+    return Color::DecodeD24S8(bytes).x;
+}
 
-    switch (registers.framebuffer.color_format) {
-    case registers.framebuffer.RGBA8:
-        return Color::DecodeRGBA8(src_pixel);
+static void EncodeD24S8Depth(u32 value, u8* bytes) {
+    // TODO(Subv): Implement the stencil buffer
+    Color::EncodeD24S8(value, 0, bytes);
+}
 
-    case registers.framebuffer.RGB8:
-        return Color::DecodeRGB8(src_pixel);
+// Accessors for unknown formats, which read zeros and drop writes
+static void ReadNoColors(const u8* buffer, const u32 indices[4], Math::Vec4<u8> colors[4]) {
+    std::fill(colors, colors + 4, Math::Vec4<u8>(0, 0, 0, 0));
+}
+
+static void WriteNoColors(u8* buffer, const u32 indices[4], const Math::Vec4<u8> colors[4], unsigned mask) {
+}
+
+static void ReadNoDepths(const u8* buffer, const u32 indices[4], u32 depths[4]) {
+    std::fill(depths, depths + 4, 0);
+}
+
+static void WriteNoDepths(u8* buffer, const u32 indices[4], const u32 depths[4], unsigned mask) {
+}
 
-    case registers.framebuffer.RGB5A1:
-        return Color::DecodeRGB5A1(src_pixel);
+/// Render target of the triangles being rasterized, set up by Flush
+static RenderTarget render_target;
 
-    case registers.framebuffer.RGB565:
-        return Color::DecodeRGB565(src_pixel);
+static void SetupRenderTarget(const PixelPipeline& pipeline) {
+    const auto& framebuffer = registers.framebuffer;
 
-    case registers.framebuffer.RGBA4:
-        return Color::DecodeRGBA4(src_pixel);
+    render_target.color_buffer = Memory::GetPhysicalPointer(framebuffer.GetColorBufferPhysicalAddress());
+    render_target.depth_buffer = nullptr;
+    if (pipeline.depth_test_enable)
+        render_target.depth_buffer = Memory::GetPhysicalPointer(framebuffer.GetDepthBufferPhysicalAddress());
+
+    // NOTE: The framebuffer height register contains the actual FB height minus one.
+    render_target.width = framebuffer.width;
+    render_target.height = framebuffer.height + 1;
+    render_target.quads_aligned = (render_target.height % 2) == 0;
+
+    switch (framebuffer.color_format) {
+    case framebuffer.RGBA8:
+        render_target.read_colors = ReadColors<Color::DecodeRGBA8, 4>;
+        render_target.write_colors = WriteColors<Color::EncodeRGBA8, 4>;
+        break;
+
+    case framebuffer.RGB8:
+        render_target.read_colors = ReadColors<Color::DecodeRGB8, 3>;
+        render_target.write_colors = WriteColors<Color::EncodeRGB8, 3>;
+        break;
+
+    case framebuffer.RGB5A1:
+        render_target.read_colors = ReadColors<Color::DecodeRGB5A1, 2>;
+        render_target.write_colors = WriteColors<Color::EncodeRGB5A1, 2>;
+        break;
+
+    case framebuffer.RGB565:
+        render_target.read_colors = ReadColors<Color::DecodeRGB565, 2>;
+        render_target.write_colors = WriteColors<Color::EncodeRGB565, 2>;
+        break;
+
+    case framebuffer.RGBA4:
+        render_target.read_colors = ReadColors<Color::DecodeRGBA4, 2>;
+        render_target.write_colors = WriteColors<Color::EncodeRGBA4, 2>;
+        break;
 
     default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", registers.framebuffer.color_format.Value());
+        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", framebuffer.color_format.Value());
         UNIMPLEMENTED();
+        render_target.read_colors = ReadNoColors;
+        render_target.write_colors = WriteNoColors;
+        break;
     }
 
-    return {0, 0, 0, 0};
-}
+    switch (framebuffer.depth_format) {
+    case Regs::DepthFormat::D16:
+        render_target.read_depths = ReadDepths<Color::DecodeD16, 2>;
+        render_target.write_depths = WriteDepths<Color::EncodeD16, 2>;
+        break;
 
-static u32 GetDepth(int x, int y) {
-    const PAddr addr = registers.framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
-
-    y = (registers.framebuffer.height - y);
-    
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(registers.framebuffer.depth_format);
-    u32 stride = registers.framebuffer.width * bytes_per_pixel;
-
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* src_pixel = depth_buffer + src_offset;
-
-    switch (registers.framebuffer.depth_format) {
-        case Pica::Regs::DepthFormat::D16:
-            return Color::DecodeD16(src_pixel);
-        case Pica::Regs::DepthFormat::D24:
-            return Color::DecodeD24(src_pixel);
-        case Pica::Regs::DepthFormat::D24S8:
-            return Color::DecodeD24S8(src_pixel).x;
-        default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", registers.framebuffer.depth_format);
-            UNIMPLEMENTED();
-            return 0;
-    }
-}
+    case Regs::DepthFormat::D24:
+        render_target.read_depths = ReadDepths<Color::DecodeD24, 3>;
+        render_target.write_depths = WriteDepths<Color::EncodeD24, 3>;
+        break;
+
+    case Regs::DepthFormat::D24S8:
+        render_target.read_depths = ReadDepths<DecodeD24S8Depth, 4>;
+        render_target.write_depths = WriteDepths<EncodeD24S8Depth, 4>;
+        break;
 
-static void SetDepth(int x, int y, u32 value) {
-    const PAddr addr = registers.framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
-
-    y = (registers.framebuffer.height - y);
-
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(registers.framebuffer.depth_format);
-    u32 stride = registers.framebuffer.width * bytes_per_pixel;
-
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* dst_pixel = depth_buffer + dst_offset;
-
-    switch (registers.framebuffer.depth_format) {
-        case Pica::Regs::DepthFormat::D16:
-            Color::EncodeD16(value, dst_pixel);
-            break;
-        case Pica::Regs::DepthFormat::D24:
-            Color::EncodeD24(value, dst_pixel);
-            break;
-        case Pica::Regs::DepthFormat::D24S8:
-            // TODO(Subv): Implement the stencil buffer
-            Color::EncodeD24S8(value, 0, dst_pixel);
-            break;
-        default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", registers.framebuffer.depth_format);
+    default:
+        if (pipeline.depth_test_enable) {
+            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", (u32)framebuffer.depth_format);
             UNIMPLEMENTED();
-            break;
+        }
+        render_target.read_depths = ReadNoDepths;
+        render_target.write_depths = WriteNoDepths;
+        break;
     }
 }
 
@@ -186,6 +246,72 @@ static int SignedArea (const Math::Vec2<Fix12P4>& vtx1,
     return Math::Cross(vec1, vec2).z;
 };
 
+/// Triangle set up for rasterization, with its vertices wound counter-clockwise
+struct Triangle {
+    VertexShader::OutputVertex v0, v1, v2;
+    Math::Vec3<Fix12P4> vtxpos[3];  ///< Vertex positions in rasterizer coordinates
+    int bias0, bias1, bias2;        ///< Biases implementing the filling rules
+    u16 min_x, min_y, max_x, max_y; ///< Bounding box in rasterizer coordinates
+};
+
+/**
+ * Width and height of the screen tiles triangles are sorted into, in pixels. Tiles are rasterized
+ * in parallel; each pixel belongs to exactly one tile, so no two threads write the same pixel. They
+ * don't necessarily line up with the 8x8 blocks of the framebuffer, since its rows are stored
+ * bottom to top.
+ */
+static const int TILE_SIZE = 32;
+
+/// Rasterizer coordinates cover 4096 pixels in each direction
+static const int NUM_TILES_PER_ROW = 4096 / TILE_SIZE;
+
+/// Number of triangles binned before drawing them even if the batch isn't finished yet
+static const size_t MAX_PENDING_TRIANGLES = 4096;
+
+/// Triangles submitted since the last flush, in submission order
+static std::vector<Triangle> triangles;
+
+/// For each tile, the indices of the triangles overlapping it, in submission order
+static std::vector<std::vector<u32>> tile_bins(NUM_TILES_PER_ROW * NUM_TILES_PER_ROW);
+
+/// Tiles with a non-empty bin
+static std::vector<u32> active_tiles;
+
+/// Maximal number of decoded pixel pipelines kept around
+static const size_t MAX_CACHED_PIPELINES = 256;
+
+/// Decoded pixel pipelines, keyed by a hash of the registers they are decoded from
+static std::unordered_map<u64, std::unique_ptr<PixelPipeline>> pipeline_cache;
+
+/// Pipeline used for the triangles being rasterized, set up by Flush
+static const PixelPipeline* current_pipeline = nullptr;
+
+/// Decoded versions of the enabled textures, set up by Flush
+static const CachedTexture* current_textures[3] = {};
+
+/**
+ * Returns the pixel pipeline for the current register configuration. Games switch between few
+ * configurations, so each of them is only decoded the first time it's drawn with.
+ */
+static const PixelPipeline& GetPixelPipeline() {
+    // Hash all registers from the first texture combiner to the output merger
+    const u8* begin = reinterpret_cast<const u8*>(&registers.tev_stage0);
+    const u8* end = reinterpret_cast<const u8*>(&registers.output_merger + 1);
+    const u64 hash = Common::ComputeHash64(begin, end - begin, registers.framebuffer.depth_format);
+
+    auto it = pipeline_cache.find(hash);
+    if (it == pipeline_cache.end()) {
+        if (pipeline_cache.size() >= MAX_CACHED_PIPELINES)
+            pipeline_cache.clear();
+
+        std::unique_ptr<PixelPipeline> pipeline = Common::make_unique<PixelPipeline>();
+        DecodePixelPipeline(*pipeline, registers);
+        it = pipeline_cache.emplace(hash, std::move(pipeline)).first;
+    }
+
+    return *it->second;
+}
+
 /**
  * Helper function for ProcessTriangle with the "reversed" flag to allow for implementing
  * culling via recursion.
@@ -259,614 +385,441 @@ static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
     int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
     int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
 
-    auto w_inverse = Math::MakeVec(v0.pos.w, v1.pos.w, v2.pos.w);
-
-    auto textures = registers.GetTextures();
-    auto tev_stages = registers.GetTevStages();
-
-    // Enter rasterization loop, starting at the center of the topleft bounding box corner.
-    // TODO: Not sure if looping through x first might be faster
-    for (u16 y = min_y + 8; y < max_y; y += 0x10) {
-        for (u16 x = min_x + 8; x < max_x; x += 0x10) {
-
-            // Calculate the barycentric coordinates w0, w1 and w2
-            int w0 = bias0 + SignedArea(vtxpos[1].xy(), vtxpos[2].xy(), {x, y});
-            int w1 = bias1 + SignedArea(vtxpos[2].xy(), vtxpos[0].xy(), {x, y});
-            int w2 = bias2 + SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), {x, y});
-            int wsum = w0 + w1 + w2;
-
-            // If current pixel is not covered by the current primitive
-            if (w0 < 0 || w1 < 0 || w2 < 0)
-                continue;
-
-            auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(static_cast<float>(w0)),
-                                                float24::FromFloat32(static_cast<float>(w1)),
-                                                float24::FromFloat32(static_cast<float>(w2)));
-            float24 interpolated_w_inverse = float24::FromFloat32(1.0f) / Math::Dot(w_inverse, baricentric_coordinates);
-
-            // Perspective correct attribute interpolation:
-            // Attribute values cannot be calculated by simple linear interpolation since
-            // they are not linear in screen space. For example, when interpolating a
-            // texture coordinate across two vertices, something simple like
-            //     u = (u0*w0 + u1*w1)/(w0+w1)
-            // will not work. However, the attribute value divided by the
-            // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
-            // in screenspace. Hence, we can linearly interpolate these two independently and
-            // calculate the interpolated attribute by dividing the results.
-            // I.e.
-            //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
-            //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
-            //     u = u_over_w / one_over_w
-            //
-            // The generalization to three vertices is straightforward in baricentric coordinates.
-            auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
-                auto attr_over_w = Math::MakeVec(attr0, attr1, attr2);
-                float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
-                return interpolated_attr_over_w * interpolated_w_inverse;
-            };
-
-            Math::Vec4<u8> primary_color{
-                (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()).ToFloat32() * 255)
-            };
-
-            Math::Vec2<float24> uv[3];
-            uv[0].u() = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
-            uv[0].v() = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
-            uv[1].u() = GetInterpolatedAttribute(v0.tc1.u(), v1.tc1.u(), v2.tc1.u());
-            uv[1].v() = GetInterpolatedAttribute(v0.tc1.v(), v1.tc1.v(), v2.tc1.v());
-            uv[2].u() = GetInterpolatedAttribute(v0.tc2.u(), v1.tc2.u(), v2.tc2.u());
-            uv[2].v() = GetInterpolatedAttribute(v0.tc2.v(), v1.tc2.v(), v2.tc2.v());
-
-            Math::Vec4<u8> texture_color[3]{};
-            for (int i = 0; i < 3; ++i) {
-                const auto& texture = textures[i];
-                if (!texture.enabled)
-                    continue;
-
-                DEBUG_ASSERT(0 != texture.config.address);
-
-                int s = (int)(uv[i].u() * float24::FromFloat32(static_cast<float>(texture.config.width))).ToFloat32();
-                int t = (int)(uv[i].v() * float24::FromFloat32(static_cast<float>(texture.config.height))).ToFloat32();
-                static auto GetWrappedTexCoord = [](Regs::TextureConfig::WrapMode mode, int val, unsigned size) {
-                    switch (mode) {
-                        case Regs::TextureConfig::ClampToEdge:
-                            val = std::max(val, 0);
-                            val = std::min(val, (int)size - 1);
-                            return val;
-
-                        case Regs::TextureConfig::Repeat:
-                            return (int)((unsigned)val % size);
-
-                        case Regs::TextureConfig::MirroredRepeat:
-                        {
-                            unsigned int coord = ((unsigned)val % (2 * size));
-                            if (coord >= size)
-                                coord = 2 * size - 1 - coord;
-                            return (int)coord;
-                        }
-
-                        default:
-                            LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
-                            UNIMPLEMENTED();
-                            return 0;
-                    }
-                };
-
-                // Textures are laid out from bottom to top, hence we invert the t coordinate.
-                // NOTE: This may not be the right place for the inversion.
-                // TODO: Check if this applies to ETC textures, too.
-                s = GetWrappedTexCoord(texture.config.wrap_s, s, texture.config.width);
-                t = texture.config.height - 1 - GetWrappedTexCoord(texture.config.wrap_t, t, texture.config.height);
-
-                u8* texture_data = Memory::GetPhysicalPointer(texture.config.GetPhysicalAddress());
-                auto info = DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
-
-                texture_color[i] = DebugUtils::LookupTexture(texture_data, s, t, info);
-                DebugUtils::DumpTexture(texture.config, texture_data);
-            }
-
-            // Texture environment - consists of 6 stages of color and alpha combining.
-            //
-            // Color combiners take three input color values from some source (e.g. interpolated
-            // vertex color, texture color, previous stage, etc), perform some very simple
-            // operations on each of them (e.g. inversion) and then calculate the output color
-            // with some basic arithmetic. Alpha combiners can be configured separately but work
-            // analogously.
-            Math::Vec4<u8> combiner_output;
-            Math::Vec4<u8> combiner_buffer = {
-                registers.tev_combiner_buffer_color.r, registers.tev_combiner_buffer_color.g,
-                registers.tev_combiner_buffer_color.b, registers.tev_combiner_buffer_color.a
-            };
-
-            for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-                const auto& tev_stage = tev_stages[tev_stage_index];
-                using Source = Regs::TevStageConfig::Source;
-                using ColorModifier = Regs::TevStageConfig::ColorModifier;
-                using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
-                using Operation = Regs::TevStageConfig::Operation;
-
-                auto GetSource = [&](Source source) -> Math::Vec4<u8> {
-                    switch (source) {
-                    // TODO: What's the difference between these two?
-                    case Source::PrimaryColor:
-                    case Source::PrimaryFragmentColor:
-                        return primary_color;
-
-                    case Source::Texture0:
-                        return texture_color[0];
-
-                    case Source::Texture1:
-                        return texture_color[1];
-
-                    case Source::Texture2:
-                        return texture_color[2];
-
-                    case Source::PreviousBuffer:
-                        return combiner_buffer;
-
-                    case Source::Constant:
-                        return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b, tev_stage.const_a};
-
-                    case Source::Previous:
-                        return combiner_output;
-
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0, 0};
-                    }
-                };
-
-                static auto GetColorModifier = [](ColorModifier factor, const Math::Vec4<u8>& values) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case ColorModifier::SourceColor:
-                        return values.rgb();
-
-                    case ColorModifier::OneMinusSourceColor:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
-
-                    case ColorModifier::SourceAlpha:
-                        return values.aaa();
-
-                    case ColorModifier::OneMinusSourceAlpha:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
-
-                    case ColorModifier::SourceRed:
-                        return values.rrr();
-
-                    case ColorModifier::OneMinusSourceRed:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
-
-                    case ColorModifier::SourceGreen:
-                        return values.ggg();
-
-                    case ColorModifier::OneMinusSourceGreen:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
-
-                    case ColorModifier::SourceBlue:
-                        return values.bbb();
-
-                    case ColorModifier::OneMinusSourceBlue:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
-                    }
-                };
-
-                static auto GetAlphaModifier = [](AlphaModifier factor, const Math::Vec4<u8>& values) -> u8 {
-                    switch (factor) {
-                    case AlphaModifier::SourceAlpha:
-                        return values.a();
-
-                    case AlphaModifier::OneMinusSourceAlpha:
-                        return 255 - values.a();
-
-                    case AlphaModifier::SourceRed:
-                        return values.r();
-
-                    case AlphaModifier::OneMinusSourceRed:
-                        return 255 - values.r();
-
-                    case AlphaModifier::SourceGreen:
-                        return values.g();
-
-                    case AlphaModifier::OneMinusSourceGreen:
-                        return 255 - values.g();
-
-                    case AlphaModifier::SourceBlue:
-                        return values.b();
-
-                    case AlphaModifier::OneMinusSourceBlue:
-                        return 255 - values.b();
-                    }
-                };
-
-                static auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
-
-                    case Operation::Modulate:
-                        return ((input[0] * input[1]) / 255).Cast<u8>();
-
-                    case Operation::Add:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
-
-                    case Operation::AddSigned:
-                    {
-                        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
-                        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
-                        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
-                        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
-                        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
-                        return result.Cast<u8>();
-                    }
-
-                    case Operation::Lerp:
-                        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
-
-                    case Operation::Subtract:
-                    {
-                        auto result = input[0].Cast<int>() - input[1].Cast<int>();
-                        result.r() = std::max(0, result.r());
-                        result.g() = std::max(0, result.g());
-                        result.b() = std::max(0, result.b());
-                        return result.Cast<u8>();
-                    }
-
-                    case Operation::MultiplyThenAdd:
-                    {
-                        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
-
-                    case Operation::AddThenMultiply:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        result = (result * input[2].Cast<int>()) / 255;
-                        return result.Cast<u8>();
-                    }
+    // Pixel centers are at odd multiples of 8, so this covers no pixels
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+
+    if (triangles.size() == MAX_PENDING_TRIANGLES)
+        Flush();
+
+    const u32 index = static_cast<u32>(triangles.size());
+    const Triangle triangle = { v0, v1, v2, { vtxpos[0], vtxpos[1], vtxpos[2] },
+                                bias0, bias1, bias2, min_x, min_y, max_x, max_y };
+    triangles.push_back(triangle);
+
+    // Add the triangle to the bins of all tiles overlapped by its bounding box
+    const int first_tile_x = (min_x >> 4) / TILE_SIZE;
+    const int first_tile_y = (min_y >> 4) / TILE_SIZE;
+    const int last_tile_x = ((max_x >> 4) - 1) / TILE_SIZE;
+    const int last_tile_y = ((max_y >> 4) - 1) / TILE_SIZE;
+    for (int tile_y = first_tile_y; tile_y <= last_tile_y; ++tile_y) {
+        for (int tile_x = first_tile_x; tile_x <= last_tile_x; ++tile_x) {
+            const u32 tile = tile_y * NUM_TILES_PER_ROW + tile_x;
+            if (tile_bins[tile].empty())
+                active_tiles.push_back(tile);
+            tile_bins[tile].push_back(index);
+        }
+    }
+}
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0};
-                    }
-                };
+/**
+ * Edge function of a triangle: the signed area spanned by an edge and a sample position, plus the
+ * fill rule bias. It is affine in the sample position, so it is evaluated once at the first sample
+ * of a block and stepped from there on.
+ */
+struct EdgeFunction {
+    EdgeFunction(const Math::Vec2<Fix12P4>& vtx1, const Math::Vec2<Fix12P4>& vtx2, int bias)
+        : x_step(-(vtx2.y - vtx1.y) * 0x10), y_step((vtx2.x - vtx1.x) * 0x10),
+          vtx1(vtx1.x, vtx1.y), vtx2(vtx2.x, vtx2.y), bias(bias) {
+    }
 
-                static auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+    /// Evaluates the edge function at the given sample, in rasterizer coordinates
+    int Evaluate(int x, int y) const {
+        return bias + (vtx2.x - vtx1.x) * (y - vtx1.y) - (vtx2.y - vtx1.y) * (x - vtx1.x);
+    }
 
-                    case Operation::Modulate:
-                        return input[0] * input[1] / 255;
+    int x_step; ///< Change of the edge function when moving one pixel to the right
+    int y_step; ///< Change of the edge function when moving one pixel down
 
-                    case Operation::Add:
-                        return std::min(255, input[0] + input[1]);
+private:
+    Math::Vec2<int> vtx1, vtx2;
+    int bias;
+};
 
-                    case Operation::Lerp:
-                        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
+/// Width and height of the blocks tested against the triangle edges as a whole, in pixels
+static const int BLOCK_SIZE = 8;
 
-                    case Operation::Subtract:
-                        return std::max(0, (int)input[0] - (int)input[1]);
+/**
+ * Shades the sample at the given position.
+ * @param x, y Sample position in rasterizer coordinates
+ * @param w0, w1, w2 Barycentric coordinates of the sample, scaled by twice the triangle area
+ * @param color Output of the texture combiners
+ * @param depth Depth of the sample, only set if depth testing is enabled
+ * @return False if the sample fails the alpha test
+ */
+static bool ShadePixel(const Triangle& triangle, u16 x, u16 y, int w0, int w1, int w2,
+                       const std::array<Regs::FullTextureConfig, 3>& textures,
+                       const PixelPipeline& pipeline, Math::Vec4<u8>& color, u32& depth) {
+    const auto& v0 = triangle.v0;
+    const auto& v1 = triangle.v1;
+    const auto& v2 = triangle.v2;
 
-                    case Operation::MultiplyThenAdd:
-                        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
+    auto w_inverse = Math::MakeVec(v0.pos.w, v1.pos.w, v2.pos.w);
+    int wsum = w0 + w1 + w2;
+
+    auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(static_cast<float>(w0)),
+                                        float24::FromFloat32(static_cast<float>(w1)),
+                                        float24::FromFloat32(static_cast<float>(w2)));
+    float24 interpolated_w_inverse = float24::FromFloat32(1.0f) / Math::Dot(w_inverse, baricentric_coordinates);
+
+    // Perspective correct attribute interpolation:
+    // Attribute values cannot be calculated by simple linear interpolation since
+    // they are not linear in screen space. For example, when interpolating a
+    // texture coordinate across two vertices, something simple like
+    //     u = (u0*w0 + u1*w1)/(w0+w1)
+    // will not work. However, the attribute value divided by the
+    // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
+    // in screenspace. Hence, we can linearly interpolate these two independently and
+    // calculate the interpolated attribute by dividing the results.
+    // I.e.
+    //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
+    //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
+    //     u = u_over_w / one_over_w
+    //
+    // The generalization to three vertices is straightforward in baricentric coordinates.
+    auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
+        auto attr_over_w = Math::MakeVec(attr0, attr1, attr2);
+        float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
+        return interpolated_attr_over_w * interpolated_w_inverse;
+    };
 
-                    case Operation::AddThenMultiply:
-                        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
+    CombinerInputs combiner_inputs = {};
+    combiner_inputs.primary_color = {
+        (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()).ToFloat32() * 255),
+        (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()).ToFloat32() * 255),
+        (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()).ToFloat32() * 255),
+        (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()).ToFloat32() * 255)
+    };
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return 0;
-                    }
-                };
-
-                // color combiner
-                // NOTE: Not sure if the alpha combiner might use the color output of the previous
-                //       stage as input. Hence, we currently don't directly write the result to
-                //       combiner_output.rgb(), but instead store it in a temporary variable until
-                //       alpha combining has been done.
-                Math::Vec3<u8> color_result[3] = {
-                    GetColorModifier(tev_stage.color_modifier1, GetSource(tev_stage.color_source1)),
-                    GetColorModifier(tev_stage.color_modifier2, GetSource(tev_stage.color_source2)),
-                    GetColorModifier(tev_stage.color_modifier3, GetSource(tev_stage.color_source3))
-                };
-                auto color_output = ColorCombine(tev_stage.color_op, color_result);
-
-                // alpha combiner
-                std::array<u8,3> alpha_result = {
-                    GetAlphaModifier(tev_stage.alpha_modifier1, GetSource(tev_stage.alpha_source1)),
-                    GetAlphaModifier(tev_stage.alpha_modifier2, GetSource(tev_stage.alpha_source2)),
-                    GetAlphaModifier(tev_stage.alpha_modifier3, GetSource(tev_stage.alpha_source3))
-                };
-                auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
-
-                combiner_output[0] = std::min((unsigned)255, color_output.r() * tev_stage.GetColorMultiplier());
-                combiner_output[1] = std::min((unsigned)255, color_output.g() * tev_stage.GetColorMultiplier());
-                combiner_output[2] = std::min((unsigned)255, color_output.b() * tev_stage.GetColorMultiplier());
-                combiner_output[3] = std::min((unsigned)255, alpha_output * tev_stage.GetAlphaMultiplier());
-
-                if (registers.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index)) {
-                    combiner_buffer.r() = combiner_output.r();
-                    combiner_buffer.g() = combiner_output.g();
-                    combiner_buffer.b() = combiner_output.b();
+    Math::Vec2<float24> uv[3];
+    uv[0].u() = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
+    uv[0].v() = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
+    uv[1].u() = GetInterpolatedAttribute(v0.tc1.u(), v1.tc1.u(), v2.tc1.u());
+    uv[1].v() = GetInterpolatedAttribute(v0.tc1.v(), v1.tc1.v(), v2.tc1.v());
+    uv[2].u() = GetInterpolatedAttribute(v0.tc2.u(), v1.tc2.u(), v2.tc2.u());
+    uv[2].v() = GetInterpolatedAttribute(v0.tc2.v(), v1.tc2.v(), v2.tc2.v());
+
+    for (int i = 0; i < 3; ++i) {
+        const auto& texture = textures[i];
+        if (!texture.enabled)
+            continue;
+
+        DEBUG_ASSERT(0 != texture.config.address);
+
+        int s = (int)(uv[i].u() * float24::FromFloat32(static_cast<float>(texture.config.width))).ToFloat32();
+        int t = (int)(uv[i].v() * float24::FromFloat32(static_cast<float>(texture.config.height))).ToFloat32();
+        static auto GetWrappedTexCoord = [](Regs::TextureConfig::WrapMode mode, int val, unsigned size) {
+            switch (mode) {
+                case Regs::TextureConfig::ClampToEdge:
+                    val = std::max(val, 0);
+                    val = std::min(val, (int)size - 1);
+                    return val;
+
+                case Regs::TextureConfig::Repeat:
+                    return (int)((unsigned)val % size);
+
+                case Regs::TextureConfig::MirroredRepeat:
+                {
+                    unsigned int coord = ((unsigned)val % (2 * size));
+                    if (coord >= size)
+                        coord = 2 * size - 1 - coord;
+                    return (int)coord;
                 }
 
-                if (registers.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index)) {
-                    combiner_buffer.a() = combiner_output.a();
-                }
+                default:
+                    LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
+                    UNIMPLEMENTED();
+                    return 0;
             }
+        };
 
-            if (registers.output_merger.alpha_test.enable) {
-                bool pass = false;
-
-                switch (registers.output_merger.alpha_test.func) {
-                case registers.output_merger.Never:
-                    pass = false;
-                    break;
+        // Textures are laid out from bottom to top, hence we invert the t coordinate.
+        // NOTE: This may not be the right place for the inversion.
+        // TODO: Check if this applies to ETC textures, too.
+        s = GetWrappedTexCoord(texture.config.wrap_s, s, texture.config.width);
+        t = texture.config.height - 1 - GetWrappedTexCoord(texture.config.wrap_t, t, texture.config.height);
 
-                case registers.output_merger.Always:
-                    pass = true;
-                    break;
-
-                case registers.output_merger.Equal:
-                    pass = combiner_output.a() == registers.output_merger.alpha_test.ref;
-                    break;
+        combiner_inputs.texture_color[i] = current_textures[i]->Lookup(s, t);
+    }
 
-                case registers.output_merger.NotEqual:
-                    pass = combiner_output.a() != registers.output_merger.alpha_test.ref;
-                    break;
+    // Texture environment - consists of 6 stages of color and alpha combining.
+    //
+    // Color combiners take three input color values from some source (e.g. interpolated
+    // vertex color, texture color, previous stage, etc), perform some very simple
+    // operations on each of them (e.g. inversion) and then calculate the output color
+    // with some basic arithmetic. Alpha combiners can be configured separately but work
+    // analogously.
+    color = pipeline.Combine(combiner_inputs);
+
+    if (!pipeline.alpha_test_pass[color.a()])
+        return false;
+
+    if (pipeline.depth_test_enable) {
+        depth = (u32)((v0.screenpos[2].ToFloat32() * w0 +
+                       v1.screenpos[2].ToFloat32() * w1 +
+                       v2.screenpos[2].ToFloat32() * w2) * pipeline.depth_max / wsum);
+    }
 
-                case registers.output_merger.LessThan:
-                    pass = combiner_output.a() < registers.output_merger.alpha_test.ref;
-                    break;
+    return true;
+}
 
-                case registers.output_merger.LessThanOrEqual:
-                    pass = combiner_output.a() <= registers.output_merger.alpha_test.ref;
-                    break;
+/**
+ * Depth tests and blends the shaded pixels of a 2x2 quad into the render target. Reading and
+ * writing whole quads at once touches the tiled buffers in contiguous chunks.
+ * @param x, y Position of the first pixel of the quad, in pixels. Both are even.
+ * @param mask Bit i is set if pixel (x + i % 2, y + i / 2) was shaded
+ * @param colors, depths Shading results of each pixel
+ */
+static void WriteQuad(int x, int y, unsigned mask, const Math::Vec4<u8> colors[4], const u32 depths[4],
+                      const PixelPipeline& pipeline) {
+    const RenderTarget& target = render_target;
+
+    u32 indices[4];
+    target.GetQuadIndices(x, y, indices);
+
+    // TODO: Does depth indeed only get written even if depth testing is enabled?
+    if (pipeline.depth_test_enable) {
+        u32 ref_depths[4];
+        target.read_depths(target.depth_buffer, indices, ref_depths);
+        for (int i = 0; i < 4; ++i) {
+            if ((mask & (1 << i)) && !pipeline.depth_test(depths[i], ref_depths[i]))
+                mask &= ~(1 << i);
+        }
 
-                case registers.output_merger.GreaterThan:
-                    pass = combiner_output.a() > registers.output_merger.alpha_test.ref;
-                    break;
+        if (mask == 0)
+            return;
 
-                case registers.output_merger.GreaterThanOrEqual:
-                    pass = combiner_output.a() >= registers.output_merger.alpha_test.ref;
-                    break;
-                }
+        if (pipeline.depth_write_enable)
+            target.write_depths(target.depth_buffer, indices, depths, mask);
+    }
 
-                if (!pass)
-                    continue;
-            }
+    Math::Vec4<u8> dest[4];
+    target.read_colors(target.color_buffer, indices, dest);
+    for (int i = 0; i < 4; ++i) {
+        if (mask & (1 << i))
+            dest[i] = pipeline.Blend(colors[i], dest[i]);
+    }
+    target.write_colors(target.color_buffer, indices, dest, mask);
+}
 
-            // TODO: Does depth indeed only get written even if depth testing is enabled?
-            if (registers.output_merger.depth_test_enable) {
-                unsigned num_bits = Pica::Regs::DepthBitsPerPixel(registers.framebuffer.depth_format);
-                u32 z = (u32)((v0.screenpos[2].ToFloat32() * w0 +
-                               v1.screenpos[2].ToFloat32() * w1 +
-                               v2.screenpos[2].ToFloat32() * w2) * ((1 << num_bits) - 1) / wsum);
-                u32 ref_z = GetDepth(x >> 4, y >> 4);
+/**
+ * Rasterizes the part of a triangle within the given bounds.
+ * @param x_begin, y_begin, x_end, y_end Bounds in rasterizer coordinates, multiples of 16
+ */
+static void RasterizeTriangle(const Triangle& triangle, int x_begin, int y_begin, int x_end, int y_end) {
+    const auto& vtxpos = triangle.vtxpos;
 
-                bool pass = false;
+    const int min_x = std::max<int>(triangle.min_x, x_begin);
+    const int min_y = std::max<int>(triangle.min_y, y_begin);
+    const int max_x = std::min<int>(triangle.max_x, x_end);
+    const int max_y = std::min<int>(triangle.max_y, y_end);
 
-                switch (registers.output_merger.depth_test_func) {
-                case registers.output_merger.Never:
-                    pass = false;
-                    break;
+    const EdgeFunction edge0(vtxpos[1].xy(), vtxpos[2].xy(), triangle.bias0);
+    const EdgeFunction edge1(vtxpos[2].xy(), vtxpos[0].xy(), triangle.bias1);
+    const EdgeFunction edge2(vtxpos[0].xy(), vtxpos[1].xy(), triangle.bias2);
 
-                case registers.output_merger.Always:
-                    pass = true;
-                    break;
+    auto textures = registers.GetTextures();
 
-                case registers.output_merger.Equal:
-                    pass = z == ref_z;
-                    break;
+    // Walk the bounding box in blocks aligned to BLOCK_SIZE pixels. The edge functions are linear,
+    // so their extrema within a block are found at its corner samples: blocks outside of any edge
+    // are skipped, and blocks inside of all edges are drawn without per-pixel coverage tests.
+    const int block_extent = BLOCK_SIZE * 0x10;
+    for (int block_y = min_y & ~(block_extent - 1); block_y < max_y; block_y += block_extent) {
+        for (int block_x = min_x & ~(block_extent - 1); block_x < max_x; block_x += block_extent) {
+            // Pixel centers of the first and last samples of this block
+            const int first_x = std::max(block_x, min_x) + 8;
+            const int first_y = std::max(block_y, min_y) + 8;
+            const int last_x = std::min(block_x + block_extent, max_x) - 8;
+            const int last_y = std::min(block_y + block_extent, max_y) - 8;
+            const int width = (last_x - first_x) / 0x10;
+            const int height = (last_y - first_y) / 0x10;
+
+            const int first_w0 = edge0.Evaluate(first_x, first_y);
+            const int first_w1 = edge1.Evaluate(first_x, first_y);
+            const int first_w2 = edge2.Evaluate(first_x, first_y);
+
+            auto EdgeRange = [width, height](const EdgeFunction& edge, int w, int& min, int& max) {
+                const int dx = edge.x_step * width;
+                const int dy = edge.y_step * height;
+                min = w + std::min(dx, 0) + std::min(dy, 0);
+                max = w + std::max(dx, 0) + std::max(dy, 0);
+            };
 
-                case registers.output_merger.NotEqual:
-                    pass = z != ref_z;
-                    break;
+            int min_w0, max_w0, min_w1, max_w1, min_w2, max_w2;
+            EdgeRange(edge0, first_w0, min_w0, max_w0);
+            EdgeRange(edge1, first_w1, min_w1, max_w1);
+            EdgeRange(edge2, first_w2, min_w2, max_w2);
 
-                case registers.output_merger.LessThan:
-                    pass = z < ref_z;
-                    break;
+            // If no pixel of the block is covered by the current primitive
+            if (max_w0 < 0 || max_w1 < 0 || max_w2 < 0)
+                continue;
 
-                case registers.output_merger.LessThanOrEqual:
-                    pass = z <= ref_z;
-                    break;
+            const bool fully_covered = min_w0 >= 0 && min_w1 >= 0 && min_w2 >= 0;
+
+            // Shade the block in 2x2 quads, starting at the quad containing the first sample
+            const int quad_extent = 2 * 0x10;
+            const int first_quad_x = first_x & ~(quad_extent - 1);
+            const int first_quad_y = first_y & ~(quad_extent - 1);
+
+            // Calculate the barycentric coordinates w0, w1 and w2 at the first pixel of each quad
+            int w0_row = edge0.Evaluate(first_quad_x + 8, first_quad_y + 8);
+            int w1_row = edge1.Evaluate(first_quad_x + 8, first_quad_y + 8);
+            int w2_row = edge2.Evaluate(first_quad_x + 8, first_quad_y + 8);
+            for (int quad_y = first_quad_y; quad_y <= last_y; quad_y += quad_extent) {
+                int w0 = w0_row, w1 = w1_row, w2 = w2_row;
+                for (int quad_x = first_quad_x; quad_x <= last_x; quad_x += quad_extent) {
+                    Math::Vec4<u8> colors[4];
+                    u32 depths[4];
+                    unsigned mask = 0;
+
+                    for (int i = 0; i < 4; ++i) {
+                        const int x = quad_x + (i % 2) * 0x10 + 8;
+                        const int y = quad_y + (i / 2) * 0x10 + 8;
+                        if (x < first_x || x > last_x || y < first_y || y > last_y)
+                            continue;
+
+                        const int pixel_w0 = w0 + (i % 2) * edge0.x_step + (i / 2) * edge0.y_step;
+                        const int pixel_w1 = w1 + (i % 2) * edge1.x_step + (i / 2) * edge1.y_step;
+                        const int pixel_w2 = w2 + (i % 2) * edge2.x_step + (i / 2) * edge2.y_step;
+
+                        // If current pixel is covered by the current primitive
+                        if (!fully_covered && (pixel_w0 < 0 || pixel_w1 < 0 || pixel_w2 < 0))
+                            continue;
+
+                        if (ShadePixel(triangle, x, y, pixel_w0, pixel_w1, pixel_w2, textures,
+                                       *current_pipeline, colors[i], depths[i]))
+                            mask |= 1 << i;
+                    }
 
-                case registers.output_merger.GreaterThan:
-                    pass = z > ref_z;
-                    break;
+                    if (mask != 0)
+                        WriteQuad(quad_x >> 4, quad_y >> 4, mask, colors, depths, *current_pipeline);
 
-                case registers.output_merger.GreaterThanOrEqual:
-                    pass = z >= ref_z;
-                    break;
+                    w0 += 2 * edge0.x_step;
+                    w1 += 2 * edge1.x_step;
+                    w2 += 2 * edge2.x_step;
                 }
-
-                if (!pass)
-                    continue;
-
-                if (registers.output_merger.depth_write_enable)
-                    SetDepth(x >> 4, y >> 4, z);
+                w0_row += 2 * edge0.y_step;
+                w1_row += 2 * edge1.y_step;
+                w2_row += 2 * edge2.y_step;
             }
+        }
+    }
+}
 
-            auto dest = GetPixel(x >> 4, y >> 4);
-            Math::Vec4<u8> blend_output = combiner_output;
-
-            if (registers.output_merger.alphablend_enable) {
-                auto params = registers.output_merger.alpha_blending;
-
-                auto LookupFactorRGB = [&](decltype(params)::BlendFactor factor) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case params.Zero:
-                        return Math::Vec3<u8>(0, 0, 0);
-
-                    case params.One:
-                        return Math::Vec3<u8>(255, 255, 255);
-
-                    case params.SourceColor:
-                        return combiner_output.rgb();
-
-                    case params.OneMinusSourceColor:
-                        return Math::Vec3<u8>(255 - combiner_output.r(), 255 - combiner_output.g(), 255 - combiner_output.b());
-
-                    case params.DestColor:
-                        return dest.rgb();
-
-                    case params.OneMinusDestColor:
-                        return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
-
-                    case params.SourceAlpha:
-                        return Math::Vec3<u8>(combiner_output.a(), combiner_output.a(), combiner_output.a());
-
-                    case params.OneMinusSourceAlpha:
-                        return Math::Vec3<u8>(255 - combiner_output.a(), 255 - combiner_output.a(), 255 - combiner_output.a());
-
-                    case params.DestAlpha:
-                        return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
-
-                    case params.OneMinusDestAlpha:
-                        return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
-
-                    case params.ConstantColor:
-                        return Math::Vec3<u8>(registers.output_merger.blend_const.r, registers.output_merger.blend_const.g, registers.output_merger.blend_const.b);
+static void RasterizeTile(u32 tile) {
+    const int x_begin = (tile % NUM_TILES_PER_ROW) * TILE_SIZE * 16;
+    const int y_begin = (tile / NUM_TILES_PER_ROW) * TILE_SIZE * 16;
 
-                    case params.OneMinusConstantColor:
-                        return Math::Vec3<u8>(255 - registers.output_merger.blend_const.r, 255 - registers.output_merger.blend_const.g, 255 - registers.output_merger.blend_const.b);
+    // Triangles are drawn in submission order, so that each pixel sees them in primitive order
+    for (u32 index : tile_bins[tile])
+        RasterizeTriangle(triangles[index], x_begin, y_begin, x_begin + TILE_SIZE * 16, y_begin + TILE_SIZE * 16);
+}
 
-                    case params.ConstantAlpha:
-                        return Math::Vec3<u8>(registers.output_merger.blend_const.a, registers.output_merger.blend_const.a, registers.output_merger.blend_const.a);
+/// Index of the next tile of active_tiles to rasterize
+static std::atomic<size_t> next_tile;
 
-                    case params.OneMinusConstantAlpha:
-                        return Math::Vec3<u8>(255 - registers.output_merger.blend_const.a, 255 - registers.output_merger.blend_const.a, 255 - registers.output_merger.blend_const.a);
+/// Rasterizes tiles until all of the current flush have been taken
+static void RasterizeTiles() {
+    size_t index;
+    while ((index = next_tile++) < active_tiles.size())
+        RasterizeTile(active_tiles[index]);
+}
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
+/// Threads helping the emulation thread rasterize tiles, started on the first flush
+static std::vector<std::thread> worker_threads;
+static std::mutex worker_mutex;
+static std::condition_variable work_available;
+static std::condition_variable work_finished;
+static unsigned flush_id = 0;       ///< Incremented for every flush which workers take part in
+static unsigned busy_workers = 0;   ///< Workers which haven't finished their part of the flush yet
+static bool stop_workers = false;
+
+static void WorkerThread(unsigned last_flush_id) {
+    Common::SetCurrentThreadName("RasterizerWorker");
+
+    std::unique_lock<std::mutex> lock(worker_mutex);
+    while (true) {
+        work_available.wait(lock, [&] { return stop_workers || flush_id != last_flush_id; });
+        if (stop_workers)
+            return;
 
-                auto LookupFactorA = [&](decltype(params)::BlendFactor factor) -> u8 {
-                    switch (factor) {
-                    case params.Zero:
-                        return 0;
+        last_flush_id = flush_id;
+        lock.unlock();
+        RasterizeTiles();
+        lock.lock();
 
-                    case params.One:
-                        return 255;
+        if (--busy_workers == 0)
+            work_finished.notify_one();
+    }
+}
 
-                    case params.SourceAlpha:
-                        return combiner_output.a();
+void Flush() {
+    if (triangles.empty())
+        return;
 
-                    case params.OneMinusSourceAlpha:
-                        return 255 - combiner_output.a();
+    current_pipeline = &GetPixelPipeline();
+    SetupRenderTarget(*current_pipeline);
 
-                    case params.DestAlpha:
-                        return dest.a();
+    TrimTextureCache();
+    const auto textures = registers.GetTextures();
+    for (unsigned i = 0; i < textures.size(); ++i) {
+        if (textures[i].enabled)
+            current_textures[i] = &GetCachedTexture(textures[i].config, textures[i].format);
+    }
 
-                    case params.OneMinusDestAlpha:
-                        return 255 - dest.a();
+    next_tile = 0;
 
-                    case params.ConstantAlpha:
-                        return registers.output_merger.blend_const.a;
+    if (active_tiles.size() == 1) {
+        RasterizeTiles();
+    } else {
+        if (worker_threads.empty()) {
+            // The emulation thread rasterizes tiles as well
+            const unsigned num_workers = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+            for (unsigned i = 0; i < num_workers; ++i)
+                worker_threads.emplace_back(WorkerThread, flush_id);
+        }
 
-                    case params.OneMinusConstantAlpha:
-                        return 255 - registers.output_merger.blend_const.a;
+        {
+            std::lock_guard<std::mutex> lock(worker_mutex);
+            busy_workers = static_cast<unsigned>(worker_threads.size());
+            ++flush_id;
+        }
+        work_available.notify_all();
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
-
-                using BlendEquation = decltype(params)::BlendEquation;
-                static auto EvaluateBlendEquation = [](const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
-                                                       const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor,
-                                                       BlendEquation equation) {
-                    Math::Vec4<int> result;
-
-                    auto src_result = (src  *  srcfactor).Cast<int>();
-                    auto dst_result = (dest * destfactor).Cast<int>();
-
-                    switch (equation) {
-                    case BlendEquation::Add:
-                        result = (src_result + dst_result) / 255;
-                        break;
-
-                    case BlendEquation::Subtract:
-                        result = (src_result - dst_result) / 255;
-                        break;
-
-                    case BlendEquation::ReverseSubtract:
-                        result = (dst_result - src_result) / 255;
-                        break;
-
-                    // TODO: How do these two actually work?
-                    //       OpenGL doesn't include the blend factors in the min/max computations,
-                    //       but is this what the 3DS actually does?
-                    case BlendEquation::Min:
-                        result.r() = std::min(src.r(), dest.r());
-                        result.g() = std::min(src.g(), dest.g());
-                        result.b() = std::min(src.b(), dest.b());
-                        result.a() = std::min(src.a(), dest.a());
-                        break;
-
-                    case BlendEquation::Max:
-                        result.r() = std::max(src.r(), dest.r());
-                        result.g() = std::max(src.g(), dest.g());
-                        result.b() = std::max(src.b(), dest.b());
-                        result.a() = std::max(src.a(), dest.a());
-                        break;
-
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
-                        UNIMPLEMENTED();
-                    }
+        RasterizeTiles();
 
-                    return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
-                                    MathUtil::Clamp(result.g(), 0, 255),
-                                    MathUtil::Clamp(result.b(), 0, 255),
-                                    MathUtil::Clamp(result.a(), 0, 255));
-                };
-
-                auto srcfactor = Math::MakeVec(LookupFactorRGB(params.factor_source_rgb),
-                                               LookupFactorA(params.factor_source_a));
-                auto dstfactor = Math::MakeVec(LookupFactorRGB(params.factor_dest_rgb),
-                                               LookupFactorA(params.factor_dest_a));
-
-                blend_output     = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_rgb);
-                blend_output.a() = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_a).a();
-            } else {
-                LOG_CRITICAL(HW_GPU, "logic op: %x", registers.output_merger.logic_op);
-                UNIMPLEMENTED();
-            }
+        std::unique_lock<std::mutex> lock(worker_mutex);
+        work_finished.wait(lock, [] { return busy_workers == 0; });
+    }
 
-            const Math::Vec4<u8> result = {
-                registers.output_merger.red_enable   ? blend_output.r() : dest.r(),
-                registers.output_merger.green_enable ? blend_output.g() : dest.g(),
-                registers.output_merger.blue_enable  ? blend_output.b() : dest.b(),
-                registers.output_merger.alpha_enable ? blend_output.a() : dest.a()
-            };
+    for (u32 tile : active_tiles)
+        tile_bins[tile].clear();
+    active_tiles.clear();
+    triangles.clear();
+
+    // Textures rendered to need to be decoded again
+    const auto& framebuffer = registers.framebuffer;
+    const u32 num_pixels = framebuffer.width * (framebuffer.height + 1);
+    const auto color_format = GPU::Regs::PixelFormat(framebuffer.color_format.Value());
+    InvalidateTextures(framebuffer.GetColorBufferPhysicalAddress(),
+                       num_pixels * GPU::Regs::BytesPerPixel(color_format));
+    if (current_pipeline->depth_test_enable && current_pipeline->depth_write_enable) {
+        InvalidateTextures(framebuffer.GetDepthBufferPhysicalAddress(),
+                           num_pixels * Regs::BytesPerDepthPixel(framebuffer.depth_format));
+    }
+}
 
-            DrawPixel(x >> 4, y >> 4, result);
-        }
+void Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        stop_workers = true;
     }
+    work_available.notify_all();
+
+    for (auto& thread : worker_threads)
+        thread.join();
+    worker_threads.clear();
+    stop_workers = false;
 }
 
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
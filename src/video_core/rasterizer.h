@@ -12,10 +12,20 @@ namespace VertexShader {
 
 namespace Rasterizer {
 
+/**
+ * Submits a triangle for rasterization. Triangles are sorted into screen tiles and only drawn by
+ * Flush, which has to be called before the rasterizer registers or the framebuffer change.
+ */
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2);
 
+/// Draws all triangles submitted since the last flush, rasterizing tiles on all host CPU cores
+void Flush();
+
+/// Stops the threads used for rasterization
+void Shutdown();
+
 } // namespace Rasterizer
 
 } // namespace Pica
@@ -0,0 +1,244 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/file_util.h"
+#include "common/linear_disk_cache.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/profiler.h"
+#include "common/thread.h"
+
+#include "video_core/renderer_opengl/gl_shader_cache.h"
+#include "video_core/renderer_opengl/gl_shader_util.h"
+#include "video_core/renderer_opengl/gl_shaders.h"
+#include "video_core/shader_translator.h"
+#include "video_core/vertex_shader.h"
+
+#include "glsl_optimizer.h"
+
+namespace ShaderCache {
+
+static Common::Profiling::TimingCategory category_shader_translation("Shader translation");
+static Common::Profiling::TimingCategory category_shader_compilation("Shader compilation");
+
+static Common::Profiling::Counter counter_shader_cache_hits("Shader cache hits");
+static Common::Profiling::Counter counter_shader_cache_disk_hits("Shader cache disk hits");
+static Common::Profiling::Counter counter_shader_cache_misses("Shader cache misses");
+static Common::Profiling::Counter counter_shader_cache_fallbacks("Shader cache CPU fallbacks");
+
+/// Upper limit for the number of translation threads
+static const unsigned MAX_TRANSLATION_THREADS = 4;
+
+/// Linked programs, keyed by the hash of the shader memory they were translated from
+static std::unordered_map<u64, GLuint> programs;
+
+/// GLSL read from the cache file which hasn't been compiled yet
+static std::unordered_map<u64, std::string> cached_sources;
+
+/// Optimized vertex shader GLSL, keyed the same way as programs
+static LinearDiskCache<u64, char> disk_cache;
+
+/// Snapshot of the shader memory taken when a shader is queued for translation
+struct TranslationJob {
+    u64 key;
+    std::array<u32, 1024> shader_binary;
+    std::array<u32, 1024> swizzle_patterns;
+};
+
+/// Keys of the queued shaders whose translation hasn't been picked up by GetVertexShaderProgram yet
+static std::unordered_set<u64> pending_keys;
+
+static std::vector<std::thread> translation_threads;
+
+/**
+ * GLSL optimizer shared by the translation threads. glsl-optimizer keeps Mesa's global type and
+ * builtin function tables, which all contexts share unsynchronized and glslopt_cleanup releases,
+ * so only one context exists and only one thread optimizes at a time.
+ */
+static glslopt_ctx* optimizer;
+static std::mutex optimizer_mutex;
+
+// The members below are shared with the translation threads and guarded by job_mutex
+static std::mutex job_mutex;
+static std::condition_variable job_available;
+static std::deque<std::unique_ptr<TranslationJob>> job_queue;
+static std::unordered_map<u64, std::string> translated_sources;
+static bool stop_translation_threads;
+
+class SourceReader : public LinearDiskCacheReader<u64, char> {
+public:
+    void Read(const u64& key, const char* value, u32 value_size) override {
+        cached_sources[key].assign(value, value_size);
+    }
+};
+
+/// Translates a PICA vertex shader to optimized GLSL
+static std::string TranslateVertexShader(const TranslationJob& job) {
+    Common::Profiling::ScopeTimer timer(category_shader_translation);
+
+    std::string source = PICABinToGLSL(job.shader_binary.data(), job.swizzle_patterns.data());
+
+    std::lock_guard<std::mutex> lock(optimizer_mutex);
+    glslopt_shader* shader = glslopt_optimize(optimizer, kGlslOptShaderVertex, source.c_str(), 0);
+    if (glslopt_get_status(shader)) {
+        source = glslopt_get_output(shader);
+    } else {
+        LOG_WARNING(Render_OpenGL, "Failed to optimize vertex shader: %s", glslopt_get_log(shader));
+    }
+    glslopt_shader_delete(shader);
+
+    return source;
+}
+
+static void TranslationThread() {
+    Common::SetCurrentThreadName("ShaderTranslation");
+
+    while (true) {
+        std::unique_ptr<TranslationJob> job;
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_available.wait(lock, [] { return stop_translation_threads || !job_queue.empty(); });
+            if (stop_translation_threads)
+                return;
+
+            job = std::move(job_queue.front());
+            job_queue.pop_front();
+        }
+
+        std::string source = TranslateVertexShader(*job);
+
+        std::lock_guard<std::mutex> lock(job_mutex);
+        translated_sources[job->key] = std::move(source);
+    }
+}
+
+void Init() {
+    const std::string& cache_dir = FileUtil::GetUserPath(D_SHADERCACHE_IDX);
+    if (!FileUtil::Exists(cache_dir))
+        FileUtil::CreateFullPath(cache_dir);
+
+    SourceReader reader;
+    u32 num_entries = disk_cache.OpenAndRead((cache_dir + "vertex_shaders.cache").c_str(), reader);
+    LOG_INFO(Render_OpenGL, "Loaded %u vertex shaders from the shader cache", num_entries);
+
+    // Leave one core to the emulation thread
+    unsigned num_threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    num_threads = std::min(num_threads, MAX_TRANSLATION_THREADS);
+
+    optimizer = glslopt_initialize(kGlslTargetOpenGL);
+
+    stop_translation_threads = false;
+    for (unsigned i = 0; i < num_threads; ++i)
+        translation_threads.emplace_back(TranslationThread);
+}
+
+void Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        stop_translation_threads = true;
+    }
+    job_available.notify_all();
+
+    for (auto& thread : translation_threads)
+        thread.join();
+    translation_threads.clear();
+
+    glslopt_cleanup(optimizer);
+    optimizer = nullptr;
+
+    job_queue.clear();
+    translated_sources.clear();
+    pending_keys.clear();
+
+    for (auto& entry : programs)
+        glDeleteProgram(entry.second);
+
+    programs.clear();
+    cached_sources.clear();
+    disk_cache.Close();
+}
+
+void PrefetchVertexShader() {
+    const u64 key = Pica::VertexShader::GetShaderMemoryHash();
+    if (programs.count(key) || cached_sources.count(key) || pending_keys.count(key))
+        return;
+
+    counter_shader_cache_misses.Add(1);
+    pending_keys.insert(key);
+
+    auto job = Common::make_unique<TranslationJob>();
+    job->key = key;
+    job->shader_binary = Pica::VertexShader::GetShaderBinary();
+    job->swizzle_patterns = Pica::VertexShader::GetSwizzlePatterns();
+
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        job_queue.push_back(std::move(job));
+    }
+    job_available.notify_one();
+}
+
+GLuint GetVertexShaderProgram() {
+    const u64 key = Pica::VertexShader::GetShaderMemoryHash();
+
+    auto it = programs.find(key);
+    if (it != programs.end()) {
+        counter_shader_cache_hits.Add(1);
+        return it->second;
+    }
+
+    std::string source;
+    auto cached_source = cached_sources.find(key);
+    if (cached_source != cached_sources.end()) {
+        counter_shader_cache_disk_hits.Add(1);
+        source = std::move(cached_source->second);
+        cached_sources.erase(cached_source);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            auto translated_source = translated_sources.find(key);
+            if (translated_source != translated_sources.end()) {
+                source = std::move(translated_source->second);
+                translated_sources.erase(translated_source);
+            }
+        }
+
+        if (source.empty()) {
+            // Not translated yet, the caller falls back to running the shader on the CPU
+            PrefetchVertexShader();
+            counter_shader_cache_fallbacks.Add(1);
+            return 0;
+        }
+
+        pending_keys.erase(key);
+        disk_cache.Append(key, source.data(), source.size());
+        disk_cache.Sync();
+    }
+
+    GLuint program;
+    {
+        Common::Profiling::ScopeTimer timer(category_shader_compilation);
+        program = ShaderUtil::LoadShaders(source.c_str(), GLShaders::g_fragment_shader_hw);
+    }
+
+    LOG_DEBUG(Render_OpenGL, "Compiled vertex shader %016llx (%u programs cached)",
+              (unsigned long long)key, (unsigned)programs.size() + 1);
+
+    programs.emplace(key, program);
+    return program;
+}
+
+} // namespace
@@ -0,0 +1,34 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "generated/gl_3_0_core.h"
+
+namespace ShaderCache {
+
+/// Loads the GLSL of previously translated vertex shaders and starts the translation threads
+void Init();
+
+/// Stops the translation threads, deletes all cached programs and closes the shader cache file
+void Shutdown();
+
+/**
+ * Queues the PICA vertex shader currently in shader memory for translation on a worker thread,
+ * unless it has been translated before. Should be called as soon as a new shader was uploaded.
+ */
+void PrefetchVertexShader();
+
+/**
+ * Returns the OpenGL program for the PICA vertex shader currently in shader memory, combined with
+ * the hardware fragment shader. Programs are keyed by the contents of the shader memory rather than
+ * by the entry point, so that games reuploading different shaders to the same offsets get the
+ * right program. Translated shaders are appended to the cache file, so that shaders seen in a
+ * previous run only need to be compiled.
+ * @return The program, or 0 if the shader is still being translated. Its translation is queued if
+ *         that didn't happen yet.
+ */
+GLuint GetVertexShaderProgram();
+
+} // namespace
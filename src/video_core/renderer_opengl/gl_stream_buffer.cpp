@@ -0,0 +1,51 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "video_core/renderer_opengl/gl_stream_buffer.h"
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr size)
+    : target(target), buffer_size(size), position(0), mapped_offset(0) {
+    glGenBuffers(1, &handle);
+    glBindBuffer(target, handle);
+    glBufferData(target, buffer_size, nullptr, GL_STREAM_DRAW);
+}
+
+StreamBuffer::~StreamBuffer() {
+    glDeleteBuffers(1, &handle);
+}
+
+std::pair<u8*, GLintptr> StreamBuffer::Map(GLsizeiptr size, GLintptr alignment) {
+    glBindBuffer(target, handle);
+
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+    position = (position + alignment - 1) / alignment * alignment;
+    if (size > buffer_size) {
+        buffer_size = size;
+        glBufferData(target, buffer_size, nullptr, GL_STREAM_DRAW);
+        position = 0;
+    } else if (position + size > buffer_size) {
+        // Draws submitted earlier keep reading from the orphaned storage
+        access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+        position = 0;
+    } else {
+        access |= GL_MAP_INVALIDATE_RANGE_BIT;
+    }
+
+    mapped_offset = position;
+
+    // Mapping an empty range is an error
+    u8* pointer = (u8*)glMapBufferRange(target, mapped_offset, std::max<GLsizeiptr>(size, 1), access);
+    return std::make_pair(pointer, mapped_offset);
+}
+
+void StreamBuffer::Unmap(GLsizeiptr used_size) {
+    if (used_size > 0)
+        glFlushMappedBufferRange(target, 0, used_size);
+
+    glUnmapBuffer(target);
+    position = mapped_offset + used_size;
+}
@@ -0,0 +1,55 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <utility>
+
+#include "common/common_types.h"
+
+#include "generated/gl_3_0_core.h"
+
+/**
+ * Buffer object which the CPU fills front to back without waiting for the GPU. Each mapping only
+ * covers memory which no submitted draw reads from yet, so it is mapped unsynchronized. Once the
+ * end of the buffer is reached, its storage is orphaned: the driver keeps the old memory alive for
+ * pending draws and writing continues at the start of fresh memory.
+ */
+class StreamBuffer {
+public:
+    /**
+     * Creates the buffer object. Requires a current OpenGL context.
+     * @param target Target the buffer is bound to when mapping it
+     * @param size Initial size of the buffer in bytes, grown if a single mapping needs more
+     */
+    StreamBuffer(GLenum target, GLsizeiptr size);
+    ~StreamBuffer();
+
+    GLuint GetHandle() const {
+        return handle;
+    }
+
+    /**
+     * Binds the buffer and maps the given number of bytes for writing.
+     * @param size Number of bytes to map
+     * @param alignment Alignment of the mapped range's offset in bytes
+     * @return Pointer to the mapped memory and its offset within the buffer
+     */
+    std::pair<u8*, GLintptr> Map(GLsizeiptr size, GLintptr alignment);
+
+    /**
+     * Unmaps the buffer, which must still be bound.
+     * @param used_size Number of bytes written from the start of the mapped range, the rest is
+     *                  reused by the next mapping
+     */
+    void Unmap(GLsizeiptr used_size);
+
+private:
+    GLenum target;
+    GLuint handle;
+    GLsizeiptr buffer_size;
+
+    GLintptr position;          ///< Offset up to which the buffer has been written
+    GLintptr mapped_offset;
+};
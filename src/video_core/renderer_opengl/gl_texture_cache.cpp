@@ -0,0 +1,217 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/hash.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/profiler.h"
+
+#include "core/mem_map.h"
+
+#include "video_core/renderer_opengl/gl_texture_cache.h"
+#include "video_core/texture_decoder.h"
+
+namespace TextureCache {
+
+static Common::Profiling::TimingCategory category_texture_upload("Texture upload");
+
+static Common::Profiling::Counter counter_texture_uploads("Texture uploads");
+static Common::Profiling::Counter counter_texture_reuploads_skipped("Texture re-uploads skipped");
+
+/// Memory used by uploaded textures above which the cache is emptied, in bytes
+static const size_t MAX_CACHED_TEXTURE_BYTES = 128 * 1024 * 1024;
+
+struct CachedTexture {
+    PAddr address;
+    u32 size;                           ///< Size of the encoded texture data in bytes
+    Pica::Regs::TextureFormat format;
+    int width;
+    int height;
+
+    GLuint handle;
+    bool uploaded;                      ///< Whether the texture has storage and contents yet
+    bool invalidated;                   ///< Whether the encoded data may have changed since its upload
+    u64 data_hash;                      ///< Hash of the encoded data at the time of its upload
+};
+
+/// Textures keyed by a hash of their address, format and dimensions
+static std::unordered_map<u64, std::unique_ptr<CachedTexture>> textures;
+
+/// The textures above ordered by address, to find the ones overlapping an invalidated range
+static std::multimap<PAddr, CachedTexture*> textures_by_address;
+
+/// Largest encoded size of the cached textures, bounds how far before a range overlapping ones start
+static u32 max_texture_size = 0;
+
+/// Memory used by the uploaded texels of all cached textures, in bytes
+static size_t cached_texture_bytes = 0;
+
+/// Decoded texels of the texture being uploaded, kept to avoid an allocation per upload
+static std::vector<Math::Vec4<u8>> staging_texels;
+
+static GLenum PICAWrapModeToOpenGL(Pica::Regs::TextureConfig::WrapMode mode) {
+    switch (mode) {
+    case Pica::Regs::TextureConfig::WrapMode::ClampToEdge:
+        return GL_CLAMP_TO_EDGE;
+
+    case Pica::Regs::TextureConfig::WrapMode::Repeat:
+        return GL_REPEAT;
+
+    case Pica::Regs::TextureConfig::WrapMode::MirroredRepeat:
+        return GL_MIRRORED_REPEAT;
+
+    default:
+        LOG_ERROR(Render_OpenGL, "Unknown texture wrap mode %d", (int)mode);
+        return GL_CLAMP_TO_EDGE;
+    }
+}
+
+static void DeleteTexture(const CachedTexture& texture) {
+    auto range = textures_by_address.equal_range(texture.address);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == &texture) {
+            textures_by_address.erase(it);
+            break;
+        }
+    }
+
+    glDeleteTextures(1, &texture.handle);
+    cached_texture_bytes -= texture.width * texture.height * 4;
+}
+
+static void DeleteAllTextures() {
+    for (auto& entry : textures)
+        glDeleteTextures(1, &entry.second->handle);
+
+    // Pages of deleted textures stay watched, which is harmless
+    textures.clear();
+    textures_by_address.clear();
+    max_texture_size = 0;
+    cached_texture_bytes = 0;
+}
+
+/// Decodes the texture data into the bound OpenGL texture, with rows from bottom to top
+static void UploadTexture(CachedTexture& texture, const u8* data) {
+    Common::Profiling::ScopeTimer timer(category_texture_upload);
+
+    const size_t num_texels = texture.width * texture.height;
+    if (staging_texels.size() < num_texels)
+        staging_texels.resize(num_texels);
+
+    Pica::TextureDecoder::DecodeTexture(data, texture.width, texture.height, texture.format,
+                                        &staging_texels[texture.width * (texture.height - 1)], -texture.width);
+
+    if (texture.uploaded) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture.width, texture.height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, staging_texels.data());
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, staging_texels.data());
+        texture.uploaded = true;
+    }
+
+    counter_texture_uploads.Add(1);
+}
+
+void Shutdown() {
+    DeleteAllTextures();
+
+    staging_texels.clear();
+    staging_texels.shrink_to_fit();
+}
+
+void Trim() {
+    if (cached_texture_bytes > MAX_CACHED_TEXTURE_BYTES)
+        DeleteAllTextures();
+}
+
+void BindTexture(const Pica::Regs::FullTextureConfig& pica_texture) {
+    const auto& config = pica_texture.config;
+    const u32 key[4] = { config.GetPhysicalAddress(), (u32)pica_texture.format, config.width, config.height };
+    const u64 hash = Common::ComputeHash64(key, sizeof(key));
+
+    CachedTexture* texture = nullptr;
+
+    auto it = textures.find(hash);
+    if (it != textures.end()) {
+        texture = it->second.get();
+        if (texture->address != key[0] || texture->format != pica_texture.format ||
+            texture->width != (int)config.width || texture->height != (int)config.height) {
+            DeleteTexture(*texture);
+            textures.erase(it);
+            texture = nullptr;
+        }
+    }
+
+    if (texture == nullptr) {
+        std::unique_ptr<CachedTexture> new_texture = Common::make_unique<CachedTexture>();
+        new_texture->address = config.GetPhysicalAddress();
+        new_texture->format = pica_texture.format;
+        new_texture->width = config.width;
+        new_texture->height = config.height;
+        new_texture->size = Pica::Regs::NibblesPerPixel(pica_texture.format) * new_texture->width * new_texture->height / 2;
+        new_texture->uploaded = false;
+        new_texture->invalidated = true;
+        new_texture->data_hash = 0;
+
+        glGenTextures(1, &new_texture->handle);
+        glBindTexture(GL_TEXTURE_2D, new_texture->handle);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        texture = new_texture.get();
+        textures_by_address.emplace(texture->address, texture);
+        max_texture_size = std::max(max_texture_size, texture->size);
+        cached_texture_bytes += texture->width * texture->height * 4;
+        textures.emplace(hash, std::move(new_texture));
+    } else {
+        glBindTexture(GL_TEXTURE_2D, texture->handle);
+    }
+
+    // The wrap modes aren't part of the key, so they are set on every use
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, PICAWrapModeToOpenGL(config.wrap_s));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, PICAWrapModeToOpenGL(config.wrap_t));
+
+    if (!texture->invalidated)
+        return;
+
+    const u8* data = Memory::GetPhysicalPointer(texture->address);
+    if (data == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Texture at invalid address 0x%08x", texture->address);
+        return;
+    }
+
+    // Games often rewrite memory next to textures, or write the same data again
+    const u64 data_hash = Common::ComputeHash64(data, texture->size);
+    if (texture->uploaded && data_hash == texture->data_hash) {
+        counter_texture_reuploads_skipped.Add(1);
+    } else {
+        UploadTexture(*texture, data);
+        texture->data_hash = data_hash;
+    }
+
+    texture->invalidated = false;
+    Memory::MarkTextureRegion(texture->address, texture->size);
+}
+
+void InvalidateRange(PAddr addr, u32 size) {
+    const PAddr search_start = (addr > max_texture_size) ? addr - max_texture_size : 0;
+    auto it = textures_by_address.lower_bound(search_start);
+    auto end = textures_by_address.lower_bound(addr + size);
+
+    for (; it != end; ++it) {
+        CachedTexture& texture = *it->second;
+        if (addr < texture.address + texture.size)
+            texture.invalidated = true;
+    }
+}
+
+} // namespace
@@ -0,0 +1,37 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/pica.h"
+
+#include "generated/gl_3_0_core.h"
+
+namespace TextureCache {
+
+/// Deletes all cached textures. Requires a current OpenGL context.
+void Shutdown();
+
+/**
+ * Deletes all cached textures if they use more memory than the cache allows. Must not be called
+ * while textures bound by BindTexture are still needed for drawing.
+ */
+void Trim();
+
+/**
+ * Binds the OpenGL texture holding the given PICA texture to GL_TEXTURE_2D of the active texture
+ * unit. Textures are keyed by their address, format and dimensions. Ones whose memory has been
+ * invalidated are hashed again, and only decoded and uploaded if their contents really changed.
+ */
+void BindTexture(const Pica::Regs::FullTextureConfig& texture);
+
+/**
+ * Marks the cached textures overlapping the given physical memory region as invalidated, so that
+ * their contents are checked for changes on their next use. Doesn't require an OpenGL context.
+ */
+void InvalidateRange(PAddr addr, u32 size);
+
+} // namespace
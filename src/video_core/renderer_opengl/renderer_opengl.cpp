@@ -10,27 +10,27 @@
 
 #include "common/emu_window.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
 #include "common/profiler_reporting.h"
 
 #include "video_core/video_core.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
+#include "video_core/renderer_opengl/gl_shader_cache.h"
 #include "video_core/renderer_opengl/gl_shader_util.h"
 #include "video_core/renderer_opengl/gl_shaders.h"
+#include "video_core/renderer_opengl/gl_texture_cache.h"
 
 #include "video_core/pica.h"
 #include "video_core/shader_translator.h"
 #include "video_core/vertex_shader.h"
-#include "video_core/debug_utils/debug_utils.h"
 
 #include <algorithm>
 
-std::map<u32, GLuint> g_tex_cache;
+/// Initial sizes of the stream buffers batches are written to, in bytes
+static const GLsizeiptr HW_VERTEX_STREAM_SIZE = 16 * 1024 * 1024;
+static const GLsizeiptr HW_INDEX_STREAM_SIZE = 1024 * 1024;
 
 GLuint g_cur_shader = -1;
-u32 g_cur_shader_main = -1;
-std::map<u32, GLuint> g_shader_cache;
-
-std::vector<RawVertex> g_vertex_batch;
 
 bool g_did_render;
 
@@ -73,12 +73,12 @@ static std::array<GLfloat, 3*2> MakeOrthographicMatrix(const float width, const
 RendererOpenGL::RendererOpenGL() {
     resolution_width  = std::max(VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth);
     resolution_height = VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight;
-    optimizer_ctx = glslopt_initialize(kGlslTargetOpenGL);
 }
 
 /// RendererOpenGL destructor
 RendererOpenGL::~RendererOpenGL() {
-    glslopt_cleanup(optimizer_ctx);
+    ShaderCache::Shutdown();
+    TextureCache::Shutdown();
 }
 
 /// Swap buffers (render frame)
@@ -139,7 +139,7 @@ void RendererOpenGL::SwapBuffers() {
         aggregator->AddFrame(profiler.GetPreviousFrameResults());
     }
     glBindVertexArray(hw_vertex_array_handle);
-    glUseProgram(hw_program_id);
+    glUseProgram(g_cur_shader);
 
 #ifdef USE_OGL_RENDERER
     // TODO: check if really needed
@@ -264,38 +264,50 @@ void RendererOpenGL::InitOpenGLObjects() {
     
     // Hardware renderer setup
     hw_program_id = ShaderUtil::LoadShaders(GLShaders::g_vertex_shader_hw, GLShaders::g_fragment_shader_hw);
-    attrib_v[0] = glGetAttribLocation(hw_program_id, "v0");
-    attrib_v[1] = glGetAttribLocation(hw_program_id, "v1");
-    attrib_v[2] = glGetAttribLocation(hw_program_id, "v2");
-    attrib_v[3] = glGetAttribLocation(hw_program_id, "v3");
-    attrib_v[4] = glGetAttribLocation(hw_program_id, "v4");
-    attrib_v[5] = glGetAttribLocation(hw_program_id, "v5");
-    attrib_v[6] = glGetAttribLocation(hw_program_id, "v6");
-    attrib_v[7] = glGetAttribLocation(hw_program_id, "v7");
-    
-    uniform_alphatest_func = glGetUniformLocation(hw_program_id, "alphatest_func");
-    uniform_alphatest_ref = glGetUniformLocation(hw_program_id, "alphatest_ref");
-
-    uniform_tex = glGetUniformLocation(hw_program_id, "tex0");
-    uniform_tex1 = glGetUniformLocation(hw_program_id, "tex1");
-    uniform_tex2 = glGetUniformLocation(hw_program_id, "tex2");
-    uniform_tevs = glGetUniformLocation(hw_program_id, "tevs");
-    uniform_out_maps = glGetUniformLocation(hw_program_id, "out_maps");
-
-    glUniform1i(uniform_tex, 0);
-    glUniform1i(uniform_tex1, 1);
-    glUniform1i(uniform_tex2, 2);
-    
-    glGenBuffers(1, &hw_vertex_buffer_handle);
 
     // Generate VAO
     glGenVertexArrays(1, &hw_vertex_array_handle);
     glBindVertexArray(hw_vertex_array_handle);
 
-    // Attach vertex data to VAO
-    glBindBuffer(GL_ARRAY_BUFFER, hw_vertex_buffer_handle);
+    // Attach vertex data to VAO, the index buffer binding is part of the VAO state
+    hw_vertex_stream = Common::make_unique<StreamBuffer>(GL_ARRAY_BUFFER, HW_VERTEX_STREAM_SIZE);
+    hw_index_stream = Common::make_unique<StreamBuffer>(GL_ELEMENT_ARRAY_BUFFER, HW_INDEX_STREAM_SIZE);
 
-    glUseProgram(hw_program_id);
+    UseHWProgram(hw_program_id);
+
+    glGenFramebuffers(2, hw_framebuffers);
+    glGenRenderbuffers(2, hw_framedepthbuffers);
+}
+
+void RendererOpenGL::UseHWProgram(GLuint program) {
+    g_cur_shader = program;
+    glUseProgram(program);
+
+    attrib_v[0] = glGetAttribLocation(program, "v0");
+    attrib_v[1] = glGetAttribLocation(program, "v1");
+    attrib_v[2] = glGetAttribLocation(program, "v2");
+    attrib_v[3] = glGetAttribLocation(program, "v3");
+    attrib_v[4] = glGetAttribLocation(program, "v4");
+    attrib_v[5] = glGetAttribLocation(program, "v5");
+    attrib_v[6] = glGetAttribLocation(program, "v6");
+    attrib_v[7] = glGetAttribLocation(program, "v7");
+
+    uniform_c = glGetUniformLocation(program, "c");
+    uniform_b = glGetUniformLocation(program, "b");
+    uniform_i = glGetUniformLocation(program, "i");
+
+    uniform_alphatest_func = glGetUniformLocation(program, "alphatest_func");
+    uniform_alphatest_ref = glGetUniformLocation(program, "alphatest_ref");
+
+    uniform_tex = glGetUniformLocation(program, "tex0");
+    uniform_tex1 = glGetUniformLocation(program, "tex1");
+    uniform_tex2 = glGetUniformLocation(program, "tex2");
+    uniform_tevs = glGetUniformLocation(program, "tevs");
+    uniform_out_maps = glGetUniformLocation(program, "out_maps");
+
+    glUniform1i(uniform_tex, 0);
+    glUniform1i(uniform_tex1, 1);
+    glUniform1i(uniform_tex2, 2);
 
     for (int i = 0; i < 8; i++) {
         if(attrib_v[i] != -1){
@@ -303,9 +315,21 @@ void RendererOpenGL::InitOpenGLObjects() {
             glEnableVertexAttribArray(attrib_v[i]);
         }
     }
+}
 
-    glGenFramebuffers(2, hw_framebuffers);
-    glGenRenderbuffers(2, hw_framedepthbuffers);
+void RendererOpenGL::UploadVertexShaderUniforms() {
+    for (u32 i = 0; i < 16; ++i)
+        SetUniformBool(i, Pica::VertexShader::GetBoolUniform(i));
+
+    SetUniformInts(0, (u32*)Pica::registers.vs_int_uniforms);
+
+    for (u32 i = 0; i < 96; ++i) {
+        const auto& uniform = Pica::VertexShader::GetFloatUniform(i);
+        const float values[4] = {
+            uniform.x.ToFloat32(), uniform.y.ToFloat32(), uniform.z.ToFloat32(), uniform.w.ToFloat32()
+        };
+        SetUniformFloats(i, values);
+    }
 }
 
 void RendererOpenGL::ConfigureFramebufferTexture(TextureInfo& texture,
@@ -494,9 +518,31 @@ GLenum PICABlendFactorToOpenGL(u32 factor)
     }
 }
 
-void RendererOpenGL::BeginBatch() {
+GLenum PICATopologyToOpenGL(Pica::Regs::TriangleTopology topology)
+{
+    switch (topology) {
+    case Pica::Regs::TriangleTopology::List:
+    case Pica::Regs::TriangleTopology::ListIndexed:
+        return GL_TRIANGLES;
+
+    case Pica::Regs::TriangleTopology::Strip:
+        return GL_TRIANGLE_STRIP;
+
+    case Pica::Regs::TriangleTopology::Fan:
+        return GL_TRIANGLE_FAN;
+
+    default:
+        LOG_ERROR(Render_OpenGL, "Unknown triangle topology %d", (int)topology);
+        return GL_TRIANGLES;
+    }
+}
+
+bool RendererOpenGL::BeginBatch() {
     render_window->MakeCurrent();
 
+    batch_num_vertices = 0;
+    batch_num_indices = 0;
+
     if (Pica::registers.output_merger.depth_test_enable.Value()) {
         glEnable(GL_DEPTH_TEST);
     } else {
@@ -570,66 +616,23 @@ void RendererOpenGL::BeginBatch() {
     //exit(0);
     
 #ifdef USE_OGL_VTXSHADER
-    // Switch shaders
-    // TODO: Should never use g_vertex_shader_hw if using glsl shaders for rendering, but for now just switch every time
-    //if (g_cur_shader_main != Pica::registers.vs_main_offset) {
-        g_cur_shader_main = Pica::registers.vs_main_offset;
-
-        std::map<u32, GLuint>::iterator cachedShader = g_shader_cache.find(Pica::registers.vs_main_offset);
-        if (cachedShader != g_shader_cache.end()) {
-            g_cur_shader = cachedShader->second;
-        } else {
-            std::string vertex = PICABinToGLSL(Pica::VertexShader::GetShaderBinary().data(), Pica::VertexShader::GetSwizzlePatterns().data());
-            char vtxshader[vertex.length()+1];
-            strcpy(vtxshader,vertex.c_str());
-            glslopt_shader* shader = glslopt_optimize(optimizer_ctx,kGlslOptShaderVertex,vtxshader,0);
-            if(glslopt_get_status(shader)){
-                g_cur_shader = ShaderUtil::LoadShaders(glslopt_get_output(shader), GLShaders::g_fragment_shader_hw);
-            }else{
-                g_cur_shader = ShaderUtil::LoadShaders(vertex.c_str(), GLShaders::g_fragment_shader_hw);
-            }
-            glslopt_shader_delete(shader);
-            g_shader_cache.insert(std::pair<u32, GLuint>(Pica::registers.vs_main_offset, g_cur_shader));
-        }
+    GLuint program = ShaderCache::GetVertexShaderProgram();
+    bool use_vertex_shader = (program != 0);
+    if (!use_vertex_shader)
+        program = hw_program_id;
+#else
+    GLuint program = hw_program_id;
+    bool use_vertex_shader = false;
+#endif
 
-        glUseProgram(g_cur_shader);
-
-        // TODO: probably a bunch of redundant stuff in here
-        attrib_v[0] = glGetAttribLocation(g_cur_shader, "v0");
-        attrib_v[1] = glGetAttribLocation(g_cur_shader, "v1");
-        attrib_v[2] = glGetAttribLocation(g_cur_shader, "v2");
-        attrib_v[3] = glGetAttribLocation(g_cur_shader, "v3");
-        attrib_v[4] = glGetAttribLocation(g_cur_shader, "v4");
-        attrib_v[5] = glGetAttribLocation(g_cur_shader, "v5");
-        attrib_v[6] = glGetAttribLocation(g_cur_shader, "v6");
-        attrib_v[7] = glGetAttribLocation(g_cur_shader, "v7");
-
-        uniform_c = glGetUniformLocation(g_cur_shader, "c");
-        uniform_b = glGetUniformLocation(g_cur_shader, "b");
-        uniform_i = glGetUniformLocation(g_cur_shader, "i");
-
-        uniform_alphatest_func = glGetUniformLocation(g_cur_shader, "alphatest_func");
-        uniform_alphatest_ref = glGetUniformLocation(g_cur_shader, "alphatest_ref");
-
-        uniform_tex = glGetUniformLocation(g_cur_shader, "tex0");
-        uniform_tex1 = glGetUniformLocation(g_cur_shader, "tex1");
-        uniform_tex2 = glGetUniformLocation(g_cur_shader, "tex2");
-        uniform_tevs = glGetUniformLocation(g_cur_shader, "tevs");
-        uniform_out_maps = glGetUniformLocation(g_cur_shader, "out_maps");
-
-        glUniform1i(uniform_tex, 0);
-        glUniform1i(uniform_tex1, 1);
-        glUniform1i(uniform_tex2, 2);
-        
+    if (program != g_cur_shader) {
+        UseHWProgram(program);
+
+        // Uniform values are per program, the new one only has those set while it was current
+        if (use_vertex_shader)
+            UploadVertexShaderUniforms();
+    }
 
-        for (int i = 0; i < 8; i++) {
-            if(attrib_v[i] != -1){
-                glVertexAttribPointer(attrib_v[i], 4, GL_FLOAT, GL_FALSE, 8 * 4 * sizeof(float), (GLvoid*)(i * 4 * sizeof(float)));
-                glEnableVertexAttribArray(attrib_v[i]);
-            }
-        }
-    //}
-#endif
     for (int i = 0; i < 7; ++i) {
         const auto& output_register_map = Pica::registers.vs_output_attributes[i];
 
@@ -661,61 +664,32 @@ void RendererOpenGL::BeginBatch() {
         glUniform1i(uniform_alphatest_func, 1);
     }
 
-    auto pica_textures = Pica::registers.GetTextures();
+    // Only safe while no texture of the previous batch is needed anymore
+    TextureCache::Trim();
 
-    // Upload or use textures
+    auto pica_textures = Pica::registers.GetTextures();
     for (int i = 0; i < 3; ++i) {
-        const auto& cur_texture = pica_textures[i];
-        if (cur_texture.enabled) {
-            u32 tex_paddr = cur_texture.config.GetPhysicalAddress();
-
-            if (i == 0) {
-                glActiveTexture(GL_TEXTURE0);
-            } else if (i == 1) {
-                glActiveTexture(GL_TEXTURE1);
-            } else {
-                glActiveTexture(GL_TEXTURE2);
-            }
-
-            std::map<u32, GLuint>::iterator cached_tex = g_tex_cache.find(tex_paddr);
-            if (cached_tex != g_tex_cache.end()) {
-                glBindTexture(GL_TEXTURE_2D, cached_tex->second);
-            } else {
-                GLuint new_tex_handle;
-                glGenTextures(1, &new_tex_handle);
-                glBindTexture(GL_TEXTURE_2D, new_tex_handle);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, cur_texture.config.wrap_s == Pica::Regs::TextureConfig::WrapMode::ClampToEdge ? GL_CLAMP_TO_EDGE : (cur_texture.config.wrap_s == Pica::Regs::TextureConfig::WrapMode::Repeat ? GL_REPEAT : GL_MIRRORED_REPEAT));
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, cur_texture.config.wrap_t == Pica::Regs::TextureConfig::WrapMode::ClampToEdge ? GL_CLAMP_TO_EDGE : (cur_texture.config.wrap_t == Pica::Regs::TextureConfig::WrapMode::Repeat ? GL_REPEAT : GL_MIRRORED_REPEAT));
-
-                Math::Vec4<u8>* rgba_tex = new Math::Vec4<u8>[cur_texture.config.width * cur_texture.config.height];
-
-                auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(cur_texture.config, cur_texture.format);
-
-                for (int i = 0; i < info.width; i++)
-                {
-                    for (int j = 0; j < info.height; j++)
-                    {
-                        rgba_tex[i + info.width * j] = Pica::DebugUtils::LookupTexture(Memory::GetPointer(Pica::PAddrToVAddr(tex_paddr)), i, info.height - 1 - j, info);
-                    }
-                }
-
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_tex);
-
-                delete rgba_tex;
-
-                g_tex_cache.insert(std::pair<u32, GLuint>(tex_paddr, new_tex_handle));
-            }
+        if (pica_textures[i].enabled) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            TextureCache::BindTexture(pica_textures[i]);
         }
     }
+
+    return use_vertex_shader;
 }
 
-void RendererOpenGL::DrawTriangle(const RawVertex& v0, const RawVertex& v1, const RawVertex& v2) {
-    g_vertex_batch.push_back(v0);
-    g_vertex_batch.push_back(v1);
-    g_vertex_batch.push_back(v2);
+RawVertex* RendererOpenGL::AllocateVertices(u32 count) {
+    auto mapping = hw_vertex_stream->Map(count * sizeof(RawVertex), sizeof(RawVertex));
+    batch_vertex_offset = mapping.second;
+    batch_num_vertices = count;
+    return (RawVertex*)mapping.first;
+}
+
+u16* RendererOpenGL::AllocateIndices(u32 count) {
+    auto mapping = hw_index_stream->Map(count * sizeof(u16), sizeof(u16));
+    batch_index_offset = mapping.second;
+    batch_num_indices = count;
+    return (u16*)mapping.first;
 }
 
 void RendererOpenGL::EndBatch() {
@@ -739,17 +713,35 @@ void RendererOpenGL::EndBatch() {
         g_last_fb = cur_fb;
     //}
 
-    glBindBuffer(GL_ARRAY_BUFFER, hw_vertex_buffer_handle);
-    glBufferData(GL_ARRAY_BUFFER, g_vertex_batch.size() * sizeof(RawVertex), g_vertex_batch.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, hw_vertex_stream->GetHandle());
+    hw_vertex_stream->Unmap(batch_num_vertices * sizeof(RawVertex));
+
+    // GL 3.0 has no base vertex for indexed draws, so the attributes point at the batch instead
+    for (int i = 0; i < 8; i++) {
+        if(attrib_v[i] != -1){
+            glVertexAttribPointer(attrib_v[i], 4, GL_FLOAT, GL_FALSE, sizeof(RawVertex), (GLvoid*)(batch_vertex_offset + i * 4 * sizeof(float)));
+        }
+    }
+
+    GLenum mode = PICATopologyToOpenGL(Pica::registers.triangle_topology.Value());
+    if (batch_num_indices != 0) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hw_index_stream->GetHandle());
+        hw_index_stream->Unmap(batch_num_indices * sizeof(u16));
 
-    glDrawArrays(GL_TRIANGLES, 0, g_vertex_batch.size());
-    g_vertex_batch.clear();
+        glDrawElements(mode, batch_num_indices, GL_UNSIGNED_SHORT, (GLvoid*)batch_index_offset);
+    } else {
+        glDrawArrays(mode, 0, batch_num_vertices);
+    }
 
     g_did_render = 1;
 }
 
 void RendererOpenGL::SetUniformBool(u32 index, int value) {
 #ifdef USE_OGL_VTXSHADER
+    // The fallback program has no vertex shader uniforms
+    if (g_cur_shader == hw_program_id)
+        return;
+
     render_window->MakeCurrent();
     glUniform1i(uniform_b + index, value);
 #endif
@@ -757,6 +749,10 @@ void RendererOpenGL::SetUniformBool(u32 index, int value) {
 
 void RendererOpenGL::SetUniformInts(u32 index, const u32* values) {
 #ifdef USE_OGL_VTXSHADER
+    // The fallback program has no vertex shader uniforms
+    if (g_cur_shader == hw_program_id)
+        return;
+
     render_window->MakeCurrent();
     glUniform4iv(uniform_i + index, 1, (const GLint*)values);
 #endif
@@ -764,22 +760,21 @@ void RendererOpenGL::SetUniformInts(u32 index, const u32* values) {
 
 void RendererOpenGL::SetUniformFloats(u32 index, const float* values) {
 #ifdef USE_OGL_VTXSHADER
+    // The fallback program has no vertex shader uniforms
+    if (g_cur_shader == hw_program_id)
+        return;
+
     render_window->MakeCurrent();
     glUniform4fv(uniform_c + index, 1, values);
 #endif
 }
 
-void RendererOpenGL::NotifyDMACopy(u32 address, u32 size) {
-    // Flush any texture that falls in the overwritten region
-    // TODO: Should maintain size of tex and do actual check for region overlap, else assume that DMA always covers start address
-    for (auto iter = g_tex_cache.begin(); iter != g_tex_cache.end();) {
-        if ((u32)iter->first >= address && (u32)iter->first <= address + size) {
-            glDeleteTextures(1, &iter->second);
-            iter = g_tex_cache.erase(iter);
-        } else {
-            ++iter;
-        }
-    }
+void RendererOpenGL::InvalidateTextures(PAddr addr, u32 size) {
+    TextureCache::InvalidateRange(addr, size);
+}
+
+void RendererOpenGL::PrefetchVertexShader() {
+    ShaderCache::PrefetchVertexShader();
 }
 
 /// Updates the framerate
@@ -806,6 +801,7 @@ void RendererOpenGL::Init() {
 
     LOG_INFO(Render_OpenGL, "GL_VERSION: %s", glGetString(GL_VERSION));
     InitOpenGLObjects();
+    ShaderCache::Init();
 }
 
 /// Shutdown the renderer
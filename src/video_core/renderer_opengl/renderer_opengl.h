@@ -5,6 +5,7 @@
 #pragma once
 
 #include <array>
+#include <memory>
 
 #include "generated/gl_3_0_core.h"
 
@@ -14,8 +15,7 @@
 #include "core/hw/gpu.h"
 
 #include "video_core/renderer_base.h"
-
-#include "glsl_optimizer.h"
+#include "video_core/renderer_opengl/gl_stream_buffer.h"
 
 #define USE_OGL_RENDERER
 #define USE_OGL_VTXSHADER
@@ -50,15 +50,41 @@ public:
     /// Shutdown the renderer
     void ShutDown() override;
 
-    void BeginBatch();
-    void DrawTriangle(const RawVertex& v0, const RawVertex& v1, const RawVertex& v2);
+    /**
+     * Sets up the OpenGL state for drawing the current batch.
+     * @return True if the batch is drawn with the translated vertex shader, false if it expects
+     *         vertices shaded on the CPU since the translated shader isn't ready yet
+     */
+    bool BeginBatch();
+
+    /**
+     * Reserves space for the vertices of the current batch in the vertex stream buffer. Must be
+     * called once per batch, between BeginBatch and EndBatch.
+     * @param count Number of vertices, which are drawn in order unless indices are provided
+     * @return Mapped memory to write the vertices to, valid until EndBatch
+     */
+    RawVertex* AllocateVertices(u32 count);
+
+    /**
+     * Reserves space for the indices of the current batch in the index stream buffer. Optional,
+     * must be called after AllocateVertices.
+     * @param count Number of indices, each relative to the first allocated vertex
+     * @return Mapped memory to write the indices to, valid until EndBatch
+     */
+    u16* AllocateIndices(u32 count);
+
+    /// Draws the allocated vertices using the PICA triangle topology
     void EndBatch();
 
     void SetUniformBool(u32 index, int value);
     void SetUniformInts(u32 index, const u32* values);
     void SetUniformFloats(u32 index, const float* values);
 
-    void NotifyDMACopy(u32 address, u32 size);
+    /// Makes the cached textures overlapping the given physical memory region check for changes
+    void InvalidateTextures(PAddr addr, u32 size);
+
+    /// Starts translating the vertex shader in shader memory ahead of its first use
+    void PrefetchVertexShader();
 
 private:
     /// Structure used for storing information about the textures for each 3DS screen
@@ -72,6 +98,12 @@ private:
     };
 
     void InitOpenGLObjects();
+
+    /// Makes the given program current and looks up its attribute and uniform locations
+    void UseHWProgram(GLuint program);
+
+    /// Uploads all vertex shader uniforms to the current program
+    void UploadVertexShaderUniforms();
     
     static void ConfigureFramebufferTexture(TextureInfo& texture,
                                             const GPU::Regs::FramebufferConfig& framebuffer);
@@ -110,7 +142,13 @@ private:
     // Hardware renderer
     GLuint hw_program_id;
     GLuint hw_vertex_array_handle;
-    GLuint hw_vertex_buffer_handle;
+    std::unique_ptr<StreamBuffer> hw_vertex_stream;
+    std::unique_ptr<StreamBuffer> hw_index_stream;
+    // Parts of the stream buffers written by the current batch
+    GLintptr batch_vertex_offset;
+    u32 batch_num_vertices;
+    GLintptr batch_index_offset;
+    u32 batch_num_indices;
     GLuint hw_framebuffers[2];
     GLuint hw_framedepthbuffers[2];
     // Hardware vertex shader
@@ -127,7 +165,4 @@ private:
     GLuint uniform_tevs;
     GLuint uniform_out_maps;
     GLuint uniform_tex_envs;
-    
-    //GLSL Optimizer
-    glslopt_ctx* optimizer_ctx;
 };
@@ -0,0 +1,729 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstddef>
+#include <cstring>
+
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/memory_util.h"
+#include "common/x64_emitter.h"
+
+#include "shader_jit.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+using nihstro::RegisterType;
+using nihstro::SourceRegister;
+
+using namespace X64;
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Size of the executable memory holding the generated code
+static const size_t CODE_BUFFER_SIZE = 4 * 1024 * 1024;
+
+/// Upper bound for the size of the code generated for a single program
+static const size_t MAX_PROGRAM_CODE_SIZE = 512 * 1024;
+
+// Registers holding pointers used throughout the generated code
+static const Reg STATE = RBX;       ///< JitState
+static const Reg UNIFORMS = RBP;    ///< Float uniforms
+static const Reg CONSTANTS = R12;   ///< JitConstants
+static const Reg SAVED_RSP = R13;   ///< Stack pointer after the prologue, restored by END
+
+/**
+ * Stack space reserved by the prologue, keeping RSP 16-byte aligned for calls. It holds the zero
+ * checked by the return checks of the outermost level.
+ */
+static const u32 STACK_ADJUSTMENT = 24;
+
+/**
+ * Set in the final offsets pushed by CALL. Each CALL, IF or LOOP pushes 16 bytes on the stack, and
+ * the final offset of a CALL is only compared with the innermost of these, as in the interpreter.
+ * The tag tells CALL frames from IF frames (which hold zero) and LOOP frames (which hold the
+ * remaining iteration count).
+ */
+static const u32 CALL_TAG = 0x80000000;
+
+/// Constants used by the generated code, stored at the start of the (page aligned) code buffer
+struct JitConstants {
+    u32 sign_mask[4];
+    u32 abs_mask[4];
+    float one[4];
+    float two_pow_23[4];    ///< Floats of at least this magnitude have no fractional part
+    double one_double[2];
+    u32 dest_masks[16][4];  ///< For each destination mask, all bits set in the enabled components
+};
+
+/// Offset of a field of JitState, as used for addressing it from the generated code
+#define STATE_OFFSET(field) static_cast<s32>(offsetof(JitState, field))
+
+/// Offset of a field of JitConstants, as used for addressing it from the generated code
+#define CONSTANT_OFFSET(field) static_cast<s32>(offsetof(JitConstants, field))
+
+static s32 RegisterOffset(RegisterType type, int index) {
+    const s32 register_size = sizeof(Math::Vec4<float24>);
+    switch (type) {
+    case RegisterType::Input:
+        return STATE_OFFSET(input_registers) + index * register_size;
+
+    case RegisterType::Temporary:
+        return STATE_OFFSET(temporary_registers) + index * register_size;
+
+    case RegisterType::Output:
+    default:
+        return STATE_OFFSET(output_registers) + index * register_size;
+    }
+}
+
+/**
+ * Loads the register read by a source operand with relative addressing into relative_source.
+ * Called by the generated code, as the register file depends on the address register's value.
+ */
+static void LoadRelativeSource(JitState* state, const DecodedSource* source, s32 offset) {
+    const SourceRegister reg = source->reg + offset;
+    const int index = reg.GetIndex();
+
+    switch (reg.GetRegisterType()) {
+    case RegisterType::Input:
+        state->relative_source = state->input_registers[index];
+        break;
+
+    case RegisterType::Temporary:
+        state->relative_source = state->temporary_registers[index];
+        break;
+
+    case RegisterType::FloatUniform:
+        if (index >= 0 && index < 96) {
+            state->relative_source = state->float_uniforms[index];
+            break;
+        }
+        // Fall through
+
+    default:
+        std::memset(&state->relative_source, 0, sizeof(state->relative_source));
+        break;
+    }
+}
+
+ShaderJit::ShaderJit() {
+    code_buffer = static_cast<u8*>(AllocateExecutableMemory(CODE_BUFFER_SIZE, false));
+
+    JitConstants values;
+    for (int i = 0; i < 4; ++i) {
+        values.sign_mask[i] = 0x80000000;
+        values.abs_mask[i] = 0x7FFFFFFF;
+        values.one[i] = 1.0f;
+        values.two_pow_23[i] = 8388608.0f;
+    }
+    values.one_double[0] = values.one_double[1] = 1.0;
+    for (int mask = 0; mask < 16; ++mask) {
+        for (int i = 0; i < 4; ++i)
+            values.dest_masks[mask][i] = (mask & (1 << i)) ? 0xFFFFFFFF : 0;
+    }
+
+    constants = code_buffer;
+    std::memcpy(constants, &values, sizeof(values));
+
+    const size_t code_offset = (sizeof(JitConstants) + 15) & ~15;
+    emit = Common::make_unique<Emitter>(code_buffer + code_offset, CODE_BUFFER_SIZE - code_offset);
+}
+
+ShaderJit::~ShaderJit() {
+    FreeMemoryPages(code_buffer, CODE_BUFFER_SIZE);
+}
+
+bool ShaderJit::IsFull() const {
+    return emit->GetSpaceLeft() < MAX_PROGRAM_CODE_SIZE;
+}
+
+void ShaderJit::Clear() {
+    emit->SetCodePtr(code_buffer + ((sizeof(JitConstants) + 15) & ~15));
+}
+
+JitProgram ShaderJit::Compile(const DecodedProgram& program) {
+    ASSERT(!IsFull());
+
+    const u32 program_size = program.instructions.size();
+    this->program = &program;
+    reachable.assign(program_size, false);
+    return_offsets.assign(program_size + 1, false);
+    visited_ranges.clear();
+    unsupported = false;
+    labels.assign(program_size, nullptr);
+    label_blocks.assign(program_size, 0);
+    compile_counts.assign(program_size, 0);
+    fixups.clear();
+    exit_jumps.clear();
+    next_block_id = 0;
+
+    MarkReachable(program.entry_point, program_size);
+    if (unsupported)
+        return nullptr;
+
+    u8* const entry = emit->GetCodePtr();
+
+    emit->PUSH(RBX);
+    emit->PUSH(RBP);
+    emit->PUSH(R12);
+    emit->PUSH(R13);
+    emit->ALU64(ALU_SUB, RSP, STACK_ADJUSTMENT);
+    emit->MOV(RSP, 8, 0u);
+    emit->MOV64(STATE, ABI_PARAM1);
+    emit->MOV64(UNIFORMS, STATE, STATE_OFFSET(float_uniforms));
+    emit->MOV64(CONSTANTS, reinterpret_cast<u64>(constants));
+    emit->MOV64(SAVED_RSP, RSP);
+    fixups.push_back({ emit->JMP(), program.entry_point, 0 });
+
+    if (!CompileBlock(0, program_size)) {
+        emit->SetCodePtr(entry);
+        return nullptr;
+    }
+
+    // Running past the end of the shader memory ends the program as well
+    emit->MOV64(RSP, SAVED_RSP);
+    for (u8* jump : exit_jumps)
+        emit->SetJumpTarget(jump);
+    emit->ALU64(ALU_ADD, RSP, STACK_ADJUSTMENT);
+    emit->POP(R13);
+    emit->POP(R12);
+    emit->POP(RBP);
+    emit->POP(RBX);
+    emit->RET();
+
+    for (const Fixup& fixup : fixups) {
+        // Jumps have to land in the block they come from, and calls in the outermost one. Targets
+        // compiled several times (see the LOOP quirk below) are ambiguous.
+        if (fixup.target >= program_size || compile_counts[fixup.target] != 1 ||
+            label_blocks[fixup.target] != fixup.block_id) {
+            emit->SetCodePtr(entry);
+            return nullptr;
+        }
+        emit->SetJumpTarget(fixup.jump_end, labels[fixup.target]);
+    }
+
+    LOG_DEBUG(HW_GPU, "Compiled vertex shader at offset %u to %u bytes of code",
+              program.entry_point, static_cast<unsigned>(emit->GetCodePtr() - entry));
+    return reinterpret_cast<JitProgram>(entry);
+}
+
+void ShaderJit::MarkReachable(u32 begin, u32 end) {
+    if (!visited_ranges.insert(static_cast<u64>(begin) << 32 | end).second)
+        return;
+
+    for (u32 offset = begin; offset < end; ++offset) {
+        const DecodedInstruction& instr = program->instructions[offset];
+        reachable[offset] = true;
+
+        if (instr.type == OpCode::Type::Arithmetic || instr.type == OpCode::Type::MultiplyAdd)
+            continue;
+
+        switch (instr.opcode) {
+        case OpCode::Id::END:
+            return;
+
+        case OpCode::Id::JMPC:
+        case OpCode::Id::JMPU:
+            MarkReachable(instr.flow.target, end);
+            break;
+
+        case OpCode::Id::CALL:
+        case OpCode::Id::CALLU:
+        case OpCode::Id::CALLC:
+            if (instr.flow.target_end > program->instructions.size()) {
+                unsupported = true;
+                return;
+            }
+            return_offsets[instr.flow.target_end] = true;
+            MarkReachable(instr.flow.target, instr.flow.target_end);
+            break;
+
+        case OpCode::Id::IFU:
+        case OpCode::Id::IFC:
+            if (instr.flow.target_end < instr.flow.target || instr.flow.else_end > end) {
+                unsupported = true;
+                return;
+            }
+            MarkReachable(instr.flow.target, instr.flow.target_end);
+            MarkReachable(instr.flow.else_target, instr.flow.else_end);
+            offset = instr.flow.return_address - 1;
+            break;
+
+        case OpCode::Id::LOOP:
+            if (instr.flow.return_address <= offset || instr.flow.target_end > end) {
+                unsupported = true;
+                return;
+            }
+            MarkReachable(instr.flow.target, instr.flow.target_end);
+            offset = instr.flow.return_address - 1;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+bool ShaderJit::CompileBlock(u32 begin, u32 end) {
+    Block block;
+    block.begin = begin;
+    block.end = end;
+    block.id = next_block_id++;
+
+    for (u32 offset = begin; offset < end; ++offset) {
+        // Jumps land before the return check, as the interpreter checks for the end of a
+        // subroutine no matter how it got to an instruction
+        if (reachable[offset] && compile_counts[offset]++ == 0) {
+            labels[offset] = emit->GetCodePtr();
+            label_blocks[offset] = block.id;
+        }
+
+        if (return_offsets[offset])
+            EmitReturnCheck(offset);
+
+        if (!reachable[offset]) {
+            // A subroutine ending right before unreachable code, which the interpreter would run
+            // if the subroutine isn't the innermost scope; we just end the program
+            if (return_offsets[offset]) {
+                emit->MOV64(RSP, SAVED_RSP);
+                exit_jumps.push_back(emit->JMP());
+            }
+            continue;
+        }
+
+        if (!CompileInstruction(offset, block))
+            return false;
+    }
+
+    for (u8* jump : block.end_jumps)
+        emit->SetJumpTarget(jump);
+
+    return true;
+}
+
+bool ShaderJit::CompileInstruction(u32& offset, Block& block) {
+    const DecodedInstruction& instr = program->instructions[offset];
+
+    switch (instr.type) {
+    case OpCode::Type::Arithmetic:
+    case OpCode::Type::MultiplyAdd:
+        return CompileArithmetic(instr);
+
+    default:
+        return CompileFlowControl(offset, block);
+    }
+}
+
+void ShaderJit::EmitLoadSource(XReg reg, const DecodedInstruction& instr, int index) {
+    const DecodedSource& source = instr.src[index];
+
+    if (index == 0 && instr.address_register_index != 0) {
+        // Loaded by LoadRelativeSource
+        emit->MOVUPS(reg, STATE, STATE_OFFSET(relative_source));
+    } else if (source.type == RegisterType::FloatUniform) {
+        emit->MOVUPS(reg, UNIFORMS, source.index * sizeof(Math::Vec4<float24>));
+    } else {
+        emit->MOVUPS(reg, STATE, RegisterOffset(source.type, source.index));
+    }
+
+    const u8 shuffle = source.selectors[0] | (source.selectors[1] << 2) |
+                       (source.selectors[2] << 4) | (source.selectors[3] << 6);
+    if (shuffle != 0xE4)
+        emit->SHUFPS(reg, reg, shuffle);
+
+    if (source.negate)
+        emit->XORPS(reg, CONSTANTS, CONSTANT_OFFSET(sign_mask));
+}
+
+void ShaderJit::EmitWriteDest(XReg reg, const DecodedInstruction& instr, u8 dest_mask) {
+    // Writes to other registers are discarded by the interpreter
+    if (instr.dest_type != RegisterType::Output && instr.dest_type != RegisterType::Temporary)
+        return;
+
+    if (dest_mask == 0)
+        return;
+
+    const s32 dest = RegisterOffset(instr.dest_type, instr.dest_index);
+    if (dest_mask != 0xF) {
+        // Merge the enabled components into the previous value of the register
+        emit->MOVUPS(XMM4, STATE, dest);
+        emit->MOVAPS(XMM5, CONSTANTS, CONSTANT_OFFSET(dest_masks) + dest_mask * 16);
+        emit->ANDPS(reg, XMM5);
+        emit->ANDNPS(XMM5, XMM4);
+        emit->ORPS(reg, XMM5);
+    }
+    emit->MOVUPS(STATE, dest, reg);
+}
+
+bool ShaderJit::CompileArithmetic(const DecodedInstruction& instr) {
+    if (instr.type == OpCode::Type::Arithmetic) {
+        // Not supported by the interpreter either
+        if (OpCode(instr.opcode).GetInfo().subtype & OpCode::Info::SrcInversed)
+            return false;
+
+        if (instr.address_register_index != 0) {
+            emit->MOV(ABI_PARAM3, STATE, STATE_OFFSET(address_registers) + (instr.address_register_index - 1) * 4);
+            emit->MOV64(ABI_PARAM2, reinterpret_cast<u64>(&instr.src[0]));
+            emit->MOV64(ABI_PARAM1, STATE);
+            if (ABI_SHADOW_SPACE != 0)
+                emit->ALU64(ALU_SUB, RSP, ABI_SHADOW_SPACE);
+            emit->CALL(reinterpret_cast<const void*>(&LoadRelativeSource));
+            if (ABI_SHADOW_SPACE != 0)
+                emit->ALU64(ALU_ADD, RSP, ABI_SHADOW_SPACE);
+        }
+
+        EmitLoadSource(XMM0, instr, 0);
+        EmitLoadSource(XMM1, instr, 1);
+
+        switch (instr.opcode) {
+        case OpCode::Id::ADD:
+            emit->ADDPS(XMM0, XMM1);
+            EmitWriteDest(XMM0, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::MUL:
+            emit->MULPS(XMM0, XMM1);
+            EmitWriteDest(XMM0, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::FLR:
+            // floor(x) = trunc(x) - (x < trunc(x) ? 1 : 0), for floats which have a fractional part.
+            // The sign is copied from x to get -0 for -0.
+            emit->CVTTPS2DQ(XMM1, XMM0);
+            emit->CVTDQ2PS(XMM1, XMM1);
+            emit->MOVAPS(XMM2, XMM0);
+            emit->CMPPS(XMM2, XMM1, CMP_LT);
+            emit->ANDPS(XMM2, CONSTANTS, CONSTANT_OFFSET(one));
+            emit->SUBPS(XMM1, XMM2);
+            emit->MOVAPS(XMM2, XMM0);
+            emit->ANDPS(XMM2, CONSTANTS, CONSTANT_OFFSET(abs_mask));
+            emit->CMPPS(XMM2, CONSTANTS, CONSTANT_OFFSET(two_pow_23), CMP_LT);
+            emit->ANDPS(XMM1, XMM2);
+            emit->ANDNPS(XMM2, XMM0);
+            emit->ORPS(XMM1, XMM2);
+            emit->ANDPS(XMM0, CONSTANTS, CONSTANT_OFFSET(sign_mask));
+            emit->ORPS(XMM1, XMM0);
+            EmitWriteDest(XMM1, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::MAX:
+            // std::max(a, b) returns a unless a < b, MAXPS returns its second operand unless the first is greater
+            emit->MAXPS(XMM1, XMM0);
+            EmitWriteDest(XMM1, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::DP3:
+        case OpCode::Id::DP4:
+        {
+            // Summed up one component after the other, starting from zero, as in the interpreter
+            const int num_components = (instr.opcode == OpCode::Id::DP3) ? 3 : 4;
+            emit->MULPS(XMM0, XMM1);
+            emit->XORPS(XMM3, XMM3);
+            for (int i = 0; i < num_components; ++i) {
+                if (i != 0)
+                    emit->SHUFPS(XMM0, XMM0, 0x39);
+                emit->ADDSS(XMM3, XMM0);
+            }
+            emit->SHUFPS(XMM3, XMM3, 0);
+            EmitWriteDest(XMM3, instr, instr.dest_mask & ((1 << num_components) - 1));
+            break;
+        }
+
+        case OpCode::Id::RCP:
+            emit->MOVAPS(XMM3, CONSTANTS, CONSTANT_OFFSET(one));
+            emit->DIVPS(XMM3, XMM0);
+            EmitWriteDest(XMM3, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::RSQ:
+            // The interpreter's sqrt and division of a float are done in double precision
+            emit->CVTPS2PD(XMM3, XMM0);
+            emit->MOVHLPS(XMM4, XMM0);
+            emit->CVTPS2PD(XMM4, XMM4);
+            emit->SQRTPD(XMM3, XMM3);
+            emit->SQRTPD(XMM4, XMM4);
+            emit->MOVAPS(XMM0, CONSTANTS, CONSTANT_OFFSET(one_double));
+            emit->DIVPD(XMM0, XMM3);
+            emit->MOVAPS(XMM3, CONSTANTS, CONSTANT_OFFSET(one_double));
+            emit->DIVPD(XMM3, XMM4);
+            emit->CVTPD2PS(XMM0, XMM0);
+            emit->CVTPD2PS(XMM3, XMM3);
+            emit->MOVLHPS(XMM0, XMM3);
+            EmitWriteDest(XMM0, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::MOVA:
+            for (int i = 0; i < 2; ++i) {
+                if (!(instr.dest_mask & (1 << i)))
+                    continue;
+
+                if (i == 0) {
+                    emit->CVTTSS2SI(RAX, XMM0);
+                } else {
+                    emit->MOVAPS(XMM3, XMM0);
+                    emit->SHUFPS(XMM3, XMM3, 0x55);
+                    emit->CVTTSS2SI(RAX, XMM3);
+                }
+                emit->MOV(STATE, STATE_OFFSET(address_registers) + i * 4, RAX);
+            }
+            break;
+
+        case OpCode::Id::MOV:
+            EmitWriteDest(XMM0, instr, instr.dest_mask);
+            break;
+
+        case OpCode::Id::CMP:
+            for (int i = 0; i < 2; ++i) {
+                switch (instr.compare_op[i]) {
+                case CompareOp::Equal:
+                    emit->MOVAPS(XMM3, XMM0);
+                    emit->CMPPS(XMM3, XMM1, CMP_EQ);
+                    break;
+
+                case CompareOp::NotEqual:
+                    emit->MOVAPS(XMM3, XMM0);
+                    emit->CMPPS(XMM3, XMM1, CMP_NEQ);
+                    break;
+
+                case CompareOp::LessThan:
+                    emit->MOVAPS(XMM3, XMM0);
+                    emit->CMPPS(XMM3, XMM1, CMP_LT);
+                    break;
+
+                case CompareOp::LessEqual:
+                    emit->MOVAPS(XMM3, XMM0);
+                    emit->CMPPS(XMM3, XMM1, CMP_LE);
+                    break;
+
+                case CompareOp::GreaterThan:
+                    emit->MOVAPS(XMM3, XMM1);
+                    emit->CMPPS(XMM3, XMM0, CMP_LT);
+                    break;
+
+                case CompareOp::GreaterEqual:
+                    emit->MOVAPS(XMM3, XMM1);
+                    emit->CMPPS(XMM3, XMM0, CMP_LE);
+                    break;
+
+                default:
+                    continue;
+                }
+
+                emit->MOVMSKPS(RAX, XMM3);
+                if (i != 0)
+                    emit->SHIFT(SHIFT_SHR, RAX, i);
+                emit->ALU(ALU_AND, RAX, 1);
+                emit->MOV(STATE, STATE_OFFSET(conditional_code) + i * 4, RAX);
+            }
+            break;
+
+        default:
+            return false;
+        }
+
+        return true;
+    }
+
+    if (instr.opcode != OpCode::Id::MAD && instr.opcode != OpCode::Id::MADI)
+        return false;
+
+    EmitLoadSource(XMM0, instr, 0);
+    EmitLoadSource(XMM1, instr, 1);
+    EmitLoadSource(XMM2, instr, 2);
+    emit->MULPS(XMM0, XMM1);
+    emit->ADDPS(XMM0, XMM2);
+    EmitWriteDest(XMM0, instr, instr.dest_mask);
+    return true;
+}
+
+void ShaderJit::EmitCondition(const DecodedInstruction& instr) {
+    // Conditional codes are 0 or 1, so comparing them with the reference value is an XOR
+    auto LoadResult = [&](Reg reg, int component, bool ref) {
+        emit->MOV(reg, STATE, STATE_OFFSET(conditional_code) + component * 4);
+        if (!ref)
+            emit->ALU(ALU_XOR, reg, 1);
+    };
+
+    switch (instr.flow.op) {
+    case Instruction::FlowControlType::Or:
+        LoadResult(RAX, 0, instr.flow.refx);
+        LoadResult(RCX, 1, instr.flow.refy);
+        emit->ALU(ALU_OR, RAX, RCX);
+        break;
+
+    case Instruction::FlowControlType::And:
+        LoadResult(RAX, 0, instr.flow.refx);
+        LoadResult(RCX, 1, instr.flow.refy);
+        emit->ALU(ALU_AND, RAX, RCX);
+        break;
+
+    case Instruction::FlowControlType::JustX:
+        LoadResult(RAX, 0, instr.flow.refx);
+        break;
+
+    case Instruction::FlowControlType::JustY:
+    default:
+        LoadResult(RAX, 1, instr.flow.refy);
+        break;
+    }
+}
+
+void ShaderJit::EmitReturnCheck(u32 offset) {
+    emit->ALU(ALU_CMP, RSP, 8, CALL_TAG | offset);
+    u8* not_returning = emit->Jcc(CC_NZ);
+    emit->RET();
+    emit->SetJumpTarget(not_returning);
+}
+
+bool ShaderJit::CompileFlowControl(u32& offset, Block& block) {
+    const DecodedInstruction& instr = program->instructions[offset];
+
+    auto LoadBoolUniform = [&]() {
+        emit->MOV64(RAX, STATE, STATE_OFFSET(bool_uniforms));
+        emit->MOVZX8(RAX, RAX, instr.flow.uniform_id);
+    };
+
+    // Reserves the stack space an IF or LOOP occupies on the interpreter's call stack
+    auto PushFrame = [&](u32 value) {
+        emit->ALU64(ALU_SUB, RSP, 16);
+        emit->MOV(RSP, 8, value);
+    };
+
+    switch (instr.opcode) {
+    case OpCode::Id::END:
+        emit->MOV64(RSP, SAVED_RSP);
+        exit_jumps.push_back(emit->JMP());
+        return true;
+
+    case OpCode::Id::NOP:
+        return true;
+
+    case OpCode::Id::JMPC:
+    case OpCode::Id::JMPU:
+    {
+        if (instr.opcode == OpCode::Id::JMPC)
+            EmitCondition(instr);
+        else
+            LoadBoolUniform();
+        emit->TEST(RAX, RAX);
+        u8* jump = emit->Jcc(CC_NZ);
+
+        if (instr.flow.target == block.end) {
+            block.end_jumps.push_back(jump);
+        } else if (instr.flow.target >= block.begin && instr.flow.target < block.end) {
+            fixups.push_back({ jump, instr.flow.target, block.id });
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    case OpCode::Id::CALL:
+    case OpCode::Id::CALLU:
+    case OpCode::Id::CALLC:
+    {
+        u8* skip = nullptr;
+        if (instr.opcode != OpCode::Id::CALL) {
+            if (instr.opcode == OpCode::Id::CALLU)
+                LoadBoolUniform();
+            else
+                EmitCondition(instr);
+            emit->TEST(RAX, RAX);
+            skip = emit->Jcc(CC_Z);
+        }
+
+        emit->MOV(RAX, CALL_TAG | instr.flow.target_end);
+        emit->PUSH(RAX);
+        fixups.push_back({ emit->CALL(), instr.flow.target, 0 });
+        emit->ALU64(ALU_ADD, RSP, 8);
+
+        if (skip != nullptr)
+            emit->SetJumpTarget(skip);
+        return true;
+    }
+
+    case OpCode::Id::IFU:
+    case OpCode::Id::IFC:
+    {
+        if (instr.flow.target_end < instr.flow.target || instr.flow.else_end > block.end)
+            return false;
+
+        PushFrame(0);
+        if (instr.opcode == OpCode::Id::IFU)
+            LoadBoolUniform();
+        else
+            EmitCondition(instr);
+        emit->TEST(RAX, RAX);
+        u8* else_jump = emit->Jcc(CC_Z);
+
+        if (!CompileBlock(instr.flow.target, instr.flow.target_end))
+            return false;
+        u8* end_jump = emit->JMP();
+
+        emit->SetJumpTarget(else_jump);
+        if (!CompileBlock(instr.flow.else_target, instr.flow.else_end))
+            return false;
+
+        emit->SetJumpTarget(end_jump);
+        emit->ALU64(ALU_ADD, RSP, 16);
+
+        offset = instr.flow.return_address - 1;
+        return true;
+    }
+
+    case OpCode::Id::LOOP:
+    {
+        if (instr.flow.return_address <= offset || instr.flow.target_end > block.end)
+            return false;
+
+        // The loop counter starts at the uniform's y component, and is incremented by its z
+        // component after each of the x + 1 iterations. The iteration count is kept in the frame,
+        // the increment right below it.
+        emit->MOV64(RAX, STATE, STATE_OFFSET(int_uniforms));
+        emit->MOV(RCX, RAX, instr.flow.uniform_id * sizeof(Math::Vec4<u8>));
+        emit->MOV(RAX, RCX);
+        emit->SHIFT(SHIFT_SHR, RAX, 8);
+        emit->ALU(ALU_AND, RAX, 0xFF);
+        emit->MOV(STATE, STATE_OFFSET(address_registers) + 2 * 4, RAX);
+        emit->MOV(RAX, RCX);
+        emit->ALU(ALU_AND, RAX, 0xFF);
+        PushFrame(0);
+        emit->MOV(RSP, 8, RAX);
+        emit->SHIFT(SHIFT_SHR, RCX, 16);
+        emit->ALU(ALU_AND, RCX, 0xFF);
+        emit->MOV(RSP, 0, RCX);
+
+        u8* const loop_start = emit->GetCodePtr();
+        if (!CompileBlock(instr.flow.target, instr.flow.target_end))
+            return false;
+
+        emit->MOV(RAX, RSP, 0);
+        emit->MOV(RCX, STATE, STATE_OFFSET(address_registers) + 2 * 4);
+        emit->ALU(ALU_ADD, RCX, RAX);
+        emit->MOV(STATE, STATE_OFFSET(address_registers) + 2 * 4, RCX);
+        emit->MOV(RAX, RSP, 8);
+        emit->ALU(ALU_SUB, RAX, 1);
+        emit->MOV(RSP, 8, RAX);
+        // Loop again unless the count was zero already
+        emit->SetJumpTarget(emit->Jcc(CC_NC), loop_start);
+        emit->ALU64(ALU_ADD, RSP, 16);
+
+        // The interpreter resumes right before the end of the loop body, so that its last
+        // instruction is run once more. That instruction is compiled a second time here.
+        offset = instr.flow.return_address - 1;
+        return true;
+    }
+
+    default:
+        // Not supported by the interpreter either
+        return false;
+    }
+}
+
+} // namespace
+
+} // namespace
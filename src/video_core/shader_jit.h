@@ -0,0 +1,128 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <common/common_types.h>
+
+#include "math.h"
+#include "pica.h"
+#include "shader_program.h"
+
+namespace X64 {
+class Emitter;
+enum XReg : u8;
+}
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Registers and uniforms of a vertex shader run by compiled code
+struct JitState {
+    Math::Vec4<float24> input_registers[16];
+    Math::Vec4<float24> temporary_registers[16];
+    Math::Vec4<float24> output_registers[16];
+
+    /// Source register selected through an address register, loaded by the generated code
+    Math::Vec4<float24> relative_source;
+
+    u32 conditional_code[2];  ///< 0 or 1
+    s32 address_registers[3]; ///< Two address registers and the loop counter
+
+    const Math::Vec4<float24>* float_uniforms;
+    const bool* bool_uniforms;
+    const Math::Vec4<u8>* int_uniforms;
+};
+
+/// Entry point of a compiled vertex shader program
+typedef void (*JitProgram)(JitState* state);
+
+/**
+ * Compiles vertex shader programs to x86-64 SSE code. Each PICA register is a vector of four
+ * floats which is processed with a single SSE instruction per operation, and operations are
+ * carried out in the same order and precision as in the interpreter, so that both produce the
+ * same results.
+ *
+ * Control flow is compiled structurally: IF and LOOP bodies are compiled inline, CALL targets are
+ * called as native functions. Programs whose control flow doesn't fit this scheme (e.g. jumps into
+ * or out of IF bodies) or which use instructions the interpreter doesn't handle either are not
+ * compiled, and have to be run by the interpreter.
+ */
+class ShaderJit {
+public:
+    ShaderJit();
+    ~ShaderJit();
+
+    /**
+     * Compiles a decoded program. The generated code refers to the decoded program, which has to
+     * outlive it.
+     * @return Entry point of the generated code, or nullptr if the program can't be compiled
+     */
+    JitProgram Compile(const DecodedProgram& program);
+
+    /// Returns whether the code buffer may be too small for another program, see Clear
+    bool IsFull() const;
+
+    /// Discards the code of all compiled programs
+    void Clear();
+
+private:
+    /// Code range of a structured block being compiled
+    struct Block {
+        u32 begin;
+        u32 end;
+        unsigned id;                 ///< Identifies the block, jumps may not leave it
+        std::vector<u8*> end_jumps;  ///< Jumps to the end of the block, from instructions within it
+    };
+
+    /// Jump or call to an instruction whose code may not have been generated yet
+    struct Fixup {
+        u8* jump_end;
+        u32 target;
+        unsigned block_id;           ///< Block the jump has to land in, 0 for calls
+    };
+
+    /// Marks the instructions run from `begin` until `end` or an END instruction
+    void MarkReachable(u32 begin, u32 end);
+
+    bool CompileBlock(u32 begin, u32 end);
+    bool CompileInstruction(u32& offset, Block& block);
+    bool CompileArithmetic(const DecodedInstruction& instr);
+    bool CompileFlowControl(u32& offset, Block& block);
+
+    /// Emits code loading a swizzled and possibly negated source operand into `reg`
+    void EmitLoadSource(X64::XReg reg, const DecodedInstruction& instr, int index);
+    /// Emits code writing the enabled components of `reg` to the destination register
+    void EmitWriteDest(X64::XReg reg, const DecodedInstruction& instr, u8 dest_mask);
+    /// Emits code setting EAX to a non-zero value if the condition of a flow control instruction holds
+    void EmitCondition(const DecodedInstruction& instr);
+    /// Emits code leaving a subroutine if it was called with the given final offset
+    void EmitReturnCheck(u32 offset);
+
+    u8* code_buffer;                 ///< Executable memory holding the generated code
+    u8* constants;                   ///< Constants used by the generated code, at the start of the buffer
+    std::unique_ptr<X64::Emitter> emit;
+
+    // State of the program being compiled
+    const DecodedProgram* program;
+    std::vector<bool> reachable;               ///< Instructions which can be run
+    std::vector<bool> return_offsets;          ///< Final offsets of subroutines
+    std::unordered_set<u64> visited_ranges;    ///< Ranges processed by MarkReachable
+    bool unsupported;                          ///< Set when finding something the compiler can't handle
+    std::vector<u8*> labels;                   ///< Code of each instruction, where it was first compiled
+    std::vector<unsigned> label_blocks;        ///< Block in which each instruction was first compiled
+    std::vector<unsigned> compile_counts;      ///< How often each instruction was compiled
+    std::vector<Fixup> fixups;
+    std::vector<u8*> exit_jumps;               ///< Jumps to the epilogue
+    unsigned next_block_id;
+};
+
+} // namespace
+
+} // namespace
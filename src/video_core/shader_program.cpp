@@ -0,0 +1,180 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/logging/log.h"
+
+#include "shader_program.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+using nihstro::RegisterType;
+using nihstro::SourceRegister;
+using nihstro::SwizzlePattern;
+
+namespace Pica {
+
+namespace VertexShader {
+
+static DecodedSource DecodeSource(const SourceRegister& reg, const SwizzlePattern& swizzle, int operand,
+                                  const Math::Vec4<float24>* float_uniforms) {
+    DecodedSource source;
+    source.reg = reg;
+    source.type = reg.GetRegisterType();
+    source.index = reg.GetIndex();
+    source.uniform = (source.type == RegisterType::FloatUniform) ? &float_uniforms[source.index].x : nullptr;
+
+    for (int i = 0; i < 4; ++i) {
+        source.selectors[i] = (operand == 0) ? (u8)swizzle.GetSelectorSrc1(i)
+                            : (operand == 1) ? (u8)swizzle.GetSelectorSrc2(i)
+                            : (u8)swizzle.GetSelectorSrc3(i);
+    }
+    source.negate = (operand == 0) ? (bool)swizzle.negate_src1
+                  : (operand == 1) ? (bool)swizzle.negate_src2
+                  : (bool)swizzle.negate_src3;
+    return source;
+}
+
+static CompareOp DecodeCompareOp(const Instruction& instr, int component) {
+    auto compare_op = instr.common.compare_op;
+    auto op = (component == 0) ? compare_op.x.Value() : compare_op.y.Value();
+
+    switch (op) {
+    case compare_op.Equal:        return CompareOp::Equal;
+    case compare_op.NotEqual:     return CompareOp::NotEqual;
+    case compare_op.LessThan:     return CompareOp::LessThan;
+    case compare_op.LessEqual:    return CompareOp::LessEqual;
+    case compare_op.GreaterThan:  return CompareOp::GreaterThan;
+    case compare_op.GreaterEqual: return CompareOp::GreaterEqual;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown compare mode %x", static_cast<int>(op));
+        return CompareOp::Unknown;
+    }
+}
+
+static void DecodeDest(DecodedInstruction& decoded, u32 dest) {
+    if (dest < 0x10) {
+        decoded.dest_type = RegisterType::Output;
+        decoded.dest_index = dest;
+    } else if (dest < 0x20) {
+        decoded.dest_type = RegisterType::Temporary;
+        decoded.dest_index = dest - 0x10;
+    } else {
+        decoded.dest_type = RegisterType::Unknown;
+        decoded.dest_index = 0;
+    }
+}
+
+static DecodedInstruction DecodeInstruction(u32 offset, const Instruction& instr,
+                                            const std::array<u32, 1024>& swizzle_data,
+                                            const Math::Vec4<float24>* float_uniforms) {
+    DecodedInstruction decoded = {};
+    decoded.type = instr.opcode.Value().GetInfo().type;
+    decoded.opcode = instr.opcode.Value().EffectiveOpCode();
+    decoded.hex = instr.hex;
+    decoded.dest_type = RegisterType::Unknown;
+
+    switch (decoded.type) {
+    case OpCode::Type::Arithmetic:
+    {
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.common.operand_desc_id];
+        bool is_inverted = 0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed);
+
+        decoded.operand_desc_id = instr.common.operand_desc_id;
+        decoded.address_register_index = instr.common.address_register_index;
+        decoded.src[0] = DecodeSource(instr.common.GetSrc1(is_inverted), swizzle, 0, float_uniforms);
+        decoded.src[1] = DecodeSource(instr.common.GetSrc2(is_inverted), swizzle, 1, float_uniforms);
+        DecodeDest(decoded, instr.common.dest.Value());
+        for (int i = 0; i < 4; ++i)
+            decoded.dest_mask |= swizzle.DestComponentEnabled(i) ? (1 << i) : 0;
+        if (decoded.opcode == OpCode::Id::CMP) {
+            decoded.compare_op[0] = DecodeCompareOp(instr, 0);
+            decoded.compare_op[1] = DecodeCompareOp(instr, 1);
+        }
+        break;
+    }
+
+    case OpCode::Type::MultiplyAdd:
+    {
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
+        bool is_inverted = (decoded.opcode == OpCode::Id::MADI);
+
+        decoded.operand_desc_id = instr.mad.operand_desc_id;
+        decoded.src[0] = DecodeSource(instr.mad.GetSrc1(is_inverted), swizzle, 0, float_uniforms);
+        decoded.src[1] = DecodeSource(instr.mad.GetSrc2(is_inverted), swizzle, 1, float_uniforms);
+        decoded.src[2] = DecodeSource(instr.mad.GetSrc3(is_inverted), swizzle, 2, float_uniforms);
+        DecodeDest(decoded, instr.mad.dest.Value());
+        for (int i = 0; i < 4; ++i)
+            decoded.dest_mask |= swizzle.DestComponentEnabled(i) ? (1 << i) : 0;
+        break;
+    }
+
+    default:
+    {
+        const auto& flow_control = instr.flow_control;
+        decoded.flow.refx = flow_control.refx != 0;
+        decoded.flow.refy = flow_control.refy != 0;
+        decoded.flow.op = flow_control.op.Value();
+
+        switch (instr.opcode.Value()) {
+        case OpCode::Id::JMPC:
+            decoded.flow.target = flow_control.dest_offset;
+            break;
+
+        case OpCode::Id::JMPU:
+            decoded.flow.uniform_id = flow_control.bool_uniform_id;
+            decoded.flow.target = flow_control.dest_offset;
+            break;
+
+        case OpCode::Id::CALL:
+        case OpCode::Id::CALLU:
+        case OpCode::Id::CALLC:
+            decoded.flow.uniform_id = flow_control.bool_uniform_id;
+            decoded.flow.target = flow_control.dest_offset;
+            decoded.flow.target_end = flow_control.dest_offset + flow_control.num_instructions;
+            decoded.flow.return_address = offset + 1;
+            break;
+
+        case OpCode::Id::IFU:
+        case OpCode::Id::IFC:
+            decoded.flow.uniform_id = flow_control.bool_uniform_id;
+            decoded.flow.target = offset + 1;
+            decoded.flow.target_end = flow_control.dest_offset;
+            decoded.flow.else_target = flow_control.dest_offset;
+            decoded.flow.else_end = flow_control.dest_offset + flow_control.num_instructions;
+            decoded.flow.return_address = flow_control.dest_offset + flow_control.num_instructions;
+            break;
+
+        case OpCode::Id::LOOP:
+            decoded.flow.uniform_id = flow_control.int_uniform_id;
+            decoded.flow.target = offset + 1;
+            decoded.flow.target_end = flow_control.dest_offset + 2;
+            decoded.flow.return_address = flow_control.dest_offset + 1;
+            break;
+
+        default:
+            break;
+        }
+        break;
+    }
+    }
+
+    return decoded;
+}
+
+void DecodeProgram(DecodedProgram& program,
+                   const std::array<u32, 1024>& shader_memory, const std::array<u32, 1024>& swizzle_data,
+                   u32 entry_point, const Math::Vec4<float24>* float_uniforms) {
+    program.entry_point = entry_point;
+    program.instructions.resize(shader_memory.size());
+
+    for (u32 offset = 0; offset < shader_memory.size(); ++offset) {
+        const Instruction& instr = *(const Instruction*)&shader_memory[offset];
+        program.instructions[offset] = DecodeInstruction(offset, instr, swizzle_data, float_uniforms);
+    }
+}
+
+} // namespace
+
+} // namespace
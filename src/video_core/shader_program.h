@@ -0,0 +1,107 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <common/common_types.h>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "math.h"
+#include "pica.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Comparison made by CMP for one of the conditional codes
+enum class CompareOp : u8 {
+    Equal,
+    NotEqual,
+    LessThan,
+    LessEqual,
+    GreaterThan,
+    GreaterEqual,
+    Unknown,       ///< Leaves the conditional code unchanged
+};
+
+/// Source operand of a decoded instruction
+struct DecodedSource {
+    nihstro::SourceRegister reg;  ///< Register as encoded, to which relative offsets are applied
+    nihstro::RegisterType type;
+    u8 index;
+
+    const float24* uniform;       ///< Components of the float uniform, if the source is one
+
+    u8 selectors[4];              ///< Component of the register read for each source component
+    bool negate;
+};
+
+/**
+ * Instruction with all fields of the raw instruction word and its swizzle pattern already
+ * extracted. Flow control targets are flattened into absolute instruction offsets.
+ */
+struct DecodedInstruction {
+    nihstro::OpCode::Type type;
+    nihstro::OpCode::Id opcode;   ///< Effective opcode
+
+    /// Register written by arithmetic instructions, either an Output or a Temporary one. Writes to
+    /// any other register are discarded.
+    nihstro::RegisterType dest_type;
+    u8 dest_index;
+    u8 dest_mask;                 ///< Bit i is set if component i of the destination is written
+
+    /// Address register applied to the first source: 0 for none, 1-2 for a0.xy, 3 for the loop counter
+    u8 address_register_index;
+    CompareOp compare_op[2];      ///< For the x and y conditional codes
+
+    u32 operand_desc_id;
+
+    DecodedSource src[3];
+
+    struct {
+        bool refx;
+        bool refy;
+        u8 op;                    ///< Instruction::FlowControlType::Op used to combine the conditions
+        u8 uniform_id;            ///< Bool uniform for JMPU/CALLU/IFU, int uniform for LOOP
+
+        /// Code run by CALL*, LOOP and the if branch of IF*, from target up to (excluding)
+        /// target_end, and where to continue afterwards. JMP* only use target.
+        u32 target;
+        u32 target_end;
+        u32 return_address;
+
+        /// Code run by the else branch of IF*
+        u32 else_target;
+        u32 else_end;
+    } flow;
+
+    u32 hex;                      ///< Raw instruction word, for diagnostics
+};
+
+/// Vertex shader program, decoded from the shader memory and swizzle patterns
+struct DecodedProgram {
+    u32 entry_point;
+
+    /// Decoded instructions, indexed by their offset in the shader memory
+    std::vector<DecodedInstruction> instructions;
+};
+
+/**
+ * Decodes a vertex shader program.
+ * @param shader_memory Shader binary
+ * @param swizzle_data Swizzle patterns referenced by the instructions
+ * @param entry_point Offset of the first instruction to run
+ * @param float_uniforms Float uniforms, to which source operands are resolved
+ */
+void DecodeProgram(DecodedProgram& program,
+                   const std::array<u32, 1024>& shader_memory, const std::array<u32, 1024>& swizzle_data,
+                   u32 entry_point, const Math::Vec4<float24>* float_uniforms);
+
+} // namespace
+
+} // namespace
@@ -69,10 +69,12 @@ public:
     u32 num_else_instr;
 };
 
-// State used when translating
-std::string g_cmp_strings[2];
-std::vector<IfElseData> g_if_else_offset_stack;
-std::map<u32, std::string> g_fn_offset_map;
+/// State used when translating a shader. Kept per call, since shaders are translated on several threads at once
+struct TranslatorState {
+    std::string cmp_strings[2];
+    std::vector<IfElseData> if_else_offset_stack;
+    std::map<u32, std::string> fn_offset_map;
+};
 
 u32 GetRegMaskLen(u32 v)
 {
@@ -226,7 +228,7 @@ std::string RegTxtDst(u8 v, u32 mask) {
     return std::string(reg_text) + ParseComponentMask(mask);
 }
 
-std::string PICAInstrToGLSL(nihstro::Instruction instr, const u32* swizzle_data) {
+std::string PICAInstrToGLSL(TranslatorState& state, nihstro::Instruction instr, const u32* swizzle_data) {
     char instr_text[256];
 
     nihstro::OpCode::Info info = instr.opcode.Value().GetInfo();
@@ -322,10 +324,10 @@ std::string PICAInstrToGLSL(nihstro::Instruction instr, const u32* swizzle_data)
         case nihstro::OpCode::Id::CMP:
         {
             sprintf(instr_text, "%s.x %s %s.x", src1.c_str(), instr.common.compare_op.ToString(instr.common.compare_op.x).c_str(), src2.c_str());
-            g_cmp_strings[0] = instr_text;
+            state.cmp_strings[0] = instr_text;
 
             sprintf(instr_text, "%s.y %s %s.y", src1.c_str(), instr.common.compare_op.ToString(instr.common.compare_op.y).c_str(), src2.c_str());
-            g_cmp_strings[1] = instr_text;
+            state.cmp_strings[1] = instr_text;
 
             sprintf(instr_text, "// Culled CMP\n");
 
@@ -349,8 +351,8 @@ std::string PICAInstrToGLSL(nihstro::Instruction instr, const u32* swizzle_data)
 
         case nihstro::OpCode::Id::CALL:
         {
-            std::map<u32, std::string>::iterator call_offset = g_fn_offset_map.find(instr.flow_control.dest_offset.Value());
-            if (call_offset != g_fn_offset_map.end()) {
+            std::map<u32, std::string>::iterator call_offset = state.fn_offset_map.find(instr.flow_control.dest_offset.Value());
+            if (call_offset != state.fn_offset_map.end()) {
                 sprintf(instr_text, "%s();\n", call_offset->second.c_str());
             } else {
                 sprintf(instr_text, "// CALL to unknown offset\n");
@@ -360,27 +362,27 @@ std::string PICAInstrToGLSL(nihstro::Instruction instr, const u32* swizzle_data)
 
         case nihstro::OpCode::Id::CALLC:
         {
-            std::map<u32, std::string>::iterator call_offset = g_fn_offset_map.find(instr.flow_control.dest_offset.Value());
-            if (call_offset != g_fn_offset_map.end()) {
+            std::map<u32, std::string>::iterator call_offset = state.fn_offset_map.find(instr.flow_control.dest_offset.Value());
+            if (call_offset != state.fn_offset_map.end()) {
                 char negate_or_space_x = instr.flow_control.refx.Value() ? ' ' : '!';
                 char negate_or_space_y = instr.flow_control.refy.Value() ? ' ' : '!';
 
                 switch (instr.flow_control.op)
                 {
                 case nihstro::Instruction::FlowControlType::Or:
-                    sprintf(instr_text, "if (%c(%s) || %c(%s)) { %s(); }\n", negate_or_space_x, g_cmp_strings[0].c_str(), negate_or_space_y, g_cmp_strings[1].c_str(), call_offset->second.c_str());
+                    sprintf(instr_text, "if (%c(%s) || %c(%s)) { %s(); }\n", negate_or_space_x, state.cmp_strings[0].c_str(), negate_or_space_y, state.cmp_strings[1].c_str(), call_offset->second.c_str());
                     break;
 
                 case nihstro::Instruction::FlowControlType::And:
-                    sprintf(instr_text, "if (%c(%s) && %c(%s)) { %s(); }\n", negate_or_space_x, g_cmp_strings[0].c_str(), negate_or_space_y, g_cmp_strings[1].c_str(), call_offset->second.c_str());
+                    sprintf(instr_text, "if (%c(%s) && %c(%s)) { %s(); }\n", negate_or_space_x, state.cmp_strings[0].c_str(), negate_or_space_y, state.cmp_strings[1].c_str(), call_offset->second.c_str());
                     break;
 
                 case nihstro::Instruction::FlowControlType::JustX:
-                    sprintf(instr_text, "if (%c(%s)) { %s(); }\n", negate_or_space_x, g_cmp_strings[0].c_str(), call_offset->second.c_str());
+                    sprintf(instr_text, "if (%c(%s)) { %s(); }\n", negate_or_space_x, state.cmp_strings[0].c_str(), call_offset->second.c_str());
                     break;
 
                 case nihstro::Instruction::FlowControlType::JustY:
-                    sprintf(instr_text, "if (%c(%s)) { %s(); }\n", negate_or_space_y, g_cmp_strings[1].c_str(), call_offset->second.c_str());
+                    sprintf(instr_text, "if (%c(%s)) { %s(); }\n", negate_or_space_y, state.cmp_strings[1].c_str(), call_offset->second.c_str());
                     break;
 
                 default:
@@ -402,19 +404,19 @@ std::string PICAInstrToGLSL(nihstro::Instruction instr, const u32* swizzle_data)
             switch (instr.flow_control.op)
             {
             case nihstro::Instruction::FlowControlType::Or:
-                sprintf(instr_text, "if (%c(%s) || %c(%s)) {\n", negate_or_space_x, g_cmp_strings[0].c_str(), negate_or_space_y, g_cmp_strings[1].c_str());
+                sprintf(instr_text, "if (%c(%s) || %c(%s)) {\n", negate_or_space_x, state.cmp_strings[0].c_str(), negate_or_space_y, state.cmp_strings[1].c_str());
                 break;
 
             case nihstro::Instruction::FlowControlType::And:
-                sprintf(instr_text, "if (%c(%s) && %c(%s)) {\n", negate_or_space_x, g_cmp_strings[0].c_str(), negate_or_space_y, g_cmp_strings[1].c_str());
+                sprintf(instr_text, "if (%c(%s) && %c(%s)) {\n", negate_or_space_x, state.cmp_strings[0].c_str(), negate_or_space_y, state.cmp_strings[1].c_str());
                 break;
 
             case nihstro::Instruction::FlowControlType::JustX:
-                sprintf(instr_text, "if (%c(%s)) {\n", negate_or_space_x, g_cmp_strings[0].c_str());
+                sprintf(instr_text, "if (%c(%s)) {\n", negate_or_space_x, state.cmp_strings[0].c_str());
                 break;
 
             case nihstro::Instruction::FlowControlType::JustY:
-                sprintf(instr_text, "if (%c(%s)) {\n", negate_or_space_y, g_cmp_strings[1].c_str());
+                sprintf(instr_text, "if (%c(%s)) {\n", negate_or_space_y, state.cmp_strings[1].c_str());
                 break;
 
             default:
@@ -449,8 +451,8 @@ std::string PICAInstrToGLSL(nihstro::Instruction instr, const u32* swizzle_data)
         {
         case nihstro::OpCode::Id::CALLU:
         {
-            std::map<u32, std::string>::iterator call_offset = g_fn_offset_map.find(instr.flow_control.dest_offset.Value());
-            if (call_offset != g_fn_offset_map.end()) {
+            std::map<u32, std::string>::iterator call_offset = state.fn_offset_map.find(instr.flow_control.dest_offset.Value());
+            if (call_offset != state.fn_offset_map.end()) {
                 sprintf(instr_text, "if (b[%d]) { %s(); }\n", instr.flow_control.bool_uniform_id.Value(), call_offset->second.c_str());
             } else {
                 sprintf(instr_text, "// CALLU to unknown offset\n");
@@ -521,18 +523,17 @@ std::string PICABinToGLSL(const u32* shader_data, const u32* swizzle_data) {
     u32 main_end_offset = 0;
     bool last_was_nop = false;
 
-    g_if_else_offset_stack.clear();
-    g_fn_offset_map.clear();
+    TranslatorState state;
 
     // First pass: scan for CALLs to determine function offsets
     for (int i = 0; i < 1024; ++i) {
         nihstro::Instruction instr = ((nihstro::Instruction*)shader_data)[i];
 
         if (instr.opcode.Value().EffectiveOpCode() == nihstro::OpCode::Id::CALL || instr.opcode.Value().EffectiveOpCode() == nihstro::OpCode::Id::CALLC || instr.opcode.Value().EffectiveOpCode() == nihstro::OpCode::Id::CALLU) {
-            if (g_fn_offset_map.find(instr.flow_control.dest_offset.Value()) == g_fn_offset_map.end()) {
+            if (state.fn_offset_map.find(instr.flow_control.dest_offset.Value()) == state.fn_offset_map.end()) {
                 char fnName[32];
-                sprintf(fnName, "fn%d", g_fn_offset_map.size());
-                g_fn_offset_map.insert(std::pair<u32, std::string>(instr.flow_control.dest_offset.Value(), fnName));
+                sprintf(fnName, "fn%d", state.fn_offset_map.size());
+                state.fn_offset_map.insert(std::pair<u32, std::string>(instr.flow_control.dest_offset.Value(), fnName));
 
                 glsl_shader += "void " + std::string(fnName) + "();\n";
             }
@@ -546,7 +547,7 @@ std::string PICABinToGLSL(const u32* shader_data, const u32* swizzle_data) {
         }
 
         // Consume ifelse offset if points to current offset
-        for (std::vector<IfElseData>::iterator cur_ifelse_it = g_if_else_offset_stack.begin(); cur_ifelse_it != g_if_else_offset_stack.end(); ++cur_ifelse_it) {
+        for (std::vector<IfElseData>::iterator cur_ifelse_it = state.if_else_offset_stack.begin(); cur_ifelse_it != state.if_else_offset_stack.end(); ++cur_ifelse_it) {
             if (cur_ifelse_it->stage == 2) {
                 if (cur_ifelse_it->num_if_instr == 1) {
                     nest_depth--;
@@ -576,8 +577,8 @@ std::string PICABinToGLSL(const u32* shader_data, const u32* swizzle_data) {
         }
 
         // Consume function offset if points to current offset
-        std::map<u32, std::string>::iterator fn_offset = g_fn_offset_map.find(i);
-        if (fn_offset != g_fn_offset_map.end()) {
+        std::map<u32, std::string>::iterator fn_offset = state.fn_offset_map.find(i);
+        if (fn_offset != state.fn_offset_map.end()) {
             if (nest_depth > 0) {
                 nest_depth--;
                 glsl_shader += std::string(nest_depth, '\t') + "}\n\n";
@@ -622,10 +623,10 @@ std::string PICABinToGLSL(const u32* shader_data, const u32* swizzle_data) {
                 glsl_shader += std::string(nest_depth, '\t') + "// NOP\n";
             }
         } else {
-            glsl_shader += std::string(nest_depth, '\t') + PICAInstrToGLSL(instr, swizzle_data);
+            glsl_shader += std::string(nest_depth, '\t') + PICAInstrToGLSL(state, instr, swizzle_data);
 
             if (instr.opcode.Value().EffectiveOpCode() == nihstro::OpCode::Id::IFU || instr.opcode.Value().EffectiveOpCode() == nihstro::OpCode::Id::IFC) {
-                g_if_else_offset_stack.push_back(IfElseData(instr.flow_control.dest_offset.Value() - i, instr.flow_control.num_instructions.Value()));
+                state.if_else_offset_stack.push_back(IfElseData(instr.flow_control.dest_offset.Value() - i, instr.flow_control.num_instructions.Value()));
 
                 nest_depth++;
             }
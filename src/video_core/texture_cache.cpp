@@ -0,0 +1,87 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <memory>
+#include <unordered_map>
+
+#include "common/hash.h"
+#include "common/make_unique.h"
+
+#include "core/mem_map.h"
+
+#include "debug_utils/debug_utils.h"
+#include "texture_cache.h"
+#include "texture_decoder.h"
+
+namespace Pica {
+
+namespace Rasterizer {
+
+/// Memory used by decoded textures above which the cache is emptied, in bytes
+static const size_t MAX_CACHED_TEXTURE_BYTES = 64 * 1024 * 1024;
+
+/// Decoded textures, keyed by a hash of their address, format and size
+static std::unordered_map<u64, std::unique_ptr<CachedTexture>> texture_cache;
+
+/// Memory used by the texels of all decoded textures, in bytes
+static size_t cached_texture_bytes = 0;
+
+const CachedTexture& GetCachedTexture(const Regs::TextureConfig& config, Regs::TextureFormat format) {
+    const u32 key[4] = { config.GetPhysicalAddress(), (u32)format, config.width, config.height };
+    const u64 hash = Common::ComputeHash64(key, sizeof(key));
+
+    auto it = texture_cache.find(hash);
+    if (it != texture_cache.end()) {
+        const CachedTexture& texture = *it->second;
+        if (texture.address == key[0] && texture.format == format &&
+            texture.width == (int)config.width && texture.height == (int)config.height)
+            return texture;
+
+        cached_texture_bytes -= texture.texels.size() * sizeof(texture.texels[0]);
+        texture_cache.erase(it);
+    }
+
+    std::unique_ptr<CachedTexture> texture = Common::make_unique<CachedTexture>();
+    texture->address = config.GetPhysicalAddress();
+    texture->format = format;
+    texture->width = config.width;
+    texture->height = config.height;
+    texture->size = Regs::NibblesPerPixel(format) * texture->width * texture->height / 2;
+
+    u8* texture_data = Memory::GetPhysicalPointer(texture->address);
+    texture->texels.resize(texture->width * texture->height);
+    TextureDecoder::DecodeTexture(texture_data, texture->width, texture->height, format,
+                                  texture->texels.data(), texture->width);
+    DebugUtils::DumpTexture(config, texture_data);
+
+    Memory::MarkTextureRegion(texture->address, texture->size);
+    cached_texture_bytes += texture->texels.size() * sizeof(texture->texels[0]);
+
+    return *texture_cache.emplace(hash, std::move(texture)).first->second;
+}
+
+void TrimTextureCache() {
+    if (cached_texture_bytes <= MAX_CACHED_TEXTURE_BYTES)
+        return;
+
+    // Pages of discarded textures stay watched, which is harmless
+    texture_cache.clear();
+    cached_texture_bytes = 0;
+}
+
+void InvalidateTextures(PAddr addr, u32 size) {
+    for (auto it = texture_cache.begin(); it != texture_cache.end();) {
+        const CachedTexture& texture = *it->second;
+        if (texture.address < addr + size && addr < texture.address + texture.size) {
+            cached_texture_bytes -= texture.texels.size() * sizeof(texture.texels[0]);
+            it = texture_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace
+
+} // namespace
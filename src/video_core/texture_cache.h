@@ -0,0 +1,52 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "math.h"
+#include "pica.h"
+
+namespace Pica {
+
+namespace Rasterizer {
+
+/// Texture decoded to linear RGBA8 texels
+struct CachedTexture {
+    PAddr address;
+    u32 size;               ///< Size of the encoded texture in guest memory, in bytes
+    Regs::TextureFormat format;
+    int width;
+    int height;
+
+    /// Texels in the order of the coordinates passed to DebugUtils::LookupTexture, rows first
+    std::vector<Math::Vec4<u8>> texels;
+
+    const Math::Vec4<u8>& Lookup(int s, int t) const {
+        return texels[t * width + s];
+    }
+};
+
+/**
+ * Returns the decoded version of the given texture, decoding it if it isn't cached yet. The
+ * memory backing the texture is watched for writes, which discard the decoded copy again.
+ * Returned textures stay valid until the next call to TrimTextureCache or InvalidateTextures.
+ */
+const CachedTexture& GetCachedTexture(const Regs::TextureConfig& config, Regs::TextureFormat format);
+
+/// Discards all decoded textures if they take up more memory than the cache is allowed to
+void TrimTextureCache();
+
+/**
+ * Discards the decoded textures overlapping the given physical memory region. Needs to be called
+ * whenever the region is modified other than by Memory::Write*, e.g. by DMA.
+ */
+void InvalidateTextures(PAddr addr, u32 size);
+
+} // namespace
+
+} // namespace
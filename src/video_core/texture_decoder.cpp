@@ -0,0 +1,597 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include "common/bit_field.h"
+#include "common/logging/log.h"
+
+#include "color.h"
+#include "texture_decoder.h"
+
+namespace Pica {
+
+namespace TextureDecoder {
+
+#if defined(__x86_64__) || defined(_M_X64)
+// SSSE3 isn't part of the x86-64 baseline, so functions using it are compiled for it individually
+// and only called if the host supports it.
+#ifdef _MSC_VER
+#define SSSE3_FUNCTION
+#else
+#define SSSE3_FUNCTION __attribute__((__target__("ssse3")))
+#endif
+#endif
+
+/// Color block of a 4x4 ETC1 subtile. Texels are numbered column by column, i.e. texel 4 * x + y.
+union ETC1Block {
+    u64 hex;
+
+    // Each of these two is a collection of 16 bits (one per texel)
+    BitField< 0, 16, u64> table_subindexes;
+    BitField<16, 16, u64> negation_flags;
+
+    BitField<32, 1, u64> flip;
+    BitField<33, 1, u64> differential_mode;
+
+    BitField<34, 3, u64> table_index_2;
+    BitField<37, 3, u64> table_index_1;
+
+    union {
+        // delta value + base value
+        BitField<40, 3, s64> db;
+        BitField<43, 5, u64> b;
+
+        BitField<48, 3, s64> dg;
+        BitField<51, 5, u64> g;
+
+        BitField<56, 3, s64> dr;
+        BitField<59, 5, u64> r;
+    } differential;
+
+    union {
+        BitField<40, 4, u64> b2;
+        BitField<44, 4, u64> b1;
+
+        BitField<48, 4, u64> g2;
+        BitField<52, 4, u64> g1;
+
+        BitField<56, 4, u64> r2;
+        BitField<60, 4, u64> r1;
+    } separate;
+
+    /// Returns a mask of the texels in the second half of the subtile
+    u16 GetSecondHalfMask() const {
+        // The halves are split horizontally (texel y >= 2) if flip is set, vertically otherwise
+        return flip ? 0xCCCC : 0xFF00;
+    }
+
+    /// Returns the base colors of the two halves of the subtile
+    void GetBaseColors(Math::Vec3<u8> base[2]) const {
+        if (differential_mode) {
+            base[0] = Math::MakeVec(Color::Convert5To8(differential.r),
+                                    Color::Convert5To8(differential.g),
+                                    Color::Convert5To8(differential.b));
+            base[1] = Math::MakeVec(Color::Convert5To8(differential.r + differential.dr),
+                                    Color::Convert5To8(differential.g + differential.dg),
+                                    Color::Convert5To8(differential.b + differential.db));
+        } else {
+            base[0] = Math::MakeVec(Color::Convert4To8(separate.r1),
+                                    Color::Convert4To8(separate.g1),
+                                    Color::Convert4To8(separate.b1));
+            base[1] = Math::MakeVec(Color::Convert4To8(separate.r2),
+                                    Color::Convert4To8(separate.g2),
+                                    Color::Convert4To8(separate.b2));
+        }
+    }
+};
+
+static const u8 etc1_modifier_table[8][2] = {
+    {  2,  8 }, {  5, 17 }, {  9,  29 }, { 13,  42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+/**
+ * Signature of the functions decoding a single subtile.
+ * @param block Color block of the subtile
+ * @param alpha Alpha block of the subtile, all ones for ETC1
+ * @param dest Pointer to the first texel of the subtile
+ * @param dest_stride Distance between two texel rows in dest, in texels
+ */
+typedef void (*SubtileDecoder)(ETC1Block block, u64 alpha, Math::Vec4<u8>* dest, int dest_stride);
+
+/**
+ * Writes the texels of a subtile given the 8 colors it can use. Color 4 * half + 2 * negate + subindex
+ * is the base color of the given half with the modifier selected by subindex added or subtracted.
+ */
+static void WriteSubtile(const Math::Vec4<u8> palette[8], ETC1Block block, u64 alpha,
+                         Math::Vec4<u8>* dest, int dest_stride) {
+    const u16 second_half = block.GetSecondHalfMask();
+    const u32 subindexes = block.table_subindexes;
+    const u32 negation_flags = block.negation_flags;
+
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            const unsigned texel = 4 * x + y;
+            const unsigned index = ((second_half >> texel) & 1) * 4 + ((negation_flags >> texel) & 1) * 2 +
+                                   ((subindexes >> texel) & 1);
+
+            Math::Vec4<u8> color = palette[index];
+            color.a() = Color::Convert4To8((alpha >> (4 * texel)) & 0xF);
+            dest[y * dest_stride + x] = color;
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+/// Builds the palette with saturating arithmetic, but still looks up the texels one by one
+static void DecodeSubtileSSE2(ETC1Block block, u64 alpha, Math::Vec4<u8>* dest, int dest_stride) {
+    Math::Vec3<u8> base[2];
+    block.GetBaseColors(base);
+    const u8* modifiers[2] = { etc1_modifier_table[block.table_index_1],
+                               etc1_modifier_table[block.table_index_2] };
+
+    Math::Vec4<u8> palette[8];
+    for (int half = 0; half < 2; ++half) {
+        const u32 base_color = base[half].r() | (base[half].g() << 8) | (base[half].b() << 16);
+        const u32 modifier0 = modifiers[half][0] * 0x010101;
+        const u32 modifier1 = modifiers[half][1] * 0x010101;
+
+        __m128i colors = _mm_adds_epu8(_mm_set1_epi32(base_color), _mm_setr_epi32(modifier0, modifier1, 0, 0));
+        colors = _mm_subs_epu8(colors, _mm_setr_epi32(0, 0, modifier0, modifier1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(palette + 4 * half), colors);
+    }
+
+    WriteSubtile(palette, block, alpha, dest, dest_stride);
+}
+
+/**
+ * Decodes all texels of a subtile at once. The red, green and blue components of the 8 palette
+ * colors are stored in separate 8-byte tables, from which pshufb selects the component of each
+ * texel. The shuffle masks also transpose the texels from column order to row order.
+ */
+SSSE3_FUNCTION
+static void DecodeSubtileSSSE3(ETC1Block block, u64 alpha, Math::Vec4<u8>* dest, int dest_stride) {
+    Math::Vec3<u8> base[2];
+    block.GetBaseColors(base);
+    const u8* modifiers[2] = { etc1_modifier_table[block.table_index_1],
+                               etc1_modifier_table[block.table_index_2] };
+
+    // Palette entries 4 * half + 2 * negate + subindex of red (bytes 0-7) and green (bytes 8-15)
+    const __m128i base_rg = _mm_setr_epi32(base[0].r() * 0x01010101, base[1].r() * 0x01010101,
+                                           base[0].g() * 0x01010101, base[1].g() * 0x01010101);
+    const __m128i base_b = _mm_setr_epi32(base[0].b() * 0x01010101, base[1].b() * 0x01010101, 0, 0);
+    const u32 added0 = modifiers[0][0] | (modifiers[0][1] << 8);
+    const u32 added1 = modifiers[1][0] | (modifiers[1][1] << 8);
+    const __m128i added = _mm_setr_epi32(added0, added1, added0, added1);
+    const __m128i subtracted = _mm_slli_epi32(added, 16);
+
+    const __m128i palette_rg = _mm_subs_epu8(_mm_adds_epu8(base_rg, added), subtracted);
+    const __m128i palette_b = _mm_subs_epu8(_mm_adds_epu8(base_b, added), subtracted);
+
+    // Texel y * 4 + x of the row-ordered output is texel 4 * x + y of the subtile, i.e. bit
+    // (4 * x + y) % 8 of byte (4 * x + y) / 8 of the subindexes and negation flags
+    const __m128i flag_bits = _mm_cvtsi32_si128((u32)block.hex);
+    const __m128i bit_masks = _mm_setr_epi8(1, 16, 1, 16, 2, 32, 2, 32, 4, 64, 4, 64, 8, -128, 8, -128);
+    const __m128i subindex_bytes = _mm_setr_epi8(0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1);
+    const __m128i negation_bytes = _mm_setr_epi8(2, 2, 3, 3, 2, 2, 3, 3, 2, 2, 3, 3, 2, 2, 3, 3);
+
+    __m128i subindexes = _mm_and_si128(_mm_shuffle_epi8(flag_bits, subindex_bytes), bit_masks);
+    subindexes = _mm_and_si128(_mm_cmpeq_epi8(subindexes, bit_masks), _mm_set1_epi8(1));
+    __m128i negation_flags = _mm_and_si128(_mm_shuffle_epi8(flag_bits, negation_bytes), bit_masks);
+    negation_flags = _mm_and_si128(_mm_cmpeq_epi8(negation_flags, bit_masks), _mm_set1_epi8(2));
+
+    const __m128i second_half = block.flip
+                              ? _mm_setr_epi32(0, 0, 0x04040404, 0x04040404)
+                              : _mm_set1_epi32(0x04040000);
+    const __m128i indexes = _mm_or_si128(_mm_or_si128(subindexes, negation_flags), second_half);
+
+    const __m128i r = _mm_shuffle_epi8(palette_rg, indexes);
+    const __m128i g = _mm_shuffle_epi8(palette_rg, _mm_add_epi8(indexes, _mm_set1_epi8(8)));
+    const __m128i b = _mm_shuffle_epi8(palette_b, indexes);
+
+    // Alpha of texel 4 * x + y is nibble (4 * x + y) % 2 of byte (4 * x + y) / 2
+    const __m128i alpha_bytes = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&alpha)),
+                                                 _mm_setr_epi8(0, 2, 4, 6, 0, 2, 4, 6, 1, 3, 5, 7, 1, 3, 5, 7));
+    const __m128i odd_rows = _mm_setr_epi32(0, -1, 0, -1);
+    const __m128i nibble_mask = _mm_set1_epi8(0xF);
+    __m128i a = _mm_or_si128(_mm_andnot_si128(odd_rows, _mm_and_si128(alpha_bytes, nibble_mask)),
+                             _mm_and_si128(odd_rows, _mm_and_si128(_mm_srli_epi16(alpha_bytes, 4), nibble_mask)));
+    a = _mm_or_si128(a, _mm_slli_epi16(a, 4));
+
+    const __m128i rg_low = _mm_unpacklo_epi8(r, g);
+    const __m128i rg_high = _mm_unpackhi_epi8(r, g);
+    const __m128i ba_low = _mm_unpacklo_epi8(b, a);
+    const __m128i ba_high = _mm_unpackhi_epi8(b, a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_unpacklo_epi16(rg_low, ba_low));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + dest_stride), _mm_unpackhi_epi16(rg_low, ba_low));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 2 * dest_stride), _mm_unpacklo_epi16(rg_high, ba_high));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 3 * dest_stride), _mm_unpackhi_epi16(rg_high, ba_high));
+}
+
+static bool HostSupportsSSSE3() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] >> 9) & 1;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 9) & 1);
+#endif
+}
+
+static SubtileDecoder SelectSubtileDecoder() {
+    return HostSupportsSSSE3() ? DecodeSubtileSSSE3 : DecodeSubtileSSE2;
+}
+
+#else
+
+/// Portable decoder for hosts without SSE2
+static void DecodeSubtile(ETC1Block block, u64 alpha, Math::Vec4<u8>* dest, int dest_stride) {
+    Math::Vec3<u8> base[2];
+    block.GetBaseColors(base);
+    const u8* modifiers[2] = { etc1_modifier_table[block.table_index_1],
+                               etc1_modifier_table[block.table_index_2] };
+
+    Math::Vec4<u8> palette[8];
+    for (unsigned index = 0; index < 8; ++index) {
+        const unsigned half = index / 4;
+        int modifier = modifiers[half][index & 1];
+        if (index & 2)
+            modifier = -modifier;
+
+        for (int i = 0; i < 3; ++i)
+            palette[index][i] = std::min(std::max(base[half][i] + modifier, 0), 255);
+    }
+
+    WriteSubtile(palette, block, alpha, dest, dest_stride);
+}
+
+static SubtileDecoder SelectSubtileDecoder() {
+    return DecodeSubtile;
+}
+
+#endif // x86_64
+
+/// Fastest subtile decoder supported by the host
+static const SubtileDecoder decode_subtile = SelectSubtileDecoder();
+
+void DecodeETC1Tile(const u8* source, bool has_alpha, Math::Vec4<u8>* dest, int dest_stride) {
+    const unsigned subtile_bytes = has_alpha ? 16 : 8;
+
+    // ETC1 further subdivides each 8x8 tile into four 4x4 subtiles
+    for (int subtile = 0; subtile < 4; ++subtile) {
+        const u64* block = reinterpret_cast<const u64*>(source + subtile * subtile_bytes);
+        u64 alpha = 0xFFFFFFFFFFFFFFFF;
+        if (has_alpha) {
+            alpha = *block;
+            block++;
+        }
+
+        ETC1Block color_block;
+        color_block.hex = *block;
+        decode_subtile(color_block, alpha, dest + (subtile / 2) * 4 * dest_stride + (subtile % 2) * 4,
+                       dest_stride);
+    }
+}
+
+void DecodeETC1(const u8* source, int width, int height, bool has_alpha,
+                Math::Vec4<u8>* dest, int dest_stride) {
+    const unsigned tile_bytes = has_alpha ? 64 : 32;
+    const int tiles_per_row = width / 8;
+
+    for (int y = 0; y < height; y += 8) {
+        for (int x = 0; x < width; x += 8) {
+            const u8* tile = source + ((y / 8) * tiles_per_row + x / 8) * tile_bytes;
+
+            if (x + 8 <= width && y + 8 <= height) {
+                DecodeETC1Tile(tile, has_alpha, dest + y * dest_stride + x, dest_stride);
+                continue;
+            }
+
+            // Partial tiles at the edges of textures with dimensions which aren't multiples of 8
+            Math::Vec4<u8> texels[8 * 8];
+            DecodeETC1Tile(tile, has_alpha, texels, 8);
+            for (int row = 0; row < std::min(8, height - y); ++row)
+                std::copy_n(texels + row * 8, std::min(8, width - x), dest + (y + row) * dest_stride + x);
+        }
+    }
+}
+
+/// Offset of the first texel of each row of an 8x8 tile, whose texels are stored in Morton order
+static const u8 morton_row_offsets[8] = { 0, 2, 8, 10, 32, 34, 40, 42 };
+
+/// Offsets of the pairs of horizontally adjacent texels of a row, relative to its first texel
+static const u8 morton_pair_offsets[4] = { 0, 4, 16, 20 };
+
+/**
+ * Signature of the functions converting the texels of an 8x8 tile to RGBA8.
+ * @param source Pointer to the encoded tile
+ * @param dest Array of 64 texels, which are written in the Morton order they are stored in
+ */
+typedef void (*TileConverter)(const u8* source, Math::Vec4<u8>* dest);
+
+/// Decodes the texel with the given Morton index in a tile, like DebugUtils::LookupTexture
+template <Regs::TextureFormat format>
+static const Math::Vec4<u8> DecodeTexel(const u8* source, unsigned index) {
+    switch (format) {
+    case Regs::TextureFormat::RGBA8:
+        return Color::DecodeRGBA8(source + index * 4);
+
+    case Regs::TextureFormat::RGB8:
+        return Color::DecodeRGB8(source + index * 3);
+
+    case Regs::TextureFormat::RGB5A1:
+        return Color::DecodeRGB5A1(source + index * 2);
+
+    case Regs::TextureFormat::RGB565:
+        return Color::DecodeRGB565(source + index * 2);
+
+    case Regs::TextureFormat::RGBA4:
+        return Color::DecodeRGBA4(source + index * 2);
+
+    case Regs::TextureFormat::IA8:
+        return { source[index * 2 + 1], source[index * 2 + 1], source[index * 2 + 1], source[index * 2] };
+
+    case Regs::TextureFormat::I8:
+        return { source[index], source[index], source[index], 255 };
+
+    case Regs::TextureFormat::A8:
+        return { 0, 0, 0, source[index] };
+
+    case Regs::TextureFormat::IA4:
+    {
+        const u8 i = Color::Convert4To8(source[index] >> 4);
+        return { i, i, i, Color::Convert4To8(source[index] & 0xF) };
+    }
+
+    case Regs::TextureFormat::A4:
+    {
+        const u8 byte = source[index / 2];
+        return { 0, 0, 0, Color::Convert4To8((index % 2) ? (byte >> 4) : (byte & 0xF)) };
+    }
+
+    default:
+        return {};
+    }
+}
+
+/// Portable tile converter, specialized with SSE2 for the formats where that pays off
+template <Regs::TextureFormat format>
+static void ConvertTile(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned index = 0; index < 8 * 8; ++index)
+        dest[index] = DecodeTexel<format>(source, index);
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+/**
+ * Stores 8 texels given as their red and green components (low and high byte of each 16-bit lane)
+ * and their blue and alpha components
+ */
+static void StoreTexels(__m128i rg, __m128i ba, Math::Vec4<u8>* dest) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 4), _mm_unpackhi_epi16(rg, ba));
+}
+
+/// Stores 16 texels given as 8-bit components
+static void StoreTexels8(__m128i r, __m128i g, __m128i b, __m128i a, Math::Vec4<u8>* dest) {
+    StoreTexels(_mm_unpacklo_epi8(r, g), _mm_unpacklo_epi8(b, a), dest);
+    StoreTexels(_mm_unpackhi_epi8(r, g), _mm_unpackhi_epi8(b, a), dest + 8);
+}
+
+static __m128i LoadTileData(const u8* source, unsigned offset) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + offset));
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::RGBA8>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8 * 4; offset += 16) {
+        // Reverse the byte order of each texel, first within its two halves, then of the halves
+        __m128i texels = LoadTileData(source, offset);
+        texels = _mm_or_si128(_mm_slli_epi16(texels, 8), _mm_srli_epi16(texels, 8));
+        texels = _mm_shufflehi_epi16(_mm_shufflelo_epi16(texels, 0xB1), 0xB1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + offset / 4), texels);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::RGB5A1>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8 * 2; offset += 16) {
+        const __m128i pixels = LoadTileData(source, offset);
+        const __m128i r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 8), _mm_set1_epi16(0xF8)),
+                                       _mm_srli_epi16(pixels, 13));
+        const __m128i g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 3), _mm_set1_epi16(0xF8)),
+                                       _mm_and_si128(_mm_srli_epi16(pixels, 8), _mm_set1_epi16(0x7)));
+        const __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(pixels, 2), _mm_set1_epi16(0xF8)),
+                                       _mm_and_si128(_mm_srli_epi16(pixels, 3), _mm_set1_epi16(0x7)));
+        const __m128i a = _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(pixels, _mm_set1_epi16(0x1)));
+        StoreTexels(_mm_or_si128(r, _mm_slli_epi16(g, 8)), _mm_or_si128(b, _mm_slli_epi16(a, 8)), dest + offset / 2);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::RGB565>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8 * 2; offset += 16) {
+        const __m128i pixels = LoadTileData(source, offset);
+        const __m128i r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 8), _mm_set1_epi16(0xF8)),
+                                       _mm_srli_epi16(pixels, 13));
+        const __m128i g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 3), _mm_set1_epi16(0xFC)),
+                                       _mm_and_si128(_mm_srli_epi16(pixels, 9), _mm_set1_epi16(0x3)));
+        const __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(pixels, 3), _mm_set1_epi16(0xF8)),
+                                       _mm_and_si128(_mm_srli_epi16(pixels, 2), _mm_set1_epi16(0x7)));
+        StoreTexels(_mm_or_si128(r, _mm_slli_epi16(g, 8)), _mm_or_si128(b, _mm_set1_epi16(0xFF00)), dest + offset / 2);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::RGBA4>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8 * 2; offset += 16) {
+        // Each 16-bit lane of ag holds alpha and green, the one of br blue and red
+        const __m128i pixels = LoadTileData(source, offset);
+        __m128i ag = _mm_and_si128(pixels, _mm_set1_epi16(0x0F0F));
+        __m128i br = _mm_and_si128(_mm_srli_epi16(pixels, 4), _mm_set1_epi16(0x0F0F));
+        ag = _mm_or_si128(ag, _mm_slli_epi16(ag, 4));
+        br = _mm_or_si128(br, _mm_slli_epi16(br, 4));
+
+        const __m128i rg = _mm_or_si128(_mm_srli_epi16(br, 8), _mm_and_si128(ag, _mm_set1_epi16(0xFF00)));
+        const __m128i ba = _mm_or_si128(_mm_and_si128(br, _mm_set1_epi16(0x00FF)), _mm_slli_epi16(ag, 8));
+        StoreTexels(rg, ba, dest + offset / 2);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::IA8>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8 * 2; offset += 16) {
+        // Alpha is stored in the low byte, intensity in the high byte
+        const __m128i pixels = LoadTileData(source, offset);
+        const __m128i intensity = _mm_srli_epi16(pixels, 8);
+        const __m128i rg = _mm_or_si128(intensity, _mm_slli_epi16(intensity, 8));
+        const __m128i ba = _mm_or_si128(intensity, _mm_slli_epi16(pixels, 8));
+        StoreTexels(rg, ba, dest + offset / 2);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::I8>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8; offset += 16) {
+        const __m128i i = LoadTileData(source, offset);
+        StoreTexels8(i, i, i, _mm_set1_epi8(-1), dest + offset);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::A8>(const u8* source, Math::Vec4<u8>* dest) {
+    const __m128i zero = _mm_setzero_si128();
+    for (unsigned offset = 0; offset < 8 * 8; offset += 16)
+        StoreTexels8(zero, zero, zero, LoadTileData(source, offset), dest + offset);
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::IA4>(const u8* source, Math::Vec4<u8>* dest) {
+    for (unsigned offset = 0; offset < 8 * 8; offset += 16) {
+        // Intensity is stored in the high nibble, alpha in the low one
+        const __m128i pixels = LoadTileData(source, offset);
+        const __m128i high = _mm_and_si128(pixels, _mm_set1_epi8(0xF0));
+        const __m128i low = _mm_and_si128(pixels, _mm_set1_epi8(0x0F));
+        const __m128i i = _mm_or_si128(high, _mm_srli_epi16(high, 4));
+        const __m128i a = _mm_or_si128(low, _mm_slli_epi16(low, 4));
+        StoreTexels8(i, i, i, a, dest + offset);
+    }
+}
+
+template <>
+void ConvertTile<Regs::TextureFormat::A4>(const u8* source, Math::Vec4<u8>* dest) {
+    const __m128i zero = _mm_setzero_si128();
+    for (unsigned offset = 0; offset < 8 * 8 / 2; offset += 16) {
+        // Each byte holds two texels, the first one in the low nibble
+        const __m128i pixels = LoadTileData(source, offset);
+        const __m128i first = _mm_and_si128(pixels, _mm_set1_epi8(0x0F));
+        const __m128i second = _mm_and_si128(_mm_srli_epi16(pixels, 4), _mm_set1_epi8(0x0F));
+        __m128i a = _mm_unpacklo_epi8(first, second);
+        StoreTexels8(zero, zero, zero, _mm_or_si128(a, _mm_slli_epi16(a, 4)), dest + offset * 2);
+        a = _mm_unpackhi_epi8(first, second);
+        StoreTexels8(zero, zero, zero, _mm_or_si128(a, _mm_slli_epi16(a, 4)), dest + offset * 2 + 16);
+    }
+}
+
+/// Copies the texels of a tile from Morton order to rows of the destination
+static void DeswizzleTile(const Math::Vec4<u8>* texels, Math::Vec4<u8>* dest, int dest_stride) {
+    for (int y = 0; y < 8; y += 2) {
+        // Each group of four texels holds a pair of texels of row y followed by the same pair of row y + 1
+        const Math::Vec4<u8>* rows = texels + morton_row_offsets[y];
+        __m128i groups[4];
+        for (int pair = 0; pair < 4; ++pair)
+            groups[pair] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + morton_pair_offsets[pair]));
+
+        __m128i* row = reinterpret_cast<__m128i*>(dest + y * dest_stride);
+        __m128i* next_row = reinterpret_cast<__m128i*>(dest + (y + 1) * dest_stride);
+        _mm_storeu_si128(row, _mm_unpacklo_epi64(groups[0], groups[1]));
+        _mm_storeu_si128(row + 1, _mm_unpacklo_epi64(groups[2], groups[3]));
+        _mm_storeu_si128(next_row, _mm_unpackhi_epi64(groups[0], groups[1]));
+        _mm_storeu_si128(next_row + 1, _mm_unpackhi_epi64(groups[2], groups[3]));
+    }
+}
+
+#else
+
+/// Copies the texels of a tile from Morton order to rows of the destination
+static void DeswizzleTile(const Math::Vec4<u8>* texels, Math::Vec4<u8>* dest, int dest_stride) {
+    for (int y = 0; y < 8; ++y) {
+        for (int pair = 0; pair < 4; ++pair)
+            std::copy_n(texels + morton_row_offsets[y] + morton_pair_offsets[pair], 2, dest + y * dest_stride + 2 * pair);
+    }
+}
+
+#endif // x86_64
+
+static TileConverter GetTileConverter(Regs::TextureFormat format) {
+    switch (format) {
+    case Regs::TextureFormat::RGBA8:  return ConvertTile<Regs::TextureFormat::RGBA8>;
+    case Regs::TextureFormat::RGB8:   return ConvertTile<Regs::TextureFormat::RGB8>;
+    case Regs::TextureFormat::RGB5A1: return ConvertTile<Regs::TextureFormat::RGB5A1>;
+    case Regs::TextureFormat::RGB565: return ConvertTile<Regs::TextureFormat::RGB565>;
+    case Regs::TextureFormat::RGBA4:  return ConvertTile<Regs::TextureFormat::RGBA4>;
+    case Regs::TextureFormat::IA8:    return ConvertTile<Regs::TextureFormat::IA8>;
+    case Regs::TextureFormat::I8:     return ConvertTile<Regs::TextureFormat::I8>;
+    case Regs::TextureFormat::A8:     return ConvertTile<Regs::TextureFormat::A8>;
+    case Regs::TextureFormat::IA4:    return ConvertTile<Regs::TextureFormat::IA4>;
+    case Regs::TextureFormat::A4:     return ConvertTile<Regs::TextureFormat::A4>;
+    default:                          return nullptr;
+    }
+}
+
+void DecodeTexture(const u8* source, int width, int height, Regs::TextureFormat format,
+                   Math::Vec4<u8>* dest, int dest_stride) {
+    if (format == Regs::TextureFormat::ETC1 || format == Regs::TextureFormat::ETC1A4) {
+        DecodeETC1(source, width, height, format == Regs::TextureFormat::ETC1A4, dest, dest_stride);
+        return;
+    }
+
+    const TileConverter convert_tile = GetTileConverter(format);
+    if (convert_tile == nullptr) {
+        LOG_ERROR(HW_GPU, "Unknown texture format: %x", (u32)format);
+        for (int t = 0; t < height; ++t)
+            std::fill_n(dest + t * dest_stride, width, Math::Vec4<u8>());
+        return;
+    }
+
+    const unsigned nibbles_per_pixel = Regs::NibblesPerPixel(format);
+
+    for (int y = 0; y < height; y += 8) {
+        for (int x = 0; x < width; x += 8) {
+            // Tiles are stored row by row, which makes tile x of a row start after x * 8 texels
+            const u8* tile = source + (y * width + x * 8) * nibbles_per_pixel / 2;
+
+            Math::Vec4<u8> texels[8 * 8];
+            convert_tile(tile, texels);
+
+            if (x + 8 <= width && y + 8 <= height) {
+                DeswizzleTile(texels, dest + y * dest_stride + x, dest_stride);
+                continue;
+            }
+
+            // Partial tiles at the edges of textures with dimensions which aren't multiples of 8
+            Math::Vec4<u8> rows[8 * 8];
+            DeswizzleTile(texels, rows, 8);
+            for (int row = 0; row < std::min(8, height - y); ++row)
+                std::copy_n(rows + row * 8, std::min(8, width - x), dest + (y + row) * dest_stride + x);
+        }
+    }
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,55 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "math.h"
+#include "pica.h"
+
+namespace Pica {
+
+namespace TextureDecoder {
+
+/**
+ * Decodes a single 8x8 ETC1 or ETC1A4 tile to RGBA8.
+ * @param source Pointer to the encoded tile
+ * @param has_alpha True for ETC1A4, false for ETC1
+ * @param dest Pointer to the first texel of the tile, texel (x, y) is written to dest[y * dest_stride + x]
+ * @param dest_stride Distance between two texel rows in dest, in texels. May be negative.
+ */
+void DecodeETC1Tile(const u8* source, bool has_alpha, Math::Vec4<u8>* dest, int dest_stride);
+
+/**
+ * Decodes a whole ETC1 or ETC1A4 texture to RGBA8. The result is identical to calling
+ * DebugUtils::LookupTexture for each texel, but decodes each block only once.
+ * @param source Pointer to the encoded texture
+ * @param width,height Dimensions of the texture
+ * @param has_alpha True for ETC1A4, false for ETC1
+ * @param dest Texel (s, t) is written to dest[t * dest_stride + s]
+ * @param dest_stride Distance between two texel rows in dest, in texels. May be negative to store
+ *                    the texture upside down.
+ */
+void DecodeETC1(const u8* source, int width, int height, bool has_alpha,
+                Math::Vec4<u8>* dest, int dest_stride);
+
+/**
+ * Decodes a whole texture of any format to RGBA8. The result is identical to calling
+ * DebugUtils::LookupTexture for each texel, but each 8x8 tile is converted and brought from Morton
+ * order into rows at once. Only reads the source and writes dest, so it may be called from any
+ * thread, e.g. to decode textures ahead of their use.
+ * @param source Pointer to the encoded texture
+ * @param width,height Dimensions of the texture
+ * @param format Format of the encoded texture
+ * @param dest Texel (s, t) is written to dest[t * dest_stride + s]
+ * @param dest_stride Distance between two texel rows in dest, in texels. May be negative to store
+ *                    the texture upside down.
+ */
+void DecodeTexture(const u8* source, int width, int height, Regs::TextureFormat format,
+                   Math::Vec4<u8>* dest, int dest_stride);
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,85 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+namespace Pica {
+
+/**
+ * Post-transform vertex cache for indexed draws. Meshes reference most of their vertices from
+ * several primitives, so remembering the processed vertices of recently used indices lets us load
+ * and shade each of them only once.
+ *
+ * The cache is direct-mapped on the low bits of the vertex index. Vertex attributes and shader
+ * state can't change in the middle of a draw call, so entries never need to be invalidated, but
+ * the cache has to be cleared before each draw call.
+ */
+template<typename VertexType>
+class VertexCache {
+public:
+    /// Number of cached vertices
+    static const size_t NUM_ENTRIES = 256;
+
+    VertexCache() {
+        Clear();
+    }
+
+    /// Discards all cached vertices and resets the hit statistics
+    void Clear() {
+        tags.fill(INVALID_TAG);
+        hits = misses = 0;
+    }
+
+    /**
+     * Looks up the processed vertex for the given index
+     * @param index Index of the vertex in the current draw call
+     * @return Pointer to the cached vertex, or nullptr if it needs to be processed (and inserted)
+     */
+    const VertexType* Find(u32 index) {
+        const size_t slot = index % NUM_ENTRIES;
+        if (tags[slot] != index) {
+            ++misses;
+            return nullptr;
+        }
+
+        ++hits;
+        return &vertices[slot];
+    }
+
+    /// Stores the processed vertex for the given index, possibly replacing another one
+    void Insert(u32 index, const VertexType& vertex) {
+        const size_t slot = index % NUM_ENTRIES;
+        tags[slot] = index;
+        vertices[slot] = vertex;
+    }
+
+    /// Returns the number of lookups which found their vertex since the last call to Clear
+    unsigned GetHits() const {
+        return hits;
+    }
+
+    /// Returns the number of lookups which did not find their vertex since the last call to Clear
+    unsigned GetMisses() const {
+        return misses;
+    }
+
+private:
+    /// Tag of unused entries, vertex indices are at most 16 bits wide
+    static const u32 INVALID_TAG = 0xFFFFFFFF;
+
+    std::array<u32, NUM_ENTRIES> tags;
+    std::array<VertexType, NUM_ENTRIES> vertices;
+
+    unsigned hits;
+    unsigned misses;
+};
+
+template<typename VertexType>
+const u32 VertexCache<VertexType>::INVALID_TAG;
+
+} // namespace
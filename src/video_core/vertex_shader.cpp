@@ -2,18 +2,30 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <memory>
 #include <stack>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #include <boost/range/algorithm.hpp>
 
 #include <common/file_util.h>
+#include <common/hash.h>
+#include <common/make_unique.h>
 
 #include <core/mem_map.h>
+#include <core/settings.h>
 
 #include <nihstro/shader_bytecode.h>
 
 
 #include "pica.h"
+#include "shader_jit.h"
+#include "shader_program.h"
 #include "vertex_shader.h"
 #include "debug_utils/debug_utils.h"
 
@@ -21,7 +33,6 @@ using nihstro::OpCode;
 using nihstro::Instruction;
 using nihstro::RegisterType;
 using nihstro::SourceRegister;
-using nihstro::SwizzlePattern;
 
 namespace Pica {
 
@@ -42,14 +53,114 @@ static Math::Vec4<float24> vs_default_attributes[16];
 static std::array<u32, 1024> shader_memory;
 static std::array<u32, 1024> swizzle_data;
 
+/// Hash of the shader memory and swizzle patterns, recomputed when they changed since the last time
+static u64 shader_memory_hash;
+static bool shader_memory_hash_valid = false;
+
+/// Maximal number of decoded programs kept around
+static const size_t MAX_CACHED_PROGRAMS = 64;
+
+/// Decoded programs, keyed by a hash of the shader memory, swizzle patterns and entry point
+static std::unordered_map<u64, std::unique_ptr<DecodedProgram>> program_cache;
+
+/// Program decoded from the current shader memory, or nullptr if it changed since then
+static const DecodedProgram* current_program = nullptr;
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+/// Compiler used by the JIT shader engines, created when first needed
+static std::unique_ptr<ShaderJit> shader_jit;
+
+/// Compiled code of decoded programs, nullptr for programs which can't be compiled
+static std::unordered_map<const DecodedProgram*, JitProgram> jit_programs;
+
+#endif
+
 void SubmitShaderMemoryChange(u32 addr, u32 value) {
+    if (shader_memory[addr] == value)
+        return;
+
     shader_memory[addr] = value;
+    current_program = nullptr;
+    shader_memory_hash_valid = false;
 }
 
 void SubmitSwizzleDataChange(u32 addr, u32 value) {
+    if (swizzle_data[addr] == value)
+        return;
+
     swizzle_data[addr] = value;
+    current_program = nullptr;
+    shader_memory_hash_valid = false;
+}
+
+u64 GetShaderMemoryHash() {
+    if (!shader_memory_hash_valid) {
+        shader_memory_hash = Common::ComputeHash64(shader_memory.data(), sizeof(shader_memory));
+        shader_memory_hash = Common::ComputeHash64(swizzle_data.data(), sizeof(swizzle_data), shader_memory_hash);
+        shader_memory_hash_valid = true;
+    }
+
+    return shader_memory_hash;
 }
 
+/**
+ * Returns the decoded version of the current program. Games tend to upload the same few programs
+ * over and over, so programs are only decoded the first time they're run.
+ */
+static const DecodedProgram& GetCurrentProgram() {
+    const u32 entry_point = registers.vs_main_offset;
+    if (current_program != nullptr && current_program->entry_point == entry_point)
+        return *current_program;
+
+    u64 hash = Common::ComputeHash64(shader_memory.data(), sizeof(shader_memory), entry_point);
+    hash = Common::ComputeHash64(swizzle_data.data(), sizeof(swizzle_data), hash);
+
+    auto it = program_cache.find(hash);
+    if (it == program_cache.end()) {
+        if (program_cache.size() >= MAX_CACHED_PROGRAMS) {
+            program_cache.clear();
+#if defined(__x86_64__) || defined(_M_X64)
+            // Compiled code refers to the decoded programs
+            jit_programs.clear();
+#endif
+        }
+
+        std::unique_ptr<DecodedProgram> program = Common::make_unique<DecodedProgram>();
+        DecodeProgram(*program, shader_memory, swizzle_data, entry_point, shader_uniforms.f);
+        it = program_cache.emplace(hash, std::move(program)).first;
+    }
+
+    current_program = it->second.get();
+    return *current_program;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+/// Returns the compiled code of a decoded program, compiling it if needed
+static JitProgram GetJitProgram(const DecodedProgram& program) {
+    auto it = jit_programs.find(&program);
+    if (it != jit_programs.end())
+        return it->second;
+
+    if (shader_jit == nullptr) {
+        shader_jit = Common::make_unique<ShaderJit>();
+    } else if (shader_jit->IsFull()) {
+        LOG_DEBUG(HW_GPU, "Vertex shader JIT code buffer full, discarding all compiled programs");
+        shader_jit->Clear();
+        jit_programs.clear();
+    }
+
+    JitProgram code = shader_jit->Compile(program);
+    if (code == nullptr)
+        LOG_WARNING(HW_GPU, "Vertex shader at offset %u can't be compiled, using the interpreter", program.entry_point);
+
+    jit_programs.emplace(&program, code);
+    return code;
+}
+
+#endif
+
 Math::Vec4<float24>& GetFloatUniform(u32 index) {
     return shader_uniforms.f[index];
 }
@@ -75,7 +186,7 @@ const std::array<u32, 1024>& GetSwizzlePatterns() {
 }
 
 struct VertexShaderState {
-    u32* program_counter;
+    u32 program_counter;
 
     const float24* input_register_table[16];
     Math::Vec4<float24> output_registers[16];
@@ -87,10 +198,6 @@ struct VertexShaderState {
     // TODO: How many bits do these actually have?
     s32 address_registers[3];
 
-    enum {
-        INVALID_ADDRESS = 0xFFFFFFFF
-    };
-
     struct CallStackElement {
         u32 final_address;  // Address upon which we jump to return_address
         u32 return_address; // Where to jump when leaving scope
@@ -101,7 +208,7 @@ struct VertexShaderState {
     };
 
     // TODO: Is there a maximal size for this?
-    std::stack<CallStackElement> call_stack;
+    std::stack<CallStackElement, std::vector<CallStackElement>> call_stack;
 
     struct {
         u32 max_offset; // maximum program counter ever reached
@@ -109,7 +216,7 @@ struct VertexShaderState {
     } debug;
 };
 
-static void ProcessShaderCode(VertexShaderState& state) {
+static void ProcessShaderCode(VertexShaderState& state, const DecodedProgram& program) {
 
     // Placeholder for invalid inputs
     static float24 dummy_vec4_float24[4];
@@ -117,14 +224,14 @@ static void ProcessShaderCode(VertexShaderState& state) {
     while (true) {
         if (!state.call_stack.empty()) {
             auto& top = state.call_stack.top();
-            if (state.program_counter - shader_memory.data() == top.final_address) {
+            if (state.program_counter == top.final_address) {
                 state.address_registers[2] += top.loop_increment;
 
                 if (top.repeat_counter-- == 0) {
-                    state.program_counter = &shader_memory[top.return_address];
+                    state.program_counter = top.return_address;
                     state.call_stack.pop();
                 } else {
-                    state.program_counter = &shader_memory[top.loop_address];
+                    state.program_counter = top.loop_address;
                 }
 
                 // TODO: Is "trying again" accurate to hardware?
@@ -133,17 +240,15 @@ static void ProcessShaderCode(VertexShaderState& state) {
         }
 
         bool exit_loop = false;
-        const Instruction& instr = *(const Instruction*)state.program_counter;
-        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.common.operand_desc_id];
+        const DecodedInstruction& instr = program.instructions[state.program_counter];
 
-        static auto call = [](VertexShaderState& state, u32 offset, u32 num_instructions,
+        static auto call = [](VertexShaderState& state, u32 offset, u32 final_address,
                               u32 return_offset, u8 repeat_count, u8 loop_increment) {
-            state.program_counter = &shader_memory[offset] - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
-            state.call_stack.push({ offset + num_instructions, return_offset, repeat_count, loop_increment, offset });
+            state.program_counter = offset - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
+            state.call_stack.push({ final_address, return_offset, repeat_count, loop_increment, offset });
         };
-        u32 binary_offset = state.program_counter - shader_memory.data();
 
-        state.debug.max_offset = std::max<u32>(state.debug.max_offset, 1 + binary_offset);
+        state.debug.max_offset = std::max<u32>(state.debug.max_offset, 1 + state.program_counter);
 
         auto LookupSourceRegister = [&](const SourceRegister& source_reg) -> const float24* {
             switch (source_reg.GetRegisterType()) {
@@ -161,60 +266,62 @@ static void ProcessShaderCode(VertexShaderState& state) {
             }
         };
 
-        switch (instr.opcode.Value().GetInfo().type) {
+        auto LookupDecodedSource = [&](const DecodedSource& source) -> const float24* {
+            switch (source.type) {
+            case RegisterType::Input:
+                return state.input_register_table[source.index];
+
+            case RegisterType::Temporary:
+                return &state.temporary_registers[source.index].x;
+
+            case RegisterType::FloatUniform:
+                return source.uniform;
+
+            default:
+                return dummy_vec4_float24;
+            }
+        };
+
+        // Applies the swizzle and negation of an operand
+        auto Swizzle = [](const DecodedSource& source, const float24* reg, float24 (&src)[4]) {
+            for (int i = 0; i < 4; ++i)
+                src[i] = reg[source.selectors[i]];
+
+            if (source.negate) {
+                for (int i = 0; i < 4; ++i)
+                    src[i] = src[i] * float24::FromFloat32(-1);
+            }
+        };
+
+        float24* dest = (instr.dest_type == RegisterType::Output) ? &state.output_registers[instr.dest_index][0]
+                      : (instr.dest_type == RegisterType::Temporary) ? &state.temporary_registers[instr.dest_index][0]
+                      : dummy_vec4_float24;
+
+        switch (instr.type) {
         case OpCode::Type::Arithmetic:
         {
-            bool is_inverted = 0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed);
+            bool is_inverted = 0 != (OpCode(instr.opcode).GetInfo().subtype & OpCode::Info::SrcInversed);
             // TODO: We don't really support this properly: For instance, the address register
             //       offset needs to be applied to SRC2 instead, etc.
             //       For now, we just abort in this situation.
             ASSERT_MSG(!is_inverted, "Bad condition...");
 
-            const int address_offset = (instr.common.address_register_index == 0)
-                                       ? 0 : state.address_registers[instr.common.address_register_index - 1];
+            const float24* src1_ = (instr.address_register_index == 0)
+                                   ? LookupDecodedSource(instr.src[0])
+                                   : LookupSourceRegister(instr.src[0].reg + state.address_registers[instr.address_register_index - 1]);
+            const float24* src2_ = LookupDecodedSource(instr.src[1]);
 
-            const float24* src1_ = LookupSourceRegister(instr.common.GetSrc1(is_inverted) + address_offset);
-            const float24* src2_ = LookupSourceRegister(instr.common.GetSrc2(is_inverted));
+            float24 src1[4], src2[4];
+            Swizzle(instr.src[0], src1_, src1);
+            Swizzle(instr.src[1], src2_, src2);
 
-            const bool negate_src1 = ((bool)swizzle.negate_src1 != false);
-            const bool negate_src2 = ((bool)swizzle.negate_src2 != false);
+            state.debug.max_opdesc_id = std::max<u32>(state.debug.max_opdesc_id, 1+instr.operand_desc_id);
 
-            float24 src1[4] = {
-                src1_[(int)swizzle.GetSelectorSrc1(0)],
-                src1_[(int)swizzle.GetSelectorSrc1(1)],
-                src1_[(int)swizzle.GetSelectorSrc1(2)],
-                src1_[(int)swizzle.GetSelectorSrc1(3)],
-            };
-            if (negate_src1) {
-                src1[0] = src1[0] * float24::FromFloat32(-1);
-                src1[1] = src1[1] * float24::FromFloat32(-1);
-                src1[2] = src1[2] * float24::FromFloat32(-1);
-                src1[3] = src1[3] * float24::FromFloat32(-1);
-            }
-            float24 src2[4] = {
-                src2_[(int)swizzle.GetSelectorSrc2(0)],
-                src2_[(int)swizzle.GetSelectorSrc2(1)],
-                src2_[(int)swizzle.GetSelectorSrc2(2)],
-                src2_[(int)swizzle.GetSelectorSrc2(3)],
-            };
-            if (negate_src2) {
-                src2[0] = src2[0] * float24::FromFloat32(-1);
-                src2[1] = src2[1] * float24::FromFloat32(-1);
-                src2[2] = src2[2] * float24::FromFloat32(-1);
-                src2[3] = src2[3] * float24::FromFloat32(-1);
-            }
-
-            float24* dest = (instr.common.dest.Value() < 0x10) ? &state.output_registers[instr.common.dest.Value().GetIndex()][0]
-                        : (instr.common.dest.Value() < 0x20) ? &state.temporary_registers[instr.common.dest.Value().GetIndex()][0]
-                        : dummy_vec4_float24;
-
-            state.debug.max_opdesc_id = std::max<u32>(state.debug.max_opdesc_id, 1+instr.common.operand_desc_id);
-
-            switch (instr.opcode.Value().EffectiveOpCode()) {
+            switch (instr.opcode) {
             case OpCode::Id::ADD:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = src1[i] + src2[i];
@@ -226,7 +333,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::MUL:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = src1[i] * src2[i];
@@ -237,7 +344,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::FLR:
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = float24::FromFloat32(std::floor(src1[i].ToFloat32()));
@@ -246,7 +353,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::MAX:
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = std::max(src1[i], src2[i]);
@@ -257,12 +364,12 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::DP4:
             {
                 float24 dot = float24::FromFloat32(0.f);
-                int num_components = (instr.opcode.Value() == OpCode::Id::DP3) ? 3 : 4;
+                int num_components = (instr.opcode == OpCode::Id::DP3) ? 3 : 4;
                 for (int i = 0; i < num_components; ++i)
                     dot = dot + src1[i] * src2[i];
 
                 for (int i = 0; i < num_components; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = dot;
@@ -274,7 +381,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::RCP:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     // TODO: Be stable against division by zero!
@@ -289,7 +396,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::RSQ:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     // TODO: Be stable against division by zero!
@@ -303,7 +410,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::MOVA:
             {
                 for (int i = 0; i < 2; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     // TODO: Figure out how the rounding is done on hardware
@@ -316,7 +423,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::MOV:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = src1[i];
@@ -328,36 +435,32 @@ static void ProcessShaderCode(VertexShaderState& state) {
                 for (int i = 0; i < 2; ++i) {
                     // TODO: Can you restrict to one compare via dest masking?
 
-                    auto compare_op = instr.common.compare_op;
-                    auto op = (i == 0) ? compare_op.x.Value() : compare_op.y.Value();
-
-                    switch (op) {
-                        case compare_op.Equal:
+                    switch (instr.compare_op[i]) {
+                        case CompareOp::Equal:
                             state.conditional_code[i] = (src1[i] == src2[i]);
                             break;
 
-                        case compare_op.NotEqual:
+                        case CompareOp::NotEqual:
                             state.conditional_code[i] = (src1[i] != src2[i]);
                             break;
 
-                        case compare_op.LessThan:
+                        case CompareOp::LessThan:
                             state.conditional_code[i] = (src1[i] <  src2[i]);
                             break;
 
-                        case compare_op.LessEqual:
+                        case CompareOp::LessEqual:
                             state.conditional_code[i] = (src1[i] <= src2[i]);
                             break;
 
-                        case compare_op.GreaterThan:
+                        case CompareOp::GreaterThan:
                             state.conditional_code[i] = (src1[i] >  src2[i]);
                             break;
 
-                        case compare_op.GreaterEqual:
+                        case CompareOp::GreaterEqual:
                             state.conditional_code[i] = (src1[i] >= src2[i]);
                             break;
 
                         default:
-                            LOG_ERROR(HW_GPU, "Unknown compare mode %x", static_cast<int>(op));
                             break;
                     }
                 }
@@ -365,7 +468,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             default:
                 LOG_ERROR(HW_GPU, "Unhandled arithmetic instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                          (int)instr.opcode, OpCode(instr.opcode).GetInfo().name, instr.hex);
                 DEBUG_ASSERT(false);
                 break;
             }
@@ -375,135 +478,79 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
         case OpCode::Type::MultiplyAdd:
         {
-            if ((instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MAD) || 
-                (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI)) {
-                const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
-
-                bool is_inverted = (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI);
-
-                const float24* src1_ = LookupSourceRegister(instr.mad.GetSrc1(is_inverted));
-                const float24* src2_ = LookupSourceRegister(instr.mad.GetSrc2(is_inverted));
-                const float24* src3_ = LookupSourceRegister(instr.mad.GetSrc3(is_inverted));
-
-                const bool negate_src1 = ((bool)swizzle.negate_src1 != false);
-                const bool negate_src2 = ((bool)swizzle.negate_src2 != false);
-                const bool negate_src3 = ((bool)swizzle.negate_src3 != false);
-
-                float24 src1[4] = {
-                    src1_[(int)swizzle.GetSelectorSrc1(0)],
-                    src1_[(int)swizzle.GetSelectorSrc1(1)],
-                    src1_[(int)swizzle.GetSelectorSrc1(2)],
-                    src1_[(int)swizzle.GetSelectorSrc1(3)],
-                };
-                if (negate_src1) {
-                    src1[0] = src1[0] * float24::FromFloat32(-1);
-                    src1[1] = src1[1] * float24::FromFloat32(-1);
-                    src1[2] = src1[2] * float24::FromFloat32(-1);
-                    src1[3] = src1[3] * float24::FromFloat32(-1);
-                }
-                float24 src2[4] = {
-                    src2_[(int)swizzle.GetSelectorSrc2(0)],
-                    src2_[(int)swizzle.GetSelectorSrc2(1)],
-                    src2_[(int)swizzle.GetSelectorSrc2(2)],
-                    src2_[(int)swizzle.GetSelectorSrc2(3)],
-                };
-                if (negate_src2) {
-                    src2[0] = src2[0] * float24::FromFloat32(-1);
-                    src2[1] = src2[1] * float24::FromFloat32(-1);
-                    src2[2] = src2[2] * float24::FromFloat32(-1);
-                    src2[3] = src2[3] * float24::FromFloat32(-1);
-                }
-                float24 src3[4] = {
-                    src3_[(int)swizzle.GetSelectorSrc3(0)],
-                    src3_[(int)swizzle.GetSelectorSrc3(1)],
-                    src3_[(int)swizzle.GetSelectorSrc3(2)],
-                    src3_[(int)swizzle.GetSelectorSrc3(3)],
-                };
-                if (negate_src3) {
-                    src3[0] = src3[0] * float24::FromFloat32(-1);
-                    src3[1] = src3[1] * float24::FromFloat32(-1);
-                    src3[2] = src3[2] * float24::FromFloat32(-1);
-                    src3[3] = src3[3] * float24::FromFloat32(-1);
-                }
-
-                float24* dest = (instr.mad.dest.Value() < 0x10) ? &state.output_registers[instr.mad.dest.Value().GetIndex()][0]
-                            : (instr.mad.dest.Value() < 0x20) ? &state.temporary_registers[instr.mad.dest.Value().GetIndex()][0]
-                            : dummy_vec4_float24;
+            if ((instr.opcode == OpCode::Id::MAD) ||
+                (instr.opcode == OpCode::Id::MADI)) {
+                float24 src1[4], src2[4], src3[4];
+                Swizzle(instr.src[0], LookupDecodedSource(instr.src[0]), src1);
+                Swizzle(instr.src[1], LookupDecodedSource(instr.src[1]), src2);
+                Swizzle(instr.src[2], LookupDecodedSource(instr.src[2]), src3);
 
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!(instr.dest_mask & (1 << i)))
                         continue;
 
                     dest[i] = src1[i] * src2[i] + src3[i];
                 }
             } else {
                 LOG_ERROR(HW_GPU, "Unhandled multiply-add instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                          (int)instr.opcode, OpCode(instr.opcode).GetInfo().name, instr.hex);
             }
             break;
         }
 
         default:
         {
-            static auto evaluate_condition = [](const VertexShaderState& state, bool refx, bool refy, Instruction::FlowControlType flow_control) {
-                bool results[2] = { refx == state.conditional_code[0],
-                                    refy == state.conditional_code[1] };
+            static auto evaluate_condition = [](const VertexShaderState& state, const DecodedInstruction& instr) {
+                bool results[2] = { instr.flow.refx == state.conditional_code[0],
+                                    instr.flow.refy == state.conditional_code[1] };
 
-                switch (flow_control.op) {
-                case flow_control.Or:
+                switch (instr.flow.op) {
+                case Instruction::FlowControlType::Or:
                     return results[0] || results[1];
 
-                case flow_control.And:
+                case Instruction::FlowControlType::And:
                     return results[0] && results[1];
 
-                case flow_control.JustX:
+                case Instruction::FlowControlType::JustX:
                     return results[0];
 
-                case flow_control.JustY:
+                case Instruction::FlowControlType::JustY:
+                default:
                     return results[1];
                 }
             };
 
             // Handle each instruction on its own
-            switch (instr.opcode.Value()) {
+            switch (instr.opcode) {
             case OpCode::Id::END:
                 exit_loop = true;
                 break;
 
             case OpCode::Id::JMPC:
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    state.program_counter = &shader_memory[instr.flow_control.dest_offset] - 1;
+                if (evaluate_condition(state, instr)) {
+                    state.program_counter = instr.flow.target - 1;
                 }
                 break;
 
             case OpCode::Id::JMPU:
-                if (shader_uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    state.program_counter = &shader_memory[instr.flow_control.dest_offset] - 1;
+                if (shader_uniforms.b[instr.flow.uniform_id]) {
+                    state.program_counter = instr.flow.target - 1;
                 }
                 break;
 
             case OpCode::Id::CALL:
-                call(state,
-                     instr.flow_control.dest_offset,
-                     instr.flow_control.num_instructions,
-                     binary_offset + 1, 0, 0);
+                call(state, instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
                 break;
 
             case OpCode::Id::CALLU:
-                if (shader_uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    call(state,
-                        instr.flow_control.dest_offset,
-                        instr.flow_control.num_instructions,
-                        binary_offset + 1, 0, 0);
+                if (shader_uniforms.b[instr.flow.uniform_id]) {
+                    call(state, instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
                 }
                 break;
 
             case OpCode::Id::CALLC:
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    call(state,
-                        instr.flow_control.dest_offset,
-                        instr.flow_control.num_instructions,
-                        binary_offset + 1, 0, 0);
+                if (evaluate_condition(state, instr)) {
+                    call(state, instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
                 }
                 break;
 
@@ -511,16 +558,10 @@ static void ProcessShaderCode(VertexShaderState& state) {
                 break;
 
             case OpCode::Id::IFU:
-                if (shader_uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    call(state,
-                         binary_offset + 1,
-                         instr.flow_control.dest_offset - binary_offset - 1,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                if (shader_uniforms.b[instr.flow.uniform_id]) {
+                    call(state, instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
                 } else {
-                    call(state,
-                         instr.flow_control.dest_offset,
-                         instr.flow_control.num_instructions,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                    call(state, instr.flow.else_target, instr.flow.else_end, instr.flow.return_address, 0, 0);
                 }
 
                 break;
@@ -529,16 +570,10 @@ static void ProcessShaderCode(VertexShaderState& state) {
             {
                 // TODO: Do we need to consider swizzlers here?
 
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    call(state,
-                         binary_offset + 1,
-                         instr.flow_control.dest_offset - binary_offset - 1,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                if (evaluate_condition(state, instr)) {
+                    call(state, instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
                 } else {
-                    call(state,
-                         instr.flow_control.dest_offset,
-                         instr.flow_control.num_instructions,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                    call(state, instr.flow.else_target, instr.flow.else_end, instr.flow.return_address, 0, 0);
                 }
 
                 break;
@@ -546,20 +581,17 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::LOOP:
             {
-                state.address_registers[2] = shader_uniforms.i[instr.flow_control.int_uniform_id].y;
+                const auto& loop_uniform = shader_uniforms.i[instr.flow.uniform_id];
+                state.address_registers[2] = loop_uniform.y;
 
-                call(state,
-                     binary_offset + 1,
-                     instr.flow_control.dest_offset - binary_offset + 1,
-                     instr.flow_control.dest_offset + 1,
-                     shader_uniforms.i[instr.flow_control.int_uniform_id].x,
-                     shader_uniforms.i[instr.flow_control.int_uniform_id].z);
+                call(state, instr.flow.target, instr.flow.target_end, instr.flow.return_address,
+                     loop_uniform.x, loop_uniform.z);
                 break;
             }
 
             default:
                 LOG_ERROR(HW_GPU, "Unhandled instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                          (int)instr.opcode, OpCode(instr.opcode).GetInfo().name, instr.hex);
                 break;
             }
 
@@ -574,11 +606,9 @@ static void ProcessShaderCode(VertexShaderState& state) {
     }
 }
 
-OutputVertex RunShader(const InputVertex& input, int num_attributes) {
-    VertexShaderState state;
-
-    const u32* main = &shader_memory[registers.vs_main_offset];
-    state.program_counter = (u32*)main;
+/// Runs the interpreter on a single vertex, leaving the results in the output registers of `state`
+static void RunInterpreter(VertexShaderState& state, const DecodedProgram& program, const InputVertex& input, int num_attributes) {
+    state.program_counter = program.entry_point;
     state.debug.max_offset = 0;
     state.debug.max_opdesc_id = 0;
 
@@ -607,12 +637,14 @@ OutputVertex RunShader(const InputVertex& input, int num_attributes) {
     state.conditional_code[0] = false;
     state.conditional_code[1] = false;
 
-    ProcessShaderCode(state);
+    ProcessShaderCode(state, program);
     DebugUtils::DumpShader(shader_memory.data(), state.debug.max_offset, swizzle_data.data(),
                            state.debug.max_opdesc_id, registers.vs_main_offset,
                            registers.vs_output_attributes);
+}
 
-    // Setup output data
+/// Converts the output registers of a shader run to a vertex, according to the output attribute mapping
+static OutputVertex MakeOutputVertex(const Math::Vec4<float24> (&output_registers)[16]) {
     OutputVertex ret;
     // TODO(neobrain): Under some circumstances, up to 16 attributes may be output. We need to
     // figure out what those circumstances are and enable the remaining outputs then.
@@ -627,7 +659,7 @@ OutputVertex RunShader(const InputVertex& input, int num_attributes) {
         for (int comp = 0; comp < 4; ++comp) {
             float24* out = ((float24*)&ret) + semantics[comp];
             if (semantics[comp] != Regs::VSOutputAttributes::INVALID) {
-                *out = state.output_registers[i][comp];
+                *out = output_registers[i][comp];
             } else {
                 // Zero output so that attributes which aren't output won't have denormals in them,
                 // which would slow us down later.
@@ -644,6 +676,761 @@ OutputVertex RunShader(const InputVertex& input, int num_attributes) {
     return ret;
 }
 
+#if defined(__x86_64__) || defined(_M_X64)
+
+/// Runs compiled code on a single vertex, leaving the results in the output registers of `state`
+static void RunJit(JitState& state, JitProgram code, const InputVertex& input, int num_attributes) {
+    memset(state.input_registers, 0, sizeof(state.input_registers));
+    for (int i = 0; i < std::min(num_attributes, 16); ++i)
+        state.input_registers[registers.vs_input_register_map.GetRegisterForAttribute(i)] = input.attr[i];
+
+    state.conditional_code[0] = 0;
+    state.conditional_code[1] = 0;
+    memset(state.address_registers, 0, sizeof(state.address_registers));
+
+    state.float_uniforms = shader_uniforms.f;
+    state.bool_uniforms = shader_uniforms.b.data();
+    state.int_uniforms = shader_uniforms.i.data();
+
+    code(&state);
+}
+
+/// Reports the first output which differs between the compiled code and the interpreter
+static void CheckJitOutputs(const DecodedProgram& program, const JitState& jit_state, const VertexShaderState& state) {
+    for (int i = 0; i < 7; ++i) {
+        const auto& output_register_map = registers.vs_output_attributes[i];
+
+        u32 semantics[4] = {
+            output_register_map.map_x, output_register_map.map_y,
+            output_register_map.map_z, output_register_map.map_w
+        };
+
+        for (int comp = 0; comp < 4; ++comp) {
+            if (semantics[comp] == Regs::VSOutputAttributes::INVALID)
+                continue;
+
+            const float jit_value = jit_state.output_registers[i][comp].ToFloat32();
+            const float value = state.output_registers[i][comp].ToFloat32();
+            if (memcmp(&jit_value, &value, sizeof(value)) == 0 || (jit_value != jit_value && value != value))
+                continue;
+
+            LOG_CRITICAL(HW_GPU, "Vertex shader JIT and interpreter disagree on o%d.%c of the program at offset %u: "
+                         "jit=%f interpreter=%f", i, "xyzw"[comp], program.entry_point, jit_value, value);
+            return;
+        }
+    }
+}
+
+#endif
+
+OutputVertex RunShader(const InputVertex& input, int num_attributes) {
+    const DecodedProgram& program = GetCurrentProgram();
+    VertexShaderState state;
+
+#if defined(__x86_64__) || defined(_M_X64)
+    if (Settings::values.shader_engine != Settings::SHADER_ENGINE_INTERPRETER) {
+        JitProgram code = GetJitProgram(program);
+        if (code != nullptr) {
+            const bool validate = (Settings::values.shader_engine == Settings::SHADER_ENGINE_JIT_VALIDATE);
+            JitState jit_state;
+
+            if (!validate) {
+                RunJit(jit_state, code, input, num_attributes);
+                return MakeOutputVertex(jit_state.output_registers);
+            }
+
+            // Programs may read registers before writing them, so start both from the same values
+            memset(jit_state.temporary_registers, 0, sizeof(jit_state.temporary_registers));
+            memset(jit_state.output_registers, 0, sizeof(jit_state.output_registers));
+            memset(state.temporary_registers, 0, sizeof(state.temporary_registers));
+            memset(state.output_registers, 0, sizeof(state.output_registers));
+            memset(state.address_registers, 0, sizeof(state.address_registers));
+
+            RunJit(jit_state, code, input, num_attributes);
+            RunInterpreter(state, program, input, num_attributes);
+            CheckJitOutputs(program, jit_state, state);
+            return MakeOutputVertex(state.output_registers);
+        }
+    }
+#endif
+
+    RunInterpreter(state, program, input, num_attributes);
+    return MakeOutputVertex(state.output_registers);
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+/// One component of a register, for each vertex of a batch
+union BatchComponent {
+    __m128 v[BATCH_SIZE / 4];
+    float lane[BATCH_SIZE];
+};
+
+/// Set of vertices of a batch, with all bits of a lane set if the vertex belongs to the set
+typedef BatchComponent BatchMask;
+
+struct BatchRegister {
+    BatchComponent comp[4];
+};
+
+/**
+ * State of the vertex shader running on a whole batch of vertices. Registers are laid out as
+ * structures of arrays, so that each component of an instruction maps to a single SIMD
+ * operation over all vertices. Control flow is shared by all vertices, with divergent IFC and
+ * CALLC instructions narrowing down the set of active vertices.
+ */
+struct BatchShaderState {
+    u32 program_counter;
+
+    BatchRegister input_registers[16];
+    BatchRegister output_registers[16];
+    BatchRegister temporary_registers[16];
+    BatchMask conditional_code[2];
+
+    // Two address registers and the loop counter, for each vertex. Even the loop counter may
+    // differ between vertices, if only some of them ran a LOOP instruction.
+    s32 address_registers[3][BATCH_SIZE];
+
+    BatchMask active;  // Vertices affected by the instructions being run
+    bool all_active;   // Whether all vertices are active, so that writes don't need masking
+
+    enum {
+        INVALID_ADDRESS = 0xFFFFFFFF
+    };
+
+    struct CallStackElement {
+        u32 final_address;
+        u32 return_address;
+        u8 repeat_counter;
+        u8 loop_increment;
+        u32 loop_address;
+
+        BatchMask restore_mask;   // Active vertices to restore when leaving the scope
+        u32 else_address;         // Start of the else branch still to be run by the vertices in else_mask, if any
+        u32 else_final_address;
+        BatchMask else_mask;
+    };
+
+    std::stack<CallStackElement, std::vector<CallStackElement>> call_stack;
+
+    struct {
+        u32 max_offset;
+        u32 max_opdesc_id;
+    } debug;
+};
+
+static __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static bool IsLaneSet(const BatchMask& mask, unsigned lane) {
+    return ((_mm_movemask_ps(mask.v[lane / 4]) >> (lane % 4)) & 1) != 0;
+}
+
+static BatchMask MaskAnd(const BatchMask& a, const BatchMask& b) {
+    BatchMask result;
+    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+        result.v[k] = _mm_and_ps(a.v[k], b.v[k]);
+    return result;
+}
+
+static BatchMask MaskAndNot(const BatchMask& a, const BatchMask& b) {
+    BatchMask result;
+    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+        result.v[k] = _mm_andnot_ps(b.v[k], a.v[k]);
+    return result;
+}
+
+static bool MaskEqual(const BatchMask& a, const BatchMask& b) {
+    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+        if (_mm_movemask_ps(a.v[k]) != _mm_movemask_ps(b.v[k]))
+            return false;
+    }
+    return true;
+}
+
+static bool MaskEmpty(const BatchMask& mask) {
+    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+        if (_mm_movemask_ps(mask.v[k]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void SetActive(BatchShaderState& state, const BatchMask& mask) {
+    state.active = mask;
+    state.all_active = true;
+    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+        state.all_active &= (_mm_movemask_ps(mask.v[k]) == 0xF);
+}
+
+/**
+ * Runs the shader program on a batch of vertices.
+ * @return False if the vertices diverged in a way which can't be handled by masking, in which case
+ *         they need to be shaded one by one instead
+ */
+static bool ProcessShaderCodeBatch(BatchShaderState& state, const DecodedProgram& program) {
+    const __m128 minus_one = _mm_set1_ps(-1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 all_ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    // Placeholder for writes to invalid destinations
+    BatchRegister dummy_register;
+
+    while (true) {
+        if (!state.call_stack.empty()) {
+            auto& top = state.call_stack.top();
+            if (state.program_counter == top.final_address) {
+                if (top.else_address != BatchShaderState::INVALID_ADDRESS) {
+                    // Run the else branch of a divergent IFC with the remaining vertices
+                    state.program_counter = top.else_address;
+                    top.final_address = top.else_final_address;
+                    top.else_address = BatchShaderState::INVALID_ADDRESS;
+                    SetActive(state, top.else_mask);
+                    continue;
+                }
+
+                for (unsigned lane = 0; lane < BATCH_SIZE; ++lane) {
+                    if (state.all_active || IsLaneSet(state.active, lane))
+                        state.address_registers[2][lane] += top.loop_increment;
+                }
+
+                if (top.repeat_counter-- == 0) {
+                    state.program_counter = top.return_address;
+                    SetActive(state, top.restore_mask);
+                    state.call_stack.pop();
+                } else {
+                    state.program_counter = top.loop_address;
+                }
+
+                continue;
+            }
+        }
+
+        bool exit_loop = false;
+        const DecodedInstruction& instr = program.instructions[state.program_counter];
+
+        auto call = [&](u32 offset, u32 final_address, u32 return_offset, u8 repeat_count, u8 loop_increment) {
+            state.program_counter = offset - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
+
+            BatchShaderState::CallStackElement element;
+            element.final_address = final_address;
+            element.return_address = return_offset;
+            element.repeat_counter = repeat_count;
+            element.loop_increment = loop_increment;
+            element.loop_address = offset;
+            element.restore_mask = state.active;
+            element.else_address = BatchShaderState::INVALID_ADDRESS;
+            state.call_stack.push(element);
+        };
+
+        state.debug.max_offset = std::max<u32>(state.debug.max_offset, 1 + state.program_counter);
+
+        // Returns the given source register, with uniforms broadcast into `scratch`
+        auto LookupSourceRegister = [&](const SourceRegister& source_reg, BatchRegister& scratch) -> const BatchRegister& {
+            switch (source_reg.GetRegisterType()) {
+            case RegisterType::Input:
+                return state.input_registers[source_reg.GetIndex()];
+
+            case RegisterType::Temporary:
+                return state.temporary_registers[source_reg.GetIndex()];
+
+            case RegisterType::FloatUniform:
+            {
+                const auto& uniform = shader_uniforms.f[source_reg.GetIndex()];
+                for (int comp = 0; comp < 4; ++comp) {
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+                        scratch.comp[comp].v[k] = _mm_set1_ps(uniform[comp].ToFloat32());
+                }
+                return scratch;
+            }
+
+            default:
+                for (int comp = 0; comp < 4; ++comp) {
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+                        scratch.comp[comp].v[k] = zero;
+                }
+                return scratch;
+            }
+        };
+
+        auto LookupDecodedSource = [&](const DecodedSource& source, BatchRegister& scratch) -> const BatchRegister& {
+            switch (source.type) {
+            case RegisterType::Input:
+                return state.input_registers[source.index];
+
+            case RegisterType::Temporary:
+                return state.temporary_registers[source.index];
+
+            case RegisterType::FloatUniform:
+                for (int comp = 0; comp < 4; ++comp) {
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+                        scratch.comp[comp].v[k] = _mm_set1_ps(source.uniform[comp].ToFloat32());
+                }
+                return scratch;
+
+            default:
+                return LookupSourceRegister(source.reg, scratch);
+            }
+        };
+
+        // Applies the swizzle and negation of an operand
+        auto Swizzle = [&](const DecodedSource& source, const BatchRegister& reg, BatchComponent (&src)[4]) {
+            for (int comp = 0; comp < 4; ++comp) {
+                src[comp] = reg.comp[source.selectors[comp]];
+                if (source.negate) {
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+                        src[comp].v[k] = _mm_mul_ps(src[comp].v[k], minus_one);
+                }
+            }
+        };
+
+        auto WriteDest = [&](BatchComponent& dest, const BatchComponent& value) {
+            if (state.all_active) {
+                dest = value;
+            } else {
+                for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+                    dest.v[k] = Select(state.active.v[k], value.v[k], dest.v[k]);
+            }
+        };
+
+        // Returns the vertices for which the given condition holds, among the active ones
+        auto EvaluateCondition = [&]() -> BatchMask {
+            BatchMask results[2];
+            for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+                results[0].v[k] = instr.flow.refx ? state.conditional_code[0].v[k] : _mm_xor_ps(state.conditional_code[0].v[k], all_ones);
+                results[1].v[k] = instr.flow.refy ? state.conditional_code[1].v[k] : _mm_xor_ps(state.conditional_code[1].v[k], all_ones);
+            }
+
+            BatchMask result;
+            for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+                switch (instr.flow.op) {
+                case Instruction::FlowControlType::Or:
+                    result.v[k] = _mm_or_ps(results[0].v[k], results[1].v[k]);
+                    break;
+
+                case Instruction::FlowControlType::And:
+                    result.v[k] = _mm_and_ps(results[0].v[k], results[1].v[k]);
+                    break;
+
+                case Instruction::FlowControlType::JustX:
+                    result.v[k] = results[0].v[k];
+                    break;
+
+                case Instruction::FlowControlType::JustY:
+                default:
+                    result.v[k] = results[1].v[k];
+                    break;
+                }
+            }
+            return MaskAnd(result, state.active);
+        };
+
+        BatchRegister& dest = (instr.dest_type == RegisterType::Output) ? state.output_registers[instr.dest_index]
+                            : (instr.dest_type == RegisterType::Temporary) ? state.temporary_registers[instr.dest_index]
+                            : dummy_register;
+
+        switch (instr.type) {
+        case OpCode::Type::Arithmetic:
+        {
+            bool is_inverted = 0 != (OpCode(instr.opcode).GetInfo().subtype & OpCode::Info::SrcInversed);
+            ASSERT_MSG(!is_inverted, "Bad condition...");
+
+            BatchRegister scratch1, scratch2;
+            const BatchRegister* src1_;
+            const SourceRegister src1_reg = instr.src[0].reg;
+            const s32* offsets = (instr.address_register_index == 0)
+                                 ? nullptr : state.address_registers[instr.address_register_index - 1];
+            if (offsets == nullptr) {
+                src1_ = &LookupDecodedSource(instr.src[0], scratch1);
+            } else if (std::all_of(offsets + 1, offsets + BATCH_SIZE, [&](s32 offset) { return offset == offsets[0]; })) {
+                src1_ = &LookupSourceRegister(src1_reg + offsets[0], scratch1);
+            } else {
+                // Each vertex has its own offset, so gather its components one by one
+                for (unsigned lane = 0; lane < BATCH_SIZE; ++lane) {
+                    BatchRegister lane_scratch;
+                    const BatchRegister& reg = LookupSourceRegister(src1_reg + offsets[lane], lane_scratch);
+                    for (int comp = 0; comp < 4; ++comp)
+                        scratch1.comp[comp].lane[lane] = reg.comp[comp].lane[lane];
+                }
+                src1_ = &scratch1;
+            }
+            const BatchRegister& src2_ = LookupDecodedSource(instr.src[1], scratch2);
+
+            BatchComponent src1[4], src2[4];
+            Swizzle(instr.src[0], *src1_, src1);
+            Swizzle(instr.src[1], src2_, src2);
+
+            state.debug.max_opdesc_id = std::max<u32>(state.debug.max_opdesc_id, 1+instr.operand_desc_id);
+
+            BatchComponent result;
+
+            switch (instr.opcode) {
+            case OpCode::Id::ADD:
+            case OpCode::Id::MUL:
+            case OpCode::Id::MAX:
+            case OpCode::Id::RCP:
+            case OpCode::Id::MOV:
+                for (int i = 0; i < 4; ++i) {
+                    if (!(instr.dest_mask & (1 << i)))
+                        continue;
+
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+                        switch (instr.opcode) {
+                        case OpCode::Id::ADD:
+                            result.v[k] = _mm_add_ps(src1[i].v[k], src2[i].v[k]);
+                            break;
+
+                        case OpCode::Id::MUL:
+                            result.v[k] = _mm_mul_ps(src1[i].v[k], src2[i].v[k]);
+                            break;
+
+                        case OpCode::Id::MAX:
+                            // Same as std::max(src1, src2), including NaNs and signed zeros
+                            result.v[k] = _mm_max_ps(src2[i].v[k], src1[i].v[k]);
+                            break;
+
+                        case OpCode::Id::RCP:
+                            result.v[k] = _mm_div_ps(_mm_set1_ps(1.0f), src1[i].v[k]);
+                            break;
+
+                        default:
+                            result.v[k] = src1[i].v[k];
+                            break;
+                        }
+                    }
+                    WriteDest(dest.comp[i], result);
+                }
+                break;
+
+            case OpCode::Id::FLR:
+                for (int i = 0; i < 4; ++i) {
+                    if (!(instr.dest_mask & (1 << i)))
+                        continue;
+
+                    for (unsigned lane = 0; lane < BATCH_SIZE; ++lane)
+                        result.lane[lane] = std::floor(src1[i].lane[lane]);
+                    WriteDest(dest.comp[i], result);
+                }
+                break;
+
+            case OpCode::Id::RSQ:
+                for (int i = 0; i < 4; ++i) {
+                    if (!(instr.dest_mask & (1 << i)))
+                        continue;
+
+                    // Computed per vertex, to round exactly like the single vertex path
+                    for (unsigned lane = 0; lane < BATCH_SIZE; ++lane)
+                        result.lane[lane] = 1.0f / sqrt(src1[i].lane[lane]);
+                    WriteDest(dest.comp[i], result);
+                }
+                break;
+
+            case OpCode::Id::DP3:
+            case OpCode::Id::DP4:
+            {
+                BatchComponent dot;
+                int num_components = (instr.opcode == OpCode::Id::DP3) ? 3 : 4;
+                for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+                    dot.v[k] = zero;
+                    for (int i = 0; i < num_components; ++i)
+                        dot.v[k] = _mm_add_ps(dot.v[k], _mm_mul_ps(src1[i].v[k], src2[i].v[k]));
+                }
+
+                for (int i = 0; i < num_components; ++i) {
+                    if (!(instr.dest_mask & (1 << i)))
+                        continue;
+
+                    WriteDest(dest.comp[i], dot);
+                }
+                break;
+            }
+
+            case OpCode::Id::MOVA:
+                for (int i = 0; i < 2; ++i) {
+                    if (!(instr.dest_mask & (1 << i)))
+                        continue;
+
+                    for (unsigned lane = 0; lane < BATCH_SIZE; ++lane) {
+                        if (state.all_active || IsLaneSet(state.active, lane))
+                            state.address_registers[i][lane] = static_cast<s32>(src1[i].lane[lane]);
+                    }
+                }
+                break;
+
+            case OpCode::Id::CMP:
+                for (int i = 0; i < 2; ++i) {
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+                        switch (instr.compare_op[i]) {
+                            case CompareOp::Equal:
+                                result.v[k] = _mm_cmpeq_ps(src1[i].v[k], src2[i].v[k]);
+                                break;
+
+                            case CompareOp::NotEqual:
+                                result.v[k] = _mm_cmpneq_ps(src1[i].v[k], src2[i].v[k]);
+                                break;
+
+                            case CompareOp::LessThan:
+                                result.v[k] = _mm_cmplt_ps(src1[i].v[k], src2[i].v[k]);
+                                break;
+
+                            case CompareOp::LessEqual:
+                                result.v[k] = _mm_cmple_ps(src1[i].v[k], src2[i].v[k]);
+                                break;
+
+                            case CompareOp::GreaterThan:
+                                result.v[k] = _mm_cmpgt_ps(src1[i].v[k], src2[i].v[k]);
+                                break;
+
+                            case CompareOp::GreaterEqual:
+                                result.v[k] = _mm_cmpge_ps(src1[i].v[k], src2[i].v[k]);
+                                break;
+
+                            default:
+                                result.v[k] = state.conditional_code[i].v[k];
+                                break;
+                        }
+                    }
+                    WriteDest(state.conditional_code[i], result);
+                }
+                break;
+
+            default:
+                LOG_ERROR(HW_GPU, "Unhandled arithmetic instruction: 0x%02x (%s): 0x%08x",
+                          (int)instr.opcode, OpCode(instr.opcode).GetInfo().name, instr.hex);
+                DEBUG_ASSERT(false);
+                break;
+            }
+
+            break;
+        }
+
+        case OpCode::Type::MultiplyAdd:
+        {
+            if ((instr.opcode == OpCode::Id::MAD) ||
+                (instr.opcode == OpCode::Id::MADI)) {
+                BatchRegister scratch1, scratch2, scratch3;
+                BatchComponent src1[4], src2[4], src3[4];
+                Swizzle(instr.src[0], LookupDecodedSource(instr.src[0], scratch1), src1);
+                Swizzle(instr.src[1], LookupDecodedSource(instr.src[1], scratch2), src2);
+                Swizzle(instr.src[2], LookupDecodedSource(instr.src[2], scratch3), src3);
+
+                for (int i = 0; i < 4; ++i) {
+                    if (!(instr.dest_mask & (1 << i)))
+                        continue;
+
+                    BatchComponent result;
+                    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k)
+                        result.v[k] = _mm_add_ps(_mm_mul_ps(src1[i].v[k], src2[i].v[k]), src3[i].v[k]);
+                    WriteDest(dest.comp[i], result);
+                }
+            } else {
+                LOG_ERROR(HW_GPU, "Unhandled multiply-add instruction: 0x%02x (%s): 0x%08x",
+                          (int)instr.opcode, OpCode(instr.opcode).GetInfo().name, instr.hex);
+            }
+            break;
+        }
+
+        default:
+        {
+            // Handle each instruction on its own
+            switch (instr.opcode) {
+            case OpCode::Id::END:
+                // Vertices which skipped the current branch would still have to run the code after it
+                if (!state.all_active)
+                    return false;
+
+                exit_loop = true;
+                break;
+
+            case OpCode::Id::JMPC:
+            {
+                BatchMask taken = EvaluateCondition();
+                if (MaskEqual(taken, state.active)) {
+                    state.program_counter = instr.flow.target - 1;
+                } else if (!MaskEmpty(taken)) {
+                    // Arbitrary jumps can't be expressed with masks
+                    return false;
+                }
+                break;
+            }
+
+            case OpCode::Id::JMPU:
+                if (shader_uniforms.b[instr.flow.uniform_id]) {
+                    state.program_counter = instr.flow.target - 1;
+                }
+                break;
+
+            case OpCode::Id::CALL:
+                call(instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
+                break;
+
+            case OpCode::Id::CALLU:
+                if (shader_uniforms.b[instr.flow.uniform_id]) {
+                    call(instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
+                }
+                break;
+
+            case OpCode::Id::CALLC:
+            {
+                BatchMask taken = EvaluateCondition();
+                if (!MaskEmpty(taken)) {
+                    call(instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
+                    SetActive(state, taken);
+                }
+                break;
+            }
+
+            case OpCode::Id::NOP:
+                break;
+
+            case OpCode::Id::IFU:
+                if (shader_uniforms.b[instr.flow.uniform_id]) {
+                    call(instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
+                } else {
+                    call(instr.flow.else_target, instr.flow.else_end, instr.flow.return_address, 0, 0);
+                }
+
+                break;
+
+            case OpCode::Id::IFC:
+            {
+                BatchMask taken = EvaluateCondition();
+                BatchMask not_taken = MaskAndNot(state.active, taken);
+
+                if (MaskEmpty(not_taken)) {
+                    call(instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
+                } else if (MaskEmpty(taken)) {
+                    call(instr.flow.else_target, instr.flow.else_end, instr.flow.return_address, 0, 0);
+                } else {
+                    // Run the if branch with the vertices which take it, then the else branch
+                    // with the others
+                    call(instr.flow.target, instr.flow.target_end, instr.flow.return_address, 0, 0);
+
+                    auto& top = state.call_stack.top();
+                    top.else_address = instr.flow.else_target;
+                    top.else_final_address = instr.flow.else_end;
+                    top.else_mask = not_taken;
+                    SetActive(state, taken);
+                }
+
+                break;
+            }
+
+            case OpCode::Id::LOOP:
+            {
+                const auto& loop_uniform = shader_uniforms.i[instr.flow.uniform_id];
+                for (unsigned lane = 0; lane < BATCH_SIZE; ++lane) {
+                    if (state.all_active || IsLaneSet(state.active, lane))
+                        state.address_registers[2][lane] = loop_uniform.y;
+                }
+
+                call(instr.flow.target, instr.flow.target_end, instr.flow.return_address,
+                     loop_uniform.x, loop_uniform.z);
+                break;
+            }
+
+            default:
+                LOG_ERROR(HW_GPU, "Unhandled instruction: 0x%02x (%s): 0x%08x",
+                          (int)instr.opcode, OpCode(instr.opcode).GetInfo().name, instr.hex);
+                break;
+            }
+
+            break;
+        }
+        }
+
+        ++state.program_counter;
+
+        if (exit_loop)
+            break;
+    }
+
+    return true;
+}
+
+void RunShaderBatch(const InputVertex* inputs, OutputVertex* outputs, unsigned count, int num_attributes) {
+    ASSERT(count <= BATCH_SIZE);
+    if (count == 0)
+        return;
+
+    const DecodedProgram& program = GetCurrentProgram();
+
+    // Compiled code runs one vertex at a time, and is faster than shading a batch in the interpreter
+    if (Settings::values.shader_engine != Settings::SHADER_ENGINE_INTERPRETER && GetJitProgram(program) != nullptr) {
+        for (unsigned lane = 0; lane < count; ++lane)
+            outputs[lane] = RunShader(inputs[lane], num_attributes);
+        return;
+    }
+
+    BatchShaderState state;
+
+    state.program_counter = program.entry_point;
+    state.debug.max_offset = 0;
+    state.debug.max_opdesc_id = 0;
+
+    // Setup input registers. Unused lanes repeat the last vertex, so that they never diverge from
+    // the others.
+    memset(state.input_registers, 0, sizeof(state.input_registers));
+    for (int i = 0; i < std::min(num_attributes, 16); ++i) {
+        BatchRegister& reg = state.input_registers[registers.vs_input_register_map.GetRegisterForAttribute(i)];
+        for (unsigned lane = 0; lane < BATCH_SIZE; ++lane) {
+            const InputVertex& input = inputs[std::min(lane, count - 1)];
+            for (int comp = 0; comp < 4; ++comp)
+                reg.comp[comp].lane[lane] = input.attr[i][comp].ToFloat32();
+        }
+    }
+
+    for (unsigned k = 0; k < BATCH_SIZE / 4; ++k) {
+        state.conditional_code[0].v[k] = _mm_setzero_ps();
+        state.conditional_code[1].v[k] = _mm_setzero_ps();
+        state.active.v[k] = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    }
+    state.all_active = true;
+
+    memset(state.address_registers, 0, sizeof(state.address_registers));
+
+    if (!ProcessShaderCodeBatch(state, program)) {
+        for (unsigned lane = 0; lane < count; ++lane)
+            outputs[lane] = RunShader(inputs[lane], num_attributes);
+        return;
+    }
+
+    DebugUtils::DumpShader(shader_memory.data(), state.debug.max_offset, swizzle_data.data(),
+                           state.debug.max_opdesc_id, registers.vs_main_offset,
+                           registers.vs_output_attributes);
+
+    // Setup output data, as in RunShader
+    for (int i = 0; i < 7; ++i) {
+        const auto& output_register_map = registers.vs_output_attributes[i];
+
+        u32 semantics[4] = {
+            output_register_map.map_x, output_register_map.map_y,
+            output_register_map.map_z, output_register_map.map_w
+        };
+
+        for (int comp = 0; comp < 4; ++comp) {
+            for (unsigned lane = 0; lane < count; ++lane) {
+                float24* out = ((float24*)&outputs[lane]) + semantics[comp];
+                if (semantics[comp] != Regs::VSOutputAttributes::INVALID) {
+                    *out = float24::FromFloat32(state.output_registers[i].comp[comp].lane[lane]);
+                } else {
+                    memset(out, 0, sizeof(*out));
+                }
+            }
+        }
+    }
+}
+
+#else
+
+void RunShaderBatch(const InputVertex* inputs, OutputVertex* outputs, unsigned count, int num_attributes) {
+    for (unsigned i = 0; i < count; ++i)
+        outputs[i] = RunShader(inputs[i], num_attributes);
+}
+
+#endif
+
 
 } // namespace
 
@@ -69,8 +69,28 @@ static_assert(sizeof(OutputVertex) == 32 * sizeof(float), "OutputVertex has inva
 void SubmitShaderMemoryChange(u32 addr, u32 value);
 void SubmitSwizzleDataChange(u32 addr, u32 value);
 
+/**
+ * Returns a hash of the shader binary and swizzle patterns, which identifies the programs that can
+ * be run without looking at their code. It is only recomputed after the shader memory changed.
+ */
+u64 GetShaderMemoryHash();
+
 OutputVertex RunShader(const InputVertex& input, int num_attributes);
 
+/// Maximum number of vertices shaded at once by RunShaderBatch
+const unsigned BATCH_SIZE = 8;
+
+/**
+ * Runs the vertex shader on several vertices at once, producing the same results as RunShader.
+ * Each instruction is decoded once for the whole batch and applied to all vertices with SIMD
+ * operations.
+ * @param inputs Input vertices
+ * @param outputs Output vertices, in the same order as the inputs
+ * @param count Number of vertices, at most BATCH_SIZE
+ * @param num_attributes Number of input attributes
+ */
+void RunShaderBatch(const InputVertex* inputs, OutputVertex* outputs, unsigned count, int num_attributes);
+
 Math::Vec4<float24>& GetFloatUniform(u32 index);
 bool& GetBoolUniform(u32 index);
 Math::Vec4<u8>& GetIntUniform(u32 index);
@@ -7,6 +7,8 @@
 
 #include "core/core.h"
 
+#include "video_core/rasterizer.h"
+#include "video_core/texture_cache.h"
 #include "video_core/video_core.h"
 #include "video_core/renderer_base.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
@@ -31,8 +33,17 @@ void Init(EmuWindow* emu_window) {
 
 /// Shutdown the video core
 void Shutdown() {
+    Pica::Rasterizer::Shutdown();
     delete g_renderer;
+    g_renderer = nullptr;
     LOG_DEBUG(Render, "shutdown OK");
 }
 
+void InvalidateTextures(PAddr addr, u32 size) {
+    Pica::Rasterizer::InvalidateTextures(addr, size);
+
+    if (g_renderer != nullptr)
+        static_cast<RendererOpenGL*>(g_renderer)->InvalidateTextures(addr, size);
+}
+
 } // namespace
@@ -40,4 +40,10 @@ void Init(EmuWindow* emu_window);
 /// Shutdown the video core
 void Shutdown();
 
+/**
+ * Notifies the texture caches of all renderers that the given physical memory region was written
+ * by something else than the rasterizers, e.g. the CPU or DMA
+ */
+void InvalidateTextures(PAddr addr, u32 size);
+
 } // namespace